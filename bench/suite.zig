@@ -0,0 +1,421 @@
+//! Throughput suite for the CLI's query paths, over generated datasets:
+//! - record width: narrow, wide (120 extra keys) and deeply nested;
+//! - selectivity: 0.1%, 10% and 90% of records matching;
+//! - operator families: $eq, ranges, $in, $regex and $exists;
+//! - output modes: ndjson, json, csv and count;
+//! - input formats: NDJSON and a JSON array;
+//! - thread scaling from 1 to every core.
+//!
+//! Each case reports GB/s, records/s and peak RSS. `--json` writes the results
+//! for tracking, and `--baseline` compares a run against an earlier file:
+//!
+//!   zig build bench -Doptimize=ReleaseFast -- --json bench.json
+//!   zig build bench -Doptimize=ReleaseFast -- --baseline bench.json
+//!
+//! Options: --mb <n> (dataset size, default 64), --runs <n> (best of, default
+//! 3), --threads <n> (default: every core), --only <substring of case name>,
+//! --threshold <percent> (slowdown reported as a regression, default 10) and
+//! --fail-on-regression.
+
+const std = @import("std");
+const builtin = @import("builtin");
+const zson = @import("zson");
+const parallel = zson.parallel_ndjson;
+
+const Width = enum { narrow, wide, nested };
+const Input = enum { ndjson, json_array };
+const Output = enum { ndjson, json, csv, count };
+
+const Case = struct {
+    width: Width = .narrow,
+    input: Input = .ndjson,
+    output: Output = .ndjson,
+    operator: []const u8 = "range",
+    selectivity: []const u8 = "10%",
+    query: []const u8,
+    threads: usize,
+
+    fn name(self: Case, buf: []u8) ![]const u8 {
+        return std.fmt.bufPrint(buf, "width={s}/in={s}/out={s}/op={s}/sel={s}/threads={d}", .{
+            @tagName(self.width),
+            @tagName(self.input),
+            @tagName(self.output),
+            self.operator,
+            self.selectivity,
+            self.threads,
+        });
+    }
+};
+
+const Result = struct {
+    name: []const u8,
+    width: []const u8,
+    input: []const u8,
+    output: []const u8,
+    operator: []const u8,
+    selectivity: []const u8,
+    threads: usize,
+    bytes: usize,
+    records: usize,
+    matches: usize,
+    seconds: f64,
+    gb_per_s: f64,
+    records_per_s: f64,
+    peak_rss_bytes: u64,
+};
+
+const Report = struct {
+    os: []const u8,
+    arch: []const u8,
+    cpu_count: usize,
+    runs: usize,
+    results: []const Result,
+};
+
+const Options = struct {
+    mb: usize = 64,
+    runs: usize = 3,
+    threads: ?usize = null,
+    only: ?[]const u8 = null,
+    json_path: ?[]const u8 = null,
+    baseline_path: ?[]const u8 = null,
+    threshold: f64 = 10,
+    fail_on_regression: bool = false,
+};
+
+const Dataset = struct {
+    path: []const u8,
+    bytes: usize,
+    records: usize,
+};
+
+const data_dir = ".zig-cache/bench";
+
+pub fn main() !void {
+    const allocator = std.heap.c_allocator;
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+    const options = parseOptions(args[1..]) catch |err| {
+        std.debug.print("bench: {}\n", .{err});
+        std.process.exit(2);
+    };
+
+    const cpu_count = std.Thread.getCpuCount() catch 1;
+    const max_threads = options.threads orelse cpu_count;
+
+    var arena_state = std.heap.ArenaAllocator.init(allocator);
+    defer arena_state.deinit();
+    const arena = arena_state.allocator();
+    const cases = try buildCases(max_threads, arena);
+
+    var datasets = std.EnumArray(Width, [2]?Dataset).initFill(.{ null, null });
+    var results = std.ArrayList(Result){};
+
+    std.debug.print("{s:<70} {s:>9} {s:>12} {s:>10}\n", .{ "case", "GB/s", "records/s", "peak RSS" });
+    std.debug.print("{s:-<70} {s:->9} {s:->12} {s:->10}\n", .{ "", "", "", "" });
+    for (cases) |case| {
+        var name_buf: [160]u8 = undefined;
+        const name = try case.name(&name_buf);
+        if (options.only) |only| {
+            if (std.mem.indexOf(u8, name, only) == null) continue;
+        }
+
+        const slot = &datasets.getPtr(case.width)[@intFromEnum(case.input)];
+        if (slot.* == null) slot.* = try generateDataset(case.width, case.input, options.mb << 20, arena);
+        const result = try runCase(case, try arena.dupe(u8, name), slot.*.?, options.runs, allocator);
+        try results.append(arena, result);
+        std.debug.print("{s:<70} {d:>9.3} {d:>12.0} {d:>7.1} MB\n", .{
+            result.name,
+            result.gb_per_s,
+            result.records_per_s,
+            @as(f64, @floatFromInt(result.peak_rss_bytes)) / (1024.0 * 1024.0),
+        });
+    }
+
+    const report = Report{
+        .os = @tagName(builtin.os.tag),
+        .arch = @tagName(builtin.cpu.arch),
+        .cpu_count = cpu_count,
+        .runs = options.runs,
+        .results = results.items,
+    };
+    if (options.json_path) |path| {
+        try writeReport(path, report);
+        std.debug.print("\nWrote {s}\n", .{path});
+    }
+    if (options.baseline_path) |path| {
+        const regressions = try compareBaseline(path, report, options.threshold, arena);
+        if (regressions > 0 and options.fail_on_regression) std.process.exit(1);
+    }
+}
+
+fn parseOptions(args: []const []const u8) !Options {
+    var options = Options{};
+    var i: usize = 0;
+    while (i < args.len) : (i += 1) {
+        const arg = args[i];
+        if (std.mem.eql(u8, arg, "--fail-on-regression")) {
+            options.fail_on_regression = true;
+            continue;
+        }
+        if (i + 1 >= args.len) return error.MissingOptionValue;
+        const value = args[i + 1];
+        i += 1;
+        if (std.mem.eql(u8, arg, "--mb")) {
+            options.mb = try std.fmt.parseInt(usize, value, 10);
+        } else if (std.mem.eql(u8, arg, "--runs")) {
+            options.runs = @max(try std.fmt.parseInt(usize, value, 10), 1);
+        } else if (std.mem.eql(u8, arg, "--threads")) {
+            options.threads = @max(try std.fmt.parseInt(usize, value, 10), 1);
+        } else if (std.mem.eql(u8, arg, "--only")) {
+            options.only = value;
+        } else if (std.mem.eql(u8, arg, "--json")) {
+            options.json_path = value;
+        } else if (std.mem.eql(u8, arg, "--baseline")) {
+            options.baseline_path = value;
+        } else if (std.mem.eql(u8, arg, "--threshold")) {
+            options.threshold = try std.fmt.parseFloat(f64, value);
+        } else {
+            return error.UnknownOption;
+        }
+    }
+    return options;
+}
+
+/// Range on `sel` (uniform over 0..999) for each selectivity
+const range_queries = [_]struct { selectivity: []const u8, flat: []const u8, nested: []const u8 }{
+    .{ .selectivity = "0.1%", .flat = "{\"sel\":{\"$lt\":1}}", .nested = "{\"a.b.c.d.e.sel\":{\"$lt\":1}}" },
+    .{ .selectivity = "10%", .flat = "{\"sel\":{\"$lt\":100}}", .nested = "{\"a.b.c.d.e.sel\":{\"$lt\":100}}" },
+    .{ .selectivity = "90%", .flat = "{\"sel\":{\"$lt\":900}}", .nested = "{\"a.b.c.d.e.sel\":{\"$lt\":900}}" },
+};
+
+/// The other operator families, each matching 10% of the records (the width
+/// grid covers ranges)
+const operator_queries = [_]struct { operator: []const u8, query: []const u8 }{
+    .{ .operator = "eq", .query = "{\"bucket\":3}" },
+    .{ .operator = "in", .query = "{\"city\":{\"$in\":[\"Austin\",\"Atlantis\"]}}" },
+    .{ .operator = "regex", .query = "{\"email\":{\"$regex\":\"^user\\\\d*7@example\\\\.com$\"}}" },
+    .{ .operator = "exists", .query = "{\"vip\":{\"$exists\":true}}" },
+};
+
+fn buildCases(max_threads: usize, allocator: std.mem.Allocator) ![]const Case {
+    var cases = std.ArrayList(Case){};
+    const base = range_queries[1].flat;
+
+    for (std.enums.values(Width)) |width| {
+        for (range_queries) |rq| try cases.append(allocator, .{
+            .width = width,
+            .selectivity = rq.selectivity,
+            .query = if (width == .nested) rq.nested else rq.flat,
+            .threads = max_threads,
+        });
+    }
+    for (operator_queries) |oq| {
+        try cases.append(allocator, .{ .operator = oq.operator, .query = oq.query, .threads = max_threads });
+    }
+    for ([_]Output{ .json, .csv, .count }) |output| {
+        try cases.append(allocator, .{ .output = output, .query = base, .threads = max_threads });
+    }
+    for ([_]Output{ .ndjson, .count }) |output| {
+        try cases.append(allocator, .{ .input = .json_array, .output = output, .query = base, .threads = max_threads });
+    }
+    var threads: usize = 1;
+    while (threads < max_threads) : (threads *= 2) {
+        try cases.append(allocator, .{ .query = base, .threads = threads });
+    }
+    return cases.items;
+}
+
+// ============================================================================
+// Datasets
+// ============================================================================
+
+const cities = [_][]const u8{ "NYC", "LA", "Chicago", "Houston", "Phoenix", "Austin", "Denver", "Boston", "Seattle", "Miami" };
+
+/// Write about `target_bytes` of `width` records to a file under `data_dir`.
+fn generateDataset(width: Width, input: Input, target_bytes: usize, allocator: std.mem.Allocator) !Dataset {
+    try std.fs.cwd().makePath(data_dir);
+    const path = try std.fmt.allocPrint(allocator, "{s}/{s}.{s}", .{
+        data_dir,
+        @tagName(width),
+        if (input == .ndjson) "ndjson" else "json",
+    });
+
+    var data = std.ArrayList(u8){};
+    defer data.deinit(std.heap.c_allocator);
+    const writer = data.writer(std.heap.c_allocator);
+    if (input == .json_array) try writer.writeAll("[\n");
+
+    var records: usize = 0;
+    while (data.items.len < target_bytes) : (records += 1) {
+        if (input == .json_array and records > 0) try writer.writeAll(",\n");
+        try writeRecord(writer, width, records);
+        if (input == .ndjson) try writer.writeByte('\n');
+    }
+    if (input == .json_array) try writer.writeAll("\n]\n");
+
+    const file = try std.fs.cwd().createFile(path, .{ .truncate = true });
+    defer file.close();
+    try file.writeAll(data.items);
+    return .{ .path = path, .bytes = data.items.len, .records = records };
+}
+
+/// Fields every width shares, each queried by one case:
+/// `sel` is spread evenly over 0..999, `bucket` over 0..9, and one record in
+/// ten has a `city` of "Austin", an id ending in 7, or a `vip` key.
+fn writeRecord(writer: anytype, width: Width, i: usize) !void {
+    const sel = i * 7919 % 1000;
+    try writer.writeByte('{');
+    if (width == .wide) {
+        // Queried keys come after the padding, so lookups have to find them
+        for (0..120) |k| {
+            if (k % 2 == 0) {
+                try writer.print("\"f{d}\":{d},", .{ k, (i + k) % 997 });
+            } else {
+                try writer.print("\"f{d}\":\"v{d}\",", .{ k, (i * k) % 101 });
+            }
+        }
+    }
+    try writer.print(
+        "\"id\":{d},\"sel\":{d},\"bucket\":{d},\"city\":\"{s}\",\"email\":\"user{d}@example.com\",\"score\":{d}.{d},\"active\":{s}",
+        .{ i, sel, i * 31 % 10, cities[(i / 3) % cities.len], i, i % 100, i % 10, if (i % 3 == 0) "true" else "false" },
+    );
+    if (i % 10 == 4) try writer.writeAll(",\"vip\":true");
+    if (width == .nested) {
+        try writer.print(
+            ",\"a\":{{\"id\":{d},\"b\":{{\"tags\":[\"x\",\"y\"],\"c\":{{\"d\":{{\"note\":\"n{d}\",\"e\":{{\"sel\":{d},\"ok\":true}}}}}}}}}}",
+            .{ i, i % 13, sel },
+        );
+    }
+    try writer.writeByte('}');
+}
+
+// ============================================================================
+// Running
+// ============================================================================
+
+fn runCase(case: Case, name: []const u8, dataset: Dataset, runs: usize, allocator: std.mem.Allocator) !Result {
+    var parsed = try zson.query.parseQuery(case.query, allocator);
+    defer parsed.deinit(allocator);
+    const config = parallel.Config{ .num_threads = case.threads };
+
+    // Warm the page cache and the allocator before timing
+    _ = try runOnce(case.output, dataset.path, &parsed.filter, config, allocator);
+    resetPeakRss();
+
+    var best: u64 = std.math.maxInt(u64);
+    var matches: usize = 0;
+    for (0..runs) |_| {
+        var timer = try std.time.Timer.start();
+        matches = try runOnce(case.output, dataset.path, &parsed.filter, config, allocator);
+        best = @min(best, timer.read());
+    }
+
+    const seconds = @as(f64, @floatFromInt(best)) / std.time.ns_per_s;
+    return .{
+        .name = name,
+        .width = @tagName(case.width),
+        .input = @tagName(case.input),
+        .output = @tagName(case.output),
+        .operator = case.operator,
+        .selectivity = case.selectivity,
+        .threads = case.threads,
+        .bytes = dataset.bytes,
+        .records = dataset.records,
+        .matches = matches,
+        .seconds = seconds,
+        .gb_per_s = @as(f64, @floatFromInt(dataset.bytes)) / 1e9 / seconds,
+        .records_per_s = @as(f64, @floatFromInt(dataset.records)) / seconds,
+        .peak_rss_bytes = peakRss(),
+    };
+}
+
+/// Run the path the CLI takes for `output`; returns the match count.
+fn runOnce(output: Output, path: []const u8, filter: *const zson.query.Filter, config: parallel.Config, allocator: std.mem.Allocator) !usize {
+    switch (output) {
+        .count => return parallel.processFileCount(path, filter, config, allocator),
+        .ndjson => {
+            var out = try parallel.processFileWithOutput(path, filter, config, null, allocator);
+            defer out.deinit(allocator);
+            return std.mem.count(u8, out.items, "\n");
+        },
+        .json, .csv => {
+            var result = try parallel.processFile(path, filter, config, allocator);
+            defer result.deinit();
+            var buffer: [64 * 1024]u8 = undefined;
+            var discard = std.Io.Writer.Discarding.init(&buffer);
+            if (output == .json) {
+                try zson.output.writeJson(&discard.writer, result.matches.items, null, false);
+            } else {
+                try zson.output.writeCsv(&discard.writer, result.matches.items, null);
+            }
+            try discard.writer.flush();
+            return result.matches.items.len;
+        },
+    }
+}
+
+/// Start a new high-water mark for `peakRss`, where the OS supports it (Linux).
+/// Elsewhere the peak covers the whole process so far.
+fn resetPeakRss() void {
+    if (builtin.os.tag != .linux) return;
+    const file = std.fs.openFileAbsolute("/proc/self/clear_refs", .{ .mode = .write_only }) catch return;
+    defer file.close();
+    file.writeAll("5") catch {};
+}
+
+fn peakRss() u64 {
+    switch (builtin.os.tag) {
+        .linux => {
+            var buf: [4096]u8 = undefined;
+            const status = std.fs.cwd().readFile("/proc/self/status", &buf) catch return 0;
+            const start = std.mem.indexOf(u8, status, "VmHWM:") orelse return 0;
+            var fields = std.mem.tokenizeAny(u8, status[start + "VmHWM:".len ..], " \t\n");
+            const kb = std.fmt.parseInt(u64, fields.next() orelse return 0, 10) catch return 0;
+            return kb * 1024;
+        },
+        .macos, .ios, .freebsd, .netbsd, .openbsd => {
+            const usage = std.posix.getrusage(std.posix.rusage.SELF);
+            const maxrss: u64 = @intCast(usage.maxrss);
+            // Bytes on Darwin, kilobytes on the BSDs
+            return if (builtin.os.tag.isDarwin()) maxrss else maxrss * 1024;
+        },
+        else => return 0,
+    }
+}
+
+// ============================================================================
+// Reports
+// ============================================================================
+
+fn writeReport(path: []const u8, report: Report) !void {
+    const file = try std.fs.cwd().createFile(path, .{ .truncate = true });
+    defer file.close();
+    var buffer: [64 * 1024]u8 = undefined;
+    var file_writer = file.writer(&buffer);
+    try std.json.Stringify.value(report, .{ .whitespace = .indent_2 }, &file_writer.interface);
+    try file_writer.interface.writeByte('\n');
+    try file_writer.interface.flush();
+}
+
+/// Print the throughput change of every case also in the baseline report and
+/// return how many slowed down by more than `threshold` percent.
+fn compareBaseline(path: []const u8, report: Report, threshold: f64, allocator: std.mem.Allocator) !usize {
+    const bytes = try std.fs.cwd().readFileAlloc(allocator, path, 64 << 20);
+    const baseline = try std.json.parseFromSliceLeaky(Report, allocator, bytes, .{ .ignore_unknown_fields = true });
+
+    std.debug.print("\nAgainst {s}:\n", .{path});
+    var regressions: usize = 0;
+    for (report.results) |result| {
+        const before = for (baseline.results) |old| {
+            if (std.mem.eql(u8, old.name, result.name)) break old;
+        } else continue;
+        const change = (result.gb_per_s / before.gb_per_s - 1) * 100;
+        const regressed = change < -threshold;
+        if (regressed) regressions += 1;
+        const marker: []const u8 = if (regressed) "  REGRESSION" else "";
+        std.debug.print("{s:<70} {d:>8.1}%{s}\n", .{ result.name, change, marker });
+    }
+    std.debug.print("{d} regression(s) beyond {d:.0}%\n", .{ regressions, threshold });
+    return regressions;
+}
@@ -24,6 +24,20 @@ pub fn build(b: *std.Build) void {
     exe.linkLibC();
     b.installArtifact(exe);
 
+    // C ABI shared library (include/zson.h)
+    const lib = b.addLibrary(.{
+        .name = "zson",
+        .linkage = .dynamic,
+        .root_module = b.createModule(.{
+            .root_source_file = b.path("src/capi.zig"),
+            .target = target,
+            .optimize = optimize,
+        }),
+    });
+    lib.linkLibC();
+    lib.installHeader(b.path("include/zson.h"), "zson.h");
+    b.installArtifact(lib);
+
     const windows_target = b.resolveTargetQuery(.{
         .cpu_arch = .x86_64,
         .os_tag = .windows,
@@ -74,6 +88,19 @@ pub fn build(b: *std.Build) void {
         b.step(ex[0], ex[2]).dependOn(&run_ex.step);
     }
 
+    const c_example = b.addExecutable(.{
+        .name = "example-c",
+        .root_module = b.createModule(.{
+            .target = target,
+            .optimize = optimize,
+        }),
+    });
+    c_example.root_module.addCSourceFile(.{ .file = b.path("examples/capi.c") });
+    c_example.root_module.addIncludePath(b.path("include"));
+    c_example.root_module.linkLibrary(lib);
+    c_example.linkLibC();
+    b.step("example-c", "Run C API example").dependOn(&b.addRunArtifact(c_example).step);
+
     const bench_json_exe = b.addExecutable(.{
         .name = "bench-json",
         .root_module = b.createModule(.{
@@ -89,11 +116,30 @@ pub fn build(b: *std.Build) void {
     const run_bench_json = b.addRunArtifact(bench_json_exe);
     b.step("bench-json", "Compare zson with Zig std.json").dependOn(&run_bench_json.step);
 
+    const bench_exe = b.addExecutable(.{
+        .name = "bench",
+        .root_module = b.createModule(.{
+            .root_source_file = b.path("bench/suite.zig"),
+            .target = target,
+            .optimize = optimize,
+            .imports = &.{
+                .{ .name = "zson", .module = mod },
+            },
+        }),
+    });
+    bench_exe.linkLibC();
+    const run_bench = b.addRunArtifact(bench_exe);
+    if (b.args) |args| run_bench.addArgs(args);
+    b.step("bench", "Run the throughput suite (pass --json <file> to save results)").dependOn(&run_bench.step);
+
     // Tests
     const mod_tests = b.addTest(.{ .root_module = mod });
     mod_tests.linkLibC();
     const exe_tests = b.addTest(.{ .root_module = exe.root_module });
+    const lib_tests = b.addTest(.{ .root_module = lib.root_module });
+    lib_tests.linkLibC();
     const test_step = b.step("test", "Run tests");
     test_step.dependOn(&b.addRunArtifact(mod_tests).step);
     test_step.dependOn(&b.addRunArtifact(exe_tests).step);
+    test_step.dependOn(&b.addRunArtifact(lib_tests).step);
 }
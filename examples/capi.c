@@ -0,0 +1,34 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "zson.h"
+
+int main(void) {
+    const char *query = "{\"level\":\"error\",\"latency_ms\":{\"$gt\":100}}";
+    int error = 0;
+    zson_query *prepared = zson_prepare(query, strlen(query), &error);
+    if (prepared == NULL) {
+        fprintf(stderr, "invalid query (%d)\n", error);
+        return 1;
+    }
+
+    const char *records[] = {
+        "{\"level\":\"info\",\"latency_ms\":250}",
+        "{\"level\":\"error\",\"latency_ms\":40}",
+        "{\"level\":\"error\",\"latency_ms\":180,\"service\":\"auth\"}",
+    };
+    size_t lens[3];
+    for (size_t i = 0; i < 3; i++) lens[i] = strlen(records[i]);
+
+    zson_pool *pool = zson_pool_create(4);
+    uint8_t bitmap[1];
+    int64_t matched = zson_pool_match_batch(pool, prepared, records, lens, 3, bitmap);
+    printf("%lld of 3 matched\n", (long long)matched);
+    for (size_t i = 0; i < 3; i++) {
+        if ((bitmap[i / 8] >> (i % 8)) & 1) printf("%s\n", records[i]);
+    }
+
+    zson_pool_destroy(pool);
+    zson_free(prepared);
+    return 0;
+}
@@ -0,0 +1,63 @@
+/*
+ * zson C ABI: prepared MongoDB-style queries over JSON records in memory.
+ *
+ * A query is parsed and compiled once by zson_prepare and can then be shared
+ * by any number of threads. Records are single JSON objects; those that are
+ * not valid JSON do not match. Batch results are bitmaps: record i matched
+ * when (out_bitmap[i / 8] >> (i % 8)) & 1, and out_bitmap must hold
+ * (n + 7) / 8 bytes.
+ */
+#ifndef ZSON_H
+#define ZSON_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ZSON_OK 0
+#define ZSON_INVALID_QUERY (-1)
+#define ZSON_OUT_OF_MEMORY (-2)
+#define ZSON_INVALID_ARGUMENT (-3)
+
+typedef struct zson_query zson_query;
+typedef struct zson_scratch zson_scratch;
+typedef struct zson_pool zson_pool;
+
+/* Compile `query` (JSON text, `query_len` bytes). Returns NULL on failure,
+ * with the reason in *error when `error` is not NULL. */
+zson_query *zson_prepare(const char *query, size_t query_len, int *error);
+void zson_free(zson_query *query);
+
+/* Parse buffers for zson_match and zson_match_batch, kept between calls so
+ * matching allocates nothing once they have grown. Use one per thread; any
+ * query can use it. NULL when out of memory. */
+zson_scratch *zson_scratch_create(void);
+void zson_scratch_destroy(zson_scratch *scratch);
+
+/* 1 when the record matches, 0 when it does not, or a negative ZSON_ code.
+ * `scratch` may be NULL, at the cost of allocating buffers for the call;
+ * `record` may not. */
+int zson_match(const zson_query *query, zson_scratch *scratch, const char *record, size_t len);
+
+/* Test n records on the calling thread. Returns the number that matched, or
+ * a negative ZSON_ code; a NULL entry in buffers is ZSON_INVALID_ARGUMENT. */
+int64_t zson_match_batch(const zson_query *query, zson_scratch *scratch, const char *const *buffers,
+                         const size_t *lens, size_t n, uint8_t *out_bitmap);
+
+/* Threads kept for zson_pool_match_batch. A pool runs one batch at a time;
+ * calls from several threads are safe and take turns. */
+zson_pool *zson_pool_create(size_t num_threads);
+void zson_pool_destroy(zson_pool *pool);
+
+/* zson_match_batch split across the pool's threads. */
+int64_t zson_pool_match_batch(zson_pool *pool, const zson_query *query, const char *const *buffers,
+                              const size_t *lens, size_t n, uint8_t *out_bitmap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,311 @@
+const std = @import("std");
+const json_parser = @import("json_parser.zig");
+const number = @import("number.zig");
+const output = @import("output.zig");
+const Allocator = std.mem.Allocator;
+
+/// One aggregate column of `--group-by` output
+pub const Aggregate = struct {
+    op: Op,
+    /// Dotted path the aggregate reads
+    field: []const u8,
+
+    pub const Op = enum {
+        sum,
+        min,
+        max,
+        /// Number of distinct values
+        distinct,
+    };
+
+    /// Column name in the output, e.g. `sum(price)`
+    pub fn name(self: Aggregate, allocator: Allocator) Allocator.Error![]u8 {
+        return std.fmt.allocPrint(allocator, "{s}({s})", .{ @tagName(self.op), self.field });
+    }
+};
+
+/// What to aggregate matches by. Every group gets a `count`; without
+/// `group_by` all matches form one group.
+pub const Spec = struct {
+    group_by: ?[]const u8 = null,
+    aggregates: []const Aggregate = &.{},
+
+    /// Make the parser build every field the aggregates read.
+    pub fn addPaths(self: Spec, projection: *json_parser.Projection, allocator: Allocator) Allocator.Error!void {
+        if (self.group_by) |field| try projection.addPath(allocator, field);
+        for (self.aggregates) |agg| try projection.addPath(allocator, agg.field);
+    }
+};
+
+/// A value as a hash key: scalars keep their raw text, so a key found in
+/// the input is hashed in place. Containers are keyed by their JSON text.
+const Key = struct {
+    kind: Kind,
+    bytes: []const u8,
+
+    const Kind = enum(u8) { null_value, bool_value, number, string, json };
+
+    /// Missing values group with null, as in SQL.
+    fn of(value: ?json_parser.JsonValue, scratch: Allocator) Allocator.Error!Key {
+        const v = value orelse return .{ .kind = .null_value, .bytes = "" };
+        return switch (v) {
+            .null_value => .{ .kind = .null_value, .bytes = "" },
+            .bool_value => |b| .{ .kind = .bool_value, .bytes = if (b) "true" else "false" },
+            .number => |n| .{ .kind = .number, .bytes = n },
+            .string => |s| .{ .kind = .string, .bytes = s },
+            .object, .array => blk: {
+                var text = std.ArrayList(u8){};
+                output.writeJsonValue(text.writer(scratch), v) catch return error.OutOfMemory;
+                break :blk .{ .kind = .json, .bytes = text.items };
+            },
+        };
+    }
+
+    fn value(self: Key) json_parser.JsonValue {
+        return switch (self.kind) {
+            .null_value => .null_value,
+            .bool_value => .{ .bool_value = self.bytes[0] == 't' },
+            .number => .{ .number = self.bytes },
+            .string, .json => .{ .string = self.bytes },
+        };
+    }
+
+    /// Output order: by kind, then numerically or bytewise.
+    fn lessThan(_: void, a: Key, b: Key) bool {
+        if (a.kind != b.kind) return @intFromEnum(a.kind) < @intFromEnum(b.kind);
+        if (a.kind == .number) {
+            const x = number.parse(a.bytes) orelse 0;
+            const y = number.parse(b.bytes) orelse 0;
+            if (x != y) return x < y;
+        }
+        return std.mem.order(u8, a.bytes, b.bytes) == .lt;
+    }
+
+    const Context = struct {
+        pub fn hash(_: Context, key: Key) u64 {
+            return std.hash.Wyhash.hash(@intFromEnum(key.kind), key.bytes);
+        }
+
+        pub fn eql(_: Context, a: Key, b: Key) bool {
+            return a.kind == b.kind and std.mem.eql(u8, a.bytes, b.bytes);
+        }
+    };
+};
+
+const KeySet = std.HashMapUnmanaged(Key, void, Key.Context, std.hash_map.default_max_load_percentage);
+
+/// Running state of one aggregate in one group
+const Cell = struct {
+    /// Sum, or the least/greatest value so far
+    number: f64 = 0,
+    /// A numeric value was seen; otherwise the aggregate is null
+    seen: bool = false,
+    distinct: KeySet = .{},
+
+    fn addNumber(self: *Cell, op: Aggregate.Op, x: f64) void {
+        if (!self.seen) {
+            self.number = x;
+            self.seen = true;
+            return;
+        }
+        switch (op) {
+            .sum => self.number += x,
+            .min => self.number = @min(self.number, x),
+            .max => self.number = @max(self.number, x),
+            .distinct => unreachable,
+        }
+    }
+};
+
+const Group = struct {
+    count: u64 = 0,
+    cells: []Cell,
+};
+
+/// Groups of one worker. Lookups hash the key where the parser left it
+/// (a slice of the input for scalars); only a group's first key is copied
+/// into the table, so each worker fills its own table without locks and
+/// the tables are merged once the workers are done.
+pub const Table = struct {
+    spec: *const Spec,
+    /// Keys and cells; freed with the table
+    arena: std.heap.ArenaAllocator,
+    groups: std.HashMapUnmanaged(Key, Group, Key.Context, std.hash_map.default_max_load_percentage) = .{},
+    /// `spec` paths split on dots, group path first when there is one
+    paths: [][][]const u8,
+
+    pub fn init(spec: *const Spec, allocator: Allocator) Allocator.Error!Table {
+        var arena = std.heap.ArenaAllocator.init(allocator);
+        errdefer arena.deinit();
+        const a = arena.allocator();
+        const has_group: usize = @intFromBool(spec.group_by != null);
+        const paths = try a.alloc([][]const u8, has_group + spec.aggregates.len);
+        if (spec.group_by) |field| paths[0] = try splitPath(field, a);
+        for (spec.aggregates, paths[has_group..]) |agg, *path| path.* = try splitPath(agg.field, a);
+        return .{ .spec = spec, .arena = arena, .paths = paths };
+    }
+
+    pub fn deinit(self: *Table) void {
+        self.arena.deinit();
+    }
+
+    fn splitPath(field: []const u8, allocator: Allocator) Allocator.Error![][]const u8 {
+        const segments = try allocator.alloc([]const u8, std.mem.count(u8, field, ".") + 1);
+        var parts = std.mem.splitScalar(u8, field, '.');
+        for (segments) |*segment| segment.* = parts.next().?;
+        return segments;
+    }
+
+    fn resolve(obj: json_parser.JsonObject, segments: []const []const u8) ?json_parser.JsonValue {
+        var current = obj;
+        for (segments[0 .. segments.len - 1]) |key| {
+            const value = current.get(key) orelse return null;
+            if (value != .object) return null;
+            current = value.object;
+        }
+        return current.get(segments[segments.len - 1]);
+    }
+
+    /// Add a matching record. `scratch` only has to live for the call.
+    pub fn add(self: *Table, obj: json_parser.JsonObject, scratch: Allocator) Allocator.Error!void {
+        const has_group: usize = @intFromBool(self.spec.group_by != null);
+        const key = if (self.spec.group_by != null) try Key.of(resolve(obj, self.paths[0]), scratch) else Key{ .kind = .null_value, .bytes = "" };
+        const group = try self.groupFor(key);
+        group.count += 1;
+
+        for (self.spec.aggregates, self.paths[has_group..], group.cells) |agg, path, *cell| {
+            const value = resolve(obj, path) orelse continue;
+            if (agg.op == .distinct) {
+                try self.addDistinct(cell, try Key.of(value, scratch));
+                continue;
+            }
+            // Aggregates skip values that are not numbers, as SQL skips NULLs
+            if (value != .number) continue;
+            cell.addNumber(agg.op, number.parse(value.number) orelse continue);
+        }
+    }
+
+    fn groupFor(self: *Table, key: Key) Allocator.Error!*Group {
+        const a = self.arena.allocator();
+        const entry = try self.groups.getOrPut(a, key);
+        if (!entry.found_existing) {
+            entry.key_ptr.bytes = try a.dupe(u8, key.bytes);
+            const cells = try a.alloc(Cell, self.spec.aggregates.len);
+            for (cells) |*cell| cell.* = .{};
+            entry.value_ptr.* = .{ .cells = cells };
+        }
+        return entry.value_ptr;
+    }
+
+    fn addDistinct(self: *Table, cell: *Cell, key: Key) Allocator.Error!void {
+        const a = self.arena.allocator();
+        const entry = try cell.distinct.getOrPut(a, key);
+        if (!entry.found_existing) entry.key_ptr.bytes = try a.dupe(u8, key.bytes);
+    }
+
+    /// Fold `other`, a table with the same spec, into this one.
+    pub fn merge(self: *Table, other: *const Table) Allocator.Error!void {
+        var it = other.groups.iterator();
+        while (it.next()) |entry| {
+            const group = try self.groupFor(entry.key_ptr.*);
+            group.count += entry.value_ptr.count;
+            for (self.spec.aggregates, group.cells, entry.value_ptr.cells) |agg, *cell, *theirs| {
+                if (agg.op == .distinct) {
+                    var keys = theirs.distinct.keyIterator();
+                    while (keys.next()) |key| try self.addDistinct(cell, key.*);
+                } else if (theirs.seen) {
+                    cell.addNumber(agg.op, theirs.number);
+                }
+            }
+        }
+    }
+
+    /// One object per group, sorted by group value: the group field, then
+    /// `count`, then each aggregate. Everything lives in the table's arena.
+    /// Without `group_by` there is always exactly one row.
+    pub fn rows(self: *Table) Allocator.Error![]json_parser.JsonObject {
+        const a = self.arena.allocator();
+        if (self.spec.group_by == null) _ = try self.groupFor(.{ .kind = .null_value, .bytes = "" });
+
+        const keys = try a.alloc(Key, self.groups.count());
+        var it = self.groups.keyIterator();
+        for (keys) |*key| key.* = it.next().?.*;
+        std.mem.sort(Key, keys, {}, Key.lessThan);
+
+        const has_group: usize = @intFromBool(self.spec.group_by != null);
+        const objects = try a.alloc(json_parser.JsonObject, keys.len);
+        for (objects, keys) |*obj, key| {
+            const group = self.groups.getPtr(key).?;
+            const fields = try a.alloc(json_parser.JsonObject.Field, has_group + 1 + self.spec.aggregates.len);
+            if (self.spec.group_by) |field| fields[0] = .{ .key = field, .value = key.value() };
+            fields[has_group] = .{ .key = "count", .value = .{ .number = try std.fmt.allocPrint(a, "{d}", .{group.count}) } };
+            for (self.spec.aggregates, group.cells, fields[has_group + 1 ..]) |agg, *cell, *field| {
+                const value: json_parser.JsonValue = if (agg.op == .distinct)
+                    .{ .number = try std.fmt.allocPrint(a, "{d}", .{cell.distinct.count()}) }
+                else if (cell.seen)
+                    .{ .number = try std.fmt.allocPrint(a, "{d}", .{cell.number}) }
+                else
+                    .null_value;
+                field.* = .{ .key = try agg.name(a), .value = value };
+            }
+            obj.* = .{ .fields = fields, .allocator = a };
+        }
+        return objects;
+    }
+};
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+test "aggregate: per-worker tables merge into sorted groups" {
+    const allocator = std.testing.allocator;
+    const records = [_][]const u8{
+        "{\"city\":\"NYC\",\"price\":10,\"user\":\"a\"}",
+        "{\"city\":\"LA\",\"price\":5,\"user\":\"b\"}",
+        "{\"city\":\"NYC\",\"price\":2.5,\"user\":\"a\"}",
+        "{\"city\":\"NYC\",\"price\":\"n/a\",\"user\":\"c\"}",
+        "{\"price\":1}",
+    };
+    const aggregates = [_]Aggregate{
+        .{ .op = .sum, .field = "price" },
+        .{ .op = .max, .field = "price" },
+        .{ .op = .distinct, .field = "user" },
+    };
+    const spec = Spec{ .group_by = "city", .aggregates = &aggregates };
+
+    // Two workers, each with half of the records
+    var tables = [_]Table{ try Table.init(&spec, allocator), try Table.init(&spec, allocator) };
+    defer {
+        for (&tables) |*t| t.deinit();
+    }
+    var scratch = std.heap.ArenaAllocator.init(allocator);
+    defer scratch.deinit();
+    for (records, 0..) |line, i| {
+        var obj = try json_parser.parseObject(line, allocator);
+        defer obj.deinit();
+        try tables[i % 2].add(obj, scratch.allocator());
+    }
+    try tables[0].merge(&tables[1]);
+
+    var out = std.ArrayList(u8){};
+    defer out.deinit(allocator);
+    try output.writeNdjson(out.writer(allocator), try tables[0].rows(), null);
+    try std.testing.expectEqualStrings(
+        "{\"city\":null,\"count\":1,\"sum(price)\":1,\"max(price)\":1,\"distinct(user)\":0}\n" ++
+            "{\"city\":\"LA\",\"count\":1,\"sum(price)\":5,\"max(price)\":5,\"distinct(user)\":1}\n" ++
+            "{\"city\":\"NYC\",\"count\":3,\"sum(price)\":12.5,\"max(price)\":10,\"distinct(user)\":2}\n",
+        out.items,
+    );
+}
+
+test "aggregate: no group-by gives one row, even with no matches" {
+    const spec = Spec{ .aggregates = &.{.{ .op = .min, .field = "n" }} };
+    var table = try Table.init(&spec, std.testing.allocator);
+    defer table.deinit();
+
+    const objects = try table.rows();
+    try std.testing.expectEqual(@as(usize, 1), objects.len);
+    try std.testing.expectEqualStrings("0", objects[0].get("count").?.number);
+    try std.testing.expect(objects[0].get("min(n)").? == .null_value);
+}
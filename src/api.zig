@@ -1,20 +1,38 @@
 const std = @import("std");
 const json_parser = @import("json_parser.zig");
 const parallel = @import("parallel_ndjson.zig");
+const Plan = @import("plan.zig").Plan;
+const Prefilter = @import("prefilter.zig").Prefilter;
 const query_mod = @import("query.zig");
+const simd = @import("simd.zig");
+const timing = @import("stats.zig");
+
+/// Comptime filter builders; see `queryDataCompiled`.
+pub const kernel = @import("kernel.zig");
 
 pub const Filter = query_mod.Filter;
 pub const Value = query_mod.Value;
+pub const Stats = timing.Stats;
 
 pub const Options = struct {
     num_threads: usize = 4,
+    /// Time each stage and count per worker; see `QueryResult.stats`
+    collect_stats: bool = false,
 };
 
 pub const QueryResult = struct {
     inner: parallel.ChunkResult,
+    /// Per-stage timings and per-worker counters, with `Options.collect_stats`
+    stats: ?Stats = null,
 
     pub fn deinit(self: *QueryResult) void {
         self.inner.deinit();
+        if (self.stats) |*s| s.deinit();
+    }
+
+    /// Records read, including those ruled out without parsing
+    pub fn linesProcessed(self: *const QueryResult) usize {
+        return self.inner.lines_processed;
     }
 
     pub fn items(self: *const QueryResult) []const json_parser.JsonObject {
@@ -163,9 +181,8 @@ pub const q = struct {
 /// Query NDJSON or a JSON array from an in-memory buffer.
 ///
 /// Matched objects are parsed `JsonObject` values. Simple field values are
-/// zero-copy slices into `data`, so `data` must outlive the returned result
-/// when querying NDJSON input. JSON array input is converted internally and
-/// owned by the result.
+/// zero-copy slices into `data`, so `data` must outlive the returned result.
+/// JSON array elements are filtered in place, like NDJSON lines.
 pub fn queryData(
     data: []const u8,
     query: []const u8,
@@ -175,12 +192,7 @@ pub fn queryData(
     var parsed_query = try query_mod.parseQuery(query, allocator);
     defer parsed_query.deinit(allocator);
 
-    return .{ .inner = try parallel.processData(
-        data,
-        &parsed_query.filter,
-        .{ .num_threads = options.num_threads },
-        allocator,
-    ) };
+    return run(parallel.processData, data, &parsed_query.filter, .{ .num_threads = options.num_threads }, options, allocator);
 }
 
 /// Query NDJSON or a JSON array from an in-memory buffer with a native filter.
@@ -190,12 +202,19 @@ pub fn queryDataWhere(
     options: Options,
     allocator: std.mem.Allocator,
 ) !QueryResult {
-    return .{ .inner = try parallel.processData(
-        data,
-        &filter,
-        .{ .num_threads = options.num_threads },
-        allocator,
-    ) };
+    return run(parallel.processData, data, &filter, .{ .num_threads = options.num_threads }, options, allocator);
+}
+
+/// Query NDJSON or a JSON array from an in-memory buffer with a filter built
+/// at compile time by `kernel` (e.g. `kernel.Eq("city", "NYC")`). Records are
+/// matched by code specialised to the filter, with no runtime dispatch.
+pub fn queryDataCompiled(
+    data: []const u8,
+    comptime K: type,
+    options: Options,
+    allocator: std.mem.Allocator,
+) !QueryResult {
+    return run(parallel.processData, data, &K.filter, .{ .num_threads = options.num_threads, .kernel = kernel.planKernel(K) }, options, allocator);
 }
 
 /// Query an NDJSON buffer from memory.
@@ -229,12 +248,7 @@ pub fn queryFile(
     var parsed_query = try query_mod.parseQuery(query, allocator);
     defer parsed_query.deinit(allocator);
 
-    return .{ .inner = try parallel.processFile(
-        path,
-        &parsed_query.filter,
-        .{ .num_threads = options.num_threads },
-        allocator,
-    ) };
+    return run(parallel.processFile, path, &parsed_query.filter, .{ .num_threads = options.num_threads }, options, allocator);
 }
 
 /// Query a file containing NDJSON or a JSON array with a native filter.
@@ -244,12 +258,29 @@ pub fn queryFileWhere(
     options: Options,
     allocator: std.mem.Allocator,
 ) !QueryResult {
-    return .{ .inner = try parallel.processFile(
-        path,
-        &filter,
-        .{ .num_threads = options.num_threads },
-        allocator,
-    ) };
+    return run(parallel.processFile, path, &filter, .{ .num_threads = options.num_threads }, options, allocator);
+}
+
+/// Run `process` (`processData` or `processFile`), collecting stats when
+/// `options` asks for them.
+fn run(
+    process: anytype,
+    input: []const u8,
+    filter: *const Filter,
+    config: parallel.Config,
+    options: Options,
+    allocator: std.mem.Allocator,
+) !QueryResult {
+    if (!options.collect_stats) return .{ .inner = try process(input, filter, config, allocator) };
+
+    var stats = Stats.init(allocator);
+    errdefer stats.deinit();
+    var instrumented = config;
+    instrumented.stats = &stats;
+    var wall = std.time.Timer.start() catch null;
+    const inner = try process(input, filter, instrumented, allocator);
+    if (wall) |*w| stats.total_ns = w.read();
+    return .{ .inner = inner, .stats = stats };
 }
 
 test "api: query ndjson returns parsed native objects" {
@@ -288,6 +319,32 @@ test "api: query ndjson with native filter" {
     try std.testing.expectEqualStrings("Iris", result.items()[1].get("name").?.string);
 }
 
+/// Query a file containing NDJSON or a JSON array with a comptime filter.
+pub fn queryFileCompiled(
+    path: []const u8,
+    comptime K: type,
+    options: Options,
+    allocator: std.mem.Allocator,
+) !QueryResult {
+    return run(parallel.processFile, path, &K.filter, .{ .num_threads = options.num_threads, .kernel = kernel.planKernel(K) }, options, allocator);
+}
+
+test "api: query ndjson with a comptime filter" {
+    const data =
+        \\{"id":1,"name":"Alice","age":30,"city":"NYC"}
+        \\{"id":2,"name":"Bob","age":35,"city":"LA"}
+        \\{"id":3,"name":"Iris","age":45,"city":"NYC"}
+        \\
+    ;
+
+    const NycOver40 = kernel.All(.{ kernel.Eq("city", "NYC"), kernel.Gt("age", 40) });
+    var result = try queryDataCompiled(data, NycOver40, .{ .num_threads = 2 }, std.testing.allocator);
+    defer result.deinit();
+
+    try std.testing.expectEqual(@as(usize, 1), result.len());
+    try std.testing.expectEqualStrings("Iris", result.items()[0].get("name").?.string);
+}
+
 test "api: query JSON array returns parsed native objects" {
     const data = "[{\"id\":1,\"age\":20},{\"id\":2,\"age\":40}]";
 
@@ -297,3 +354,307 @@ test "api: query JSON array returns parsed native objects" {
     try std.testing.expectEqual(@as(usize, 1), result.len());
     try std.testing.expectEqualStrings("2", result.items()[0].get("id").?.number);
 }
+
+test "api: collect_stats reports per-worker counters" {
+    const data =
+        \\{"id":1,"age":20}
+        \\{"id":2,"age":40}
+        \\{"id":4,"age":oops}
+        \\{"id":3,"age":50}
+        \\
+    ;
+
+    var result = try queryData(data, "{\"age\":{\"$gte\":30}}", .{ .num_threads = 2, .collect_stats = true }, std.testing.allocator);
+    defer result.deinit();
+
+    const stats = result.stats orelse return error.TestExpectedStats;
+    const sum = stats.totals();
+    try std.testing.expectEqual(@as(u64, data.len), sum.bytes_scanned);
+    try std.testing.expectEqual(@as(u64, 2), sum.matches);
+    try std.testing.expectEqual(@as(u64, 1), sum.parse_failures);
+    try std.testing.expectEqual(@as(usize, 2), result.len());
+}
+
+/// A query parsed and compiled once, for testing records that are already in
+/// memory (say, messages off a queue) one at a time or in batches. Only the
+/// fields the filter reads are parsed, into a `Scratch` reset after every
+/// record. Immutable once made, so any number of threads may share one, each
+/// with its own `Scratch`. The C ABI (capi.zig) hands these out.
+pub const Prepared = struct {
+    query: query_mod.Query,
+    plan: Plan,
+    prefilter: Prefilter,
+    projection: ?json_parser.Projection,
+    allocator: std.mem.Allocator,
+
+    /// Heap-allocated, since the plan points into the parsed filter.
+    pub fn create(query_str: []const u8, allocator: std.mem.Allocator) !*Prepared {
+        const self = try allocator.create(Prepared);
+        errdefer allocator.destroy(self);
+        self.allocator = allocator;
+        self.query = try query_mod.parseQuery(query_str, allocator);
+        errdefer self.query.deinit(allocator);
+        self.plan = try Plan.init(&self.query.filter, allocator);
+        errdefer self.plan.deinit();
+        self.prefilter = try Prefilter.init(&self.query.filter, allocator);
+        errdefer self.prefilter.deinit();
+        self.projection = try parallel.filterProjection(&self.query.filter, allocator);
+        return self;
+    }
+
+    pub fn destroy(self: *Prepared) void {
+        if (self.projection) |*p| p.deinit(self.allocator);
+        self.prefilter.deinit();
+        self.plan.deinit();
+        self.query.deinit(self.allocator);
+        self.allocator.destroy(self);
+    }
+
+    /// Whether `record`, one JSON object, matches. Records that are not
+    /// valid JSON objects do not.
+    pub fn matches(self: *const Prepared, record: []const u8, scratch: *Scratch) std.mem.Allocator.Error!bool {
+        if (!self.prefilter.mayMatch(record)) return false;
+        scratch.tokens.clearRetainingCapacity();
+        try simd.findJsonStructure(record, &scratch.tokens, scratch.allocator);
+        defer _ = scratch.arena.reset(.retain_capacity);
+        const projection = if (self.projection) |*p| p else null;
+        const obj = json_parser.parseObjectTokens(record, scratch.tokens.items, scratch.arena.allocator(), projection) catch |err| switch (err) {
+            error.OutOfMemory => return error.OutOfMemory,
+            else => return false,
+        };
+        return self.plan.matches(&obj);
+    }
+
+    /// Set bit `i % 8` of `bitmap[i / 8]` for each record `i` that matches
+    /// and clear it for the others; returns how many matched. `bitmap` holds
+    /// at least `(records.len + 7) / 8` bytes.
+    pub fn matchBatch(self: *const Prepared, records: Records, bitmap: []u8, scratch: *Scratch) std.mem.Allocator.Error!usize {
+        return self.matchRange(records, 0, records.len(), bitmap, scratch);
+    }
+
+    /// `matchBatch` on `pool`'s threads, one slice of the batch each.
+    pub fn matchBatchPool(self: *const Prepared, records: Records, bitmap: []u8, pool: *Pool) std.mem.Allocator.Error!usize {
+        return pool.run(.{ .prepared = self, .records = records, .bitmap = bitmap });
+    }
+
+    fn matchRange(self: *const Prepared, records: Records, start: usize, end: usize, bitmap: []u8, scratch: *Scratch) std.mem.Allocator.Error!usize {
+        std.debug.assert(start % 8 == 0 and bitmap.len * 8 >= end);
+        @memset(bitmap[start / 8 .. (end + 7) / 8], 0);
+        var count: usize = 0;
+        for (start..end) |i| {
+            if (!try self.matches(records.get(i), scratch)) continue;
+            bitmap[i / 8] |= @as(u8, 1) << @intCast(i % 8);
+            count += 1;
+        }
+        return count;
+    }
+};
+
+/// The records of a batch: Zig slices, or the pointer and length arrays the
+/// C ABI takes.
+pub const Records = union(enum) {
+    slices: []const []const u8,
+    split: struct { ptrs: [*]const [*]const u8, lens: [*]const usize, len: usize },
+
+    pub fn len(self: Records) usize {
+        return switch (self) {
+            .slices => |s| s.len,
+            .split => |s| s.len,
+        };
+    }
+
+    pub fn get(self: Records, i: usize) []const u8 {
+        return switch (self) {
+            .slices => |s| s[i],
+            .split => |s| s.ptrs[i][0..s.lens[i]],
+        };
+    }
+};
+
+/// Parse memory for `Prepared`, kept by one thread and reused across records
+/// and queries.
+pub const Scratch = struct {
+    tokens: std.ArrayList(simd.Token) = .{},
+    arena: std.heap.ArenaAllocator,
+    allocator: std.mem.Allocator,
+
+    pub fn init(allocator: std.mem.Allocator) Scratch {
+        return .{ .arena = std.heap.ArenaAllocator.init(allocator), .allocator = allocator };
+    }
+
+    pub fn deinit(self: *Scratch) void {
+        self.tokens.deinit(self.allocator);
+        self.arena.deinit();
+    }
+};
+
+/// Threads kept for `Prepared.matchBatchPool`, so batches pay no spawn cost.
+/// Each thread has its own `Scratch`. A pool runs one batch at a time, of
+/// any prepared query; callers on other threads wait their turn.
+pub const Pool = struct {
+    threads: []std.Thread,
+    scratch: []Scratch,
+    allocator: std.mem.Allocator,
+
+    /// Held by `run` for a whole batch. `mutex` is released while the
+    /// batch runs, so it cannot keep a second caller out of `job`
+    turn: std.Thread.Mutex = .{},
+    mutex: std.Thread.Mutex = .{},
+    /// Signalled by `run` when a batch is posted
+    posted: std.Thread.Condition = .{},
+    /// Signalled by the last worker to finish a batch
+    finished: std.Thread.Condition = .{},
+    job: Job = undefined,
+    /// Bumped for every batch, so each worker takes each batch once
+    generation: usize = 0,
+    running: usize = 0,
+    matched: usize = 0,
+    failure: ?std.mem.Allocator.Error = null,
+    shutdown: bool = false,
+
+    /// Batches this small run on the calling thread
+    const min_parallel = 256;
+
+    const Job = struct {
+        prepared: *const Prepared,
+        records: Records,
+        bitmap: []u8,
+    };
+
+    pub fn create(num_threads: usize, allocator: std.mem.Allocator) !*Pool {
+        const n = @max(num_threads, 1);
+        const self = try allocator.create(Pool);
+        errdefer allocator.destroy(self);
+        self.* = .{ .threads = try allocator.alloc(std.Thread, n), .scratch = undefined, .allocator = allocator };
+        errdefer allocator.free(self.threads);
+        self.scratch = try allocator.alloc(Scratch, n);
+        errdefer allocator.free(self.scratch);
+        for (self.scratch) |*s| s.* = Scratch.init(allocator);
+
+        var spawned: usize = 0;
+        errdefer self.stop(spawned);
+        while (spawned < n) : (spawned += 1) {
+            self.threads[spawned] = try std.Thread.spawn(.{}, loop, .{ self, spawned });
+        }
+        return self;
+    }
+
+    pub fn destroy(self: *Pool) void {
+        self.stop(self.threads.len);
+        for (self.scratch) |*s| s.deinit();
+        self.allocator.free(self.scratch);
+        self.allocator.free(self.threads);
+        self.allocator.destroy(self);
+    }
+
+    fn stop(self: *Pool, spawned: usize) void {
+        self.mutex.lock();
+        self.shutdown = true;
+        self.posted.broadcast();
+        self.mutex.unlock();
+        for (self.threads[0..spawned]) |t| t.join();
+    }
+
+    fn run(self: *Pool, job: Job) std.mem.Allocator.Error!usize {
+        self.turn.lock();
+        defer self.turn.unlock();
+        if (job.records.len() < min_parallel) {
+            return job.prepared.matchRange(job.records, 0, job.records.len(), job.bitmap, &self.scratch[0]);
+        }
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        self.job = job;
+        self.matched = 0;
+        self.failure = null;
+        self.running = self.threads.len;
+        self.generation += 1;
+        self.posted.broadcast();
+        while (self.running > 0) self.finished.wait(&self.mutex);
+        if (self.failure) |err| return err;
+        return self.matched;
+    }
+
+    fn loop(self: *Pool, index: usize) void {
+        var seen: usize = 0;
+        while (true) {
+            self.mutex.lock();
+            while (self.generation == seen and !self.shutdown) self.posted.wait(&self.mutex);
+            if (self.shutdown) {
+                self.mutex.unlock();
+                return;
+            }
+            seen = self.generation;
+            const job = self.job;
+            self.mutex.unlock();
+
+            // Slices start on a byte of the bitmap, so no two threads write one
+            const total = job.records.len();
+            const share = std.mem.alignForward(usize, (total + self.threads.len - 1) / self.threads.len, 8);
+            const start = @min(index * share, total);
+            const end = @min(start + share, total);
+            const result: std.mem.Allocator.Error!usize = if (start < end) job.prepared.matchRange(job.records, start, end, job.bitmap, &self.scratch[index]) else 0;
+
+            self.mutex.lock();
+            if (result) |count| self.matched += count else |err| self.failure = err;
+            self.running -= 1;
+            if (self.running == 0) self.finished.signal();
+            self.mutex.unlock();
+        }
+    }
+};
+
+test "api: prepared queries match batches into a bitmap, on a pool or not" {
+    const allocator = std.testing.allocator;
+    const prepared = try Prepared.create("{\"age\":{\"$gte\":30},\"city\":\"NYC\"}", allocator);
+    defer prepared.destroy();
+
+    var scratch = Scratch.init(allocator);
+    defer scratch.deinit();
+    try std.testing.expect(try prepared.matches("{\"city\":\"NYC\",\"age\":31}", &scratch));
+    try std.testing.expect(!try prepared.matches("{\"city\":\"LA\",\"age\":31}", &scratch));
+    try std.testing.expect(!try prepared.matches("{\"city\":\"NYC\",", &scratch));
+
+    // Enough records to be split across the pool
+    var arena = std.heap.ArenaAllocator.init(allocator);
+    defer arena.deinit();
+    const records = try arena.allocator().alloc([]const u8, 1000);
+    for (records, 0..) |*r, i| {
+        r.* = try std.fmt.allocPrint(arena.allocator(), "{{\"age\":{d},\"city\":\"{s}\"}}", .{ i % 50, if (i % 3 == 0) "NYC" else "LA" });
+    }
+    var serial: [125]u8 = undefined;
+    const count = try prepared.matchBatch(.{ .slices = records }, &serial, &scratch);
+    for (records, 0..) |_, i| {
+        const expected = i % 50 >= 30 and i % 3 == 0;
+        try std.testing.expectEqual(expected, (serial[i / 8] >> @intCast(i % 8)) & 1 == 1);
+    }
+
+    const pool = try Pool.create(3, allocator);
+    defer pool.destroy();
+    var pooled: [125]u8 = undefined;
+    for (0..2) |_| {
+        @memset(&pooled, 0xff);
+        try std.testing.expectEqual(count, try prepared.matchBatchPool(.{ .slices = records }, &pooled, pool));
+        try std.testing.expectEqualSlices(u8, &serial, &pooled);
+    }
+
+    // Callers on several threads share the pool, with large batches and
+    // small ones (which run on the caller, in the pool's first scratch)
+    const Caller = struct {
+        fn run(p: *const Prepared, batch: []const []const u8, on: *Pool, expected: []const u8, failed: *std.atomic.Value(bool)) void {
+            var bitmap: [125]u8 = undefined;
+            for (0..50) |round| {
+                const n = if (round % 2 == 0) batch.len else 96;
+                _ = p.matchBatchPool(.{ .slices = batch[0..n] }, &bitmap, on) catch {
+                    failed.store(true, .monotonic);
+                    return;
+                };
+                if (!std.mem.eql(u8, expected[0 .. n / 8], bitmap[0 .. n / 8])) failed.store(true, .monotonic);
+            }
+        }
+    };
+    var failed = std.atomic.Value(bool).init(false);
+    var callers: [4]std.Thread = undefined;
+    for (&callers) |*t| t.* = try std.Thread.spawn(.{}, Caller.run, .{ prepared, records, pool, &serial, &failed });
+    for (callers) |t| t.join();
+    try std.testing.expect(!failed.load(.monotonic));
+}
@@ -0,0 +1,633 @@
+const std = @import("std");
+const json_parser = @import("json_parser.zig");
+const number = @import("number.zig");
+const query = @import("query.zig");
+const plan_mod = @import("plan.zig");
+const simd = @import("simd.zig");
+const Allocator = std.mem.Allocator;
+
+/// Columnar, vectorized counting straight off the structural index.
+///
+/// Records are shredded `batch_rows` at a time into small typed column
+/// vectors, one per field path the filter reads: an `f64` vector for numbers,
+/// offset and length for strings and number text, element runs for arrays of
+/// scalars, and bitmaps for presence, strings, booleans and null. Each plan
+/// node then yields a selection bitmask for the whole batch: numeric bounds
+/// run as SIMD compares over the `f64` vector, string equality only looks at
+/// rows holding strings, and `$and` / `$or` / `$nor` / `$not` combine masks.
+/// Nested paths are followed through the index of their enclosing objects.
+///
+/// No `JsonObject` is built and the heap is never touched: columns and
+/// array elements live inline in the counter. Shredding uses
+/// `json_parser.forEachField` and rejects exactly the records the projected
+/// parse rejects. Records it cannot decide on its own (an object, a nested
+/// array or an escape in a filtered field, an escaped key) are handed back to
+/// the caller for the row path.
+pub const batch_rows = 64;
+
+/// Most field paths a batch plan reads; wider filters take the row path
+pub const max_columns = 16;
+
+/// Array elements one batch holds across all its rows
+const max_elements = batch_rows * 4;
+
+/// One bit per row of a batch
+const Mask = u64;
+
+/// Columnar form of a `Plan`.
+pub const BatchPlan = struct {
+    root: Node,
+    /// Dotted path of each column, in column order
+    keys: []const []const u8,
+    /// Last segment of each column's path, and the object it is in
+    key_segments: []const Segment,
+    /// Objects walked on the way to nested columns ("user" for "user.tier")
+    prefixes: []const []const u8,
+    prefix_segments: []const Segment,
+    arena: std.heap.ArenaAllocator,
+
+    /// Null when the plan reads more than `max_columns` paths. Bounds and
+    /// filters are borrowed from `plan` and the query, which must outlive the
+    /// result.
+    pub fn init(plan: *const plan_mod.Plan, allocator: Allocator) Allocator.Error!?BatchPlan {
+        var arena = std.heap.ArenaAllocator.init(allocator);
+        errdefer arena.deinit();
+        var paths = Paths{};
+        const root = try compile(&plan.root, &paths, arena.allocator()) orelse {
+            arena.deinit();
+            return null;
+        };
+        return .{
+            .root = root,
+            .keys = paths.keys.items,
+            .key_segments = paths.key_segments.items,
+            .prefixes = paths.prefixes.items,
+            .prefix_segments = paths.prefix_segments.items,
+            .arena = arena,
+        };
+    }
+
+    pub fn deinit(self: *BatchPlan) void {
+        self.arena.deinit();
+    }
+};
+
+/// One segment of a path: the key `name` inside the object `parent`, which
+/// is 0 for the top level and `1 + i` for `BatchPlan.prefixes[i]`. Keys are
+/// matched one segment per depth, as the row path resolves them, so a key
+/// with a dot in it never stands for a nested path.
+const Segment = struct {
+    parent: usize,
+    name: []const u8,
+};
+
+/// Index of the segment naming `key` inside the object `parent`.
+fn findPath(segments: []const Segment, parent: usize, key: []const u8) ?usize {
+    for (segments, 0..) |segment, i| {
+        if (segment.parent == parent and simd.stringsEqualFast(segment.name, key)) return i;
+    }
+    return null;
+}
+
+/// Column and prefix paths collected while compiling
+const Paths = struct {
+    keys: std.ArrayList([]const u8) = .{},
+    key_segments: std.ArrayList(Segment) = .{},
+    prefixes: std.ArrayList([]const u8) = .{},
+    prefix_segments: std.ArrayList(Segment) = .{},
+
+    /// The column for `field`, added on first use. Null when the plan is too
+    /// wide, or when a path has an empty segment (it would alias the top level).
+    fn column(self: *Paths, field: []const u8, allocator: Allocator) Allocator.Error!?usize {
+        for (self.keys.items, 0..) |key, i| {
+            if (std.mem.eql(u8, key, field)) return i;
+        }
+        if (self.keys.items.len == max_columns) return null;
+        if (field.len == 0 or field[0] == '.' or field[field.len - 1] == '.' or
+            std.mem.indexOf(u8, field, "..") != null) return null;
+
+        var parent: usize = 0;
+        var start: usize = 0;
+        for (field, 0..) |c, i| {
+            if (c != '.') continue;
+            const prefix = field[0..i];
+            const known = for (self.prefixes.items, 0..) |p, k| {
+                if (std.mem.eql(u8, p, prefix)) break k;
+            } else new: {
+                // `Row.seen` has one bit per prefix
+                if (self.prefixes.items.len == 64) return null;
+                try self.prefixes.append(allocator, prefix);
+                try self.prefix_segments.append(allocator, .{ .parent = parent, .name = field[start..i] });
+                break :new self.prefixes.items.len - 1;
+            };
+            parent = known + 1;
+            start = i + 1;
+        }
+        try self.keys.append(allocator, field);
+        try self.key_segments.append(allocator, .{ .parent = parent, .name = field[start..] });
+        return self.keys.items.len - 1;
+    }
+};
+
+const Node = union(enum) {
+    always_true,
+    all: []Node,
+    any: []Node,
+    none: []Node,
+    not: *Node,
+    number: struct { column: usize, bounds: []const plan_mod.NumberTest.Bound },
+    string_eq: struct { column: usize, value: []const u8 },
+    exists: struct { column: usize, should_exist: bool },
+    /// Any other predicate, evaluated per present row by `query.matchesFieldValue`
+    field: struct { column: usize, filter: *const query.Filter },
+};
+
+fn compile(node: *const plan_mod.Node, paths: *Paths, allocator: Allocator) Allocator.Error!?Node {
+    switch (node.*) {
+        .always_true => return .always_true,
+        .all => |nodes| return Node{ .all = try compileAll(nodes, paths, allocator) orelse return null },
+        .any => |nodes| return Node{ .any = try compileAll(nodes, paths, allocator) orelse return null },
+        .none => |nodes| return Node{ .none = try compileAll(nodes, paths, allocator) orelse return null },
+        .not => |inner| {
+            const child = try allocator.create(Node);
+            child.* = try compile(inner, paths, allocator) orelse return null;
+            return Node{ .not = child };
+        },
+        .number => |*check| {
+            const column = try paths.column(check.path.field, allocator) orelse return null;
+            return Node{ .number = .{ .column = column, .bounds = check.bounds } };
+        },
+        .field => |*check| {
+            const column = try paths.column(check.path.field, allocator) orelse return null;
+            if (check.isStringEquality()) {
+                return Node{ .string_eq = .{ .column = column, .value = check.filter.comparison.value.string } };
+            }
+            if (check.filter.* == .exists) {
+                return Node{ .exists = .{ .column = column, .should_exist = check.filter.exists.should_exist } };
+            }
+            return Node{ .field = .{ .column = column, .filter = check.filter } };
+        },
+    }
+}
+
+fn compileAll(nodes: []const plan_mod.Node, paths: *Paths, allocator: Allocator) Allocator.Error!?[]Node {
+    const compiled = try allocator.alloc(Node, nodes.len);
+    for (nodes, compiled) |*node, *out| out.* = try compile(node, paths, allocator) orelse return null;
+    return compiled;
+}
+
+/// Values of one field for the rows of a batch
+const Column = struct {
+    present: Mask = 0,
+    /// Literal that `number.parse` accepts; its value is in `numbers`
+    numeric: Mask = 0,
+    string: Mask = 0,
+    /// Array of scalars; its span indexes `BatchCounter.elements`
+    array: Mask = 0,
+    true_value: Mask = 0,
+    false_value: Mask = 0,
+    null_value: Mask = 0,
+    /// Always initialised, so the SIMD compares never read undefined lanes
+    numbers: [batch_rows]f64 = [_]f64{0} ** batch_rows,
+    /// String contents or literal text, as offsets into the batch source
+    spans: [batch_rows]Span = undefined,
+
+    const Span = struct { start: u32, len: u32 };
+
+    fn keep(self: *Column, rows: Mask) void {
+        self.present &= rows;
+        self.numeric &= rows;
+        self.string &= rows;
+        self.array &= rows;
+        self.true_value &= rows;
+        self.false_value &= rows;
+        self.null_value &= rows;
+    }
+};
+
+/// Counts the matches of a `BatchPlan` over the records of one source at a
+/// time. Not thread-safe; each worker keeps its own.
+pub const BatchCounter = struct {
+    plan: *const BatchPlan,
+    /// The first `plan.keys.len` are in use
+    columns: [max_columns]Column = [_]Column{.{}} ** max_columns,
+    /// Elements of the array values in the current batch
+    elements: [max_elements]json_parser.JsonValue = undefined,
+    /// Elements in use
+    used: usize = 0,
+    source: []const u8 = &.{},
+    /// Rows shredded into the current batch
+    rows: usize = 0,
+    /// Matches in the batches evaluated since `begin`
+    count: usize = 0,
+
+    pub const Outcome = enum {
+        /// Shredded; counted when its batch is evaluated
+        batched,
+        /// Malformed; never matches
+        rejected,
+        /// Needs the row path
+        undecided,
+    };
+
+    pub fn init(plan: *const BatchPlan) BatchCounter {
+        return .{ .plan = plan };
+    }
+
+    /// Start counting the records of `source`.
+    pub fn begin(self: *BatchCounter, source: []const u8) void {
+        std.debug.assert(self.rows == 0);
+        self.source = source;
+        self.count = 0;
+    }
+
+    /// Shred the record whose structural index is `tokens` (positions index
+    /// the source given to `begin`).
+    pub fn add(self: *BatchCounter, tokens: []const simd.Token) Outcome {
+        // Spans are 32-bit offsets
+        if (self.source.len > std.math.maxInt(u32)) return .undecided;
+
+        var row = Row{ .counter = self, .index = self.rows, .first_element = self.used };
+        const top = Shredder{ .row = &row, .parent = 0, .store = true };
+        const outcome: Outcome = if (json_parser.forEachField(self.source, tokens, &top, Shredder.visit)) |_|
+            (if (row.rejected) .rejected else if (row.undecided) .undecided else .batched)
+        else |_|
+            .rejected;
+
+        if (outcome != .batched) {
+            const others = ~row.bit();
+            for (self.activeColumns()) |*column| column.keep(others);
+            self.used = row.first_element;
+            return outcome;
+        }
+        self.rows += 1;
+        if (self.rows == batch_rows) self.flush();
+        return .batched;
+    }
+
+    /// Evaluate the last, partial batch and return the matches since `begin`.
+    pub fn end(self: *BatchCounter) usize {
+        self.flush();
+        return self.count;
+    }
+
+    fn activeColumns(self: *BatchCounter) []Column {
+        return self.columns[0..self.plan.keys.len];
+    }
+
+    fn flush(self: *BatchCounter) void {
+        if (self.rows == 0) return;
+        const live: Mask = if (self.rows == batch_rows) ~@as(Mask, 0) else (@as(Mask, 1) << @intCast(self.rows)) - 1;
+        self.count += @popCount(self.eval(&self.plan.root, live));
+        for (self.activeColumns()) |*column| column.keep(0);
+        self.used = 0;
+        self.rows = 0;
+    }
+
+    /// Rows of `live` that match `node`; always a subset of `live`.
+    fn eval(self: *BatchCounter, node: *const Node, live: Mask) Mask {
+        switch (node.*) {
+            .always_true => return live,
+            .all => |nodes| {
+                var selected = live;
+                for (nodes) |*child| {
+                    if (selected == 0) break;
+                    selected = self.eval(child, selected);
+                }
+                return selected;
+            },
+            .any => |nodes| return self.anyOf(nodes, live),
+            .none => |nodes| return live & ~self.anyOf(nodes, live),
+            .not => |child| return live & ~self.eval(child, live),
+            .number => |leaf| {
+                const column = &self.columns[leaf.column];
+                var selected = live & column.present;
+                for (leaf.bounds) |bound| {
+                    if (selected == 0) break;
+                    // Mirrors `NumberTest.Bound.holds` for present non-numbers
+                    const non_numeric: Mask = switch (bound.op) {
+                        .eq, .gt, .lt => 0,
+                        .ne, .gte, .lte => ~column.numeric,
+                    };
+                    const compared = switch (bound.op) {
+                        inline else => |op| compareColumn(op, &column.numbers, bound.value),
+                    };
+                    selected &= (column.numeric & compared) | non_numeric;
+                }
+                return selected;
+            },
+            .string_eq => |leaf| {
+                const column = &self.columns[leaf.column];
+                var selected: Mask = 0;
+                var rows = live & column.string;
+                while (rows != 0) : (rows &= rows - 1) {
+                    const row = @ctz(rows);
+                    const span = column.spans[row];
+                    if (span.len == leaf.value.len and
+                        simd.stringsEqualFast(self.source[span.start..][0..span.len], leaf.value))
+                    {
+                        selected |= @as(Mask, 1) << @intCast(row);
+                    }
+                }
+                return selected;
+            },
+            .exists => |leaf| {
+                const present = self.columns[leaf.column].present;
+                return live & if (leaf.should_exist) present else ~present;
+            },
+            .field => |leaf| {
+                const column = &self.columns[leaf.column];
+                var selected: Mask = if (query.matchesFieldValue(null, leaf.filter)) live & ~column.present else 0;
+                var rows = live & column.present;
+                while (rows != 0) : (rows &= rows - 1) {
+                    const row = @ctz(rows);
+                    if (query.matchesFieldValue(self.valueAt(column, row), leaf.filter)) {
+                        selected |= @as(Mask, 1) << @intCast(row);
+                    }
+                }
+                return selected;
+            },
+        }
+    }
+
+    fn anyOf(self: *BatchCounter, nodes: []const Node, live: Mask) Mask {
+        var selected: Mask = 0;
+        for (nodes) |*child| {
+            const undecided = live & ~selected;
+            if (undecided == 0) break;
+            selected |= self.eval(child, undecided);
+        }
+        return selected;
+    }
+
+    /// The value a parse would give for a present row of `column`.
+    fn valueAt(self: *BatchCounter, column: *const Column, row: usize) json_parser.JsonValue {
+        const bit = @as(Mask, 1) << @intCast(row);
+        if (column.true_value & bit != 0) return .{ .bool_value = true };
+        if (column.false_value & bit != 0) return .{ .bool_value = false };
+        if (column.null_value & bit != 0) return .{ .null_value = {} };
+        const span = column.spans[row];
+        if (column.array & bit != 0) return .{ .array = self.elements[span.start..][0..span.len] };
+        const text = self.source[span.start..][0..span.len];
+        return if (column.string & bit != 0) .{ .string = text } else .{ .number = text };
+    }
+};
+
+/// `op` against `value` for every row of the batch, `lanes` rows per compare.
+fn compareColumn(comptime op: query.Comparison.CompOp, numbers: *const [batch_rows]f64, value: f64) Mask {
+    const lanes = comptime @min(std.simd.suggestVectorLength(f64) orelse 4, batch_rows);
+    const V = @Vector(lanes, f64);
+    const constant: V = @splat(value);
+    var mask: Mask = 0;
+    inline for (0..batch_rows / lanes) |k| {
+        const x: V = numbers[k * lanes ..][0..lanes].*;
+        const hits = switch (op) {
+            .eq => x == constant,
+            .ne => x != constant,
+            .gt => x > constant,
+            .gte => x >= constant,
+            .lt => x < constant,
+            .lte => x <= constant,
+        };
+        const bits: std.meta.Int(.unsigned, lanes) = @bitCast(hits);
+        mask |= @as(Mask, bits) << (k * lanes);
+    }
+    return mask;
+}
+
+/// Shredding state of the record being added
+const Row = struct {
+    counter: *BatchCounter,
+    index: usize,
+    /// Prefix objects already walked; like the parser's lookups, only the
+    /// first of duplicate keys is read
+    seen: u64 = 0,
+    /// `counter.used` before this record, restored if it is not batched
+    first_element: usize,
+    rejected: bool = false,
+    undecided: bool = false,
+
+    fn bit(self: *const Row) Mask {
+        return @as(Mask, 1) << @intCast(self.index);
+    }
+};
+
+/// Writes the filtered fields of one object into the row's columns.
+const Shredder = struct {
+    row: *Row,
+    /// The object being walked, as a `Segment.parent`
+    parent: usize,
+    /// False inside a duplicate of an object already walked: its fields are
+    /// checked, as the parser builds them too, but not stored
+    store: bool,
+
+    fn visit(self: *const Shredder, field: json_parser.RawField) void {
+        const row = self.row;
+        const counter = row.counter;
+        const plan = counter.plan;
+
+        // The parser decodes escaped keys, which may then name a column
+        if (std.mem.indexOfScalar(u8, field.key, '\\') != null) {
+            row.undecided = true;
+            return;
+        }
+        const column_index = findPath(plan.key_segments, self.parent, field.key);
+
+        if (field.value == .container and field.value.container[0].type == .open_brace) {
+            // Whole objects are not shredded
+            if (column_index != null) {
+                row.undecided = true;
+                return;
+            }
+            const prefix = findPath(plan.prefix_segments, self.parent, field.key) orelse return;
+            const seen = @as(u64, 1) << @intCast(prefix);
+            const nested = Shredder{ .row = row, .parent = prefix + 1, .store = self.store and row.seen & seen == 0 };
+            row.seen |= seen;
+            json_parser.forEachField(counter.source, field.value.container, &nested, visit) catch {
+                row.rejected = true;
+            };
+            return;
+        }
+
+        const column = &counter.columns[column_index orelse return];
+        const bit = row.bit();
+        const store = self.store and column.present & bit == 0;
+
+        switch (field.value) {
+            .container => |tokens| {
+                const items = json_parser.parseScalarArray(counter.source, tokens, counter.elements[counter.used..]) catch {
+                    row.rejected = true;
+                    return;
+                } orelse {
+                    row.undecided = true;
+                    return;
+                };
+                if (!store) return;
+                column.array |= bit;
+                column.spans[row.index] = .{ .start = @intCast(counter.used), .len = @intCast(items.len) };
+                counter.used += items.len;
+            },
+            .string => |raw| {
+                if (std.mem.indexOfScalar(u8, raw, '\\') != null) {
+                    row.undecided = true;
+                    return;
+                }
+                if (!store) return;
+                column.string |= bit;
+                column.spans[row.index] = spanOf(counter.source, raw);
+            },
+            .literal => |text| {
+                if (!store) return;
+                if (std.mem.eql(u8, text, "true")) {
+                    column.true_value |= bit;
+                } else if (std.mem.eql(u8, text, "false")) {
+                    column.false_value |= bit;
+                } else if (std.mem.eql(u8, text, "null")) {
+                    column.null_value |= bit;
+                } else {
+                    column.spans[row.index] = spanOf(counter.source, text);
+                    if (number.parse(text)) |value| {
+                        column.numeric |= bit;
+                        column.numbers[row.index] = value;
+                    }
+                }
+            },
+        }
+        column.present |= bit;
+    }
+};
+
+fn spanOf(source: []const u8, text: []const u8) Column.Span {
+    const start = @intFromPtr(text.ptr) - @intFromPtr(source.ptr);
+    return .{ .start = @intCast(start), .len = @intCast(text.len) };
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+/// Count `records` through the batch path, falling back to a projected parse
+/// and the plan for undecided rows, like the count workers do.
+fn countBatched(query_str: []const u8, records: []const []const u8) !struct { batched: usize, row_path: usize } {
+    const allocator = std.testing.allocator;
+    var parsed = try query.parseQuery(query_str, allocator);
+    defer parsed.deinit(allocator);
+    var plan = try plan_mod.Plan.init(&parsed.filter, allocator);
+    defer plan.deinit();
+    var batch_plan = (try BatchPlan.init(&plan, allocator)).?;
+    defer batch_plan.deinit();
+    var counter = BatchCounter.init(&batch_plan);
+
+    var projection = json_parser.Projection{};
+    defer projection.deinit(allocator);
+    try query.addFilterPaths(&parsed.filter, &projection, allocator);
+
+    const data = try std.mem.join(allocator, "\n", records);
+    defer allocator.free(data);
+    var indexer = simd.RecordIndexer.init(data);
+    defer indexer.deinit(allocator);
+
+    var row_path: usize = 0;
+    var expected: usize = 0;
+    counter.begin(data);
+    while (try indexer.next(allocator)) |record| {
+        if (record.line.len == 0) continue;
+        var obj: ?json_parser.JsonObject = json_parser.parseObjectTokens(data, record.tokens, allocator, &projection) catch null;
+        defer if (obj) |*o| o.deinit();
+        const matches = if (obj) |*o| plan.matches(o) else false;
+        if (matches) expected += 1;
+        switch (counter.add(record.tokens)) {
+            .batched => {},
+            .rejected => try std.testing.expect(obj == null),
+            .undecided => {
+                if (matches) row_path += 1;
+            },
+        }
+    }
+    const batched = counter.end();
+    try std.testing.expectEqual(expected, batched + row_path);
+    return .{ .batched = batched, .row_path = row_path };
+}
+
+test "batch: counts like the row path" {
+    const records = [_][]const u8{
+        "{\"age\":30,\"city\":\"NYC\",\"vip\":true}",
+        "{\"city\":\"LA\",\"age\":17,\"vip\":false,\"tags\":[1,2]}",
+        "{\"age\":\"unknown\",\"city\":null}",
+        "{\"age\":65.0,\"name\":\"Bo\"}",
+        "{\"name\":\"alice\",\"age\":1e2,\"city\":\"SF\"}",
+        "{\"age\":,\"city\":\"NYC\"}",
+        "{\"age\":41,\"city\":\"NYC\"",
+        "{\"city\":\"N\\u0059C\",\"age\":50}",
+        "{\"\\u0061ge\":99}",
+        "{\"city\":{\"name\":\"NYC\"},\"age\":35}",
+        "{\"user\":{\"tier\":\"gold\",\"score\":9.5},\"tags\":[\"a\",\"b\"]}",
+        "{\"user\":{\"score\":-3,\"tier\":\"free\",\"extra\":{}},\"tags\":[3,\"a\",null]}",
+        "{\"user\":\"flat\",\"tags\":[]}",
+        "{\"user\":{\"tier\":\"gold\",\"score\":},\"age\":20}",
+        "{\"tags\":[[1],\"a\"],\"user\":{\"tier\":\"g\\u006fld\"}}",
+        "{\"tags\":[1,,2]}",
+        "{}",
+    };
+    const queries = [_][]const u8{
+        "{\"age\":{\"$gt\":18,\"$lt\":65}}",
+        "{\"age\":{\"$gte\":30,\"$ne\":100}}",
+        "{\"age\":{\"$lte\":40}}",
+        "{\"city\":\"NYC\",\"age\":{\"$gte\":30}}",
+        "{\"$or\":[{\"name\":{\"$regex\":\"^al\"}},{\"city\":{\"$in\":[\"LA\",\"SF\"]}}]}",
+        "{\"$nor\":[{\"vip\":true},{\"age\":{\"$exists\":false}}]}",
+        "{\"age\":{\"$not\":{\"$gt\":20}},\"city\":{\"$ne\":\"LA\"}}",
+        "{\"city\":null}",
+        "{\"name\":{\"$exists\":true}}",
+        "{\"user.tier\":\"gold\",\"user.score\":{\"$gt\":0}}",
+        "{\"user.score\":{\"$lte\":9.5}}",
+        "{\"tags\":{\"$in\":[\"a\",3]}}",
+        "{\"tags\":{\"$nin\":[\"b\"]},\"user.tier\":{\"$exists\":true}}",
+        "{\"tags\":{\"$size\":2}}",
+        "{\"$or\":[{\"tags\":{\"$type\":\"array\"}},{\"user\":{\"$type\":\"object\"}}]}",
+        "{}",
+    };
+    for (queries) |query_str| _ = try countBatched(query_str, &records);
+}
+
+test "batch: full batches use the columns, wide filters do not compile" {
+    const allocator = std.testing.allocator;
+    var lines: [batch_rows * 2 + 5][]const u8 = undefined;
+    var storage: [lines.len][48]u8 = undefined;
+    for (&lines, &storage, 0..) |*line, *buf, i| {
+        line.* = try std.fmt.bufPrint(buf, "{{\"id\":{d},\"level\":\"{s}\"}}", .{ i, if (i % 3 == 0) "error" else "info" });
+    }
+    const result = try countBatched("{\"level\":\"error\",\"id\":{\"$gte\":10}}", &lines);
+    try std.testing.expectEqual(@as(usize, 0), result.row_path);
+    try std.testing.expectEqual(@as(usize, 41), result.batched);
+
+    var parsed = try query.parseQuery(
+        "{\"a\":1,\"b\":1,\"c\":1,\"d\":1,\"e\":1,\"f\":1,\"g\":1,\"h\":1," ++
+            "\"i\":1,\"j\":1,\"k\":1,\"l\":1,\"m\":1,\"n\":1,\"o\":1,\"p\":1,\"q\":1}",
+        allocator,
+    );
+    defer parsed.deinit(allocator);
+    var plan = try plan_mod.Plan.init(&parsed.filter, allocator);
+    defer plan.deinit();
+    try std.testing.expect((try BatchPlan.init(&plan, allocator)) == null);
+}
+
+test "batch: dotted keys are not nested paths" {
+    const records = [_][]const u8{
+        "{\"a.b\":1}",
+        "{\"a\":{\"b.c\":1}}",
+        "{\"a\":{\"b\":{\"c\":1}}}",
+        "{\"a\":{\"b\":1},\"a.b\":2}",
+        "{\"a.b\":{\"c\":1}}",
+    };
+    // `countBatched` checks the counter against the row path; each query
+    // matches one record, which a column keyed on the dotted path would miss
+    const queries = [_][]const u8{
+        "{\"a.b.c\":1}",
+        "{\"a.b\":{\"$gte\":1}}",
+    };
+    for (queries) |query_str| {
+        const result = try countBatched(query_str, &records);
+        try std.testing.expectEqual(@as(usize, 1), result.batched + result.row_path);
+    }
+}
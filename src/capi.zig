@@ -0,0 +1,179 @@
+const std = @import("std");
+const api = @import("api.zig");
+
+// C ABI of libzson; declared in include/zson.h. Handles are `api.Prepared`,
+// `api.Scratch` and `api.Pool` behind opaque pointers, allocated with the C
+// allocator.
+
+const allocator = std.heap.c_allocator;
+
+const Query = opaque {};
+const Scratch = opaque {};
+const Pool = opaque {};
+
+/// Status codes, as `ZSON_*` in zson.h
+const ok: c_int = 0;
+const invalid_query: c_int = -1;
+const out_of_memory: c_int = -2;
+const invalid_argument: c_int = -3;
+
+fn prepared(query: *const Query) *const api.Prepared {
+    return @ptrCast(@alignCast(query));
+}
+
+fn status(err: anyerror) c_int {
+    return switch (err) {
+        error.OutOfMemory => out_of_memory,
+        else => invalid_query,
+    };
+}
+
+/// The batch behind `buffers` and `lens`, or null if an entry is NULL
+fn records(buffers: [*c]const [*c]const u8, lens: [*c]const usize, n: usize) ?api.Records {
+    for (buffers[0..n]) |buffer| if (buffer == null) return null;
+    return .{ .split = .{ .ptrs = @ptrCast(buffers), .lens = lens, .len = n } };
+}
+
+/// Runs `f` with the caller's scratch, or with one made for the call when
+/// `scratch` is NULL
+fn withScratch(scratch: ?*Scratch, comptime T: type, f: anytype, args: anytype) std.mem.Allocator.Error!T {
+    if (scratch) |s| return @call(.auto, f, args ++ .{@as(*api.Scratch, @ptrCast(@alignCast(s)))});
+    var temporary = api.Scratch.init(allocator);
+    defer temporary.deinit();
+    return @call(.auto, f, args ++ .{&temporary});
+}
+
+export fn zson_prepare(query: [*c]const u8, query_len: usize, err: [*c]c_int) ?*Query {
+    if (query == null) {
+        if (err != null) err.* = invalid_argument;
+        return null;
+    }
+    const result = api.Prepared.create(query[0..query_len], allocator) catch |e| {
+        if (err != null) err.* = status(e);
+        return null;
+    };
+    if (err != null) err.* = ok;
+    return @ptrCast(result);
+}
+
+export fn zson_free(query: ?*Query) void {
+    const q = query orelse return;
+    const p: *api.Prepared = @ptrCast(@alignCast(q));
+    p.destroy();
+}
+
+export fn zson_scratch_create() ?*Scratch {
+    const scratch = allocator.create(api.Scratch) catch return null;
+    scratch.* = api.Scratch.init(allocator);
+    return @ptrCast(scratch);
+}
+
+export fn zson_scratch_destroy(scratch: ?*Scratch) void {
+    const s = scratch orelse return;
+    const inner: *api.Scratch = @ptrCast(@alignCast(s));
+    inner.deinit();
+    allocator.destroy(inner);
+}
+
+export fn zson_match(query: ?*const Query, scratch: ?*Scratch, record: [*c]const u8, len: usize) c_int {
+    const q = query orelse return invalid_argument;
+    if (record == null) return invalid_argument;
+    const matched = withScratch(scratch, bool, api.Prepared.matches, .{ prepared(q), record[0..len] }) catch return out_of_memory;
+    return @intFromBool(matched);
+}
+
+export fn zson_match_batch(
+    query: ?*const Query,
+    scratch: ?*Scratch,
+    buffers: [*c]const [*c]const u8,
+    lens: [*c]const usize,
+    n: usize,
+    out_bitmap: [*c]u8,
+) i64 {
+    const q = query orelse return invalid_argument;
+    if (n == 0) return 0;
+    if (buffers == null or lens == null or out_bitmap == null) return invalid_argument;
+    const batch = records(buffers, lens, n) orelse return invalid_argument;
+    const count = withScratch(scratch, usize, api.Prepared.matchBatch, .{ prepared(q), batch, out_bitmap[0 .. (n + 7) / 8] }) catch return out_of_memory;
+    return @intCast(count);
+}
+
+export fn zson_pool_create(num_threads: usize) ?*Pool {
+    const pool = api.Pool.create(num_threads, allocator) catch return null;
+    return @ptrCast(pool);
+}
+
+export fn zson_pool_destroy(pool: ?*Pool) void {
+    const p = pool orelse return;
+    const inner: *api.Pool = @ptrCast(@alignCast(p));
+    inner.destroy();
+}
+
+export fn zson_pool_match_batch(
+    pool: ?*Pool,
+    query: ?*const Query,
+    buffers: [*c]const [*c]const u8,
+    lens: [*c]const usize,
+    n: usize,
+    out_bitmap: [*c]u8,
+) i64 {
+    const p = pool orelse return invalid_argument;
+    const q = query orelse return invalid_argument;
+    if (n == 0) return 0;
+    if (buffers == null or lens == null or out_bitmap == null) return invalid_argument;
+    const batch = records(buffers, lens, n) orelse return invalid_argument;
+    const inner: *api.Pool = @ptrCast(@alignCast(p));
+    const count = prepared(q).matchBatchPool(batch, out_bitmap[0 .. (n + 7) / 8], inner) catch return out_of_memory;
+    return @intCast(count);
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+test "capi: prepare, match and free through the C ABI" {
+    var err: c_int = 1;
+    try std.testing.expectEqual(@as(?*Query, null), zson_prepare("{\"age\":", 7, &err));
+    try std.testing.expectEqual(invalid_query, err);
+
+    const text = "{\"level\":\"error\"}";
+    const query = zson_prepare(text, text.len, &err) orelse return error.TestUnexpectedNull;
+    defer zson_free(query);
+    try std.testing.expectEqual(ok, err);
+
+    const lines = [_][]const u8{ "{\"level\":\"info\"}", "{\"level\":\"error\",\"id\":1}", "not json", "{\"level\":\"error\"}", "{\"level\":\"error\",\"x\":[1}}" };
+    var ptrs: [lines.len][*c]const u8 = undefined;
+    var lens: [lines.len]usize = undefined;
+    for (lines, &ptrs, &lens) |line, *ptr, *len| {
+        ptr.* = line.ptr;
+        len.* = line.len;
+    }
+    const scratch = zson_scratch_create() orelse return error.TestUnexpectedNull;
+    defer zson_scratch_destroy(scratch);
+    try std.testing.expectEqual(@as(c_int, 1), zson_match(query, scratch, ptrs[1], lens[1]));
+    try std.testing.expectEqual(@as(c_int, 0), zson_match(query, scratch, ptrs[0], lens[0]));
+    try std.testing.expectEqual(@as(c_int, 1), zson_match(query, null, ptrs[1], lens[1]));
+    // Not valid JSON, though the query never reads "x"
+    const malformed = "{\"level\":\"error\",\"x\":}";
+    try std.testing.expectEqual(@as(c_int, 0), zson_match(query, scratch, malformed, malformed.len));
+    try std.testing.expectEqual(invalid_argument, zson_match(query, scratch, null, 0));
+
+    var bitmap = [_]u8{0xff};
+    try std.testing.expectEqual(@as(i64, 2), zson_match_batch(query, scratch, &ptrs, &lens, lines.len, &bitmap));
+    try std.testing.expectEqual(@as(u8, 0b1010), bitmap[0]);
+    bitmap[0] = 0;
+    try std.testing.expectEqual(@as(i64, 2), zson_match_batch(query, null, &ptrs, &lens, lines.len, &bitmap));
+    try std.testing.expectEqual(@as(u8, 0b1010), bitmap[0]);
+
+    const pool = zson_pool_create(2) orelse return error.TestUnexpectedNull;
+    defer zson_pool_destroy(pool);
+    bitmap[0] = 0;
+    try std.testing.expectEqual(@as(i64, 2), zson_pool_match_batch(pool, query, &ptrs, &lens, lines.len, &bitmap));
+    try std.testing.expectEqual(@as(u8, 0b1010), bitmap[0]);
+    try std.testing.expectEqual(@as(i64, invalid_argument), zson_pool_match_batch(null, query, &ptrs, &lens, lines.len, &bitmap));
+
+    // A NULL record is an error, not a crash
+    ptrs[2] = null;
+    try std.testing.expectEqual(@as(i64, invalid_argument), zson_match_batch(query, scratch, &ptrs, &lens, lines.len, &bitmap));
+    try std.testing.expectEqual(@as(i64, invalid_argument), zson_pool_match_batch(pool, query, &ptrs, &lens, lines.len, &bitmap));
+}
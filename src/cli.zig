@@ -1,4 +1,6 @@
 const std = @import("std");
+const aggregate = @import("aggregate.zig");
+const fileio = @import("fileio.zig");
 
 pub const OutputFormat = enum {
     json,
@@ -14,8 +16,11 @@ pub const OutputFormat = enum {
 };
 
 pub const CliOptions = struct {
-    /// Input file path (null means stdin)
-    input_file: ?[]const u8 = null,
+    /// Input files in command-line order, globs expanded ('-' is stdin)
+    input_files: []const []const u8 = &.{},
+
+    /// Tag each record with the file it came from
+    with_filename: bool = false,
 
     /// MongoDB query string
     query: []const u8,
@@ -29,27 +34,58 @@ pub const CliOptions = struct {
     /// Just count matches, don't output records
     count_only: bool = false,
 
+    /// Output one row per distinct value of this field instead of records
+    group_by: ?[]const u8 = null,
+
+    /// --sum/--min/--max/--distinct columns of the grouped output
+    aggregates: []const aggregate.Aggregate = &.{},
+
     /// Assert that the match count equals this value
     assert_count: ?usize = null,
 
     /// Limit number of results
     limit: ?usize = null,
 
+    /// Output matches ordered by this field (dotted path)
+    sort_by: ?[]const u8 = null,
+
+    /// Sort largest first
+    descending: bool = false,
+
     /// Pretty-print JSON output
     pretty: bool = false,
 
     /// Number of threads to use
     threads: usize = 4,
 
+    /// How input files are read
+    io: fileio.Backend = .mmap,
+
+    /// Keep reading the input file as it grows, across log rotation
+    follow: bool = false,
+
+    /// Build or reuse a sidecar index (`<file>.zsidx`) to skip blocks
+    use_index: bool = false,
+
+    /// Print per-stage timings and per-thread counters to stderr
+    show_stats: bool = false,
+
     /// Show help message
     show_help: bool = false,
 
     allocator: std.mem.Allocator,
 
+    /// Paths produced by glob expansion
+    expanded_paths: [][]u8 = &.{},
+
     pub fn deinit(self: *CliOptions) void {
         if (self.select_fields) |fields| {
             self.allocator.free(fields);
         }
+        self.allocator.free(self.input_files);
+        self.allocator.free(self.aggregates);
+        for (self.expanded_paths) |path| self.allocator.free(path);
+        self.allocator.free(self.expanded_paths);
     }
 };
 
@@ -65,7 +101,16 @@ pub fn parseArgs(allocator: std.mem.Allocator) !CliOptions {
         .allocator = allocator,
     };
 
-    var positional_count: usize = 0;
+    var inputs = std.ArrayList([]const u8){};
+    defer inputs.deinit(allocator);
+    var expanded = std.ArrayList([]u8){};
+    errdefer {
+        for (expanded.items) |path| allocator.free(path);
+        expanded.deinit(allocator);
+    }
+    errdefer if (options.select_fields) |fields| allocator.free(fields);
+    var aggregates = std.ArrayList(aggregate.Aggregate){};
+    defer aggregates.deinit(allocator);
 
     while (args.next()) |arg| {
         if (std.mem.startsWith(u8, arg, "--")) {
@@ -94,6 +139,29 @@ pub fn parseArgs(allocator: std.mem.Allocator) !CliOptions {
             } else if (std.mem.eql(u8, arg, "--threads")) {
                 const value = args.next() orelse return error.MissingValue;
                 options.threads = try std.fmt.parseInt(usize, value, 10);
+            } else if (std.mem.eql(u8, arg, "--io")) {
+                const value = args.next() orelse return error.MissingValue;
+                options.io = fileio.Backend.fromString(value) orelse {
+                    std.debug.print("Invalid I/O backend: {s}\n", .{value});
+                    return error.InvalidIoBackend;
+                };
+            } else if (std.mem.eql(u8, arg, "--follow")) {
+                options.follow = true;
+            } else if (std.mem.eql(u8, arg, "--index")) {
+                options.use_index = true;
+            } else if (std.mem.eql(u8, arg, "--stats")) {
+                options.show_stats = true;
+            } else if (std.mem.eql(u8, arg, "--with-filename")) {
+                options.with_filename = true;
+            } else if (std.mem.eql(u8, arg, "--sort-by")) {
+                options.sort_by = args.next() orelse return error.MissingValue;
+            } else if (std.mem.eql(u8, arg, "--desc")) {
+                options.descending = true;
+            } else if (std.mem.eql(u8, arg, "--group-by")) {
+                options.group_by = args.next() orelse return error.MissingValue;
+            } else if (aggregateOp(arg)) |op| {
+                const field = args.next() orelse return error.MissingValue;
+                try aggregates.append(allocator, .{ .op = op, .field = field });
             } else {
                 std.debug.print("Unknown option: {s}\n", .{arg});
                 return error.UnknownOption;
@@ -106,40 +174,34 @@ pub fn parseArgs(allocator: std.mem.Allocator) !CliOptions {
                 options.count_only = true;
             } else if (std.mem.eql(u8, arg, "-p")) {
                 options.pretty = true;
+            } else if (std.mem.eql(u8, arg, "-f")) {
+                options.follow = true;
             } else {
                 std.debug.print("Unknown option: {s}\n", .{arg});
                 return error.UnknownOption;
             }
-        } else {
-            // Positional argument
-            if (positional_count == 0) {
-                // First positional: could be file or query
-                // If it ends with .json or .ndjson, it's a file
-                if (std.mem.endsWith(u8, arg, ".json") or
-                    std.mem.endsWith(u8, arg, ".ndjson") or
-                    std.mem.eql(u8, arg, "-"))
-                {
-                    options.input_file = arg;
-                } else {
-                    options.query = arg;
-                }
-                positional_count += 1;
-            } else if (positional_count == 1) {
-                // Second positional: if we got a file first, this is the query
-                if (options.input_file != null) {
-                    options.query = arg;
-                } else {
-                    // We got a query first, this is the file
-                    options.input_file = arg;
-                }
-                positional_count += 1;
-            } else {
-                std.debug.print("Too many positional arguments\n", .{});
-                return error.TooManyArgs;
+        } else if (options.query.len == 0 and !looksLikeInput(arg)) {
+            // The first positional that isn't a file is the query
+            options.query = arg;
+        } else if (hasGlob(arg)) {
+            const first = expanded.items.len;
+            try expandGlob(std.fs.cwd(), arg, &expanded, allocator);
+            if (expanded.items.len == first) {
+                std.debug.print("No files match: {s}\n", .{arg});
+                return error.NoFilesMatch;
             }
+            for (expanded.items[first..]) |path| try inputs.append(allocator, path);
+        } else {
+            try inputs.append(allocator, arg);
         }
     }
 
+    options.input_files = try inputs.toOwnedSlice(allocator);
+    errdefer allocator.free(options.input_files);
+    options.aggregates = try aggregates.toOwnedSlice(allocator);
+    errdefer allocator.free(options.aggregates);
+    options.expanded_paths = try expanded.toOwnedSlice(allocator);
+
     // Validate required arguments
     if (!options.show_help and options.query.len == 0) {
         std.debug.print("Error: Query string is required\n\n", .{});
@@ -150,6 +212,97 @@ pub fn parseArgs(allocator: std.mem.Allocator) !CliOptions {
     return options;
 }
 
+/// The aggregate named by an option such as `--sum`.
+fn aggregateOp(arg: []const u8) ?aggregate.Aggregate.Op {
+    const name = arg[2..];
+    inline for (comptime std.enums.values(aggregate.Aggregate.Op)) |op| {
+        if (std.mem.eql(u8, name, @tagName(op))) return op;
+    }
+    return null;
+}
+
+/// Whether a positional argument names input rather than being the query.
+fn looksLikeInput(arg: []const u8) bool {
+    if (std.mem.startsWith(u8, arg, "{")) return false;
+    var name = arg;
+    for ([_][]const u8{ ".gz", ".zst" }) |suffix| {
+        if (std.mem.endsWith(u8, name, suffix)) name = name[0 .. name.len - suffix.len];
+    }
+    return std.mem.endsWith(u8, name, ".json") or
+        std.mem.endsWith(u8, name, ".ndjson") or
+        std.mem.endsWith(u8, name, ".jsonl") or
+        std.mem.eql(u8, arg, "-") or
+        hasGlob(arg);
+}
+
+fn hasGlob(arg: []const u8) bool {
+    return std.mem.indexOfAny(u8, arg, "*?") != null;
+}
+
+/// Append the files matching `pattern` to `paths`, sorted by name. Only the
+/// last path component may hold wildcards (`*` and `?`); names starting with
+/// a dot match only a pattern that does too.
+pub fn expandGlob(dir: std.fs.Dir, pattern: []const u8, paths: *std.ArrayList([]u8), allocator: std.mem.Allocator) !void {
+    const slash = std.mem.lastIndexOfScalar(u8, pattern, '/');
+    const dir_path = if (slash) |i| pattern[0 .. i + 1] else "";
+    const name_pattern = if (slash) |i| pattern[i + 1 ..] else pattern;
+
+    var search = try dir.openDir(if (dir_path.len == 0) "." else dir_path, .{ .iterate = true });
+    defer search.close();
+
+    const first = paths.items.len;
+    errdefer {
+        for (paths.items[first..]) |path| allocator.free(path);
+        paths.shrinkRetainingCapacity(first);
+    }
+    var it = search.iterate();
+    while (try it.next()) |entry| {
+        if (entry.kind == .directory) continue;
+        if (entry.name[0] == '.' and !std.mem.startsWith(u8, name_pattern, ".")) continue;
+        if (!globMatch(name_pattern, entry.name)) continue;
+        const path = try std.mem.concat(allocator, u8, &.{ dir_path, entry.name });
+        paths.append(allocator, path) catch |err| {
+            allocator.free(path);
+            return err;
+        };
+    }
+
+    std.mem.sort([]u8, paths.items[first..], {}, struct {
+        fn lessThan(_: void, a: []u8, b: []u8) bool {
+            return std.mem.lessThan(u8, a, b);
+        }
+    }.lessThan);
+}
+
+/// Shell-style match of `name` against `pattern`: `*` is any run of
+/// characters, `?` any one character.
+pub fn globMatch(pattern: []const u8, name: []const u8) bool {
+    var p: usize = 0;
+    var n: usize = 0;
+    // Last `*` seen, and where in `name` its match currently ends
+    var star: ?usize = null;
+    var star_end: usize = 0;
+    while (n < name.len) {
+        if (p < pattern.len and pattern[p] == '*') {
+            star = p;
+            p += 1;
+            star_end = n;
+        } else if (p < pattern.len and (pattern[p] == '?' or pattern[p] == name[n])) {
+            p += 1;
+            n += 1;
+        } else if (star) |s| {
+            // Let the last `*` swallow one more character and retry
+            p = s + 1;
+            star_end += 1;
+            n = star_end;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.len and pattern[p] == '*') p += 1;
+    return p == pattern.len;
+}
+
 fn parseSelectFields(value: []const u8, allocator: std.mem.Allocator) ![]const []const u8 {
     var fields = std.ArrayList([]const u8){};
     defer fields.deinit(allocator);
@@ -172,11 +325,13 @@ pub fn printHelp(writer: anytype) !void {
         \\USAGE:
         \\    zson [OPTIONS] <QUERY> [FILE]
         \\    zson [OPTIONS] [FILE] <QUERY>
+        \\    zson [OPTIONS] <QUERY> FILE... (or a quoted glob: 'logs/*.ndjson')
         \\    cat data.ndjson | zson [OPTIONS] <QUERY>
         \\
         \\ARGUMENTS:
         \\    <QUERY>    MongoDB query string (e.g., '{"age": {"$gt": 30}}')
-        \\    [FILE]     Input file (NDJSON/JSON). Use '-' or omit for stdin
+        \\    [FILE]     Input files (NDJSON/JSON), scanned by one thread pool. Use '-' for stdin
+        \\               gzip and zstd input is detected and decompressed
         \\
         \\OPTIONS:
         \\    -h, --help              Show this help message
@@ -186,7 +341,19 @@ pub fn printHelp(writer: anytype) !void {
         \\    --output <FORMAT>       Output format: json, ndjson, csv (default: ndjson)
         \\    --select <FIELDS>       Comma-separated fields to output (e.g., 'name,age,city')
         \\    --limit <N>             Limit number of results
+        \\    --sort-by <FIELD>       Output matches ordered by FIELD (with --limit: the top N)
+        \\    --desc                  Sort largest first
         \\    --threads <N>           Number of threads to use (default: 4)
+        \\    --io <BACKEND>          How files are read: mmap, populate, read (default: mmap)
+        \\    -f, --follow            Keep filtering FILE as it grows, like tail -F (NDJSON only)
+        \\    --index                 Build/reuse a sidecar index (<file>.zsidx) to skip blocks
+        \\    --stats                 Print per-stage timings and per-thread counters to stderr
+        \\    --with-filename         Add the source file to each record as "_file"
+        \\    --group-by <FIELD>      Output one row per value of FIELD with its match count
+        \\    --sum <FIELD>           Add the sum of the numbers in FIELD to each group
+        \\    --min <FIELD>           Add the least number in FIELD to each group
+        \\    --max <FIELD>           Add the greatest number in FIELD to each group
+        \\    --distinct <FIELD>      Add the number of distinct values of FIELD to each group
         \\
         \\EXAMPLES:
         \\    # Find all users over 30
@@ -201,6 +368,18 @@ pub fn printHelp(writer: anytype) !void {
         \\    # Select specific fields, output as JSON
         \\    zson --select 'name,email' --output json '{"age": {"$gte": 21}}' users.ndjson
         \\
+        \\    # Scan a day of hourly shards at once, tagging records with their shard
+        \\    zson --with-filename '{"level": "error"}' 'logs/2024-05-01T*.ndjson'
+        \\
+        \\    # The latest 100 errors
+        \\    zson --sort-by ts --desc --limit 100 '{"level": "error"}' logs.ndjson
+        \\
+        \\    # Errors per service, with the worst latency of each
+        \\    zson --group-by service --max latency_ms '{"level": "error"}' logs.ndjson
+        \\
+        \\    # Errors as they are logged, across rotation
+        \\    zson --follow '{"level": "error"}' /var/log/app.ndjson
+        \\
         \\    # Pipe from stdin
         \\    cat data.ndjson | zson '{"status": "success"}' --limit 100
         \\
@@ -253,3 +432,43 @@ test "cli: parse select fields with spaces" {
     try std.testing.expectEqualStrings("age", fields[1]);
     try std.testing.expectEqualStrings("city", fields[2]);
 }
+
+test "cli: glob matching" {
+    try std.testing.expect(globMatch("*.ndjson", "a.ndjson"));
+    try std.testing.expect(globMatch("h??.log", "h01.log"));
+    try std.testing.expect(globMatch("a*b*c", "aXbYbZc"));
+    try std.testing.expect(globMatch("*", ""));
+    try std.testing.expect(!globMatch("*.ndjson", "a.json"));
+    try std.testing.expect(!globMatch("h?.log", "h01.log"));
+    try std.testing.expect(!globMatch("a*b", "aXbY"));
+}
+
+test "cli: compressed files are inputs, not queries" {
+    try std.testing.expect(looksLikeInput("events.ndjson.zst"));
+    try std.testing.expect(looksLikeInput("dump.json.gz"));
+    try std.testing.expect(!looksLikeInput("notes.gz"));
+    try std.testing.expect(!looksLikeInput("{\"a\":1}"));
+}
+
+test "cli: glob expansion is sorted and skips directories" {
+    const allocator = std.testing.allocator;
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    try tmp.dir.makePath("logs/nested.ndjson");
+    for ([_][]const u8{ "logs/b.ndjson", "logs/a.ndjson", "logs/c.json", "logs/.hidden.ndjson" }) |name| {
+        const file = try tmp.dir.createFile(name, .{});
+        file.close();
+    }
+
+    var paths = std.ArrayList([]u8){};
+    defer {
+        for (paths.items) |path| allocator.free(path);
+        paths.deinit(allocator);
+    }
+    try expandGlob(tmp.dir, "logs/*.ndjson", &paths, allocator);
+
+    try std.testing.expectEqual(@as(usize, 2), paths.items.len);
+    try std.testing.expectEqualStrings("logs/a.ndjson", paths.items[0]);
+    try std.testing.expectEqualStrings("logs/b.ndjson", paths.items[1]);
+}
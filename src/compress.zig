@@ -0,0 +1,383 @@
+const std = @import("std");
+const flate = std.compress.flate;
+const zstd = std.compress.zstd;
+
+/// Compressed input formats read natively, recognised by their magic bytes.
+///
+/// Input made of many independent frames (multi-frame zstd, as written by
+/// `zstd --block-size`/seekable zstd, or BGZF gzip) is cut into pieces of
+/// whole frames that workers decompress in parallel. Plain gzip has no frame
+/// boundaries to cut on and is decompressed as one stream, which may still
+/// hold several members (`cat a.gz b.gz`).
+pub const Codec = enum {
+    none,
+    gzip,
+    zstd,
+
+    /// Size of the history buffer a decoder needs
+    pub fn windowLen(self: Codec) usize {
+        return switch (self) {
+            .none => 0,
+            .gzip => flate.max_window_len,
+            .zstd => zstd.default_window_len + zstd.block_size_max,
+        };
+    }
+};
+
+pub const Error = error{InvalidCompressedData} || std.mem.Allocator.Error;
+
+pub fn detect(head: []const u8) Codec {
+    if (head.len >= 2 and head[0] == 0x1f and head[1] == 0x8b) return .gzip;
+    if (head.len >= 4) {
+        const magic = std.mem.readInt(u32, head[0..4], .little);
+        if (magic == zstd_magic or magic & 0xffff_fff0 == zstd_skippable_magic) return .zstd;
+    }
+    return .none;
+}
+
+/// Codec of the file at `path`, from its first bytes.
+pub fn detectFile(path: []const u8) !Codec {
+    const file = try std.fs.cwd().openFile(path, .{});
+    defer file.close();
+    var head: [4]u8 = undefined;
+    const n = try file.readAll(&head);
+    return detect(head[0..n]);
+}
+
+const zstd_magic = 0xfd2f_b528;
+const zstd_skippable_magic = 0x184d_2a50;
+
+/// Length of the independently decodable frame at the start of `data`: a
+/// zstd frame or a BGZF block. Plain gzip runs to the end of `data`.
+pub fn frameLen(codec: Codec, data: []const u8) error{InvalidCompressedData}!usize {
+    return switch (codec) {
+        .none => data.len,
+        .gzip => bgzfBlockLen(data) orelse data.len,
+        .zstd => zstdFrameLen(data),
+    };
+}
+
+/// Block size from the `BC` extra subfield of a BGZF member header, if any.
+fn bgzfBlockLen(data: []const u8) ?usize {
+    // ID1 ID2 CM FLG MTIME(4) XFL OS XLEN(2), then XLEN bytes of subfields
+    if (data.len < 18 or data[0] != 0x1f or data[1] != 0x8b or data[3] & 0x04 == 0) return null;
+    const xlen = std.mem.readInt(u16, data[10..12], .little);
+    if (12 + @as(usize, xlen) > data.len) return null;
+    var extra = data[12 .. 12 + @as(usize, xlen)];
+    while (extra.len >= 4) {
+        const len: usize = std.mem.readInt(u16, extra[2..4], .little);
+        if (4 + len > extra.len) return null;
+        if (extra[0] == 'B' and extra[1] == 'C' and len == 2) {
+            const block = @as(usize, std.mem.readInt(u16, extra[4..6], .little)) + 1;
+            return if (block <= data.len) block else null;
+        }
+        extra = extra[4 + len ..];
+    }
+    return null;
+}
+
+/// Walk a zstd frame's header and block headers without decoding anything.
+fn zstdFrameLen(data: []const u8) error{InvalidCompressedData}!usize {
+    if (data.len < 8) return error.InvalidCompressedData;
+    const magic = std.mem.readInt(u32, data[0..4], .little);
+    if (magic & 0xffff_fff0 == zstd_skippable_magic) {
+        const len = 8 + @as(usize, std.mem.readInt(u32, data[4..8], .little));
+        return if (len <= data.len) len else error.InvalidCompressedData;
+    }
+    if (magic != zstd_magic) return error.InvalidCompressedData;
+
+    const descriptor = data[4];
+    const single_segment = descriptor & 0x20 != 0;
+    const dictionary_len: usize = switch (descriptor & 3) {
+        0 => 0,
+        1 => 1,
+        2 => 2,
+        else => 4,
+    };
+    const content_size_len: usize = switch (descriptor >> 6) {
+        0 => @intFromBool(single_segment),
+        1 => 2,
+        2 => 4,
+        else => 8,
+    };
+    var pos: usize = 5 + @as(usize, @intFromBool(!single_segment)) + dictionary_len + content_size_len;
+    while (true) {
+        if (pos + 3 > data.len) return error.InvalidCompressedData;
+        const header = std.mem.readInt(u24, data[pos..][0..3], .little);
+        pos += 3;
+        const size: usize = header >> 3;
+        pos += switch ((header >> 1) & 3) {
+            0, 2 => size, // raw, compressed
+            1 => 1, // RLE: a single byte repeated
+            else => return error.InvalidCompressedData,
+        };
+        if (header & 1 != 0) break;
+    }
+    // Content checksum
+    if (descriptor & 0x04 != 0) pos += 4;
+    return if (pos <= data.len) pos else error.InvalidCompressedData;
+}
+
+/// Cut `data` into runs of whole frames of at least `target` compressed
+/// bytes (except the last); each piece decodes on its own.
+pub fn splitPieces(codec: Codec, data: []const u8, target: usize, allocator: std.mem.Allocator) Error![][]const u8 {
+    var pieces = std.ArrayList([]const u8){};
+    errdefer pieces.deinit(allocator);
+    var start: usize = 0;
+    var pos: usize = 0;
+    while (pos < data.len) {
+        pos += try frameLen(codec, data[pos..]);
+        if (pos - start >= target or pos == data.len) {
+            try pieces.append(allocator, data[start..pos]);
+            start = pos;
+        }
+    }
+    return pieces.toOwnedSlice(allocator);
+}
+
+/// Decompressing reader over `input`. It must not move once `reader` has
+/// been called.
+pub const Stream = union(enum) {
+    gzip: GzipMembers,
+    zstd: zstd.Decompress,
+
+    /// `window` must hold `codec.windowLen()` bytes.
+    pub fn init(codec: Codec, input: *std.Io.Reader, window: []u8) Stream {
+        return switch (codec) {
+            .gzip => .{ .gzip = .init(input, window) },
+            .zstd => .{ .zstd = .init(input, window, .{}) },
+            .none => unreachable,
+        };
+    }
+
+    pub fn reader(self: *Stream) *std.Io.Reader {
+        return switch (self.*) {
+            .gzip => |*d| &d.interface,
+            .zstd => |*d| &d.reader,
+        };
+    }
+};
+
+/// gzip members one after another, read as one stream the way gzip reads
+/// them. A flate decoder stops at its member's footer, so the next member's
+/// decoder starts where `input` was left. Bytes after the last member that
+/// start no other member are ignored, as gzip ignores them.
+const GzipMembers = struct {
+    input: *std.Io.Reader,
+    window: []u8,
+    member: flate.Decompress,
+    /// Unbuffered: reads go straight to the member's decoder, whose window
+    /// is its buffer
+    interface: std.Io.Reader = .{
+        .vtable = &.{ .stream = stream, .readVec = readVec },
+        .buffer = &.{},
+        .seek = 0,
+        .end = 0,
+    },
+
+    fn init(input: *std.Io.Reader, window: []u8) GzipMembers {
+        return .{ .input = input, .window = window, .member = .init(input, .gzip, window) };
+    }
+
+    /// Start the member after the one just finished; false when there is none.
+    fn next(self: *GzipMembers) std.Io.Reader.Error!bool {
+        const head = self.input.peek(2) catch |err| switch (err) {
+            error.EndOfStream => return false,
+            error.ReadFailed => return error.ReadFailed,
+        };
+        if (head[0] != 0x1f or head[1] != 0x8b) return false;
+        self.member = .init(self.input, .gzip, self.window);
+        return true;
+    }
+
+    fn stream(r: *std.Io.Reader, w: *std.Io.Writer, limit: std.Io.Limit) std.Io.Reader.StreamError!usize {
+        const self: *GzipMembers = @alignCast(@fieldParentPtr("interface", r));
+        while (true) {
+            if (self.member.reader.stream(w, limit)) |n| return n else |err| switch (err) {
+                error.EndOfStream => if (!try self.next()) return error.EndOfStream,
+                else => |e| return e,
+            }
+        }
+    }
+
+    fn readVec(r: *std.Io.Reader, data: [][]u8) std.Io.Reader.Error!usize {
+        const self: *GzipMembers = @alignCast(@fieldParentPtr("interface", r));
+        while (true) {
+            if (self.member.reader.readVec(data)) |n| return n else |err| switch (err) {
+                error.EndOfStream => if (!try self.next()) return error.EndOfStream,
+                error.ReadFailed => return error.ReadFailed,
+            }
+        }
+    }
+};
+
+/// Decodes pieces from `splitPieces`, reusing one window; one per thread.
+pub const Decoder = struct {
+    codec: Codec,
+    window: []u8,
+    allocator: std.mem.Allocator,
+
+    pub fn init(codec: Codec, allocator: std.mem.Allocator) !Decoder {
+        return .{ .codec = codec, .window = try allocator.alloc(u8, codec.windowLen()), .allocator = allocator };
+    }
+
+    pub fn deinit(self: *Decoder) void {
+        self.allocator.free(self.window);
+    }
+
+    /// The first `buffer.len` bytes `piece` decompresses to (fewer if it
+    /// holds less), decoding no more of it than that.
+    pub fn decodeHead(self: *Decoder, piece: []const u8, buffer: []u8) Error![]u8 {
+        var len: usize = 0;
+        var pos: usize = 0;
+        while (pos < piece.len and len < buffer.len) {
+            const frame = piece[pos..][0..try frameLen(self.codec, piece[pos..])];
+            pos += frame.len;
+            if (self.codec == .zstd and std.mem.readInt(u32, frame[0..4], .little) != zstd_magic) continue;
+            var input = std.Io.Reader.fixed(frame);
+            var stream = Stream.init(self.codec, &input, self.window);
+            len += stream.reader().readSliceShort(buffer[len..]) catch return error.InvalidCompressedData;
+        }
+        return buffer[0..len];
+    }
+
+    /// Append the decompressed contents of `piece` to `out`.
+    pub fn decode(self: *Decoder, piece: []const u8, out: *std.ArrayList(u8)) Error!void {
+        var pos: usize = 0;
+        while (pos < piece.len) {
+            const frame = piece[pos..][0..try frameLen(self.codec, piece[pos..])];
+            pos += frame.len;
+            if (self.codec == .zstd and std.mem.readInt(u32, frame[0..4], .little) != zstd_magic) continue;
+            var input = std.Io.Reader.fixed(frame);
+            var stream = Stream.init(self.codec, &input, self.window);
+            try readAll(stream.reader(), out, self.allocator);
+        }
+    }
+};
+
+/// Decompress all of `data` into one buffer owned by the caller.
+pub fn decompressAll(data: []const u8, allocator: std.mem.Allocator) Error![]u8 {
+    var out = std.ArrayList(u8){};
+    errdefer out.deinit(allocator);
+    var decoder = try Decoder.init(detect(data), allocator);
+    defer decoder.deinit();
+    try decoder.decode(data, &out);
+    return out.toOwnedSlice(allocator);
+}
+
+fn readAll(reader: *std.Io.Reader, out: *std.ArrayList(u8), allocator: std.mem.Allocator) Error!void {
+    while (true) {
+        try out.ensureUnusedCapacity(allocator, 64 * 1024);
+        const free = out.unusedCapacitySlice();
+        const n = reader.readSliceShort(free) catch return error.InvalidCompressedData;
+        out.items.len += n;
+        // Short only at the end of the stream
+        if (n < free.len) return;
+    }
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+/// A zstd frame holding `text` in one raw (stored) block.
+pub fn testZstdFrame(text: []const u8, out: *std.ArrayList(u8), allocator: std.mem.Allocator) !void {
+    std.debug.assert(text.len < 256);
+    // Single segment, one-byte content size, no checksum
+    try out.appendSlice(allocator, &.{ 0x28, 0xb5, 0x2f, 0xfd, 0x20, @intCast(text.len) });
+    var header: [3]u8 = undefined;
+    std.mem.writeInt(u24, &header, @as(u24, @intCast(text.len)) << 3 | 1, .little);
+    try out.appendSlice(allocator, &header);
+    try out.appendSlice(allocator, text);
+}
+
+/// A BGZF member holding `text` in one stored deflate block.
+pub fn testBgzfBlock(text: []const u8, out: *std.ArrayList(u8), allocator: std.mem.Allocator) !void {
+    const block_len = 18 + 5 + text.len + 8;
+    var header = [_]u8{ 0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0, 0, 0 };
+    std.mem.writeInt(u16, header[16..18], @intCast(block_len - 1), .little);
+    try out.appendSlice(allocator, &header);
+    try testGzipBody(text, out, allocator);
+}
+
+/// A plain gzip member (no BGZF size) holding `text` in one stored block.
+fn testGzipMember(text: []const u8, out: *std.ArrayList(u8), allocator: std.mem.Allocator) !void {
+    try out.appendSlice(allocator, &.{ 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff });
+    try testGzipBody(text, out, allocator);
+}
+
+fn testGzipBody(text: []const u8, out: *std.ArrayList(u8), allocator: std.mem.Allocator) !void {
+    // Final stored block: LEN and its complement
+    var stored: [5]u8 = .{ 1, 0, 0, 0, 0 };
+    std.mem.writeInt(u16, stored[1..3], @intCast(text.len), .little);
+    std.mem.writeInt(u16, stored[3..5], ~@as(u16, @intCast(text.len)), .little);
+    try out.appendSlice(allocator, &stored);
+    try out.appendSlice(allocator, text);
+    var footer: [8]u8 = undefined;
+    std.mem.writeInt(u32, footer[0..4], std.hash.Crc32.hash(text), .little);
+    std.mem.writeInt(u32, footer[4..8], @intCast(text.len), .little);
+    try out.appendSlice(allocator, &footer);
+}
+
+test "compress: frames are found without decoding and decode on their own" {
+    const allocator = std.testing.allocator;
+    const parts = [_][]const u8{ "{\"id\":1}\n{\"i", "d\":2}\n", "{\"id\":3}" };
+
+    inline for (.{ .zstd, .gzip }) |codec| {
+        var data = std.ArrayList(u8){};
+        defer data.deinit(allocator);
+        for (parts) |part| {
+            if (codec == .zstd) try testZstdFrame(part, &data, allocator) else try testBgzfBlock(part, &data, allocator);
+        }
+        try std.testing.expectEqual(@as(Codec, codec), detect(data.items));
+
+        // A one-byte target puts every frame in a piece of its own
+        const pieces = try splitPieces(codec, data.items, 1, allocator);
+        defer allocator.free(pieces);
+        try std.testing.expectEqual(@as(usize, 3), pieces.len);
+
+        var decoder = try Decoder.init(codec, allocator);
+        defer decoder.deinit();
+        var out = std.ArrayList(u8){};
+        defer out.deinit(allocator);
+        try decoder.decode(pieces[1], &out);
+        try std.testing.expectEqualStrings(parts[1], out.items);
+
+        // A head across frames, cut short of the end
+        var head: [14]u8 = undefined;
+        try std.testing.expectEqualStrings("{\"id\":1}\n{\"id\"", try decoder.decodeHead(data.items, &head));
+
+        const all = try decompressAll(data.items, allocator);
+        defer allocator.free(all);
+        try std.testing.expectEqualStrings("{\"id\":1}\n{\"id\":2}\n{\"id\":3}", all);
+    }
+
+    try std.testing.expectEqual(Codec.none, detect("{\"id\":1}"));
+    try std.testing.expectError(error.InvalidCompressedData, frameLen(.zstd, "\x28\xb5\x2f\xfd\x20\x05\x29"));
+}
+
+test "compress: every member of concatenated gzip is read" {
+    const allocator = std.testing.allocator;
+    // As `cat a.gz b.gz` or `gzip -c >> log.gz` leave it, with zero padding
+    // after the last member
+    var data = std.ArrayList(u8){};
+    defer data.deinit(allocator);
+    try testGzipMember("{\"id\":1}\n", &data, allocator);
+    try testGzipMember("{\"id\":2}\n", &data, allocator);
+    try data.appendSlice(allocator, &.{ 0, 0, 0, 0 });
+    try std.testing.expectEqual(data.items.len, try frameLen(.gzip, data.items));
+
+    const all = try decompressAll(data.items, allocator);
+    defer allocator.free(all);
+    try std.testing.expectEqualStrings("{\"id\":1}\n{\"id\":2}\n", all);
+
+    // One stream over a reader, as stdin is read
+    var input = std.Io.Reader.fixed(data.items);
+    const window = try allocator.alloc(u8, Codec.gzip.windowLen());
+    defer allocator.free(window);
+    var stream = Stream.init(.gzip, &input, window);
+    var out = std.ArrayList(u8){};
+    defer out.deinit(allocator);
+    try readAll(stream.reader(), &out, allocator);
+    try std.testing.expectEqualStrings(all, out.items);
+}
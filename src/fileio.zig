@@ -0,0 +1,216 @@
+const std = @import("std");
+const builtin = @import("builtin");
+
+/// How input files are brought into memory (`--io`)
+pub const Backend = enum {
+    /// Map the file. Pages are read as the scan reaches them, with
+    /// sequential read-ahead and each morsel asked for ahead of the workers
+    /// (`willNeed`)
+    mmap,
+    /// Map the file and read all of it in before the scan starts
+    /// (MAP_POPULATE on Linux)
+    populate,
+    /// Read the file into memory with large reads, many in flight:
+    /// io_uring on Linux, plain reads elsewhere or when io_uring is not
+    /// available. Streamed output reads the file in chunks instead.
+    read,
+
+    pub fn fromString(s: []const u8) ?Backend {
+        return std.meta.stringToEnum(Backend, s);
+    }
+};
+
+const page_alignment = std.mem.Alignment.fromByteUnits(std.heap.page_size_min);
+
+/// A file's contents, as `load` brought them into memory.
+pub const Contents = struct {
+    data: []const u8 = &.{},
+    backing: Backing = .none,
+
+    const Backing = union(enum) {
+        none,
+        mapped,
+        owned: []align(std.heap.page_size_min) u8,
+    };
+
+    pub fn deinit(self: Contents, allocator: std.mem.Allocator) void {
+        switch (self.backing) {
+            .none => {},
+            .mapped => if (builtin.os.tag == .windows) {
+                _ = kernel32.UnmapViewOfFile(self.data.ptr);
+            } else {
+                std.posix.munmap(@alignCast(self.data));
+            },
+            .owned => |buffer| allocator.free(buffer),
+        }
+    }
+};
+
+/// The contents of `file` through `backend`. Empty files take no memory.
+pub fn load(file: std.fs.File, backend: Backend, allocator: std.mem.Allocator) !Contents {
+    const size = try file.getEndPos();
+    if (size == 0) return .{};
+    const len = std.math.cast(usize, size) orelse return error.FileTooBig;
+    return switch (backend) {
+        .mmap, .populate => map(file, len, backend == .populate),
+        .read => read(file, len, allocator),
+    };
+}
+
+pub fn loadPath(path: []const u8, backend: Backend, allocator: std.mem.Allocator) !Contents {
+    const file = try std.fs.cwd().openFile(path, .{});
+    defer file.close();
+    return load(file, backend, allocator);
+}
+
+/// Ask for the pages under `data` to be read in now, in large requests,
+/// rather than one fault at a time when the scan reaches them.
+pub fn willNeed(data: []const u8) void {
+    if (builtin.os.tag != .windows) advise(data, std.posix.MADV.WILLNEED);
+}
+
+fn advise(data: []const u8, advice: u32) void {
+    if (data.len == 0) return;
+    const start = std.mem.alignBackward(usize, @intFromPtr(data.ptr), std.heap.pageSize());
+    const pages: [*]align(std.heap.page_size_min) u8 = @ptrFromInt(start);
+    // Only a hint: a kernel that ignores it costs nothing
+    std.posix.madvise(pages, @intFromPtr(data.ptr) + data.len - start, advice) catch {};
+}
+
+fn map(file: std.fs.File, len: usize, populate: bool) !Contents {
+    if (builtin.os.tag == .windows) return mapWindows(file, len);
+
+    const flags: std.posix.MAP = if (builtin.os.tag == .linux)
+        .{ .TYPE = .PRIVATE, .POPULATE = populate }
+    else
+        .{ .TYPE = .PRIVATE };
+    const data = try std.posix.mmap(null, len, std.posix.PROT.READ, flags, file.handle, 0);
+    advise(data, std.posix.MADV.SEQUENTIAL);
+    // Huge pages in the page cache, where the filesystem supports them
+    if (builtin.os.tag == .linux) advise(data, std.posix.MADV.HUGEPAGE);
+    if (populate and builtin.os.tag != .linux) advise(data, std.posix.MADV.WILLNEED);
+    return .{ .data = data, .backing = .mapped };
+}
+
+fn mapWindows(file: std.fs.File, len: usize) !Contents {
+    const mapping = kernel32.CreateFileMappingW(file.handle, null, kernel32.PAGE_READONLY, 0, 0, null) orelse
+        return error.Unexpected;
+    // The view keeps the mapping alive
+    defer std.os.windows.CloseHandle(mapping);
+    const view = kernel32.MapViewOfFile(mapping, kernel32.FILE_MAP_READ, 0, 0, 0) orelse return error.Unexpected;
+    const bytes: [*]const u8 = @ptrCast(view);
+    return .{ .data = bytes[0..len], .backing = .mapped };
+}
+
+const kernel32 = struct {
+    const windows = std.os.windows;
+    const PAGE_READONLY: windows.DWORD = 0x02;
+    const FILE_MAP_READ: windows.DWORD = 0x04;
+
+    extern "kernel32" fn CreateFileMappingW(
+        file: windows.HANDLE,
+        attributes: ?*anyopaque,
+        protect: windows.DWORD,
+        size_high: windows.DWORD,
+        size_low: windows.DWORD,
+        name: ?windows.LPCWSTR,
+    ) callconv(.winapi) ?windows.HANDLE;
+    extern "kernel32" fn MapViewOfFile(
+        mapping: windows.HANDLE,
+        access: windows.DWORD,
+        offset_high: windows.DWORD,
+        offset_low: windows.DWORD,
+        len: usize,
+    ) callconv(.winapi) ?*anyopaque;
+    extern "kernel32" fn UnmapViewOfFile(base: *const anyopaque) callconv(.winapi) windows.BOOL;
+};
+
+/// Reads of this size, `ring_depth` at a time, keep a fast device busy
+const ring_block = 4 * 1024 * 1024;
+const ring_depth = 16;
+
+fn read(file: std.fs.File, len: usize, allocator: std.mem.Allocator) !Contents {
+    const buffer = try allocator.alignedAlloc(u8, page_alignment, len);
+    errdefer allocator.free(buffer);
+    if (builtin.os.tag == .linux) {
+        // Fewer TLB misses while the scan walks the buffer
+        advise(buffer, std.posix.MADV.HUGEPAGE);
+        // Disabled or too old a kernel: fall back to plain reads
+        if (std.os.linux.IoUring.init(ring_depth, 0) catch null) |ring_value| {
+            var ring = ring_value;
+            defer ring.deinit();
+            const n = try readRing(&ring, file.handle, buffer);
+            return .{ .data = buffer[0..n], .backing = .{ .owned = buffer } };
+        }
+    }
+    const n = try file.preadAll(buffer, 0);
+    return .{ .data = buffer[0..n], .backing = .{ .owned = buffer } };
+}
+
+/// Fill `buffer` from the start of `fd` with `ring_block` reads, keeping
+/// `ring_depth` in flight. Returns how much was read: less than the buffer
+/// only if the file shrank.
+fn readRing(ring: *std.os.linux.IoUring, fd: std.posix.fd_t, buffer: []u8) !usize {
+    var queued: usize = 0;
+    var in_flight: usize = 0;
+    var end = buffer.len;
+    while (queued < end or in_flight > 0) {
+        while (queued < end and in_flight < ring_depth) {
+            const len = @min(ring_block, end - queued);
+            _ = try ring.read(queued, fd, .{ .buffer = buffer[queued..][0..len] }, queued);
+            queued += len;
+            in_flight += 1;
+        }
+        _ = try ring.submit_and_wait(1);
+        while (ring.cq_ready() > 0) {
+            const cqe = try ring.copy_cqe();
+            in_flight -= 1;
+            if (cqe.res < 0) return std.posix.unexpectedErrno(cqe.err());
+            // Reads start inside a block and run to its end
+            const start: usize = @intCast(cqe.user_data);
+            const block_end = @min((start / ring_block + 1) * ring_block, end);
+            const got: usize = @intCast(cqe.res);
+            if (got == 0) {
+                end = @min(end, start);
+                continue;
+            }
+            if (start + got < block_end) {
+                _ = try ring.read(start + got, fd, .{ .buffer = buffer[start + got .. block_end] }, start + got);
+                in_flight += 1;
+            }
+        }
+    }
+    return end;
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+test "fileio: every backend loads the same bytes" {
+    const allocator = std.testing.allocator;
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    // More than one ring block, ending partway through one
+    const text = try allocator.alloc(u8, ring_block * 2 + 12345);
+    defer allocator.free(text);
+    for (text, 0..) |*c, i| c.* = if (i % 61 == 60) '\n' else 'a' + @as(u8, @intCast(i % 26));
+    try tmp.dir.writeFile(.{ .sub_path = "input.ndjson", .data = text });
+    try tmp.dir.writeFile(.{ .sub_path = "empty.ndjson", .data = "" });
+
+    for ([_]Backend{ .mmap, .populate, .read }) |backend| {
+        const file = try tmp.dir.openFile("input.ndjson", .{});
+        defer file.close();
+        const contents = try load(file, backend, allocator);
+        defer contents.deinit(allocator);
+        try std.testing.expectEqualSlices(u8, text, contents.data);
+        willNeed(contents.data[100..200]);
+
+        const empty_file = try tmp.dir.openFile("empty.ndjson", .{});
+        defer empty_file.close();
+        const empty = try load(empty_file, backend, allocator);
+        defer empty.deinit(allocator);
+        try std.testing.expectEqual(@as(usize, 0), empty.data.len);
+    }
+}
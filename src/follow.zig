@@ -0,0 +1,336 @@
+const std = @import("std");
+const builtin = @import("builtin");
+const query = @import("query.zig");
+const parallel = @import("parallel_ndjson.zig");
+const stream = @import("stream.zig");
+const timing = @import("stats.zig");
+
+/// Appended ranges at least this large go through the parallel pipeline;
+/// smaller ones are filtered on the calling thread, so a record written to a
+/// quiet log is out one wake-up later
+const parallel_min = 1024 * 1024;
+
+/// Most of the file read at once
+const read_window = 64 * 1024 * 1024;
+
+/// How long to wait for an event before looking for a rotated file anyway
+const recheck_ms = 250;
+
+/// Filter the NDJSON file at `path` as it grows, like `tail -F` piped into
+/// zson. What the file holds already is filtered first, then every complete
+/// line appended to it, as soon as the file is reported changed; only the
+/// new bytes are read. A file truncated in place is read again from the
+/// start, and when `path` is renamed or deleted and recreated (log
+/// rotation), the rest of the old file is filtered before the new one is
+/// opened. Runs until `config.limit` matches are out.
+pub fn followPath(
+    path: []const u8,
+    filter: *const query.Filter,
+    config: parallel.Config,
+    select_fields: ?[]const []const u8,
+    out: *std.Io.Writer,
+    allocator: std.mem.Allocator,
+) !stream.Summary {
+    var follower = try Follower.init(path, filter, config, select_fields, out, allocator);
+    defer follower.deinit();
+    try follower.run(null);
+    return follower.summary;
+}
+
+const Follower = struct {
+    path: []const u8,
+    filter: *const query.Filter,
+    config: parallel.Config,
+    select_fields: ?[]const []const u8,
+    out: *std.Io.Writer,
+    allocator: std.mem.Allocator,
+
+    file: std.fs.File,
+    inode: std.fs.File.INode,
+    /// End of the last complete line filtered
+    offset: u64 = 0,
+    /// Grows past `read_window` for a line longer than it
+    window: usize = read_window,
+    watcher: Watcher,
+    ndjson_filter: parallel.NdjsonFilter,
+    buffer: std.ArrayList(u8) = .{},
+    output: std.ArrayList(u8) = .{},
+    scratch: std.heap.ArenaAllocator,
+    summary: stream.Summary = .{},
+
+    fn init(
+        path: []const u8,
+        filter: *const query.Filter,
+        config: parallel.Config,
+        select_fields: ?[]const []const u8,
+        out: *std.Io.Writer,
+        allocator: std.mem.Allocator,
+    ) !Follower {
+        const file = try std.fs.cwd().openFile(path, .{});
+        errdefer file.close();
+        var watcher = try Watcher.init();
+        errdefer watcher.deinit();
+        try watcher.watch(path, file);
+        return .{
+            .path = path,
+            .filter = filter,
+            .config = config,
+            .select_fields = select_fields,
+            .out = out,
+            .allocator = allocator,
+            .file = file,
+            .inode = (try file.stat()).inode,
+            .watcher = watcher,
+            .ndjson_filter = try parallel.NdjsonFilter.init(filter, select_fields, allocator),
+            .scratch = std.heap.ArenaAllocator.init(allocator),
+        };
+    }
+
+    fn deinit(self: *Follower) void {
+        self.ndjson_filter.deinit();
+        self.buffer.deinit(self.allocator);
+        self.output.deinit(self.allocator);
+        self.scratch.deinit();
+        self.watcher.deinit();
+        self.file.close();
+    }
+
+    /// Filter until `config.limit` matches are out. Past `deadline` (a
+    /// `std.time.milliTimestamp`), gives up with `error.Timeout`.
+    fn run(self: *Follower, deadline: ?i64) !void {
+        try self.drain();
+        while (!self.done()) {
+            if (deadline) |d| if (std.time.milliTimestamp() >= d) return error.Timeout;
+            try self.watcher.wait(recheck_ms);
+            try self.reopenIfRotated();
+            try self.drain();
+        }
+    }
+
+    fn done(self: *const Follower) bool {
+        const limit = self.config.limit orelse return false;
+        return self.summary.matches >= limit;
+    }
+
+    /// Filter the complete lines appended since the last call. A partial
+    /// last line is left until its newline arrives.
+    fn drain(self: *Follower) !void {
+        while (!self.done()) {
+            const size = (try self.file.stat()).size;
+            // Truncated in place (copytruncate rotation)
+            if (size < self.offset) self.offset = 0;
+            if (size == self.offset) return;
+
+            try self.buffer.resize(self.allocator, @intCast(@min(size - self.offset, self.window)));
+            var read = timing.Span.start(self.config.stats);
+            const n = try self.file.preadAll(self.buffer.items, self.offset);
+            read.end(.read);
+            const data = self.buffer.items[0..n];
+            const end = if (std.mem.lastIndexOfScalar(u8, data, '\n')) |nl| nl + 1 else {
+                // A line longer than the window: take more of it next time round
+                if (n == self.window) {
+                    self.window *= 2;
+                    continue;
+                }
+                return;
+            };
+            try self.filterLines(data[0..end]);
+            self.offset += end;
+        }
+    }
+
+    fn filterLines(self: *Follower, lines: []const u8) !void {
+        const remaining = if (self.config.limit) |limit| limit - self.summary.matches else null;
+        if (lines.len >= parallel_min) {
+            var config = self.config;
+            config.limit = remaining;
+            const summary = try stream.streamData(lines, self.filter, config, self.select_fields, self.out, self.allocator);
+            self.summary.lines_processed += summary.lines_processed;
+            self.summary.matches += summary.matches;
+        } else {
+            self.output.clearRetainingCapacity();
+            const stats = try self.ndjson_filter.run(lines, .ndjson, &self.output, &self.scratch, .{ .max_matches = remaining });
+            try self.out.writeAll(self.output.items);
+            self.summary.lines_processed += stats.lines_processed;
+            self.summary.matches += stats.matches;
+        }
+        try self.out.flush();
+    }
+
+    /// Switch to the file now at `path` if it is not the one open. The old
+    /// one is drained first, since it may have grown before it was rotated.
+    /// While nothing is at `path` yet, the old file is kept.
+    fn reopenIfRotated(self: *Follower) !void {
+        const stat = std.fs.cwd().statFile(self.path) catch |err| switch (err) {
+            error.FileNotFound => return,
+            else => return err,
+        };
+        if (stat.inode == self.inode) return;
+
+        try self.drain();
+        const file = try std.fs.cwd().openFile(self.path, .{});
+        errdefer file.close();
+        try self.watcher.watch(self.path, file);
+        self.inode = (try file.stat()).inode;
+        self.file.close();
+        self.file = file;
+        self.offset = 0;
+        self.window = read_window;
+    }
+};
+
+/// Wakes the follower when the file may have changed: inotify on Linux,
+/// kqueue on macOS and FreeBSD, and a short sleep elsewhere.
+const Watcher = switch (builtin.os.tag) {
+    .linux => Inotify,
+    .macos, .freebsd => Kqueue,
+    else => Sleep,
+};
+
+const Inotify = struct {
+    fd: i32,
+    wd: ?i32 = null,
+
+    fn init() !Inotify {
+        return .{ .fd = try std.posix.inotify_init1(std.os.linux.IN.NONBLOCK | std.os.linux.IN.CLOEXEC) };
+    }
+
+    fn deinit(self: *Inotify) void {
+        std.posix.close(self.fd);
+    }
+
+    /// Watch the file at `path` instead of the one watched so far.
+    fn watch(self: *Inotify, path: []const u8, _: std.fs.File) !void {
+        // The kernel drops the watch of a deleted file by itself, so a
+        // failure here is expected and ignored
+        if (self.wd) |wd| _ = std.os.linux.inotify_rm_watch(self.fd, wd);
+        const IN = std.os.linux.IN;
+        self.wd = try std.posix.inotify_add_watch(self.fd, path, IN.MODIFY | IN.ATTRIB | IN.MOVE_SELF | IN.DELETE_SELF);
+    }
+
+    /// Block until an event or `timeout_ms`, then discard the events: the
+    /// follower looks at the file itself.
+    fn wait(self: *Inotify, timeout_ms: i32) !void {
+        var fds = [_]std.posix.pollfd{.{ .fd = self.fd, .events = std.posix.POLL.IN, .revents = 0 }};
+        if (try std.posix.poll(&fds, timeout_ms) == 0) return;
+        var events: [4096]u8 align(@alignOf(std.os.linux.inotify_event)) = undefined;
+        while (true) {
+            _ = std.posix.read(self.fd, &events) catch |err| switch (err) {
+                error.WouldBlock => return,
+                else => return err,
+            };
+        }
+    }
+};
+
+const Kqueue = struct {
+    kq: i32,
+
+    fn init() !Kqueue {
+        return .{ .kq = try std.posix.kqueue() };
+    }
+
+    fn deinit(self: *Kqueue) void {
+        std.posix.close(self.kq);
+    }
+
+    /// Vnode events follow the descriptor, and closing the old file drops
+    /// its registration.
+    fn watch(self: *Kqueue, _: []const u8, file: std.fs.File) !void {
+        const change = std.posix.Kevent{
+            .ident = @intCast(file.handle),
+            .filter = std.c.EVFILT.VNODE,
+            .flags = std.c.EV.ADD | std.c.EV.CLEAR,
+            .fflags = std.c.NOTE.WRITE | std.c.NOTE.EXTEND | std.c.NOTE.ATTRIB | std.c.NOTE.DELETE | std.c.NOTE.RENAME,
+            .data = 0,
+            .udata = 0,
+        };
+        _ = try std.posix.kevent(self.kq, &.{change}, &.{}, null);
+    }
+
+    fn wait(self: *Kqueue, timeout_ms: i32) !void {
+        var events: [8]std.posix.Kevent = undefined;
+        const timeout = std.posix.timespec{
+            .sec = @divTrunc(timeout_ms, 1000),
+            .nsec = @rem(timeout_ms, 1000) * std.time.ns_per_ms,
+        };
+        _ = try std.posix.kevent(self.kq, &.{}, &events, &timeout);
+    }
+};
+
+const Sleep = struct {
+    fn init() !Sleep {
+        return .{};
+    }
+
+    fn deinit(_: *Sleep) void {}
+
+    fn watch(_: *Sleep, _: []const u8, _: std.fs.File) !void {}
+
+    fn wait(_: *Sleep, timeout_ms: i32) !void {
+        std.Thread.sleep(@as(u64, @intCast(@min(timeout_ms, 50))) * std.time.ns_per_ms);
+    }
+};
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+fn appendTo(dir: std.fs.Dir, name: []const u8, bytes: []const u8) !void {
+    const file = try dir.createFile(name, .{ .truncate = false });
+    defer file.close();
+    try file.seekFromEnd(0);
+    try file.writeAll(bytes);
+}
+
+/// Grows and then rotates the followed log, pausing so the follower is
+/// likely to see each step on its own. The output does not depend on it.
+fn writeLog(dir: std.fs.Dir) !void {
+    const pause = 30 * std.time.ns_per_ms;
+    std.Thread.sleep(pause);
+    try appendTo(dir, "app.log", "{\"n\":3,\"level\":\"error\"}\n{\"n\":4,\"level\":\"info\"}\n{\"n\":5,");
+    std.Thread.sleep(pause);
+    try appendTo(dir, "app.log", "\"level\":\"error\"}\n");
+    std.Thread.sleep(pause);
+    try appendTo(dir, "app.log", "{\"n\":6,\"level\":\"error\"}\n");
+    try dir.rename("app.log", "app.log.1");
+    try appendTo(dir, "app.log", "{\"n\":7,\"level\":\"error\"}\n");
+}
+
+test "follow: appended lines, partial lines and rotation" {
+    const allocator = std.testing.allocator;
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+    try appendTo(tmp.dir, "app.log", "{\"n\":1,\"level\":\"error\"}\n{\"n\":2,\"level\":\"info\"}\n");
+    const dir_path = try tmp.dir.realpathAlloc(allocator, ".");
+    defer allocator.free(dir_path);
+    const path = try std.fs.path.join(allocator, &.{ dir_path, "app.log" });
+    defer allocator.free(path);
+
+    var parsed = try query.parseQuery("{\"level\":\"error\"}", allocator);
+    defer parsed.deinit(allocator);
+    var out = std.Io.Writer.Allocating.init(allocator);
+    defer out.deinit();
+
+    const Writer = struct {
+        fn run(dir: std.fs.Dir, failure: *?anyerror) void {
+            writeLog(dir) catch |err| {
+                failure.* = err;
+            };
+        }
+    };
+    // Opened before the writer starts, so even a rotation it gets to first
+    // finds the old file open
+    var follower = try Follower.init(path, &parsed.filter, .{ .num_threads = 2, .limit = 5 }, &.{"n"}, &out.writer, allocator);
+    defer follower.deinit();
+    var writer_failure: ?anyerror = null;
+    const writer = try std.Thread.spawn(.{}, Writer.run, .{ tmp.dir, &writer_failure });
+    // A writer that fails never sends the last matches
+    const result = follower.run(std.time.milliTimestamp() + 10 * std.time.ms_per_s);
+    writer.join();
+    if (writer_failure) |err| return err;
+    try result;
+
+    try std.testing.expectEqual(@as(usize, 5), follower.summary.matches);
+    try std.testing.expectEqualStrings("{\"n\":1}\n{\"n\":3}\n{\"n\":5}\n{\"n\":6}\n{\"n\":7}\n", out.written());
+}
@@ -0,0 +1,619 @@
+const std = @import("std");
+const fileio = @import("fileio.zig");
+const json_parser = @import("json_parser.zig");
+const number = @import("number.zig");
+const parallel = @import("parallel_ndjson.zig");
+const query = @import("query.zig");
+const simd = @import("simd.zig");
+const Allocator = std.mem.Allocator;
+
+/// Persistent sidecar index for an NDJSON file (`<file>.zsidx`).
+///
+/// The file is cut into line-aligned blocks of `Config.chunk_size` bytes, and
+/// for every field path seen in it (up to `max_fields`) the index keeps, per
+/// block, how often it was present, the min/max of its numeric values and a
+/// bloom filter of its string values. `mayMatch` uses those to prove that a
+/// block holds no match, so `processFile*` never read it.
+///
+/// An index records the size and mtime of the file it was built from and is
+/// ignored once either changes.
+pub const Index = struct {
+    file_size: u64,
+    mtime: i128,
+    blocks: []Block,
+    fields: []Field,
+    allocator: Allocator,
+
+    pub const Block = struct {
+        start: u64,
+        end: u64,
+        /// Non-empty lines, so skipped blocks still count as processed
+        lines: u64,
+    };
+
+    pub const Field = struct {
+        path: []u8,
+        /// One entry per block
+        stats: []Stats,
+    };
+
+    pub fn deinit(self: *Index) void {
+        for (self.fields) |field| {
+            self.allocator.free(field.path);
+            self.allocator.free(field.stats);
+        }
+        self.allocator.free(self.fields);
+        self.allocator.free(self.blocks);
+    }
+
+    /// Statistics for `path` in block `b`; null when the path is not indexed.
+    fn statsFor(self: *const Index, path: []const u8, b: usize) ?*const Stats {
+        for (self.fields) |*field| {
+            if (std.mem.eql(u8, field.path, path)) return &field.stats[b];
+        }
+        return null;
+    }
+
+    /// False only when no record of block `b` can match `filter`.
+    pub fn mayMatch(self: *const Index, filter: *const query.Filter, b: usize) bool {
+        return switch (filter.*) {
+            .always_true => true,
+            .logical => |*log| switch (log.op) {
+                .@"and" => {
+                    for (log.operands) |*operand| if (!self.mayMatch(operand, b)) return false;
+                    return true;
+                },
+                .@"or" => {
+                    for (log.operands) |*operand| if (self.mayMatch(operand, b)) return true;
+                    return false;
+                },
+                .not, .nor => true,
+            },
+            .comparison => |*cmp| blk: {
+                const stats = self.statsFor(cmp.field, b) orelse break :blk true;
+                break :blk stats.mayCompare(cmp.op, &cmp.value);
+            },
+            .array_op => |*arr| blk: {
+                if (arr.op == .nin) break :blk true;
+                const stats = self.statsFor(arr.field, b) orelse break :blk true;
+                if (stats.flags.arrays) break :blk true;
+                for (arr.values) |*value| {
+                    if (stats.mayCompare(.eq, value)) break :blk true;
+                }
+                break :blk false;
+            },
+            .exists => |*ex| if (ex.should_exist) self.mayBePresent(ex.field, b) else true,
+            .regex_match => |*rm| blk: {
+                const stats = self.statsFor(rm.field, b) orelse break :blk true;
+                break :blk stats.flags.strings;
+            },
+            .size_match => |*sm| blk: {
+                const stats = self.statsFor(sm.field, b) orelse break :blk true;
+                break :blk stats.flags.arrays;
+            },
+            .type_match => true,
+        };
+    }
+
+    fn mayBePresent(self: *const Index, path: []const u8, b: usize) bool {
+        const stats = self.statsFor(path, b) orelse return true;
+        return stats.present > 0;
+    }
+
+    // ------------------------------------------------------------------------
+    // Building
+    // ------------------------------------------------------------------------
+
+    /// Index NDJSON `data` (the contents of a file with `stat`), in blocks of
+    /// `block_size` bytes built in parallel.
+    pub fn build(
+        data: []const u8,
+        stat: std.fs.File.Stat,
+        block_size: usize,
+        num_threads: usize,
+        allocator: Allocator,
+    ) !Index {
+        if (parallel.detectFormat(data) == .json_array) return error.UnsupportedFormat;
+
+        const morsels = try parallel.splitIntoMorsels(data, block_size, allocator);
+        defer allocator.free(morsels);
+
+        const partials = try allocator.alloc(BlockBuilder, morsels.len);
+        for (partials) |*p| p.* = BlockBuilder.init(allocator);
+        defer {
+            for (partials) |*p| p.deinit();
+            allocator.free(partials);
+        }
+
+        var next = std.atomic.Value(usize).init(0);
+        var failed = std.atomic.Value(bool).init(false);
+        const worker_count = @max(1, @min(num_threads, morsels.len));
+        const threads = try allocator.alloc(std.Thread, worker_count);
+        defer allocator.free(threads);
+        for (threads) |*t| t.* = try std.Thread.spawn(.{}, BlockBuilder.worker, .{ morsels, partials, &next, &failed, allocator });
+        for (threads) |t| t.join();
+        if (failed.load(.monotonic)) return error.OutOfMemory;
+
+        var index = Index{
+            .file_size = stat.size,
+            .mtime = stat.mtime,
+            .blocks = try allocator.alloc(Block, morsels.len),
+            .fields = &.{},
+            .allocator = allocator,
+        };
+        errdefer index.deinit();
+
+        const base = @intFromPtr(data.ptr);
+        for (morsels, partials, index.blocks) |morsel, *partial, *block| {
+            const start = @intFromPtr(morsel.ptr) - base;
+            block.* = .{ .start = start, .end = start + morsel.len, .lines = partial.lines };
+        }
+
+        // Fields in order of first appearance, capped at max_fields
+        var fields = std.ArrayList(Field){};
+        defer fields.deinit(allocator);
+        errdefer {
+            for (fields.items) |field| {
+                allocator.free(field.path);
+                allocator.free(field.stats);
+            }
+        }
+        for (partials) |*partial| {
+            for (partial.fields.keys()) |path| {
+                if (fields.items.len == max_fields) break;
+                for (fields.items) |field| {
+                    if (std.mem.eql(u8, field.path, path)) break;
+                } else {
+                    const stats = try allocator.alloc(Stats, morsels.len);
+                    errdefer allocator.free(stats);
+                    for (stats, partials) |*s, *p| s.* = p.fields.get(path) orelse .{};
+                    const owned = try allocator.dupe(u8, path);
+                    errdefer allocator.free(owned);
+                    try fields.append(allocator, .{ .path = owned, .stats = stats });
+                }
+            }
+        }
+        index.fields = try fields.toOwnedSlice(allocator);
+        return index;
+    }
+
+    // ------------------------------------------------------------------------
+    // Persistence
+    // ------------------------------------------------------------------------
+
+    /// Sidecar path for `file_path`; caller frees.
+    pub fn sidecarPath(file_path: []const u8, allocator: Allocator) ![]u8 {
+        return std.fmt.allocPrint(allocator, "{s}.zsidx", .{file_path});
+    }
+
+    pub fn save(self: *const Index, index_path: []const u8, allocator: Allocator) !void {
+        // Write next to the target and rename over it, so readers never see half an index
+        const tmp_path = try std.fmt.allocPrint(allocator, "{s}.tmp", .{index_path});
+        defer allocator.free(tmp_path);
+
+        {
+            const file = try std.fs.cwd().createFile(tmp_path, .{});
+            defer file.close();
+            var buffer: [64 * 1024]u8 = undefined;
+            var file_writer = file.writer(&buffer);
+            try self.write(&file_writer.interface);
+            try file_writer.interface.flush();
+        }
+        try std.fs.cwd().rename(tmp_path, index_path);
+    }
+
+    fn write(self: *const Index, w: *std.Io.Writer) !void {
+        try w.writeAll(magic);
+        try w.writeInt(u64, self.file_size, .little);
+        try w.writeInt(i128, self.mtime, .little);
+        try w.writeInt(u64, self.blocks.len, .little);
+        for (self.blocks) |block| {
+            try w.writeInt(u64, block.start, .little);
+            try w.writeInt(u64, block.end, .little);
+            try w.writeInt(u64, block.lines, .little);
+        }
+        try w.writeInt(u64, self.fields.len, .little);
+        for (self.fields) |field| {
+            try w.writeInt(u32, @intCast(field.path.len), .little);
+            try w.writeAll(field.path);
+            for (field.stats) |stats| {
+                try w.writeInt(u32, stats.present, .little);
+                try w.writeInt(u32, stats.numbers, .little);
+                try w.writeInt(u8, @bitCast(stats.flags), .little);
+                try w.writeInt(u64, @bitCast(stats.min), .little);
+                try w.writeInt(u64, @bitCast(stats.max), .little);
+                for (stats.bloom) |word| try w.writeInt(u64, word, .little);
+            }
+        }
+    }
+
+    /// Load the sidecar at `index_path` if it describes a file with `stat`.
+    /// Returns null when it is missing, stale or unreadable.
+    pub fn load(index_path: []const u8, stat: std.fs.File.Stat, allocator: Allocator) !?Index {
+        const bytes = std.fs.cwd().readFileAlloc(allocator, index_path, std.math.maxInt(usize)) catch |err| switch (err) {
+            error.OutOfMemory => return err,
+            else => return null,
+        };
+        defer allocator.free(bytes);
+
+        var reader = Reader{ .bytes = bytes };
+        return read(&reader, stat, allocator) catch |err| switch (err) {
+            error.OutOfMemory => return err,
+            error.InvalidIndex => return null,
+        };
+    }
+
+    fn read(r: *Reader, stat: std.fs.File.Stat, allocator: Allocator) (Allocator.Error || error{InvalidIndex})!?Index {
+        if (!std.mem.eql(u8, try r.take(magic.len), magic)) return error.InvalidIndex;
+        const file_size = try r.int(u64);
+        const mtime = try r.int(i128);
+        if (file_size != stat.size or mtime != stat.mtime) return null;
+
+        const block_count = try r.count(3 * 8);
+        var index = Index{
+            .file_size = file_size,
+            .mtime = mtime,
+            .blocks = try allocator.alloc(Block, block_count),
+            .fields = &.{},
+            .allocator = allocator,
+        };
+        errdefer index.deinit();
+        var end: u64 = 0;
+        for (index.blocks) |*block| {
+            block.* = .{ .start = try r.int(u64), .end = try r.int(u64), .lines = try r.int(u64) };
+            if (block.start != end or block.end < block.start) return error.InvalidIndex;
+            end = block.end;
+        }
+        if (end != file_size) return error.InvalidIndex;
+
+        const field_count = try r.count(4);
+        var fields = try std.ArrayList(Field).initCapacity(allocator, field_count);
+        defer fields.deinit(allocator);
+        errdefer {
+            for (fields.items) |field| {
+                allocator.free(field.path);
+                allocator.free(field.stats);
+            }
+        }
+        for (0..field_count) |_| {
+            const path = try allocator.dupe(u8, try r.take(try r.int(u32)));
+            errdefer allocator.free(path);
+            const stats = try allocator.alloc(Stats, block_count);
+            errdefer allocator.free(stats);
+            for (stats) |*s| {
+                s.* = .{
+                    .present = try r.int(u32),
+                    .numbers = try r.int(u32),
+                    .flags = @bitCast(try r.int(u8)),
+                    .min = @bitCast(try r.int(u64)),
+                    .max = @bitCast(try r.int(u64)),
+                };
+                for (&s.bloom) |*word| word.* = try r.int(u64);
+            }
+            fields.appendAssumeCapacity(.{ .path = path, .stats = stats });
+        }
+        if (r.pos != r.bytes.len) return error.InvalidIndex;
+
+        index.fields = try fields.toOwnedSlice(allocator);
+        return index;
+    }
+
+    /// Use the sidecar of `file_path` if it is current, otherwise (re)build
+    /// and save it. Used by `--index`.
+    pub fn openOrBuild(file_path: []const u8, config: parallel.Config, allocator: Allocator) !Index {
+        const file = try std.fs.cwd().openFile(file_path, .{});
+        defer file.close();
+        const stat = try file.stat();
+
+        const index_path = try sidecarPath(file_path, allocator);
+        defer allocator.free(index_path);
+        if (try load(index_path, stat, allocator)) |index| return index;
+
+        if (stat.size == 0) return build(&.{}, stat, config.chunk_size, 1, allocator);
+        const contents = try fileio.load(file, config.io, allocator);
+        defer contents.deinit(allocator);
+
+        var index = try build(contents.data, stat, config.chunk_size, config.num_threads, allocator);
+        errdefer index.deinit();
+        try index.save(index_path, allocator);
+        return index;
+    }
+};
+
+const magic = "ZSONIDX1";
+
+/// Paths beyond this many are not indexed (and never used to skip blocks)
+pub const max_fields = 64;
+/// Paths longer than this, or nested deeper, are not indexed
+const max_path_len = 256;
+const max_depth = 4;
+
+/// Per-block statistics of one field path
+pub const Stats = struct {
+    /// Records where the path was present
+    present: u32 = 0,
+    /// Present values that were parseable numbers, summarised by min/max
+    numbers: u32 = 0,
+    flags: Flags = .{},
+    min: f64 = std.math.inf(f64),
+    max: f64 = -std.math.inf(f64),
+    /// Bloom filter over string values
+    bloom: [bloom_words]u64 = [_]u64{0} ** bloom_words,
+
+    pub const Flags = packed struct(u8) {
+        strings: bool = false,
+        arrays: bool = false,
+        /// Objects, booleans, null, or numbers that failed to parse
+        others: bool = false,
+        reserved: u5 = 0,
+    };
+
+    const bloom_words = 4;
+    const bloom_bits = bloom_words * 64;
+
+    fn add(self: *Stats, value: json_parser.JsonValue) void {
+        self.present += 1;
+        switch (value) {
+            .number => |text| if (number.parse(text)) |n| {
+                self.numbers += 1;
+                self.min = @min(self.min, n);
+                self.max = @max(self.max, n);
+            } else {
+                self.flags.others = true;
+            },
+            .string => |s| {
+                self.flags.strings = true;
+                var hashes = bloomHashes(s);
+                while (hashes.next()) |bit| self.bloom[bit / 64] |= @as(u64, 1) << @intCast(bit % 64);
+            },
+            .array => self.flags.arrays = true,
+            .object, .bool_value, .null_value => self.flags.others = true,
+        }
+    }
+
+    fn mayContainString(self: *const Stats, s: []const u8) bool {
+        if (!self.flags.strings) return false;
+        var hashes = bloomHashes(s);
+        while (hashes.next()) |bit| {
+            if (self.bloom[bit / 64] & (@as(u64, 1) << @intCast(bit % 64)) == 0) return false;
+        }
+        return true;
+    }
+
+    /// Whether some value could satisfy `{path: {op: value}}`, following the
+    /// rules of `query.matches`: a missing path never does, and values that
+    /// cannot be ordered against the constant compare as equal.
+    fn mayCompare(self: *const Stats, op: query.Comparison.CompOp, value: *const query.Value) bool {
+        if (self.present == 0) return false;
+        const unordered = self.present > self.numbers;
+        return switch (value.*) {
+            .number => |n| switch (op) {
+                .ne => true,
+                .eq => self.numbers > 0 and self.min <= n and n <= self.max,
+                .gt => self.numbers > 0 and self.max > n,
+                .lt => self.numbers > 0 and self.min < n,
+                // Non-numbers compare as equal, which satisfies >= and <=
+                .gte => unordered or (self.numbers > 0 and self.max >= n),
+                .lte => unordered or (self.numbers > 0 and self.min <= n),
+            },
+            .string => |s| if (op == .eq) self.mayContainString(s) else true,
+            .bool_value, .null_value => true,
+        };
+    }
+
+    fn bloomHashes(s: []const u8) BloomHashes {
+        const h = std.hash.Wyhash.hash(0x5a534f4e, s);
+        return .{ .h1 = @truncate(h), .h2 = @truncate(h >> 32) };
+    }
+
+    /// Three probe positions from one 64-bit hash (Kirsch–Mitzenmacher)
+    const BloomHashes = struct {
+        h1: u32,
+        h2: u32,
+        i: u32 = 0,
+
+        fn next(self: *BloomHashes) ?usize {
+            if (self.i == 3) return null;
+            const bit = (self.h1 +% self.i *% self.h2) % bloom_bits;
+            self.i += 1;
+            return bit;
+        }
+    };
+};
+
+/// Statistics of one block, gathered by a build worker.
+const BlockBuilder = struct {
+    arena: std.heap.ArenaAllocator,
+    fields: std.StringArrayHashMapUnmanaged(Stats) = .{},
+    lines: u64 = 0,
+
+    fn init(allocator: Allocator) BlockBuilder {
+        return .{ .arena = std.heap.ArenaAllocator.init(allocator) };
+    }
+
+    fn deinit(self: *BlockBuilder) void {
+        self.arena.deinit();
+    }
+
+    fn worker(
+        morsels: []const []const u8,
+        partials: []BlockBuilder,
+        next: *std.atomic.Value(usize),
+        failed: *std.atomic.Value(bool),
+        allocator: Allocator,
+    ) void {
+        var scratch = std.heap.ArenaAllocator.init(allocator);
+        defer scratch.deinit();
+        var indexer = simd.RecordIndexer.init(&.{});
+        defer indexer.deinit(allocator);
+
+        while (true) {
+            const b = next.fetchAdd(1, .monotonic);
+            if (b >= morsels.len) return;
+            partials[b].scan(morsels[b], &indexer, &scratch) catch {
+                failed.store(true, .monotonic);
+                return;
+            };
+        }
+    }
+
+    fn scan(self: *BlockBuilder, morsel: []const u8, indexer: *simd.RecordIndexer, scratch: *std.heap.ArenaAllocator) !void {
+        indexer.reset(morsel);
+        while (try indexer.next(self.arena.child_allocator)) |record| {
+            if (record.line.len == 0) continue;
+            self.lines += 1;
+            defer _ = scratch.reset(.retain_capacity);
+            // A record the parse rejects matches no query, so it adds nothing
+            const obj = json_parser.parseObjectTokens(morsel, record.tokens, scratch.allocator(), null) catch |err| switch (err) {
+                error.OutOfMemory => return err,
+                else => continue,
+            };
+            var path: [max_path_len]u8 = undefined;
+            try self.collect(obj, &path, 0, 0);
+        }
+    }
+
+    /// Record every field of `obj`, prefixed by `path[0..prefix_len]`.
+    fn collect(self: *BlockBuilder, obj: json_parser.JsonObject, path: *[max_path_len]u8, prefix_len: usize, depth: usize) Allocator.Error!void {
+        for (obj.fields) |field| {
+            const sep: usize = if (prefix_len > 0) 1 else 0;
+            const len = prefix_len + sep + field.key.len;
+            if (len > max_path_len) continue;
+            if (sep == 1) path[prefix_len] = '.';
+            @memcpy(path[prefix_len + sep .. len], field.key);
+
+            const entry = try self.fields.getOrPut(self.arena.allocator(), path[0..len]);
+            if (!entry.found_existing) {
+                entry.key_ptr.* = try self.arena.allocator().dupe(u8, path[0..len]);
+                entry.value_ptr.* = .{};
+            }
+            entry.value_ptr.add(field.value);
+
+            if (field.value == .object and depth + 1 < max_depth) {
+                try self.collect(field.value.object, path, len, depth + 1);
+            }
+        }
+    }
+};
+
+/// Cursor over a serialized index; any overrun means a corrupt file.
+const Reader = struct {
+    bytes: []const u8,
+    pos: usize = 0,
+
+    fn take(self: *Reader, n: usize) error{InvalidIndex}![]const u8 {
+        if (self.bytes.len - self.pos < n) return error.InvalidIndex;
+        defer self.pos += n;
+        return self.bytes[self.pos..][0..n];
+    }
+
+    fn int(self: *Reader, comptime T: type) error{InvalidIndex}!T {
+        const bytes = try self.take(@sizeOf(T));
+        return std.mem.readInt(T, bytes[0..@sizeOf(T)], .little);
+    }
+
+    /// An element count, checked against the bytes left (each at least `min_size`)
+    fn count(self: *Reader, min_size: usize) error{InvalidIndex}!usize {
+        const n = try self.int(u64);
+        if (n > (self.bytes.len - self.pos) / min_size) return error.InvalidIndex;
+        return @intCast(n);
+    }
+};
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+fn testData(allocator: Allocator) !std.ArrayList(u8) {
+    var data = std.ArrayList(u8){};
+    errdefer data.deinit(allocator);
+    for (0..2000) |i| {
+        const level = if (i < 1000) "info" else "error";
+        try data.writer(allocator).print("{{\"id\":{d},\"level\":\"{s}\",\"ctx\":{{\"shard\":{d}}}}}\n", .{ i, level, i / 100 });
+    }
+    return data;
+}
+
+test "index: block statistics rule out blocks without matches" {
+    const allocator = std.testing.allocator;
+    var data = try testData(allocator);
+    defer data.deinit(allocator);
+
+    const stat = std.fs.File.Stat{ .inode = 0, .size = data.items.len, .mode = 0, .kind = .file, .atime = 0, .mtime = 42, .ctime = 0 };
+    var index = try Index.build(data.items, stat, 4096, 2, allocator);
+    defer index.deinit();
+    try std.testing.expect(index.blocks.len > 4);
+
+    const cases = [_]struct { query: []const u8, matches: usize }{
+        .{ .query = "{\"id\":{\"$gte\":1500}}", .matches = 500 },
+        .{ .query = "{\"level\":\"error\",\"ctx.shard\":{\"$lt\":12}}", .matches = 200 },
+        .{ .query = "{\"id\":{\"$in\":[3,1999]}}", .matches = 2 },
+        .{ .query = "{\"ctx.shard\":{\"$gt\":18}}", .matches = 100 },
+    };
+    for (cases) |case| {
+        var parsed = try query.parseQuery(case.query, allocator);
+        defer parsed.deinit(allocator);
+
+        var scanned: usize = 0;
+        for (index.blocks, 0..) |_, b| {
+            if (index.mayMatch(&parsed.filter, b)) scanned += 1;
+        }
+        try std.testing.expect(scanned < index.blocks.len);
+
+        // Skipping must never change the answer
+        var result = try parallel.processData(data.items, &parsed.filter, .{ .num_threads = 2, .chunk_size = 4096, .index = &index }, allocator);
+        defer result.deinit();
+        try std.testing.expectEqual(case.matches, result.matches.items.len);
+        try std.testing.expectEqual(@as(usize, 2000), result.lines_processed);
+    }
+}
+
+test "index: round-trips through the sidecar and goes stale with the file" {
+    const allocator = std.testing.allocator;
+    var data = try testData(allocator);
+    defer data.deinit(allocator);
+
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+    const stat = std.fs.File.Stat{ .inode = 0, .size = data.items.len, .mode = 0, .kind = .file, .atime = 0, .mtime = 42, .ctime = 0 };
+    var index = try Index.build(data.items, stat, 4096, 2, allocator);
+    defer index.deinit();
+
+    const dir_path = try tmp.dir.realpathAlloc(allocator, ".");
+    defer allocator.free(dir_path);
+    const index_path = try std.fs.path.join(allocator, &.{ dir_path, "events.ndjson.zsidx" });
+    defer allocator.free(index_path);
+    try index.save(index_path, allocator);
+
+    var loaded = (try Index.load(index_path, stat, allocator)).?;
+    defer loaded.deinit();
+    try std.testing.expectEqual(index.blocks.len, loaded.blocks.len);
+    try std.testing.expectEqual(index.fields.len, loaded.fields.len);
+    try std.testing.expectEqualStrings("ctx.shard", loaded.fields[3].path);
+    try std.testing.expectEqual(index.fields[0].stats[1].max, loaded.fields[0].stats[1].max);
+
+    var touched = stat;
+    touched.mtime += 1;
+    try std.testing.expect(try Index.load(index_path, touched, allocator) == null);
+}
+
+test "index: records the parse rejects are left out of blocks and results alike" {
+    const allocator = std.testing.allocator;
+    var data = try testData(allocator);
+    defer data.deinit(allocator);
+    // "x" is malformed; the query never reads it, but its parse still rejects the record
+    try data.appendSlice(allocator, "{\"x\":[1,,2],\"id\":5000}\n");
+
+    const stat = std.fs.File.Stat{ .inode = 0, .size = data.items.len, .mode = 0, .kind = .file, .atime = 0, .mtime = 42, .ctime = 0 };
+    var index = try Index.build(data.items, stat, 4096, 2, allocator);
+    defer index.deinit();
+
+    var parsed = try query.parseQuery("{\"id\":5000}", allocator);
+    defer parsed.deinit(allocator);
+    var plain = try parallel.processData(data.items, &parsed.filter, .{ .num_threads = 2, .chunk_size = 4096 }, allocator);
+    defer plain.deinit();
+    var indexed = try parallel.processData(data.items, &parsed.filter, .{ .num_threads = 2, .chunk_size = 4096, .index = &index }, allocator);
+    defer indexed.deinit();
+    try std.testing.expectEqual(@as(usize, 0), plain.matches.items.len);
+    try std.testing.expectEqual(plain.matches.items.len, indexed.matches.items.len);
+}
@@ -0,0 +1,277 @@
+const std = @import("std");
+const simd = @import("simd.zig");
+
+/// Morsel splitting for JSON array input (`[{...},{...},...]`).
+///
+/// Elements are filtered in place, straight from the input, so the array only
+/// has to be cut at top-level commas. Finding them is a depth scan that is
+/// split across threads, each starting at an arbitrary byte where neither the
+/// string state nor the nesting depth is known:
+/// 1. Quote positions do not depend on either: an escape at the split point is
+///    recovered by counting the backslashes just before it.
+/// 2. Each segment is scanned once under both string hypotheses. Starting
+///    inside a string flips the in-string mask of the whole segment, so both
+///    come from the same prefix-XOR. For each, the scan keeps the depth change,
+///    the lowest relative depth reached and the commas at that depth.
+/// 3. A serial pass over the segments resolves the real starting state of
+///    each from the quote parity and depth change of the segments before it.
+///    A segment's commas are top-level exactly when its lowest depth is zero.
+pub fn splitIntoMorsels(
+    data: []const u8,
+    morsel_size: usize,
+    num_threads: usize,
+    allocator: std.mem.Allocator,
+) ![][]const u8 {
+    var morsels = std.ArrayList([]const u8){};
+    errdefer morsels.deinit(allocator);
+
+    const body = arrayBody(data);
+    const spacing = @max(morsel_size, 1);
+    const len = body.end - body.start;
+    const count = std.math.clamp(len / spacing, 1, @max(num_threads, 1));
+
+    const segments = try allocator.alloc(Segment, count);
+    for (segments, 0..) |*segment, i| segment.* = .{
+        .start = body.start + len * i / count,
+        .end = body.start + len * (i + 1) / count,
+    };
+    defer {
+        for (segments) |*segment| segment.deinit(allocator);
+        allocator.free(segments);
+    }
+
+    {
+        const threads = try allocator.alloc(std.Thread, count - 1);
+        defer allocator.free(threads);
+        var spawned: usize = 0;
+        defer {
+            for (threads[0..spawned]) |t| t.join();
+        }
+        while (spawned < threads.len) : (spawned += 1) {
+            threads[spawned] = try std.Thread.spawn(.{}, Segment.run, .{ &segments[spawned + 1], data, spacing, allocator });
+        }
+        segments[0].run(data, spacing, allocator);
+    }
+    for (segments) |segment| if (segment.failure) |err| return err;
+
+    var in_string: u1 = 0;
+    var depth: i64 = 0;
+    var start = body.start;
+    for (segments) |*segment| {
+        const hypothesis = &segment.hypotheses[in_string];
+        if (depth + hypothesis.floor == 0) {
+            for (hypothesis.cuts.items) |comma| {
+                if (comma - start < spacing) continue;
+                try morsels.append(allocator, data[start..comma]);
+                start = comma + 1;
+            }
+        }
+        depth += hypothesis.depth;
+        in_string ^= segment.quote_parity;
+    }
+    if (std.mem.trim(u8, data[start..body.end], &std.ascii.whitespace).len > 0) {
+        try morsels.append(allocator, data[start..body.end]);
+    }
+
+    return morsels.toOwnedSlice(allocator);
+}
+
+const Bounds = struct { start: usize, end: usize };
+
+/// The bytes between the outer brackets. A truncated array runs to the end.
+fn arrayBody(data: []const u8) Bounds {
+    const open = std.mem.indexOfScalar(u8, data, '[') orelse return .{ .start = data.len, .end = data.len };
+    var end = data.len;
+    while (end > open + 1 and std.ascii.isWhitespace(data[end - 1])) end -= 1;
+    if (end > open + 1 and data[end - 1] == ']') return .{ .start = open + 1, .end = end - 1 };
+    return .{ .start = open + 1, .end = data.len };
+}
+
+/// 1 when `data[pos]` follows an odd run of backslashes.
+fn escapedAt(data: []const u8, pos: usize) u64 {
+    var run: usize = 0;
+    while (run < pos and data[pos - 1 - run] == '\\') run += 1;
+    return run & 1;
+}
+
+/// One thread's share of the array.
+const Segment = struct {
+    start: usize,
+    end: usize,
+    /// Odd number of string-delimiting quotes in the segment
+    quote_parity: u1 = 0,
+    /// Indexed by the string state at `start`: 0 outside, 1 inside
+    hypotheses: [2]Hypothesis = .{ .{}, .{} },
+    failure: ?std.mem.Allocator.Error = null,
+
+    fn deinit(self: *Segment, allocator: std.mem.Allocator) void {
+        for (&self.hypotheses) |*h| h.cuts.deinit(allocator);
+    }
+
+    fn run(self: *Segment, data: []const u8, spacing: usize, allocator: std.mem.Allocator) void {
+        self.scan(data, spacing, allocator) catch |err| {
+            self.failure = err;
+        };
+    }
+
+    fn scan(self: *Segment, data: []const u8, spacing: usize, allocator: std.mem.Allocator) !void {
+        var scanner = simd.StructuralScanner{ .prev_escaped = escapedAt(data, self.start) };
+        var prev_in_string: u64 = 0;
+
+        var pos = self.start;
+        while (pos + 64 <= self.end) : (pos += 64) {
+            try self.scanBlock(&scanner, &prev_in_string, data[pos..][0..64], pos, spacing, allocator);
+        }
+        // Pad the final partial block with spaces, which are never structural
+        if (pos < self.end) {
+            var tail = [_]u8{' '} ** 64;
+            @memcpy(tail[0 .. self.end - pos], data[pos..self.end]);
+            try self.scanBlock(&scanner, &prev_in_string, &tail, pos, spacing, allocator);
+        }
+    }
+
+    inline fn scanBlock(
+        self: *Segment,
+        scanner: *simd.StructuralScanner,
+        prev_in_string: *u64,
+        block: *const [64]u8,
+        base: usize,
+        spacing: usize,
+        allocator: std.mem.Allocator,
+    ) !void {
+        const quotes = scanner.scanQuotes(block);
+        // In-string mask assuming the segment starts outside a string
+        const in_string = simd.prefixXor(quotes) ^ prev_in_string.*;
+        prev_in_string.* = 0 -% (in_string >> 63);
+        self.quote_parity ^= @truncate(@popCount(quotes));
+
+        const v: @Vector(64, u8) = block.*;
+        const opens = simd.eqMask(v, '{') | simd.eqMask(v, '[');
+        const closes = simd.eqMask(v, '}') | simd.eqMask(v, ']');
+        const commas = simd.eqMask(v, ',');
+        try self.hypotheses[0].step(base, opens & ~in_string, closes & ~in_string, commas & ~in_string, spacing, allocator);
+        try self.hypotheses[1].step(base, opens & in_string, closes & in_string, commas & in_string, spacing, allocator);
+    }
+};
+
+/// Depth bookkeeping of a segment under one starting string state.
+const Hypothesis = struct {
+    /// Depth at the scan position, relative to the segment start
+    depth: i64 = 0,
+    /// Lowest relative depth reached so far
+    floor: i64 = 0,
+    /// Commas at `floor`, at least `spacing` bytes apart
+    cuts: std.ArrayList(usize) = .{},
+
+    fn step(
+        self: *Hypothesis,
+        base: usize,
+        opens: u64,
+        closes: u64,
+        commas: u64,
+        spacing: usize,
+        allocator: std.mem.Allocator,
+    ) !void {
+        // Inside an element: no comma, and too few closes to reach the floor
+        if (commas == 0 and self.depth - @popCount(closes) >= self.floor) {
+            self.depth += @as(i64, @popCount(opens)) - @popCount(closes);
+            return;
+        }
+
+        var bits = opens | closes | commas;
+        while (bits != 0) : (bits &= bits - 1) {
+            const bit = bits & (0 -% bits);
+            if (opens & bit != 0) {
+                self.depth += 1;
+            } else if (closes & bit != 0) {
+                self.depth -= 1;
+                if (self.depth < self.floor) {
+                    self.floor = self.depth;
+                    self.cuts.clearRetainingCapacity();
+                }
+            } else if (self.depth == self.floor) {
+                const pos = base + @ctz(bits);
+                const last = self.cuts.getLastOrNull();
+                if (last == null or pos - last.? >= spacing) try self.cuts.append(allocator, pos);
+            }
+        }
+    }
+};
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+/// Elements of every morsel, in order, as the workers' indexer sees them.
+fn collectElements(morsels: []const []const u8, out: *std.ArrayList([]const u8), allocator: std.mem.Allocator) !void {
+    var indexer = simd.RecordIndexer.init(&.{});
+    indexer.framing = .elements;
+    defer indexer.deinit(allocator);
+    for (morsels) |morsel| {
+        indexer.reset(morsel);
+        while (try indexer.next(allocator)) |record| try out.append(allocator, record.line);
+    }
+}
+
+test "json_array: morsels cut only at top-level commas" {
+    const allocator = std.testing.allocator;
+
+    // Pretty-printed, with commas, brackets, escaped quotes and backslash runs
+    // inside strings, so most split points land somewhere awkward
+    var data = std.ArrayList(u8){};
+    defer data.deinit(allocator);
+    var expected = std.ArrayList(u8){};
+    defer expected.deinit(allocator);
+    try data.appendSlice(allocator, " [\n");
+    for (0..300) |i| {
+        const separator: []const u8 = if (i > 0) ",\n  " else "  ";
+        try data.appendSlice(allocator, separator);
+        const start = data.items.len;
+        try data.writer(allocator).print(
+            "{{\"id\": {d},\n   \"s\": \"a, ]}}[ \\\" \\\\\\\\\", \"t\": \"\\\\\", \"n\": [{d}, {{\"k\": [[], {{}}]}}]}}",
+            .{ i, i % 5 },
+        );
+        try expected.appendSlice(allocator, data.items[start..]);
+        try expected.append(allocator, '\n');
+    }
+    try data.appendSlice(allocator, "\n]\n");
+
+    for ([_]usize{ 1, 100, 1000, 1 << 20 }) |morsel_size| {
+        const morsels = try splitIntoMorsels(data.items, morsel_size, 4, allocator);
+        defer allocator.free(morsels);
+        if (morsel_size == 1) try std.testing.expectEqual(@as(usize, 300), morsels.len);
+        if (morsel_size == 1 << 20) try std.testing.expectEqual(@as(usize, 1), morsels.len);
+
+        var elements = std.ArrayList([]const u8){};
+        defer elements.deinit(allocator);
+        try collectElements(morsels, &elements, allocator);
+
+        var joined = std.ArrayList(u8){};
+        defer joined.deinit(allocator);
+        for (elements.items) |element| {
+            try joined.appendSlice(allocator, element);
+            try joined.append(allocator, '\n');
+        }
+        try std.testing.expectEqualStrings(expected.items, joined.items);
+    }
+}
+
+test "json_array: empty, truncated and non-object elements" {
+    const allocator = std.testing.allocator;
+
+    const empty = try splitIntoMorsels(" [ ]\n", 1, 4, allocator);
+    defer allocator.free(empty);
+    try std.testing.expectEqual(@as(usize, 0), empty.len);
+
+    const data = "[1, \"x\", {\"a\":[1,2]}, [3], {\"b\":2}, {\"c\":";
+    const morsels = try splitIntoMorsels(data, 4, 2, allocator);
+    defer allocator.free(morsels);
+    var elements = std.ArrayList([]const u8){};
+    defer elements.deinit(allocator);
+    try collectElements(morsels, &elements, allocator);
+
+    try std.testing.expectEqual(@as(usize, 3), elements.items.len);
+    try std.testing.expectEqualStrings("{\"a\":[1,2]}", elements.items[0]);
+    try std.testing.expectEqualStrings("{\"b\":2}", elements.items[1]);
+    try std.testing.expectEqualStrings("{\"c\":", elements.items[2]);
+}
@@ -1,5 +1,6 @@
 const std = @import("std");
 const simd = @import("simd.zig");
+const number = @import("number.zig");
 const Allocator = std.mem.Allocator;
 
 /// JSON value types (union for different types)
@@ -36,6 +37,11 @@ pub const JsonObject = struct {
     fields: []Field,
     allocator: Allocator,
     owned_strings: ?[][]u8 = null,
+    /// Open-addressing table over `fields`, built by the parser for objects
+    /// with at least `index_threshold` keys; smaller objects are scanned.
+    /// Each slot holds the key hash in its high half and the field index + 1
+    /// in its low half (0 = empty), so probes rarely compare key bytes.
+    slots: ?[]u64 = null,
 
     pub const Field = struct {
         key: []const u8, // Zero-copy slice
@@ -43,133 +49,314 @@ pub const JsonObject = struct {
         key_owned: bool = false,
     };
 
-    /// Get field value by key (O(n) for MVP, can optimize later with HashMap)
+    /// Below this many keys a linear scan beats hashing the key
+    pub const index_threshold = 16;
+
+    /// Hash used by `slots`. Callers that look the same key up in many
+    /// objects compute it once (at compile time, for comptime keys).
+    pub fn hashKey(key: []const u8) u32 {
+        return std.hash.Fnv1a_32.hash(key);
+    }
+
+    /// Get field value by key. When a key repeats, the first one wins.
     pub fn get(self: JsonObject, key: []const u8) ?JsonValue {
-        for (self.fields) |field| {
-            if (simd.stringsEqualFast(field.key, key)) {
-                return field.value;
-            }
+        const i = if (self.slots != null) self.indexOfHashed(key, hashKey(key)) else self.indexOf(key);
+        return if (i) |found| self.fields[found].value else null;
+    }
+
+    /// `get` with the key's `hashKey` precomputed.
+    pub fn getHashed(self: JsonObject, key: []const u8, hash: u32) ?JsonValue {
+        const i = self.indexOfHashed(key, hash) orelse return null;
+        return self.fields[i].value;
+    }
+
+    /// Position of the first field named `key`.
+    pub fn indexOfHashed(self: JsonObject, key: []const u8, hash: u32) ?usize {
+        const slots = self.slots orelse return self.indexOf(key);
+        const mask = slots.len - 1;
+        var slot: usize = hash & mask;
+        while (true) : (slot = (slot + 1) & mask) {
+            const entry = slots[slot];
+            if (entry == 0) return null;
+            if (@as(u32, @intCast(entry >> 32)) != hash) continue;
+            const i: usize = @as(u32, @truncate(entry)) - 1;
+            if (simd.stringsEqualFast(self.fields[i].key, key)) return i;
+        }
+    }
+
+    fn indexOf(self: JsonObject, key: []const u8) ?usize {
+        for (self.fields, 0..) |field, i| {
+            if (simd.stringsEqualFast(field.key, key)) return i;
         }
         return null;
     }
 
-    pub fn deinit(self: *JsonObject) void {
-        // Free nested objects and arrays recursively
-        for (self.fields) |*field| {
-            if (field.key_owned) self.allocator.free(field.key);
-            switch (field.value) {
-                .string => |s| {
-                    if (self.ownsString(s)) self.allocator.free(s);
-                },
-                .object => |*nested| {
-                    var obj = nested.*;
-                    obj.deinit();
-                },
-                .array => |arr| {
-                    for (arr) |*item| {
-                        switch (item.*) {
-                            .string => |s| if (self.ownsString(s)) self.allocator.free(s),
-                            .object => {
-                                var obj = item.object;
-                                obj.deinit();
-                            },
-                            else => {},
-                        }
-                    }
-                    self.allocator.free(arr);
-                },
-                else => {},
+    /// The `slots` table for `fields`, or null when they are few enough to scan.
+    fn buildSlots(fields: []const Field, allocator: Allocator) Allocator.Error!?[]u64 {
+        if (fields.len < index_threshold) return null;
+        // At most half full, so probe sequences stay short
+        const slots = try allocator.alloc(u64, std.math.ceilPowerOfTwoAssert(usize, fields.len * 2));
+        @memset(slots, 0);
+        const mask = slots.len - 1;
+        insert: for (fields, 0..) |field, i| {
+            const hash = hashKey(field.key);
+            var slot: usize = hash & mask;
+            while (slots[slot] != 0) : (slot = (slot + 1) & mask) {
+                // Keep the first of duplicate keys, as the scan does
+                const existing = slots[slot];
+                if (@as(u32, @intCast(existing >> 32)) == hash and
+                    simd.stringsEqualFast(fields[@as(u32, @truncate(existing)) - 1].key, field.key)) continue :insert;
             }
+            slots[slot] = @as(u64, hash) << 32 | (i + 1);
         }
-        if (self.owned_strings) |owned| self.allocator.free(owned);
+        return slots;
+    }
+
+    pub fn deinit(self: *JsonObject) void {
+        const owned: []const []u8 = self.owned_strings orelse &.{};
+        freeParts(self.fields, owned, self.allocator);
+        if (self.owned_strings) |list| self.allocator.free(list);
+        if (self.slots) |slots| self.allocator.free(slots);
         self.allocator.free(self.fields);
     }
 
-    inline fn ownsString(self: JsonObject, s: []const u8) bool {
-        const owned = self.owned_strings orelse return false;
-        for (owned) |owned_string| {
-            if (owned_string.ptr == s.ptr and owned_string.len == s.len) return true;
+    /// Free keys, nested values and decoded strings. Decoded strings live only
+    /// in `owned`, so values never have to be matched against it.
+    fn freeParts(fields: []const Field, owned: []const []u8, allocator: Allocator) void {
+        for (fields) |field| {
+            if (field.key_owned) allocator.free(field.key);
+            freeValue(field.value, allocator);
+        }
+        for (owned) |s| allocator.free(s);
+    }
+
+    fn freeValue(value: JsonValue, allocator: Allocator) void {
+        switch (value) {
+            .object => |obj| {
+                var nested = obj;
+                nested.deinit();
+            },
+            .array => |arr| {
+                for (arr) |item| freeValue(item, allocator);
+                allocator.free(arr);
+            },
+            else => {},
         }
-        return false;
     }
 };
 
-/// Parse a single JSON object from a line (NDJSON)
-/// Returns zero-copy slices into the original line data
-pub fn parseObject(line: []const u8, allocator: Allocator) ParseError!JsonObject {
-    // Tokenize using SIMD
-    var tokens: [4096]simd.Token = undefined;
-    const token_count = simd.findJsonStructure(line, &tokens);
+/// Set of field paths a caller is going to read from parsed objects.
+/// `parseObjectProjected` only materialises fields named here; every other
+/// value is skipped over in the token stream without being built.
+/// Keys are borrowed and must outlive the projection.
+pub const Projection = struct {
+    entries: std.ArrayList(Entry) = .{},
+
+    pub const Entry = struct {
+        key: []const u8,
+        /// Fields needed inside a nested object; null means the whole value.
+        child: ?*Projection,
+    };
 
-    if (token_count == 0 or tokens[0].type != .open_brace) {
-        return error.InvalidJSON;
+    pub fn deinit(self: *Projection, allocator: Allocator) void {
+        for (self.entries.items) |entry| {
+            if (entry.child) |child| {
+                child.deinit(allocator);
+                allocator.destroy(child);
+            }
+        }
+        self.entries.deinit(allocator);
     }
 
-    // Parse fields
-    var fields = std.ArrayList(JsonObject.Field){};
-    var owned_strings = std.ArrayList([]u8){};
-    errdefer {
-        for (fields.items) |*field| {
-            if (field.key_owned) allocator.free(field.key);
+    /// Require the whole value of a top-level key, taken literally (no dots).
+    pub fn addKey(self: *Projection, allocator: Allocator, key: []const u8) Allocator.Error!void {
+        if (self.find(key)) |entry| {
+            if (entry.child) |child| {
+                child.deinit(allocator);
+                allocator.destroy(child);
+                entry.child = null;
+            }
+            return;
         }
-        fields.deinit(allocator);
-        for (owned_strings.items) |s| allocator.free(s);
-        owned_strings.deinit(allocator);
+        try self.entries.append(allocator, .{ .key = key, .child = null });
     }
 
-    var i: usize = 1; // Skip opening {
-    while (i < token_count) {
-        const token = tokens[i];
+    /// Require a dot-separated path ("address.city"), as resolved by queries.
+    pub fn addPath(self: *Projection, allocator: Allocator, path: []const u8) Allocator.Error!void {
+        const dot = std.mem.indexOfScalar(u8, path, '.') orelse return self.addKey(allocator, path);
+        const head = path[0..dot];
+        const entry = self.find(head) orelse blk: {
+            const child = try allocator.create(Projection);
+            child.* = .{};
+            errdefer allocator.destroy(child);
+            try self.entries.append(allocator, .{ .key = head, .child = child });
+            break :blk &self.entries.items[self.entries.items.len - 1];
+        };
+        const child = entry.child orelse return; // whole value already required
+        try child.addPath(allocator, path[dot + 1 ..]);
+    }
 
-        // Check for closing brace
-        if (token.type == .close_brace) {
-            break;
+    pub fn lookup(self: *const Projection, key: []const u8) ?Entry {
+        for (self.entries.items) |entry| {
+            if (simd.stringsEqualFast(entry.key, key)) return entry;
         }
+        return null;
+    }
 
-        // Expect: " key " : value
-        if (token.type != .quote) {
-            // Skip commas
-            if (token.type == .comma) {
-                i += 1;
-                continue;
-            }
-            return error.ExpectedQuote;
+    fn find(self: *Projection, key: []const u8) ?*Entry {
+        for (self.entries.items) |*entry| {
+            if (std.mem.eql(u8, entry.key, key)) return entry;
         }
+        return null;
+    }
+};
 
-        const key_start = token.pos + 1;
-        const key_end = findStringEndFromTokens(line, tokens[0..token_count], i + 1, key_start) orelse return error.MalformedKey;
-        const raw_key = line[key_start..key_end];
-        const key_has_escape = hasJsonEscape(raw_key);
-        const key = if (key_has_escape) try decodeOwnedJsonString(raw_key, allocator) else raw_key;
-        advanceTokenIndex(tokens[0..token_count], &i, key_end + 1);
+/// Parse a single JSON object from a line (NDJSON)
+/// Returns zero-copy slices into the original line data
+pub fn parseObject(line: []const u8, allocator: Allocator) ParseError!JsonObject {
+    return parseObjectProjected(line, allocator, null);
+}
+
+/// Parse a JSON object, materialising only the fields named by `projection`.
+/// Other values are skipped by walking to their end in the token stream.
+/// A null projection parses every field, exactly like `parseObject`.
+pub fn parseObjectProjected(line: []const u8, allocator: Allocator, projection: ?*const Projection) ParseError!JsonObject {
+    // Stage 1: structural index of the whole line
+    var tokens = std.ArrayList(simd.Token){};
+    defer tokens.deinit(allocator);
+    try simd.findJsonStructure(line, &tokens, allocator);
+
+    // Stage 2: one recursive walk over the index
+    return parseObjectTokens(line, tokens.items, allocator, projection);
+}
+
+/// Stage 2 over a structural index built by `simd.findJsonStructure`.
+/// `tokens` must start at the object's opening brace; positions index `source`.
+pub fn parseObjectTokens(
+    source: []const u8,
+    tokens: []const simd.Token,
+    allocator: Allocator,
+    projection: ?*const Projection,
+) ParseError!JsonObject {
+    if (tokens.len == 0) return error.InvalidJSON;
+    var parser = Parser{ .source = source, .tokens = tokens, .allocator = allocator };
+    return parser.parseObject(projection);
+}
+
+/// A top-level field as found by `forEachField`, still in source form.
+pub const RawField = struct {
+    /// Key between its quotes, escapes not decoded
+    key: []const u8,
+    value: RawValue,
+};
+
+pub const RawValue = union(enum) {
+    /// Contents between the quotes, escapes not decoded
+    string: []const u8,
+    /// Trimmed number, bool or null text
+    literal: []const u8,
+    /// Tokens of a nested object or array, from its opening to its closing token
+    container: []const simd.Token,
+};
 
-        // Expect colon
-        if (i >= token_count or tokens[i].type != .colon) {
-            return error.ExpectedColon;
+/// Walk the top-level fields of the object at the start of `tokens` without
+/// building anything, calling `visit(context, field)` for each one in order.
+/// Everything but the values of nested containers is checked as
+/// `parseObjectTokens` checks it, so an error here means the parse fails too;
+/// containers are checked as the parse checks those it skips.
+pub fn forEachField(
+    source: []const u8,
+    tokens: []const simd.Token,
+    context: anytype,
+    comptime visit: fn (@TypeOf(context), RawField) void,
+) ParseError!void {
+    if (tokens.len == 0) return error.InvalidJSON;
+    var parser = Parser{ .source = source, .tokens = tokens, .allocator = undefined };
+    if ((try parser.peek()).type != .open_brace) return error.InvalidJSON;
+    parser.i += 1;
+
+    while (true) {
+        const token = try parser.peek();
+        if (token.type == .close_brace) return;
+        if (token.type != .quote) return error.ExpectedQuote;
+        const key = parser.rawString() orelse return error.MalformedKey;
+        try checkEscapes(key);
+
+        const colon = try parser.peek();
+        if (colon.type != .colon) return error.ExpectedColon;
+        parser.i += 1;
+
+        const next = try parser.peek();
+        const value: RawValue = switch (next.type) {
+            .quote => blk: {
+                const raw = parser.rawString() orelse return error.MalformedString;
+                try checkEscapes(raw);
+                break :blk .{ .string = raw };
+            },
+            .open_brace, .open_bracket => blk: {
+                const start = parser.i;
+                try parser.skipValue(colon.pos + 1);
+                break :blk .{ .container = tokens[start..parser.i] };
+            },
+            .comma, .close_brace => blk: {
+                const literal = std.mem.trim(u8, source[colon.pos + 1 .. next.pos], &std.ascii.whitespace);
+                _ = try literalValue(literal);
+                break :blk .{ .literal = literal };
+            },
+            else => return error.UnexpectedToken,
+        };
+        visit(context, .{ .key = key, .value = value });
+
+        const separator = try parser.peek();
+        parser.i += 1;
+        switch (separator.type) {
+            .comma => {},
+            .close_brace => return,
+            else => return error.UnexpectedToken,
         }
-        const colon_pos = tokens[i].pos;
-        i += 1; // Skip colon
-
-        // Parse value - pass the colon position for literal extraction
-        const value = try parseValueAfterColon(line, tokens[0..token_count], &i, colon_pos, allocator, &owned_strings);
-
-        try fields.append(allocator, JsonObject.Field{
-            .key = key,
-            .value = value,
-            .key_owned = key_has_escape,
-        });
-    }
-
-    return JsonObject{
-        .fields = try fields.toOwnedSlice(allocator),
-        .allocator = allocator,
-        .owned_strings = if (owned_strings.items.len > 0)
-            try owned_strings.toOwnedSlice(allocator)
-        else blk: {
-            owned_strings.deinit(allocator);
-            break :blk null;
-        },
-    };
+    }
+}
+
+/// Parse the array at the start of `tokens` into `out` without allocating,
+/// when every element is a number, bool, null or a string without escapes.
+/// Null when it holds anything else or more than `out.len` elements; the
+/// rest of the array is then unchecked. Errors are those `parseObjectTokens`
+/// reports for the same array.
+pub fn parseScalarArray(source: []const u8, tokens: []const simd.Token, out: []JsonValue) ParseError!?[]JsonValue {
+    var parser = Parser{ .source = source, .tokens = tokens, .allocator = undefined };
+    const open = try parser.peek();
+    if (open.type != .open_bracket) return error.UnexpectedToken;
+    parser.i += 1;
+
+    const first = try parser.peek();
+    if (first.type == .close_bracket and isBlank(source[open.pos + 1 .. first.pos])) return out[0..0];
+
+    var len: usize = 0;
+    var value_start = open.pos + 1;
+    while (true) {
+        const token = try parser.peek();
+        const value: JsonValue = switch (token.type) {
+            .quote => blk: {
+                const raw = parser.rawString() orelse return error.MalformedString;
+                if (hasJsonEscape(raw)) return null;
+                break :blk .{ .string = raw };
+            },
+            .open_brace, .open_bracket => return null,
+            .comma, .close_brace, .close_bracket => try literalValue(source[value_start..token.pos]),
+            else => return error.UnexpectedToken,
+        };
+        if (len == out.len) return null;
+        out[len] = value;
+        len += 1;
+
+        const separator = try parser.peek();
+        parser.i += 1;
+        switch (separator.type) {
+            .comma => value_start = separator.pos + 1,
+            .close_bracket => return out[0..len],
+            else => return error.UnexpectedToken,
+        }
+    }
 }
 
 pub const ParseError = error{
@@ -191,256 +378,393 @@ pub const ParseError = error{
     OutOfMemory,
 };
 
-/// Parse a JSON value that comes after a colon
-/// i points to the token after the colon (may be quote, comma, or close brace)
-/// colon_pos is the position of the colon in the source text
-fn parseValueAfterColon(
-    line: []const u8,
-    tokens: []simd.Token,
-    i: *usize,
-    colon_pos: usize,
+/// Recursive-descent parser over a structural index.
+///
+/// Stage 1 guarantees that the index holds no characters from inside strings,
+/// so every string is exactly two consecutive quote tokens and containers nest
+/// by token alone. Nested objects and arrays are parsed from the same index
+/// rather than re-tokenizing their substring.
+const Parser = struct {
+    source: []const u8,
+    tokens: []const simd.Token,
     allocator: Allocator,
-    owned_strings: *std.ArrayList([]u8),
-) ParseError!JsonValue {
-    if (i.* >= tokens.len) return error.UnexpectedEnd;
-
-    const next_token = tokens[i.*];
-
-    switch (next_token.type) {
-        .quote => {
-            const start = next_token.pos + 1;
-            const end = findStringEndFromTokens(line, tokens, i.* + 1, start) orelse return error.MalformedString;
-            const raw = line[start..end];
-            const has_escape = hasJsonEscape(raw);
-            const value = if (has_escape) try decodeOwnedJsonString(raw, allocator) else raw;
-            if (has_escape) try owned_strings.append(allocator, @constCast(value));
-            advanceTokenIndex(tokens, i, end + 1);
-
-            return JsonValue{ .string = value };
-        },
-        .open_brace => {
-            // Nested object - parse it recursively
-            // Find the matching close brace
-            var brace_depth: i32 = 1;
-            var end_pos = next_token.pos + 1;
-
-            while (end_pos < line.len and brace_depth > 0) : (end_pos += 1) {
-                if (line[end_pos] == '{') brace_depth += 1;
-                if (line[end_pos] == '}') brace_depth -= 1;
-            }
+    /// Index of the next unconsumed token
+    i: usize = 0,
+
+    fn peek(self: *const Parser) ParseError!simd.Token {
+        if (self.i >= self.tokens.len) return error.UnexpectedEnd;
+        return self.tokens[self.i];
+    }
 
-            const nested_json = line[next_token.pos..end_pos];
-            const nested_obj = try parseObject(nested_json, allocator);
+    fn parseObject(self: *Parser, projection: ?*const Projection) ParseError!JsonObject {
+        if ((try self.peek()).type != .open_brace) return error.InvalidJSON;
+        self.i += 1;
+
+        var fields = std.ArrayList(JsonObject.Field){};
+        var owned_strings = std.ArrayList([]u8){};
+        errdefer {
+            JsonObject.freeParts(fields.items, owned_strings.items, self.allocator);
+            fields.deinit(self.allocator);
+            owned_strings.deinit(self.allocator);
+        }
 
-            // Skip tokens until we pass the close brace
-            while (i.* < tokens.len and tokens[i.*].pos < end_pos) {
-                i.* += 1;
+        while (true) {
+            const token = try self.peek();
+            // Empty object (or a trailing comma)
+            if (token.type == .close_brace) {
+                self.i += 1;
+                break;
             }
 
-            return JsonValue{ .object = nested_obj };
-        },
-        .open_bracket => {
-            // Array - parse elements recursively
-            var array_items = std.ArrayList(JsonValue){};
-            errdefer {
-                for (array_items.items) |*item| {
-                    if (item.* == .object) {
-                        var obj = item.object;
-                        obj.deinit();
+            // Expect: " key " : value
+            if (token.type != .quote) return error.ExpectedQuote;
+            const raw_key = self.rawString() orelse return error.MalformedKey;
+            const key_escape = firstJsonEscape(raw_key);
+            const key_has_escape = key_escape != null;
+            const key = if (key_escape) |first| try decodeOwnedJsonString(raw_key, first, self.allocator) else raw_key;
+
+            const colon = self.peek() catch |err| {
+                if (key_has_escape) self.allocator.free(key);
+                return err;
+            };
+            if (colon.type != .colon) {
+                if (key_has_escape) self.allocator.free(key);
+                return error.ExpectedColon;
+            }
+            self.i += 1;
+
+            // Projected parse: skip values nobody will read
+            var child_projection: ?*const Projection = null;
+            var skip = false;
+            if (projection) |proj| {
+                if (proj.lookup(key)) |entry| {
+                    if (entry.child) |child| {
+                        // Only nested paths are wanted; they can only resolve through an object
+                        const next = if (self.i < self.tokens.len) self.tokens[self.i].type else .unknown;
+                        if (next == .open_brace) child_projection = child else skip = true;
                     }
-                }
-                array_items.deinit(allocator);
+                } else skip = true;
             }
 
-            // Find the array content between [ and ]
-            const array_start = next_token.pos;
-            var bracket_depth: i32 = 1;
-            var end_pos = array_start + 1;
+            if (skip) {
+                if (key_has_escape) self.allocator.free(key);
+                try self.skipValue(colon.pos + 1);
+            } else {
+                const value = self.parseValue(colon.pos + 1, child_projection, &owned_strings) catch |err| {
+                    if (key_has_escape) self.allocator.free(key);
+                    return err;
+                };
+                fields.append(self.allocator, .{
+                    .key = key,
+                    .value = value,
+                    .key_owned = key_has_escape,
+                }) catch |err| {
+                    JsonObject.freeValue(value, self.allocator);
+                    if (key_has_escape) self.allocator.free(key);
+                    return err;
+                };
+            }
 
-            while (end_pos < line.len and bracket_depth > 0) : (end_pos += 1) {
-                if (line[end_pos] == '[') bracket_depth += 1;
-                if (line[end_pos] == ']') bracket_depth -= 1;
+            const separator = try self.peek();
+            self.i += 1;
+            switch (separator.type) {
+                .comma => {},
+                .close_brace => break,
+                else => return error.UnexpectedToken,
             }
+        }
+
+        const slots = try JsonObject.buildSlots(fields.items, self.allocator);
+        errdefer if (slots) |table| self.allocator.free(table);
+        return JsonObject{
+            .fields = try fields.toOwnedSlice(self.allocator),
+            .allocator = self.allocator,
+            .slots = slots,
+            .owned_strings = if (owned_strings.items.len > 0)
+                try owned_strings.toOwnedSlice(self.allocator)
+            else blk: {
+                owned_strings.deinit(self.allocator);
+                break :blk null;
+            },
+        };
+    }
 
-            const array_content = line[array_start + 1 .. end_pos - 1];
+    /// Parse the value at the current token. `value_start` is the source
+    /// position just after the preceding colon, comma or bracket, which is
+    /// where a literal (number, bool, null) begins. Decoded strings are
+    /// recorded in `owned_strings` of the enclosing object.
+    fn parseValue(
+        self: *Parser,
+        value_start: usize,
+        projection: ?*const Projection,
+        owned_strings: *std.ArrayList([]u8),
+    ) ParseError!JsonValue {
+        const token = try self.peek();
+        switch (token.type) {
+            .quote => {
+                const raw = self.rawString() orelse return error.MalformedString;
+                const first = firstJsonEscape(raw) orelse return JsonValue{ .string = raw };
+                const decoded = try decodeOwnedJsonString(raw, first, self.allocator);
+                owned_strings.append(self.allocator, decoded) catch |err| {
+                    self.allocator.free(decoded);
+                    return err;
+                };
+                return JsonValue{ .string = decoded };
+            },
+            .open_brace => return JsonValue{ .object = try self.parseObject(projection) },
+            .open_bracket => return JsonValue{ .array = try self.parseArray(owned_strings) },
+            // The value is a literal between the previous token and this one
+            .comma, .close_brace, .close_bracket => return literalValue(self.source[value_start..token.pos]),
+            else => return error.UnexpectedToken,
+        }
+    }
 
-            // Parse each element: strings, numbers, booleans, nulls, objects
-            if (std.mem.trim(u8, array_content, &std.ascii.whitespace).len > 0) {
-                var elem_start: usize = 0;
-                var depth: i32 = 0;
-                var in_str = false;
+    fn parseArray(self: *Parser, owned_strings: *std.ArrayList([]u8)) ParseError![]JsonValue {
+        const open = try self.peek();
+        self.i += 1;
 
-                for (array_content, 0..) |ch, idx| {
-                    if (ch == '"' and (idx == 0 or array_content[idx - 1] != '\\')) {
-                        in_str = !in_str;
-                    }
-                    if (in_str) continue;
-                    if (ch == '{' or ch == '[') depth += 1;
-                    if (ch == '}' or ch == ']') depth -= 1;
-
-                    const is_sep = ch == ',' and depth == 0;
-                    const is_last = idx == array_content.len - 1;
-
-                    if (is_sep or is_last) {
-                        const end = if (is_sep) idx else idx + 1;
-                        const elem = std.mem.trim(u8, array_content[elem_start..end], " \t\r\n");
-                        if (elem.len > 0) {
-                            const val = try parseArrayElement(elem, allocator, owned_strings);
-                            try array_items.append(allocator, val);
-                        }
-                        elem_start = idx + 1;
-                    }
-                }
-            }
+        var items = std.ArrayList(JsonValue){};
+        errdefer {
+            for (items.items) |item| JsonObject.freeValue(item, self.allocator);
+            items.deinit(self.allocator);
+        }
 
-            // Skip tokens until we pass the close bracket
-            while (i.* < tokens.len and tokens[i.*].pos < end_pos) {
-                i.* += 1;
-            }
+        // Empty array
+        const first = try self.peek();
+        if (first.type == .close_bracket and isBlank(self.source[open.pos + 1 .. first.pos])) {
+            self.i += 1;
+            return try items.toOwnedSlice(self.allocator);
+        }
 
-            return JsonValue{ .array = try array_items.toOwnedSlice(allocator) };
-        },
-        .comma, .close_brace => {
-            // The value is a literal between the colon and this token
-            // Extract it from the source text
-            var value_start = colon_pos + 1;
-            while (value_start < next_token.pos and std.ascii.isWhitespace(line[value_start])) {
-                value_start += 1;
+        var value_start = open.pos + 1;
+        while (true) {
+            const value = try self.parseValue(value_start, null, owned_strings);
+            items.append(self.allocator, value) catch |err| {
+                JsonObject.freeValue(value, self.allocator);
+                return err;
+            };
+
+            const separator = try self.peek();
+            self.i += 1;
+            switch (separator.type) {
+                .comma => value_start = separator.pos + 1,
+                .close_bracket => return try items.toOwnedSlice(self.allocator),
+                else => return error.UnexpectedToken,
             }
+        }
+    }
 
-            const value_end = next_token.pos;
-            const literal = std.mem.trim(u8, line[value_start..value_end], &std.ascii.whitespace);
+    /// Consume an opening/closing quote pair and return the raw string between them.
+    fn rawString(self: *Parser) ?[]const u8 {
+        if (self.i + 1 >= self.tokens.len) return null;
+        const close = self.tokens[self.i + 1];
+        if (close.type != .quote) return null;
+        const start = self.tokens[self.i].pos + 1;
+        self.i += 2;
+        return self.source[start..close.pos];
+    }
 
-            // Determine type
-            if (std.mem.eql(u8, literal, "null")) {
-                return JsonValue{ .null_value = {} };
-            } else if (std.mem.eql(u8, literal, "true")) {
-                return JsonValue{ .bool_value = true };
-            } else if (std.mem.eql(u8, literal, "false")) {
-                return JsonValue{ .bool_value = false };
-            } else {
-                // Assume number (keep as zero-copy string, parse on-demand)
-                return JsonValue{ .number = literal };
+    /// Skip the value at the current token without building it, rejecting
+    /// whatever `parseValue` would reject: a skipped field never lets a
+    /// malformed record through. `value_start` is as for `parseValue`.
+    fn skipValue(self: *Parser, value_start: usize) ParseError!void {
+        const token = try self.peek();
+        switch (token.type) {
+            .quote => try checkEscapes(self.rawString() orelse return error.MalformedString),
+            .open_brace => try self.skipObject(),
+            .open_bracket => try self.skipArray(),
+            .comma, .close_brace, .close_bracket => _ = try literalValue(self.source[value_start..token.pos]),
+            else => return error.UnexpectedToken,
+        }
+    }
+
+    /// `parseObject` without the object
+    fn skipObject(self: *Parser) ParseError!void {
+        self.i += 1;
+        while (true) {
+            const token = try self.peek();
+            if (token.type == .close_brace) {
+                self.i += 1;
+                return;
             }
-        },
-        else => {
-            return error.UnexpectedToken;
-        },
-    }
-}
-
-/// Parse a single element inside a JSON array (string, number, bool, null, or object)
-fn parseArrayElement(elem: []const u8, allocator: Allocator, owned_strings: *std.ArrayList([]u8)) ParseError!JsonValue {
-    if (elem.len == 0) return error.InvalidJSON;
-    return switch (elem[0]) {
-        '{' => JsonValue{ .object = try parseObject(elem, allocator) },
-        '"' => blk: {
-            if (elem.len < 2 or elem[elem.len - 1] != '"') return error.MalformedString;
-            const raw = elem[1 .. elem.len - 1];
-            const has_escape = hasJsonEscape(raw);
-            const value = if (has_escape) try decodeOwnedJsonString(raw, allocator) else raw;
-            if (has_escape) try owned_strings.append(allocator, @constCast(value));
-            break :blk JsonValue{ .string = value };
-        },
-        else => {
-            if (std.mem.eql(u8, elem, "null")) return JsonValue{ .null_value = {} };
-            if (std.mem.eql(u8, elem, "true")) return JsonValue{ .bool_value = true };
-            if (std.mem.eql(u8, elem, "false")) return JsonValue{ .bool_value = false };
-            return JsonValue{ .number = elem }; // zero-copy slice
-        },
-    };
-}
+            if (token.type != .quote) return error.ExpectedQuote;
+            try checkEscapes(self.rawString() orelse return error.MalformedKey);
+
+            const colon = try self.peek();
+            if (colon.type != .colon) return error.ExpectedColon;
+            self.i += 1;
+            try self.skipValue(colon.pos + 1);
+
+            const separator = try self.peek();
+            self.i += 1;
+            switch (separator.type) {
+                .comma => {},
+                .close_brace => return,
+                else => return error.UnexpectedToken,
+            }
+        }
+    }
 
-fn advanceTokenIndex(tokens: []simd.Token, i: *usize, min_pos: usize) void {
-    while (i.* < tokens.len and tokens[i.*].pos < min_pos) i.* += 1;
-}
+    /// `parseArray` without the array
+    fn skipArray(self: *Parser) ParseError!void {
+        const open = try self.peek();
+        self.i += 1;
 
-fn findStringEnd(line: []const u8, start: usize) ?usize {
-    var idx = start;
-    var escaped = false;
-    while (idx < line.len) : (idx += 1) {
-        const c = line[idx];
-        if (escaped) {
-            escaped = false;
-            continue;
+        const first = try self.peek();
+        if (first.type == .close_bracket and isBlank(self.source[open.pos + 1 .. first.pos])) {
+            self.i += 1;
+            return;
         }
-        if (c == '\\') {
-            escaped = true;
-            continue;
+
+        var value_start = open.pos + 1;
+        while (true) {
+            try self.skipValue(value_start);
+            const separator = try self.peek();
+            self.i += 1;
+            switch (separator.type) {
+                .comma => value_start = separator.pos + 1,
+                .close_bracket => return,
+                else => return error.UnexpectedToken,
+            }
         }
-        if (c == '"') return idx;
     }
-    return null;
+};
+
+/// The number, bool or null spelled by `text`, ignoring surrounding whitespace.
+fn literalValue(text: []const u8) ParseError!JsonValue {
+    const literal = std.mem.trim(u8, text, &std.ascii.whitespace);
+    if (literal.len == 0) return error.UnexpectedToken;
+
+    if (std.mem.eql(u8, literal, "null")) {
+        return JsonValue{ .null_value = {} };
+    } else if (std.mem.eql(u8, literal, "true")) {
+        return JsonValue{ .bool_value = true };
+    } else if (std.mem.eql(u8, literal, "false")) {
+        return JsonValue{ .bool_value = false };
+    } else if (isJsonNumber(literal)) {
+        // Zero-copy string, parsed on demand
+        return JsonValue{ .number = literal };
+    } else {
+        return error.UnexpectedToken;
+    }
 }
 
-fn findStringEndFromTokens(line: []const u8, tokens: []simd.Token, token_start: usize, string_start: usize) ?usize {
-    if (token_start < tokens.len and tokens[token_start].type == .quote and !isEscapedAt(line, tokens[token_start].pos)) {
-        return tokens[token_start].pos;
+/// `-?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?`
+fn isJsonNumber(text: []const u8) bool {
+    var i: usize = 0;
+    if (i < text.len and text[i] == '-') i += 1;
+    if (i >= text.len or !std.ascii.isDigit(text[i])) return false;
+    i = if (text[i] == '0') i + 1 else digitsEnd(text, i);
+    if (i < text.len and text[i] == '.') {
+        const start = i + 1;
+        i = digitsEnd(text, start);
+        if (i == start) return false;
     }
-    return findStringEnd(line, string_start);
+    if (i < text.len and (text[i] == 'e' or text[i] == 'E')) {
+        i += 1;
+        if (i < text.len and (text[i] == '+' or text[i] == '-')) i += 1;
+        const start = i;
+        i = digitsEnd(text, start);
+        if (i == start) return false;
+    }
+    return i == text.len;
+}
+
+fn digitsEnd(text: []const u8, start: usize) usize {
+    var i = start;
+    while (i < text.len and std.ascii.isDigit(text[i])) i += 1;
+    return i;
 }
 
-fn isEscapedAt(line: []const u8, pos: usize) bool {
-    if (pos == 0) return false;
-    var backslashes: usize = 0;
-    var idx = pos;
-    while (idx > 0) {
-        idx -= 1;
-        if (line[idx] != '\\') break;
-        backslashes += 1;
+fn isBlank(text: []const u8) bool {
+    for (text) |c| {
+        if (!std.ascii.isWhitespace(c)) return false;
     }
-    return backslashes % 2 == 1;
+    return true;
 }
 
 fn hasJsonEscape(raw: []const u8) bool {
-    return std.mem.indexOfScalar(u8, raw, '\\') != null;
+    return firstJsonEscape(raw) != null;
 }
 
-fn decodeOwnedJsonString(raw: []const u8, allocator: Allocator) ParseError![]u8 {
-    var out = std.ArrayList(u8){};
-    errdefer out.deinit(allocator);
+/// Position of the first backslash in a raw string (vectorised search).
+fn firstJsonEscape(raw: []const u8) ?usize {
+    return std.mem.indexOfScalar(u8, raw, '\\');
+}
 
-    var i: usize = 0;
-    while (i < raw.len) : (i += 1) {
-        const c = raw[i];
-        if (c != '\\') {
-            try out.append(allocator, c);
-            continue;
-        }
+/// Decode the escapes of `raw`, whose first backslash is at `first`. Escapes
+/// never decode longer than they are written, so the result goes into one
+/// allocation of `raw.len`, shrunk at the end; with the per-record scratch
+/// arenas of the parallel paths that is a bump and a trim. The runs between
+/// backslashes are found with the same vectorised search and copied whole.
+fn decodeOwnedJsonString(raw: []const u8, first: usize, allocator: Allocator) ParseError![]u8 {
+    const buffer = try allocator.alloc(u8, raw.len);
+    errdefer allocator.free(buffer);
+    @memcpy(buffer[0..first], raw[0..first]);
+    var len = first;
+
+    var i = first;
+    while (i < raw.len) {
+        // raw[i] is a backslash
+        i += 1;
+        if (i >= raw.len) return error.InvalidEscape;
+        const decoded: u8 = switch (raw[i]) {
+            '"' => '"',
+            '\\' => '\\',
+            '/' => '/',
+            'b' => 0x08,
+            'f' => 0x0c,
+            'n' => '\n',
+            'r' => '\r',
+            't' => '\t',
+            'u' => {
+                if (i + 4 >= raw.len) return error.InvalidUnicodeEscape;
+                const code = std.fmt.parseInt(u21, raw[i + 1 .. i + 5], 16) catch return error.InvalidUnicodeEscape;
+                len += std.unicode.utf8Encode(code, buffer[len..][0..4]) catch return error.InvalidUnicodeEscape;
+                i += 5;
+                i = copyRun(raw, i, buffer, &len);
+                continue;
+            },
+            else => return error.InvalidEscape,
+        };
+        buffer[len] = decoded;
+        len += 1;
+        i = copyRun(raw, i + 1, buffer, &len);
+    }
 
+    return allocator.realloc(buffer, len);
+}
+
+/// Fail as `decodeOwnedJsonString` would on `raw`, without decoding it: for
+/// strings the parser skips.
+fn checkEscapes(raw: []const u8) ParseError!void {
+    var i = firstJsonEscape(raw) orelse return;
+    while (true) {
+        // raw[i] is a backslash
         i += 1;
         if (i >= raw.len) return error.InvalidEscape;
         switch (raw[i]) {
-            '"' => try out.append(allocator, '"'),
-            '\\' => try out.append(allocator, '\\'),
-            '/' => try out.append(allocator, '/'),
-            'b' => try out.append(allocator, 0x08),
-            'f' => try out.append(allocator, 0x0c),
-            'n' => try out.append(allocator, '\n'),
-            'r' => try out.append(allocator, '\r'),
-            't' => try out.append(allocator, '\t'),
+            '"', '\\', '/', 'b', 'f', 'n', 'r', 't' => i += 1,
             'u' => {
                 if (i + 4 >= raw.len) return error.InvalidUnicodeEscape;
                 const code = std.fmt.parseInt(u21, raw[i + 1 .. i + 5], 16) catch return error.InvalidUnicodeEscape;
-                var utf8_buf: [4]u8 = undefined;
-                const len = std.unicode.utf8Encode(code, &utf8_buf) catch return error.InvalidUnicodeEscape;
-                try out.appendSlice(allocator, utf8_buf[0..len]);
-                i += 4;
+                var encoded: [4]u8 = undefined;
+                _ = std.unicode.utf8Encode(code, &encoded) catch return error.InvalidUnicodeEscape;
+                i += 5;
             },
             else => return error.InvalidEscape,
         }
+        i = std.mem.indexOfScalarPos(u8, raw, i, '\\') orelse return;
     }
-
-    return try out.toOwnedSlice(allocator);
 }
 
-/// Old parseValue function - keeping for reference but unused
-fn parseValue(line: []const u8, tokens: []simd.Token, i: *usize, allocator: Allocator) !JsonValue {
-    _ = line;
-    _ = tokens;
-    _ = i;
-    _ = allocator;
-    return error.OldFunctionNotUsed;
+/// Copy `raw[start..]` up to the next backslash to `buffer[len.*..]`;
+/// returns where the copy stopped.
+fn copyRun(raw: []const u8, start: usize, buffer: []u8, len: *usize) usize {
+    const end = std.mem.indexOfScalarPos(u8, raw, start, '\\') orelse raw.len;
+    @memcpy(buffer[len.*..][0 .. end - start], raw[start..end]);
+    len.* += end - start;
+    return end;
 }
 
 /// Helper to get integer value from JsonValue
@@ -454,7 +778,7 @@ pub fn getInt(value: JsonValue) !i64 {
 /// Helper to get float value from JsonValue
 pub fn getFloat(value: JsonValue) !f64 {
     return switch (value) {
-        .number => |n| try simd.parseFloatFast(n),
+        .number => |n| number.parse(n) orelse error.InvalidCharacter,
         else => error.NotANumber,
     };
 }
@@ -568,6 +892,40 @@ test "parse escaped JSON strings" {
     try std.testing.expectEqualStrings("AB", try getString(obj.get("unicode").?));
 }
 
+test "projected parse skips unreferenced fields" {
+    const allocator = std.testing.allocator;
+    const line = "{\"id\":7,\"blob\":{\"x\":[1,{\"y\":\"}\"}],\"z\":\"a,b\"},\"tags\":[\"a\",\"b\"],\"address\":{\"city\":\"NYC\",\"zip\":\"10001\"},\"name\":\"Ann\"}";
+
+    var projection = Projection{};
+    defer projection.deinit(allocator);
+    try projection.addPath(allocator, "address.city");
+    try projection.addKey(allocator, "name");
+
+    var obj = try parseObjectProjected(line, allocator, &projection);
+    defer obj.deinit();
+
+    try std.testing.expectEqual(@as(usize, 2), obj.fields.len);
+    try std.testing.expectEqualStrings("Ann", try getString(obj.get("name").?));
+    const address = obj.get("address").?.object;
+    try std.testing.expectEqual(@as(usize, 1), address.fields.len);
+    try std.testing.expectEqualStrings("NYC", try getString(address.get("city").?));
+    try std.testing.expect(obj.get("blob") == null);
+    try std.testing.expect(obj.get("id") == null);
+}
+
+test "projection: whole key supersedes nested paths" {
+    const allocator = std.testing.allocator;
+
+    var projection = Projection{};
+    defer projection.deinit(allocator);
+    try projection.addPath(allocator, "address.city");
+    try projection.addPath(allocator, "address");
+    try projection.addPath(allocator, "address.zip");
+
+    try std.testing.expectEqual(@as(usize, 1), projection.entries.items.len);
+    try std.testing.expect(projection.lookup("address").?.child == null);
+}
+
 test "parse escaped string in array" {
     const line = "{\"tags\":[\"alpha\",\"line\\nbreak\"]}";
     var obj = try parseObject(line, std.testing.allocator);
@@ -578,3 +936,134 @@ test "parse escaped string in array" {
     try std.testing.expectEqualStrings("alpha", try getString(tags[0]));
     try std.testing.expectEqualStrings("line\nbreak", try getString(tags[1]));
 }
+
+test "parse nested arrays and objects from one index" {
+    const line = "{\"m\":[[1,2],[],{\"k\":[\"x\\ty\",{}]}],\"o\":{\"p\":{\"q\":\"]}\"}},\"e\":{}}";
+    var obj = try parseObject(line, std.testing.allocator);
+    defer obj.deinit();
+
+    const m = obj.get("m").?.array;
+    try std.testing.expectEqual(@as(usize, 3), m.len);
+    try std.testing.expectEqual(@as(usize, 2), m[0].array.len);
+    try std.testing.expectEqualStrings("2", m[0].array[1].number);
+    try std.testing.expectEqual(@as(usize, 0), m[1].array.len);
+    const k = m[2].object.get("k").?.array;
+    try std.testing.expectEqualStrings("x\ty", try getString(k[0]));
+    try std.testing.expectEqual(@as(usize, 0), k[1].object.fields.len);
+
+    const q = obj.get("o").?.object.get("p").?.object.get("q").?;
+    try std.testing.expectEqualStrings("]}", try getString(q));
+    try std.testing.expectEqual(@as(usize, 0), obj.get("e").?.object.fields.len);
+}
+
+test "parse wide object beyond any fixed token budget" {
+    const allocator = std.testing.allocator;
+    var line = std.ArrayList(u8){};
+    defer line.deinit(allocator);
+
+    try line.append(allocator, '{');
+    for (0..2000) |n| {
+        if (n > 0) try line.append(allocator, ',');
+        try line.writer(allocator).print("\"k{d}\":\"v{d}\"", .{ n, n });
+    }
+    try line.append(allocator, '}');
+
+    var obj = try parseObject(line.items, allocator);
+    defer obj.deinit();
+
+    try std.testing.expectEqual(@as(usize, 2000), obj.fields.len);
+    try std.testing.expectEqualStrings("v1999", try getString(obj.get("k1999").?));
+}
+
+test "wide objects are looked up through a hash index" {
+    const allocator = std.testing.allocator;
+    var line = std.ArrayList(u8){};
+    defer line.deinit(allocator);
+
+    try line.appendSlice(allocator, "{\"dup\":1");
+    for (0..JsonObject.index_threshold * 4) |n| try line.writer(allocator).print(",\"k{d}\":{d}", .{ n, n });
+    try line.appendSlice(allocator, ",\"dup\":2,\"\\u0065sc\":\"escaped\"}");
+
+    var obj = try parseObject(line.items, allocator);
+    defer obj.deinit();
+    try std.testing.expect(obj.slots != null);
+
+    for (0..JsonObject.index_threshold * 4) |n| {
+        var key_buf: [16]u8 = undefined;
+        const key = try std.fmt.bufPrint(&key_buf, "k{d}", .{n});
+        try std.testing.expectEqual(obj.indexOf(key), obj.indexOfHashed(key, JsonObject.hashKey(key)));
+        try std.testing.expectEqual(@as(i64, @intCast(n)), try getInt(obj.get(key).?));
+    }
+    // First duplicate wins, decoded keys are indexed, absent keys miss
+    try std.testing.expectEqual(@as(i64, 1), try getInt(obj.get("dup").?));
+    try std.testing.expectEqualStrings("escaped", try getString(obj.get("esc").?));
+    try std.testing.expect(obj.get("k") == null);
+    try std.testing.expect(obj.get("missing") == null);
+
+    var small = try parseObject("{\"a\":1}", allocator);
+    defer small.deinit();
+    try std.testing.expect(small.slots == null);
+    try std.testing.expect(small.getHashed("a", JsonObject.hashKey("a")) != null);
+}
+
+test "malformed objects are rejected" {
+    const allocator = std.testing.allocator;
+    try std.testing.expectError(error.UnexpectedEnd, parseObject("{\"a\":1", allocator));
+    try std.testing.expectError(error.ExpectedColon, parseObject("{\"a\" 1}", allocator));
+    try std.testing.expectError(error.MalformedKey, parseObject("{\"a", allocator));
+    try std.testing.expectError(error.InvalidJSON, parseObject("[1,2]", allocator));
+}
+
+test "skipped values are checked like parsed ones" {
+    const allocator = std.testing.allocator;
+    var projection = Projection{};
+    defer projection.deinit(allocator);
+    try projection.addKey(allocator, "id");
+
+    const malformed = [_][]const u8{
+        "{\"id\":1,\"x\":}",
+        "{\"id\":1,\"x\":bogus}",
+        "{\"id\":1,\"x\":01}",
+        "{\"id\":1,\"x\":1.}",
+        "{\"id\":1,\"x\":[1,,2]}",
+        "{\"id\":1,\"x\":[1}}",
+        "{\"id\":1,\"x\":{\"y\" 2}}",
+        "{\"id\":1,\"x\":\"\\q\"}",
+        "{\"id\":1,\"x\":{\"\\u12\":1}}",
+    };
+    for (malformed) |line| {
+        try std.testing.expect(std.meta.isError(parseObject(line, allocator)));
+        try std.testing.expect(std.meta.isError(parseObjectProjected(line, allocator, &projection)));
+    }
+
+    const valid = "{\"id\":1,\"x\":{\"a\":[-0.5e+3,true,null,[],{}],\"b\":\"\\u00e9\\n\"},\"y\":\"\"}";
+    var full = try parseObject(valid, allocator);
+    defer full.deinit();
+    var projected = try parseObjectProjected(valid, allocator, &projection);
+    defer projected.deinit();
+    try std.testing.expectEqual(@as(usize, 1), projected.fields.len);
+}
+
+test "scalar arrays parse without allocating" {
+    const allocator = std.testing.allocator;
+    var buffer: [4]JsonValue = undefined;
+    const cases = [_]struct { text: []const u8, len: ?usize }{
+        .{ .text = "[1, \"a\", true ,null]", .len = 4 },
+        .{ .text = "[ ]", .len = 0 },
+        .{ .text = "[1,2,3,4,5]", .len = null },
+        .{ .text = "[{\"a\":1}]", .len = null },
+        .{ .text = "[\"a\\\"b\"]", .len = null },
+    };
+    for (cases) |case| {
+        var tokens = std.ArrayList(simd.Token){};
+        defer tokens.deinit(allocator);
+        try simd.findJsonStructure(case.text, &tokens, allocator);
+        const items = try parseScalarArray(case.text, tokens.items, &buffer);
+        try std.testing.expectEqual(case.len, if (items) |i| i.len else null);
+    }
+
+    var tokens = std.ArrayList(simd.Token){};
+    defer tokens.deinit(allocator);
+    try simd.findJsonStructure("[1,,2]", &tokens, allocator);
+    try std.testing.expectError(error.UnexpectedToken, parseScalarArray("[1,,2]", tokens.items, &buffer));
+}
@@ -0,0 +1,224 @@
+const std = @import("std");
+const json_parser = @import("json_parser.zig");
+const number = @import("number.zig");
+const query = @import("query.zig");
+const plan = @import("plan.zig");
+const simd = @import("simd.zig");
+
+/// Filters fixed at compile time.
+///
+/// Each builder returns a type whose `matches` is a straight-line function
+/// specialised to the filter's shape, paths and constant types: paths are
+/// split at compile time, conjunctions are unrolled, and constants are
+/// compared without switching on their type. Every kernel also carries the
+/// equivalent runtime `filter`, which the parallel paths use to derive the
+/// prefilter and projection.
+///
+///     const Active = kernel.All(.{ kernel.Eq("city", "NYC"), kernel.Gte("age", 30) });
+///     var result = try api.queryDataCompiled(data, Active, .{}, allocator);
+///
+/// Constants may be strings, numbers, booleans or `null`. Matching is
+/// identical to `query.matches` on `filter`.
+pub fn Eq(comptime field: []const u8, comptime value: anytype) type {
+    return Compare(field, .eq, value);
+}
+
+pub fn Ne(comptime field: []const u8, comptime value: anytype) type {
+    return Compare(field, .ne, value);
+}
+
+pub fn Gt(comptime field: []const u8, comptime value: anytype) type {
+    return Compare(field, .gt, value);
+}
+
+pub fn Gte(comptime field: []const u8, comptime value: anytype) type {
+    return Compare(field, .gte, value);
+}
+
+pub fn Lt(comptime field: []const u8, comptime value: anytype) type {
+    return Compare(field, .lt, value);
+}
+
+pub fn Lte(comptime field: []const u8, comptime value: anytype) type {
+    return Compare(field, .lte, value);
+}
+
+pub fn Exists(comptime field: []const u8) type {
+    return Presence(field, true);
+}
+
+pub fn Missing(comptime field: []const u8) type {
+    return Presence(field, false);
+}
+
+/// Every kernel in the tuple `kernels` matches.
+pub fn All(comptime kernels: anytype) type {
+    return Logical(.@"and", kernels);
+}
+
+/// At least one kernel in the tuple `kernels` matches.
+pub fn Any(comptime kernels: anytype) type {
+    return Logical(.@"or", kernels);
+}
+
+/// No kernel in the tuple `kernels` matches.
+pub fn None(comptime kernels: anytype) type {
+    return Logical(.nor, kernels);
+}
+
+pub fn Not(comptime K: type) type {
+    return Logical(.not, .{K});
+}
+
+/// Adapt a kernel type for `Plan.kernel` / `Config.kernel`.
+pub fn planKernel(comptime K: type) plan.Kernel {
+    return struct {
+        fn match(_: *const plan.Plan, obj: *const json_parser.JsonObject) bool {
+            return K.matches(obj);
+        }
+    }.match;
+}
+
+fn Compare(comptime field: []const u8, comptime op: query.Comparison.CompOp, comptime value: anytype) type {
+    const constant = constantOf(value);
+    return struct {
+        pub const filter: query.Filter = .{ .comparison = .{ .field = field, .op = op, .value = constant } };
+
+        pub fn matches(obj: *const json_parser.JsonObject) bool {
+            const found = lookup(field, obj.*) orelse return false;
+            return switch (op) {
+                .eq => equals(found),
+                .ne => !equals(found),
+                .gt => order(found) == .gt,
+                .gte => order(found) != .lt,
+                .lt => order(found) == .lt,
+                .lte => order(found) != .gt,
+            };
+        }
+
+        inline fn equals(found: json_parser.JsonValue) bool {
+            return switch (constant) {
+                .null_value => found == .null_value,
+                .bool_value => |b| found == .bool_value and found.bool_value == b,
+                .number => |n| found == .number and (number.parse(found.number) orelse return false) == n,
+                .string => |s| found == .string and std.mem.eql(u8, found.string, s),
+            };
+        }
+
+        /// Values that cannot be ordered compare as equal, as in `query.compareValues`
+        inline fn order(found: json_parser.JsonValue) std.math.Order {
+            return switch (constant) {
+                .number => |n| if (found == .number) std.math.order(number.parse(found.number) orelse return .eq, n) else .eq,
+                .string => |s| if (found == .string) std.mem.order(u8, found.string, s) else .eq,
+                .null_value, .bool_value => .eq,
+            };
+        }
+    };
+}
+
+fn Presence(comptime field: []const u8, comptime should_exist: bool) type {
+    return struct {
+        pub const filter: query.Filter = .{ .exists = .{ .field = field, .should_exist = should_exist } };
+
+        pub fn matches(obj: *const json_parser.JsonObject) bool {
+            return (lookup(field, obj.*) != null) == should_exist;
+        }
+    };
+}
+
+fn Logical(comptime op: query.Logical.LogicalOp, comptime kernels: anytype) type {
+    const fields = @typeInfo(@TypeOf(kernels)).@"struct".fields;
+    if (fields.len == 0) @compileError("a logical kernel needs at least one operand");
+    return struct {
+        var operands: [fields.len]query.Filter = blk: {
+            var filters: [fields.len]query.Filter = undefined;
+            for (&filters, 0..) |*f, i| f.* = kernels[i].filter;
+            break :blk filters;
+        };
+        pub const filter: query.Filter = .{ .logical = .{ .op = op, .operands = &operands } };
+
+        pub fn matches(obj: *const json_parser.JsonObject) bool {
+            switch (op) {
+                .@"and" => {
+                    inline for (kernels) |K| if (!K.matches(obj)) return false;
+                    return true;
+                },
+                .@"or" => {
+                    inline for (kernels) |K| if (K.matches(obj)) return true;
+                    return false;
+                },
+                .nor => {
+                    inline for (kernels) |K| if (K.matches(obj)) return false;
+                    return true;
+                },
+                .not => return !kernels[0].matches(obj),
+            }
+        }
+    };
+}
+
+fn constantOf(comptime value: anytype) query.Value {
+    return switch (@typeInfo(@TypeOf(value))) {
+        .comptime_int, .comptime_float => .{ .number = value },
+        .int => .{ .number = @floatFromInt(value) },
+        .float => .{ .number = @floatCast(value) },
+        .bool => .{ .bool_value = value },
+        .null => .{ .null_value = {} },
+        .pointer => .{ .string = value },
+        else => @compileError("unsupported kernel constant type " ++ @typeName(@TypeOf(value))),
+    };
+}
+
+/// Resolve a dotted path whose segments are known at compile time.
+fn lookup(comptime path: []const u8, obj: json_parser.JsonObject) ?json_parser.JsonValue {
+    const dot = comptime std.mem.indexOfScalar(u8, path, '.');
+    if (dot) |d| {
+        const value = get(obj, path[0..d]) orelse return null;
+        return if (value == .object) lookup(path[d + 1 ..], value.object) else null;
+    }
+    return get(obj, path);
+}
+
+inline fn get(obj: json_parser.JsonObject, comptime key: []const u8) ?json_parser.JsonValue {
+    if (obj.slots != null) return obj.getHashed(key, comptime json_parser.JsonObject.hashKey(key));
+    for (obj.fields) |field| {
+        if (field.key.len == key.len and simd.stringsEqualFast(field.key, key)) return field.value;
+    }
+    return null;
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+test "kernel: matches exactly like the runtime filter" {
+    const allocator = std.testing.allocator;
+    const records = [_][]const u8{
+        "{\"city\":\"NYC\",\"age\":30,\"user\":{\"tier\":\"gold\"},\"vip\":true}",
+        "{\"age\":\"n/a\",\"city\":\"LA\",\"user\":{\"tier\":\"free\"}}",
+        "{\"city\":\"NYC\",\"age\":64.5,\"note\":null}",
+        "{\"user\":\"flat\",\"age\":12}",
+    };
+
+    const kernels = .{
+        Eq("city", "NYC"),
+        Gte("age", 30),
+        Lt("age", 64.5),
+        Ne("user.tier", "gold"),
+        Eq("note", null),
+        Eq("vip", true),
+        Missing("user"),
+        All(.{ Eq("city", "NYC"), Gt("age", 18), Lte("age", 40) }),
+        Any(.{ Eq("user.tier", "gold"), Exists("note") }),
+        None(.{ Eq("city", "LA"), Lt("age", 20) }),
+        Not(Gt("age", 50)),
+    };
+
+    for (records) |record| {
+        var obj = try json_parser.parseObject(record, allocator);
+        defer obj.deinit();
+        inline for (kernels) |K| {
+            try std.testing.expectEqual(query.matches(&obj, &K.filter), K.matches(&obj));
+        }
+    }
+}
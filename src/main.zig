@@ -2,8 +2,15 @@ const std = @import("std");
 const cli = @import("cli.zig");
 const query = @import("query.zig");
 const parallel = @import("parallel_ndjson.zig");
+const stream = @import("stream.zig");
+const follow = @import("follow.zig");
+const index = @import("index.zig");
 const output = @import("output.zig");
 const json_parser = @import("json_parser.zig");
+const timing = @import("stats.zig");
+const compress = @import("compress.zig");
+const aggregate = @import("aggregate.zig");
+const sort = @import("sort.zig");
 
 pub fn main() !void {
     const allocator = std.heap.c_allocator;
@@ -39,75 +46,273 @@ pub fn main() !void {
     };
     defer parsed_query.deinit(allocator);
 
+    // --stats: every stage adds its time here; reported once the output is done
+    var query_stats = timing.Stats.init(allocator);
+    defer query_stats.deinit();
+    const stats: ?*timing.Stats = if (options.show_stats) &query_stats else null;
+    var wall = std.time.Timer.start() catch null;
+    defer if (stats) |s| {
+        if (wall) |*w| s.total_ns = w.read();
+        printStats(s, allocator);
+    };
+
     // Check we have an input file
-    const file_path = options.input_file orelse {
+    const paths = options.input_files;
+    if (paths.len == 0) {
         std.debug.print("Error: No input file specified\n", .{});
         std.debug.print("Usage: zson '{{query}}' <file.ndjson>\n", .{});
         std.process.exit(1);
-    };
+    }
+    const from_stdin = for (paths) |path| {
+        if (std.mem.eql(u8, path, "-")) break true;
+    } else false;
+    if (from_stdin and paths.len > 1) {
+        std.debug.print("Error: stdin ('-') cannot be combined with other input files\n", .{});
+        std.process.exit(1);
+    }
+
+    // --group-by and the aggregates output one row per group instead of records
+    const aggregating = options.group_by != null or options.aggregates.len > 0;
+    const spec = aggregate.Spec{ .group_by = options.group_by, .aggregates = options.aggregates };
+    // --sort-by needs every match before the first can be written
+    const order: ?sort.Order = if (options.sort_by) |field| .{ .field = field, .descending = options.descending } else null;
+
+    // ── --follow: filter the file as it grows ────────────────────────────────
+    if (options.follow) {
+        const counting = options.count_only or options.assert_count != null;
+        if (from_stdin or paths.len != 1 or aggregating or order != null or counting or options.output_format != .ndjson) {
+            std.debug.print("Error: --follow takes one input file and outputs NDJSON records\n", .{});
+            std.process.exit(1);
+        }
+        if (try compress.detectFile(paths[0]) != .none) {
+            std.debug.print("Error: --follow cannot read compressed input\n", .{});
+            std.process.exit(1);
+        }
+        var stdout_buffer: [64 * 1024]u8 = undefined;
+        var stdout_writer = std.fs.File.stdout().writer(&stdout_buffer);
+        _ = try follow.followPath(
+            paths[0],
+            &parsed_query.filter,
+            .{ .num_threads = options.threads, .limit = options.limit, .stats = stats },
+            options.select_fields,
+            &stdout_writer.interface,
+            allocator,
+        );
+        return;
+    }
+
+    // ── file paths: use fast streaming output when flags allow it ────────────
+    // Every file shares one worker pool; output follows the order given.
+    if (!from_stdin) {
+        const file_indexes = try allocator.alloc(?index.Index, paths.len);
+        defer allocator.free(file_indexes);
+        @memset(file_indexes, null);
+        defer {
+            for (file_indexes) |*idx| if (idx.*) |*i| i.deinit();
+        }
+        // Offsets into a compressed file mean nothing to an index; any of the
+        // paths may be one
+        var compressed = false;
+        for (file_indexes, paths) |*idx, path| {
+            const packed_input = try compress.detectFile(path) != .none;
+            compressed = compressed or packed_input;
+            if (options.use_index and !packed_input) idx.* = openIndex(path, options, allocator);
+        }
+        const index_ptrs = try allocator.alloc(?*const index.Index, paths.len);
+        defer allocator.free(index_ptrs);
+        var indexed = false;
+        for (index_ptrs, file_indexes) |*ptr, *idx| {
+            ptr.* = if (idx.*) |*i| i else null;
+            indexed = indexed or ptr.* != null;
+        }
+
+        const config = parallel.Config{
+            .num_threads = options.threads,
+            // A sort has to see every match; the limit only bounds its top-k heaps
+            .limit = if (order == null) options.limit else null,
+            .stats = stats,
+            .with_filename = options.with_filename,
+            .io = options.io,
+        };
+
+        if (aggregating) {
+            var table = try parallel.processFilesAggregate(paths, index_ptrs, &parsed_query.filter, config, &spec, allocator);
+            defer table.deinit();
+            try writeGroups(&table, options, stats, allocator);
+            return;
+        }
 
-    // ── file path: use fast streaming output when flags allow it ─────────────
-    if (!std.mem.eql(u8, file_path, "-")) {
-        if ((options.count_only or options.assert_count != null) and options.limit == null) {
+        if (options.count_only or options.assert_count != null) {
             // Fast count-only path: no object materialisation, just atomic counters
-            const count = try parallel.processFileCount(
-                file_path,
+            var count_config = config;
+            count_config.limit = countLimit(options);
+            // Streamed, a compressed file is decompressed piece by piece
+            const count = if (compressed and paths.len == 1)
+                (try stream.streamPath(paths[0], &parsed_query.filter, count_config, null, null, allocator)).matches
+            else
+                try parallel.processFilesCount(paths, index_ptrs, &parsed_query.filter, count_config, allocator);
+            try maybeAssertCount(count, options.assert_count);
+            if (options.count_only) try writeCount(count);
+            return;
+        }
+
+        if (order == null and options.output_format == .ndjson and (indexed or paths.len > 1 or options.with_filename)) {
+            // Indexed output: only the blocks the index cannot rule out are
+            // scanned, so the whole file is never streamed through. Each
+            // block's matches go to stdout once the blocks before it are out.
+            // Several files are scanned the same way, as one run of morsels.
+            try parallel.processFilesToFile(
+                paths,
+                index_ptrs,
                 &parsed_query.filter,
-                .{ .num_threads = options.threads },
+                config,
+                options.select_fields,
+                std.fs.File.stdout(),
                 allocator,
             );
-            try maybeAssertCount(count, options.assert_count);
-            if (options.count_only) try writeCount(count);
             return;
         }
 
-        if (options.output_format == .ndjson and options.limit == null) {
-            // Fast default output path: worker threads serialize NDJSON directly.
-            var output_buffer = try parallel.processFileWithOutput(
-                file_path,
+        if (order == null and options.output_format == .ndjson) {
+            // Fast default output path: worker threads serialize NDJSON directly
+            // and chunks are flushed in order as soon as they are done.
+            var stdout_buffer: [64 * 1024]u8 = undefined;
+            var stdout_writer = std.fs.File.stdout().writer(&stdout_buffer);
+            _ = try stream.streamPath(
+                paths[0],
                 &parsed_query.filter,
-                .{ .num_threads = options.threads },
+                config,
                 options.select_fields,
+                &stdout_writer.interface,
                 allocator,
             );
-            defer output_buffer.deinit(allocator);
-            try writeStdout(output_buffer.items);
             return;
         }
 
-        var result = try parallel.processFile(
-            file_path,
-            &parsed_query.filter,
-            .{ .num_threads = options.threads },
-            allocator,
-        );
+        if (order == null and options.limit == null and !options.with_filename) {
+            // JSON arrays and CSV: workers serialize their own morsels, which
+            // are stitched in order between the brackets or after the header
+            try parallel.processFilesToFileStyled(
+                paths,
+                index_ptrs,
+                &parsed_query.filter,
+                config,
+                options.select_fields,
+                .{ .format = options.output_format, .pretty = options.pretty },
+                std.fs.File.stdout(),
+                allocator,
+            );
+            return;
+        }
+
+        // The top of a sort under --limit comes from bounded per-worker heaps
+        var result = if (order != null and options.limit != null)
+            try parallel.processFilesTopK(paths, index_ptrs, &parsed_query.filter, config, order.?, options.limit.?, allocator)
+        else
+            try parallel.processFiles(paths, index_ptrs, &parsed_query.filter, config, allocator);
         defer result.deinit();
+        try sortMatches(&result, order, options, stats, allocator);
 
-        const objects = limitedObjects(result.matches.items, options.limit);
-        try writeResults(objects, options, allocator);
+        // --select drops the filename field unless it is selected too
+        var output_options = options;
+        var tagged_fields: ?[]const []const u8 = null;
+        defer if (tagged_fields) |fields| allocator.free(fields);
+        if (options.with_filename) {
+            if (options.select_fields) |fields| {
+                tagged_fields = try std.mem.concat(allocator, []const u8, &.{ &.{parallel.filename_key}, fields });
+                output_options.select_fields = tagged_fields;
+            }
+        }
+
+        const objects = sort.limited(result.matches.items, options.limit);
+        try writeResults(objects, output_options, stats, allocator);
         return;
     }
 
     // ── stdin path ────────────────────────────────────────────────────────────
-    var result = try processStdin(&parsed_query.filter, options, allocator);
+    if (aggregating) {
+        const data = try readStdin(stats, allocator);
+        defer allocator.free(data);
+        const cfg = parallel.Config{ .num_threads = options.threads, .stats = stats };
+        var table = try parallel.processDataAggregate(data, &parsed_query.filter, cfg, &spec, allocator);
+        defer table.deinit();
+        try writeGroups(&table, options, stats, allocator);
+        return;
+    }
+
+    // Bounded memory: stdin is filtered chunk by chunk as it arrives
+    const counting = options.count_only or options.assert_count != null;
+    if (counting or (order == null and options.output_format == .ndjson)) {
+        var stdout_buffer: [64 * 1024]u8 = undefined;
+        var stdout_writer = std.fs.File.stdout().writer(&stdout_buffer);
+        const summary = try stream.streamFile(
+            std.fs.File.stdin(),
+            &parsed_query.filter,
+            .{ .num_threads = options.threads, .limit = if (counting) countLimit(options) else options.limit, .stats = stats },
+            if (counting) null else options.select_fields,
+            if (counting) null else &stdout_writer.interface,
+            allocator,
+        );
+        if (counting) {
+            try maybeAssertCount(summary.matches, options.assert_count);
+            if (options.count_only) try writeCount(summary.matches);
+        }
+        return;
+    }
+
+    var result = try processStdin(&parsed_query.filter, options, order, stats, allocator);
     defer result.deinit();
+    try sortMatches(&result, order, options, stats, allocator);
 
     // Apply limit if specified
-    const objects = limitedObjects(result.matches.items, options.limit);
-    try writeResults(objects, options, allocator);
+    const objects = sort.limited(result.matches.items, options.limit);
+    try writeResults(objects, options, stats, allocator);
 }
 
-fn limitedObjects(
-    objects: []const json_parser.JsonObject,
-    limit: ?usize,
-) []const json_parser.JsonObject {
-    if (limit) |n| return objects[0..@min(n, objects.len)];
-    return objects;
+/// Sort all matches for --sort-by without --limit; with a limit they come
+/// sorted from the top-k workers already.
+fn sortMatches(
+    result: *parallel.ChunkResult,
+    order: ?sort.Order,
+    options: cli.CliOptions,
+    stats: ?*timing.Stats,
+    allocator: std.mem.Allocator,
+) !void {
+    const o = order orelse return;
+    if (options.limit != null) return;
+    var span = timing.Span.start(stats);
+    defer span.end(.output);
+    try sort.sortObjects(result.matches.items, o, options.threads, allocator);
+}
+
+fn printStats(stats: *const timing.Stats, allocator: std.mem.Allocator) void {
+    var buf = std.ArrayList(u8){};
+    defer buf.deinit(allocator);
+    stats.write(buf.writer(allocator)) catch return;
+    std.debug.print("{s}", .{buf.items});
+}
+
+/// Load the sidecar index for `file_path`, building it if it is missing or
+/// stale. Falls back to a full scan when no index can be used.
+fn openIndex(file_path: []const u8, options: cli.CliOptions, allocator: std.mem.Allocator) ?index.Index {
+    return index.Index.openOrBuild(file_path, .{ .num_threads = options.threads }, allocator) catch |err| {
+        std.debug.print("Warning: not using an index: {}\n", .{err});
+        return null;
+    };
+}
+
+/// How many matches a count needs to see: `--limit` caps the count, and
+/// `--assert-count N` fails as soon as a match beyond N turns up.
+fn countLimit(options: cli.CliOptions) ?usize {
+    const expected = options.assert_count orelse return options.limit;
+    const needed = expected +| 1;
+    return if (options.limit) |limit| @min(limit, needed) else needed;
 }
 
 fn writeResults(
     objects: []const json_parser.JsonObject,
     options: cli.CliOptions,
+    stats: ?*timing.Stats,
     allocator: std.mem.Allocator,
 ) !void {
     try maybeAssertCount(objects.len, options.assert_count);
@@ -122,20 +327,40 @@ fn writeResults(
     defer output_buf.deinit(allocator);
     const writer = output_buf.writer(allocator);
 
+    var serialize = timing.Span.start(stats);
     switch (options.output_format) {
         .ndjson => try output.writeNdjson(writer, objects, options.select_fields),
         .json => try output.writeJson(writer, objects, options.select_fields, options.pretty),
         .csv => try output.writeCsv(writer, objects, options.select_fields),
     }
+    serialize.end(.output);
 
+    var write = timing.Span.start(stats);
+    defer write.end(.write);
     try writeStdout(output_buf.items);
 }
 
+/// Write the rows of an aggregation in the chosen output format. `--count`
+/// is implied by the per-group counts; `--limit` keeps the first groups.
+fn writeGroups(table: *aggregate.Table, options: cli.CliOptions, stats: ?*timing.Stats, allocator: std.mem.Allocator) !void {
+    var span = timing.Span.start(stats);
+    const rows = try table.rows();
+    span.end(.output);
+    var output_options = options;
+    output_options.count_only = false;
+    try writeResults(sort.limited(rows, options.limit), output_options, stats, allocator);
+}
+
 fn maybeAssertCount(actual: usize, expected: ?usize) !void {
     const expected_count = expected orelse return;
     if (actual == expected_count) return;
 
-    std.debug.print("assert-count failed: expected {d}, got {d}\n", .{ expected_count, actual });
+    // Counts stop one past the expectation, so a larger count is only a lower bound
+    if (actual > expected_count) {
+        std.debug.print("assert-count failed: expected {d}, got more than {d}\n", .{ expected_count, expected_count });
+    } else {
+        std.debug.print("assert-count failed: expected {d}, got {d}\n", .{ expected_count, actual });
+    }
     std.process.exit(1);
 }
 
@@ -152,18 +377,32 @@ fn writeStdout(bytes: []const u8) !void {
 fn processStdin(
     filter: *const query.Filter,
     options: cli.CliOptions,
+    order: ?sort.Order,
+    stats: ?*timing.Stats,
     allocator: std.mem.Allocator,
 ) !parallel.ChunkResult {
-    const stdin_file = std.fs.File.stdin();
-    const data = try stdin_file.readToEndAlloc(allocator, 4 * 1024 * 1024 * 1024); // up to 4 GB
-    const cfg = parallel.Config{ .num_threads = options.threads };
-    var result = try parallel.processData(data, filter, cfg, allocator);
-    if (result.owned_data == null) {
-        // NDJSON: matched field slices point into data; transfer ownership to result
-        result.owned_data = data;
-    } else {
-        // JSON array: processData owns the converted NDJSON buffer; free original
+    const data = try readStdin(stats, allocator);
+    // A sort has to see every match, so the limit only bounds the top-k heaps
+    const cfg = parallel.Config{ .num_threads = options.threads, .limit = if (order == null) options.limit else null, .stats = stats };
+    const processed = if (order != null and options.limit != null)
+        parallel.processDataTopK(data, filter, cfg, order.?, options.limit.?, allocator)
+    else
+        parallel.processData(data, filter, cfg, allocator);
+    var result = processed catch |err| {
         allocator.free(data);
-    }
+        return err;
+    };
+    // Matched field slices point into data; transfer ownership to result
+    result.owned_data = data;
     return result;
 }
+
+/// All of stdin, decompressed if it is gzip or zstd.
+fn readStdin(stats: ?*timing.Stats, allocator: std.mem.Allocator) ![]u8 {
+    var read = timing.Span.start(stats);
+    defer read.end(.read);
+    const data = try std.fs.File.stdin().readToEndAlloc(allocator, 4 * 1024 * 1024 * 1024); // up to 4 GB
+    if (compress.detect(data) == .none) return data;
+    defer allocator.free(data);
+    return compress.decompressAll(data, allocator);
+}
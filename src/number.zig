@@ -0,0 +1,213 @@
+const std = @import("std");
+const simd = @import("simd.zig");
+
+/// Integers with this many digits or fewer are exact in an `f64`, so
+/// comparing their text on the bytes (`Integer.order`) agrees with comparing
+/// parsed values.
+pub const max_exact_digits = 15;
+
+/// The value of number text, or null when it is not a number.
+///
+/// Number values stay as their JSON text (`JsonValue.number`) until a
+/// filter, sort or aggregate needs them. Digits are read eight at a time,
+/// and a number of at most 19 digits with a small exponent becomes an `f64`
+/// with one exact multiply or divide (Clinger's fast path). Everything else
+/// goes through `std.fmt.parseFloat` (Eisel-Lemire, with a slow fallback).
+pub fn parse(text: []const u8) ?f64 {
+    const negative = text.len > 0 and text[0] == '-';
+    var i: usize = @intFromBool(negative);
+    var mantissa: u64 = 0;
+
+    const integer_start = i;
+    i = scanDigits(text, i, &mantissa);
+    var digits = i - integer_start;
+    if (digits == 0) return parseSlow(text);
+
+    var exponent: i64 = 0;
+    if (i < text.len and text[i] == '.') {
+        i += 1;
+        const fraction_start = i;
+        i = scanDigits(text, i, &mantissa);
+        if (i == fraction_start) return parseSlow(text);
+        digits += i - fraction_start;
+        exponent = -@as(i64, @intCast(i - fraction_start));
+    }
+    if (i < text.len and (text[i] == 'e' or text[i] == 'E')) {
+        i += 1;
+        const exponent_negative = i < text.len and text[i] == '-';
+        if (i < text.len and (text[i] == '-' or text[i] == '+')) i += 1;
+        const exponent_start = i;
+        var written: i64 = 0;
+        while (i < text.len and std.ascii.isDigit(text[i]) and i - exponent_start < 4) : (i += 1) {
+            written = written * 10 + (text[i] - '0');
+        }
+        if (i == exponent_start) return parseSlow(text);
+        exponent += if (exponent_negative) -written else written;
+    }
+    // Trailing bytes, a mantissa that may have wrapped, or a huge exponent
+    if (i != text.len or digits > 19) return parseSlow(text);
+
+    // Both operands are exact, so the one rounding is the correct one
+    if (mantissa > 1 << 53 or exponent < -22 or exponent > 22) return parseSlow(text);
+    var value: f64 = @floatFromInt(mantissa);
+    if (exponent < 0) {
+        value /= powers_of_ten[@intCast(-exponent)];
+    } else {
+        value *= powers_of_ten[@intCast(exponent)];
+    }
+    return if (negative) -value else value;
+}
+
+fn parseSlow(text: []const u8) ?f64 {
+    return std.fmt.parseFloat(f64, text) catch null;
+}
+
+/// Exact up to 1e22
+const powers_of_ten = table: {
+    var table: [23]f64 = undefined;
+    var power: f64 = 1;
+    for (&table) |*entry| {
+        entry.* = power;
+        power *= 10;
+    }
+    break :table table;
+};
+
+/// Add the digits at `text[start..]` to `mantissa`, eight at a time; returns
+/// where they end. Past 19 digits the mantissa wraps, which `parse` rejects.
+fn scanDigits(text: []const u8, start: usize, mantissa: *u64) usize {
+    var i = start;
+    while (i + 8 <= text.len) : (i += 8) {
+        const chunk = std.mem.readInt(u64, text[i..][0..8], .little);
+        if (!simd.isEightDigits(chunk)) break;
+        mantissa.* = mantissa.* *% 100_000_000 +% simd.parseEightDigits(chunk);
+    }
+    while (i < text.len and std.ascii.isDigit(text[i])) : (i += 1) {
+        mantissa.* = mantissa.* *% 10 +% (text[i] - '0');
+    }
+    return i;
+}
+
+/// One field's number text, tested against several constants.
+pub const Number = struct {
+    text: []const u8,
+    /// The digits, without sign, when `text` is a plain integer of at most
+    /// `max_exact_digits` digits
+    magnitude: ?[]const u8,
+    /// Below zero; never set for `-0`
+    negative: bool,
+    value: ?f64 = null,
+    parsed: bool = false,
+
+    pub fn init(text: []const u8) Number {
+        const sign = text.len > 0 and text[0] == '-';
+        const digits = text[@intFromBool(sign)..];
+        const plain = digits.len > 0 and digits.len <= max_exact_digits and
+            (digits[0] != '0' or digits.len == 1) and allDigits(digits);
+        return .{
+            .text = text,
+            .magnitude = if (plain) digits else null,
+            .negative = sign and plain and digits[0] != '0',
+        };
+    }
+
+    /// The parsed value, or null when the text is not a number. Parsed on
+    /// first use only.
+    pub fn float(self: *Number) ?f64 {
+        if (!self.parsed) {
+            self.value = parse(self.text);
+            self.parsed = true;
+        }
+        return self.value;
+    }
+};
+
+fn allDigits(digits: []const u8) bool {
+    if (digits.len >= 8 and !simd.isEightDigits(std.mem.readInt(u64, digits[0..8], .little))) return false;
+    for (digits[if (digits.len >= 8) 8 else 0..]) |c| {
+        if (!std.ascii.isDigit(c)) return false;
+    }
+    return true;
+}
+
+/// An integral constant of at most `max_exact_digits` digits, kept as the
+/// digits its JSON text would have.
+pub const Integer = struct {
+    negative: bool,
+    len: u8,
+    buffer: [max_exact_digits]u8,
+
+    /// Null when `value` has a fraction or too many digits.
+    pub fn of(value: f64) ?Integer {
+        if (value != @trunc(value) or @abs(value) >= 1e15) return null;
+        const magnitude: u64 = @intFromFloat(@abs(value));
+        var integer = Integer{ .negative = value < 0 and magnitude != 0, .len = 0, .buffer = undefined };
+        integer.len = @intCast((std.fmt.bufPrint(&integer.buffer, "{d}", .{magnitude}) catch unreachable).len);
+        return integer;
+    }
+
+    pub fn digits(self: *const Integer) []const u8 {
+        return self.buffer[0..self.len];
+    }
+
+    /// How `number` orders against this constant, decided on the bytes.
+    /// Null when `number` is not plain integer text.
+    pub fn order(self: *const Integer, number: *const Number) ?std.math.Order {
+        const magnitude = number.magnitude orelse return null;
+        if (number.negative != self.negative) return if (number.negative) .lt else .gt;
+        const by_magnitude = if (magnitude.len != self.len)
+            std.math.order(magnitude.len, self.len)
+        else
+            std.mem.order(u8, magnitude, self.digits());
+        return if (number.negative) by_magnitude.invert() else by_magnitude;
+    }
+};
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+test "number: the fast path agrees with std.fmt.parseFloat" {
+    const texts = [_][]const u8{
+        "0",                    "-0",       "7",                      "-42",
+        "1700000000123",        "12345678", "00012",                  "9007199254740993",
+        "12345678901234567890", "3.14159",  "-0.000123",              "0.1",
+        "123456789.123456789",  "1e2",      "2.5E-3",                 "1e22",
+        "1e23",                 "4.9e-324", "1.7976931348623157e308",
+    };
+    for (texts) |text| {
+        try std.testing.expectEqual(std.fmt.parseFloat(f64, text) catch unreachable, parse(text).?);
+    }
+
+    var prng = std.Random.DefaultPrng.init(25);
+    const random = prng.random();
+    var buffer: [64]u8 = undefined;
+    for (0..10_000) |_| {
+        const value = @as(f64, @floatFromInt(random.int(i32))) / std.math.pow(f64, 10, @floatFromInt(random.uintLessThan(u8, 12)));
+        const text = try std.fmt.bufPrint(&buffer, "{d}", .{value});
+        try std.testing.expectEqual(try std.fmt.parseFloat(f64, text), parse(text).?);
+    }
+
+    for ([_][]const u8{ "", "-", "1.", ".5", "1e", "1x", "--1" }) |text| {
+        try std.testing.expectEqual(std.fmt.parseFloat(f64, text) catch null, parse(text));
+    }
+}
+
+test "number: integer text orders on its bytes like the parsed values" {
+    const texts = [_][]const u8{ "0", "-0", "9", "10", "-10", "199", "200", "-1000000", "123456789012345", "7.5", "1e3", "0123" };
+    const constants = [_]f64{ 0, 9, 10, -10, 150, 200, -999999, 123456789012345, 0.5, 1e15 };
+    for (constants) |constant| {
+        for (texts) |text| {
+            var number = Number.init(text);
+            const integer = Integer.of(constant) orelse {
+                try std.testing.expect(constant != @trunc(constant) or constant >= 1e15);
+                continue;
+            };
+            const by_bytes = integer.order(&number) orelse {
+                try std.testing.expect(number.magnitude == null);
+                continue;
+            };
+            try std.testing.expectEqual(std.math.order(number.float().?, constant), by_bytes);
+        }
+    }
+}
@@ -1,6 +1,7 @@
 const std = @import("std");
 const json_parser = @import("json_parser.zig");
 const cli = @import("cli.zig");
+const simd = @import("simd.zig");
 
 /// Write results in NDJSON format (one JSON object per line)
 pub fn writeNdjson(
@@ -14,6 +15,36 @@ pub fn writeNdjson(
     }
 }
 
+/// Output format of a query, as chosen on the command line
+pub const Style = struct {
+    format: cli.OutputFormat = .ndjson,
+    pretty: bool = false,
+};
+
+/// What a JSON array or CSV table puts around its records, so records
+/// serialized separately (one buffer per morsel) can be stitched together:
+/// every record is written with `separator` in front of it
+/// (`writeRecord`), and the first one written drops it.
+pub const Framing = struct {
+    /// Before the first record
+    open: []const u8 = "",
+    /// After the last record
+    close: []const u8 = "",
+    /// The whole output when there are no records
+    empty: []const u8 = "",
+    separator: []const u8 = "",
+
+    pub fn of(style: Style) Framing {
+        return switch (style.format) {
+            .ndjson, .csv => .{},
+            .json => if (style.pretty)
+                .{ .open = "[\n  ", .close = "\n]\n", .empty = "[]\n", .separator = ",\n  " }
+            else
+                .{ .open = "[", .close = "]", .empty = "[]", .separator = "," },
+        };
+    }
+};
+
 /// Write results as a JSON array
 pub fn writeJson(
     writer: anytype,
@@ -21,33 +52,15 @@ pub fn writeJson(
     select_fields: ?[]const []const u8,
     pretty: bool,
 ) !void {
-    try writer.writeByte('[');
-
-    if (pretty and objects.len > 0) {
-        try writer.writeByte('\n');
-    }
+    const framing = Framing.of(.{ .format = .json, .pretty = pretty });
+    if (objects.len == 0) return writer.writeAll(framing.empty);
 
+    try writer.writeAll(framing.open);
     for (objects, 0..) |obj, i| {
-        if (pretty) {
-            try writer.writeAll("  ");
-        }
-
+        if (i > 0) try writer.writeAll(framing.separator);
         try writeJsonObject(writer, &obj, select_fields, pretty);
-
-        if (i < objects.len - 1) {
-            try writer.writeByte(',');
-        }
-
-        if (pretty) {
-            try writer.writeByte('\n');
-        }
-    }
-
-    try writer.writeByte(']');
-
-    if (pretty) {
-        try writer.writeByte('\n');
     }
+    try writer.writeAll(framing.close);
 }
 
 /// Write results in CSV format
@@ -57,41 +70,72 @@ pub fn writeCsv(
     select_fields: ?[]const []const u8,
 ) !void {
     if (objects.len == 0) return;
+    try writeCsvHeader(writer, &objects[0], select_fields);
+    for (objects) |obj| try writeCsvRow(writer, &obj, select_fields);
+}
 
-    // Write header
+/// Write one record in `style`, preceded by its `Framing` separator. A
+/// sequence of these between `Framing.open` and `Framing.close`, with the
+/// first separator dropped, is what `writeNdjson`/`writeJson`/`writeCsv`
+/// write for the same records.
+pub fn writeRecord(
+    writer: anytype,
+    obj: *const json_parser.JsonObject,
+    select_fields: ?[]const []const u8,
+    style: Style,
+) !void {
+    switch (style.format) {
+        .ndjson => {
+            try writeJsonObject(writer, obj, select_fields, false);
+            try writer.writeByte('\n');
+        },
+        .json => {
+            try writer.writeAll(Framing.of(style).separator);
+            try writeJsonObject(writer, obj, select_fields, style.pretty);
+        },
+        .csv => try writeCsvRow(writer, obj, select_fields),
+    }
+}
+
+/// The CSV header line: the selected fields, or else the keys of `first`.
+pub fn writeCsvHeader(
+    writer: anytype,
+    first: *const json_parser.JsonObject,
+    select_fields: ?[]const []const u8,
+) !void {
     if (select_fields) |sf| {
         for (sf, 0..) |field, i| {
             if (i > 0) try writer.writeByte(',');
             try writeCsvField(writer, field);
         }
     } else {
-        // Use fields from first object
-        const first_obj_fields = objects[0].fields;
-        for (first_obj_fields, 0..) |field, i| {
+        for (first.fields, 0..) |field, i| {
             if (i > 0) try writer.writeByte(',');
             try writeCsvField(writer, field.key);
         }
     }
     try writer.writeByte('\n');
+}
 
-    // Write data rows
-    for (objects) |obj| {
-        if (select_fields) |sf| {
-            for (sf, 0..) |field_name, i| {
-                if (i > 0) try writer.writeByte(',');
-                if (obj.get(field_name)) |value| {
-                    try writeCsvValue(writer, value);
-                }
-            }
-        } else {
-            const obj_fields = obj.fields;
-            for (obj_fields, 0..) |field, i| {
-                if (i > 0) try writer.writeByte(',');
-                try writeCsvValue(writer, field.value);
+fn writeCsvRow(
+    writer: anytype,
+    obj: *const json_parser.JsonObject,
+    select_fields: ?[]const []const u8,
+) !void {
+    if (select_fields) |sf| {
+        for (sf, 0..) |field_name, i| {
+            if (i > 0) try writer.writeByte(',');
+            if (obj.get(field_name)) |value| {
+                try writeCsvValue(writer, value);
             }
         }
-        try writer.writeByte('\n');
+    } else {
+        for (obj.fields, 0..) |field, i| {
+            if (i > 0) try writer.writeByte(',');
+            try writeCsvValue(writer, field.value);
+        }
     }
+    try writer.writeByte('\n');
 }
 
 /// Write a single JSON object
@@ -141,7 +185,7 @@ fn writeJsonObject(
 }
 
 /// Write a JSON value
-fn writeJsonValue(writer: anytype, value: json_parser.JsonValue) anyerror!void {
+pub fn writeJsonValue(writer: anytype, value: json_parser.JsonValue) anyerror!void {
     switch (value) {
         .null_value => try writer.writeAll("null"),
         .bool_value => |b| try writer.writeAll(if (b) "true" else "false"),
@@ -161,10 +205,14 @@ fn writeJsonValue(writer: anytype, value: json_parser.JsonValue) anyerror!void {
     }
 }
 
-fn writeJsonString(writer: anytype, value: []const u8) anyerror!void {
+/// Write `value` as a JSON string. Runs without anything to escape are
+/// found 32 bytes at a time and written whole.
+pub fn writeJsonString(writer: anytype, value: []const u8) anyerror!void {
     try writer.writeByte('"');
-    for (value) |c| {
-        switch (c) {
+    var start: usize = 0;
+    while (simd.indexOfJsonEscape(value, start)) |i| {
+        try writer.writeAll(value[start..i]);
+        switch (value[i]) {
             '"' => try writer.writeAll("\\\""),
             '\\' => try writer.writeAll("\\\\"),
             0x08 => try writer.writeAll("\\b"),
@@ -172,31 +220,29 @@ fn writeJsonString(writer: anytype, value: []const u8) anyerror!void {
             '\n' => try writer.writeAll("\\n"),
             '\r' => try writer.writeAll("\\r"),
             '\t' => try writer.writeAll("\\t"),
-            0x00...0x07, 0x0b, 0x0e...0x1f => try writer.print("\\u{x:0>4}", .{c}),
-            else => try writer.writeByte(c),
+            else => |c| try writer.print("\\u{x:0>4}", .{c}),
         }
+        start = i + 1;
     }
+    try writer.writeAll(value[start..]);
     try writer.writeByte('"');
 }
 
 /// Write a CSV field (header)
 fn writeCsvField(writer: anytype, field: []const u8) !void {
     // Quote if contains comma, quote, or newline
-    const needs_quote = std.mem.indexOfAny(u8, field, ",\"\n") != null;
+    if (simd.indexOfCsvSpecial(field) == null) return writer.writeAll(field);
 
-    if (needs_quote) {
-        try writer.writeByte('"');
-        for (field) |c| {
-            if (c == '"') {
-                try writer.writeAll("\"\""); // Escape quotes
-            } else {
-                try writer.writeByte(c);
-            }
-        }
+    try writer.writeByte('"');
+    // Each quote is written twice: the run up to it, then the quote again
+    var start: usize = 0;
+    while (std.mem.indexOfScalarPos(u8, field, start, '"')) |i| {
+        try writer.writeAll(field[start .. i + 1]);
         try writer.writeByte('"');
-    } else {
-        try writer.writeAll(field);
+        start = i + 1;
     }
+    try writer.writeAll(field[start..]);
+    try writer.writeByte('"');
 }
 
 /// Write a CSV value
@@ -369,3 +415,31 @@ test "output: field projection" {
     try std.testing.expect(std.mem.indexOf(u8, buffer.items, "city") != null);
     try std.testing.expect(std.mem.indexOf(u8, buffer.items, "age") == null);
 }
+
+test "output: long escaped strings round-trip through the parser" {
+    const allocator = std.testing.allocator;
+    var prng = std.Random.DefaultPrng.init(27);
+    const random = prng.random();
+
+    for (0..50) |_| {
+        // Long clean runs with the odd special byte, as in log payloads
+        var value: [300]u8 = undefined;
+        for (&value) |*c| c.* = if (random.uintLessThan(u8, 20) == 0) random.uintLessThan(u8, 0x80) else 'a' + random.uintLessThan(u8, 26);
+
+        var line = std.ArrayList(u8){};
+        defer line.deinit(allocator);
+        const writer = line.writer(allocator);
+        try writer.writeAll("{\"k\":");
+        try writeJsonString(writer, &value);
+        try writer.writeByte('}');
+
+        var obj = try json_parser.parseObject(line.items, allocator);
+        defer obj.deinit();
+        try std.testing.expectEqualStrings(&value, obj.get("k").?.string);
+    }
+
+    var csv = std.ArrayList(u8){};
+    defer csv.deinit(allocator);
+    try writeCsvField(csv.writer(allocator), "long field, with \"quotes\" past the first thirty-two bytes \"");
+    try std.testing.expectEqualStrings("\"long field, with \"\"quotes\"\" past the first thirty-two bytes \"\"\"", csv.items);
+}
@@ -3,32 +3,73 @@ const builtin = @import("builtin");
 const json_parser = @import("json_parser.zig");
 const query = @import("query.zig");
 const simd = @import("simd.zig");
+const output = @import("output.zig");
+const Prefilter = @import("prefilter.zig").Prefilter;
+const Plan = @import("plan.zig").Plan;
+const Kernel = @import("plan.zig").Kernel;
+const Index = @import("index.zig").Index;
+const batch = @import("batch.zig");
+const json_array = @import("json_array.zig");
+const timing = @import("stats.zig");
+const compress = @import("compress.zig");
+const fileio = @import("fileio.zig");
+const aggregate = @import("aggregate.zig");
+const sort = @import("sort.zig");
 
 /// Result of processing a chunk of NDJSON data
 pub const ChunkResult = struct {
     matches: std.ArrayList(json_parser.JsonObject),
     lines_processed: usize,
     allocator: std.mem.Allocator,
+    arenas: std.ArrayList(*std.heap.ArenaAllocator), // Own every object in `matches`; freed in bulk
     mmap_data: ?[]align(std.heap.page_size_min) const u8, // Memory-mapped data (needs munmap, not free)
     owned_data: ?[]u8, // Allocated data (needs free)
     output_buffer: ?std.ArrayList(u8), // Pre-serialized output for parallel generation
+    /// Files the matches were read from; kept mapped for the life of the result
+    inputs: ?Inputs = null,
 
     pub fn init(allocator: std.mem.Allocator) ChunkResult {
         return .{
             .matches = std.ArrayList(json_parser.JsonObject){},
             .lines_processed = 0,
             .allocator = allocator,
+            .arenas = .{},
             .mmap_data = null,
             .owned_data = null,
             .output_buffer = null,
         };
     }
 
-    pub fn deinit(self: *ChunkResult) void {
-        for (self.matches.items) |*obj| {
-            obj.deinit();
+    /// Allocator for objects appended to `matches`. They live in an arena owned
+    /// by this result, so deinit frees them all at once instead of walking each.
+    pub fn matchAllocator(self: *ChunkResult) !std.mem.Allocator {
+        if (self.arenas.items.len == 0) {
+            const arena = try self.allocator.create(std.heap.ArenaAllocator);
+            errdefer self.allocator.destroy(arena);
+            arena.* = std.heap.ArenaAllocator.init(self.allocator);
+            try self.arenas.append(self.allocator, arena);
         }
+        return self.arenas.items[0].allocator();
+    }
+
+    /// Move `other`'s matches (and the arenas backing them) onto the end of self.
+    pub fn absorb(self: *ChunkResult, other: *ChunkResult) !void {
+        try self.arenas.ensureUnusedCapacity(self.allocator, other.arenas.items.len);
+        try self.matches.appendSlice(self.allocator, other.matches.items);
+        self.arenas.appendSliceAssumeCapacity(other.arenas.items);
+        self.lines_processed += other.lines_processed;
+        other.matches.clearRetainingCapacity();
+        other.arenas.clearRetainingCapacity();
+    }
+
+    pub fn deinit(self: *ChunkResult) void {
+        // Objects in `matches` are arena-allocated: no per-object free walk
         self.matches.deinit(self.allocator);
+        for (self.arenas.items) |arena| {
+            arena.deinit();
+            self.allocator.destroy(arena);
+        }
+        self.arenas.deinit(self.allocator);
 
         // Free output buffer if present
         if (self.output_buffer) |*buf| {
@@ -44,17 +85,47 @@ pub const ChunkResult = struct {
         if (self.owned_data) |data| {
             self.allocator.free(data);
         }
+
+        if (self.inputs) |*inputs| inputs.deinit();
     }
 };
 
 /// Configuration for parallel processing
 pub const Config = struct {
     num_threads: usize = 4,
-    chunk_size: usize = 1024 * 1024, // 1MB chunks
+    chunk_size: usize = 1024 * 1024, // 1MB morsels / streaming chunks
+    /// Stop once this many matches (the first ones in input order) are known
+    limit: ?usize = null,
+    /// Matcher to use instead of the one compiled from the filter, e.g. a
+    /// comptime kernel from kernel.zig; it must agree with the filter.
+    kernel: ?Kernel = null,
+    /// Sidecar index of the input (index.zig); blocks it rules out are skipped
+    index: ?*const Index = null,
+    /// Per-stage timings and per-worker counters are added here (`--stats`)
+    stats: ?*timing.Stats = null,
+    /// Tag every match from a file with a leading `filename_key` member
+    /// naming that file (`--with-filename`)
+    with_filename: bool = false,
+    /// How input files are read (`--io`)
+    io: fileio.Backend = .mmap,
 };
 
+/// Member added to matches by `Config.with_filename`
+pub const filename_key = "_file";
+
 /// Input format: auto-detected from the first non-whitespace byte.
-pub const Format = enum { ndjson, json_array };
+pub const Format = enum {
+    ndjson,
+    json_array,
+
+    /// How records are delimited within a morsel of this format
+    pub fn framing(self: Format) simd.RecordIndexer.Framing {
+        return switch (self) {
+            .ndjson => .lines,
+            .json_array => .elements,
+        };
+    }
+};
 
 /// Detect whether data is NDJSON (objects separated by newlines) or a JSON array ([...]).
 pub fn detectFormat(data: []const u8) Format {
@@ -71,6 +142,8 @@ pub fn detectFormat(data: []const u8) Format {
 /// Convert a JSON array ([{...},{...},...]) to NDJSON (one object per line).
 /// Handles nested objects and strings correctly via a depth counter.
 /// Returns an owned slice; caller must free with allocator.free().
+/// The processing entry points no longer need this: they filter array
+/// elements in place (see json_array.zig).
 pub fn jsonArrayToNdjson(data: []const u8, allocator: std.mem.Allocator) ![]u8 {
     var out = std.ArrayList(u8){};
     errdefer out.deinit(allocator);
@@ -133,325 +206,911 @@ pub fn jsonArrayToNdjson(data: []const u8, allocator: std.mem.Allocator) ![]u8 {
 
 /// Context passed to each worker thread
 const WorkerContext = struct {
-    data: []const u8,
-    filter: *const query.Filter,
-    result: *ChunkResult,
+    queue: *MorselQueue,
+    /// One result per morsel, so matches can be stitched back in input order
+    results: []ChunkResult,
+    plan: *const Plan,
+    prefilter: *const Prefilter,
+    /// Fields the filter reads; null parses every field up front
+    projection: ?*const json_parser.Projection,
+    allocator: std.mem.Allocator,
+    /// Per-line parse memory, reset after every line
+    scratch: std.heap.ArenaAllocator,
+    /// This worker's `Config.stats` slot
+    worker: ?*timing.Worker = null,
+    failure: ?anyerror = null,
+};
+
+/// Projection of the fields `filter` reads, for evaluating records without
+/// materialising the rest. Null for `{}`, where every record matches anyway.
+pub fn filterProjection(filter: *const query.Filter, allocator: std.mem.Allocator) !?json_parser.Projection {
+    if (filter.* == .always_true) return null;
+    var projection = json_parser.Projection{};
+    errdefer projection.deinit(allocator);
+    try query.addFilterPaths(filter, &projection, allocator);
+    return projection;
+}
+
+/// Filters NDJSON chunks and serializes the matches, as NDJSON lines unless
+/// made with `initStyled`. Shared by `processFileWithOutput` and the
+/// streaming pipeline (stream.zig); one instance is read concurrently by
+/// every worker.
+pub const NdjsonFilter = struct {
+    plan: Plan,
+    /// Counts without output run columnar when the plan allows it
+    batch_plan: ?batch.BatchPlan,
+    prefilter: Prefilter,
+    projection: ?json_parser.Projection,
+    /// NDJSON without --select: matches are copied through byte for byte
+    verbatim: bool,
+    select_fields: ?[]const []const u8,
+    /// Records are written with `output.writeRecord` in this style
+    style: output.Style = .{},
     allocator: std.mem.Allocator,
+
+    pub const Stats = struct {
+        lines_processed: usize = 0,
+        matches: usize = 0,
+    };
+
+    pub fn init(
+        filter: *const query.Filter,
+        select_fields: ?[]const []const u8,
+        allocator: std.mem.Allocator,
+    ) !NdjsonFilter {
+        return initStyled(filter, select_fields, .{}, allocator);
+    }
+
+    /// A filter whose matches are serialized in `style`, each with its
+    /// `output.Framing` separator in front, for an `OrderedSink` to stitch.
+    pub fn initStyled(
+        filter: *const query.Filter,
+        select_fields: ?[]const []const u8,
+        style: output.Style,
+        allocator: std.mem.Allocator,
+    ) !NdjsonFilter {
+        var plan = try Plan.init(filter, allocator);
+        errdefer plan.deinit();
+        var batch_plan = try batch.BatchPlan.init(&plan, allocator);
+        errdefer if (batch_plan) |*b| b.deinit();
+        var prefilter = try Prefilter.init(filter, allocator);
+        errdefer prefilter.deinit();
+
+        // With --select, one projected parse serves both the filter and the output.
+        // Without it, records are evaluated projected and matches are emitted as
+        // their original bytes, so the output never needs the full object.
+        var projection: ?json_parser.Projection = null;
+        errdefer if (projection) |*p| p.deinit(allocator);
+        if (select_fields) |fields| {
+            projection = json_parser.Projection{};
+            try query.addFilterPaths(filter, &projection.?, allocator);
+            for (fields) |field| try projection.?.addKey(allocator, field);
+        } else {
+            projection = try filterProjection(filter, allocator);
+        }
+
+        return .{
+            .plan = plan,
+            .batch_plan = batch_plan,
+            .prefilter = prefilter,
+            .projection = projection,
+            .verbatim = select_fields == null and style.format == .ndjson,
+            .select_fields = select_fields,
+            .style = style,
+            .allocator = allocator,
+        };
+    }
+
+    pub fn deinit(self: *NdjsonFilter) void {
+        self.plan.deinit();
+        if (self.batch_plan) |*b| b.deinit();
+        self.prefilter.deinit();
+        if (self.projection) |*p| p.deinit(self.allocator);
+    }
+
+    /// Early-exit controls and instrumentation for `run`
+    pub const RunOptions = struct {
+        /// Stop after this many matches in the chunk
+        max_matches: ?usize = null,
+        /// Abandon the chunk as soon as this is set
+        cancel: ?*const std.atomic.Value(bool) = null,
+        /// Time and counts of the chunk are added to this worker's stats
+        worker: ?*timing.Worker = null,
+        /// Serialized member (`"key":value`) put first in every match; not
+        /// for CSV
+        label: ?[]const u8 = null,
+        /// CSV only: the header of the first match goes here if it is empty
+        header: ?*std.ArrayList(u8) = null,
+    };
+
+    /// Filter every record of `chunk`, appending matches to `out`, or only
+    /// counting them when `out` is null. `scratch` is reset after each record.
+    /// A `.json_array` chunk is a morsel from `json_array.splitIntoMorsels`.
+    pub fn run(
+        self: *const NdjsonFilter,
+        chunk: []const u8,
+        format: Format,
+        out: ?*std.ArrayList(u8),
+        scratch: *std.heap.ArenaAllocator,
+        options: RunOptions,
+    ) !Stats {
+        const projection = if (self.projection) |*p| p else null;
+        var stats = Stats{};
+        if (options.max_matches) |max| if (max == 0) return stats;
+
+        // Everything since this worker's previous chunk was spent waiting for it
+        const worker = options.worker;
+        timing.idle(worker);
+        defer if (worker) |w| {
+            timing.lap(w, .scan);
+            w.bytes_scanned += chunk.len;
+            w.records += stats.lines_processed;
+            w.matches += stats.matches;
+        };
+
+        var indexer = simd.RecordIndexer.init(chunk);
+        indexer.framing = format.framing();
+        defer indexer.deinit(self.allocator);
+
+        // Counting only: decide whole batches of records at once
+        var counter: ?batch.BatchCounter = null;
+        if (out == null) {
+            if (self.batch_plan) |*b| {
+                counter = batch.BatchCounter.init(b);
+                counter.?.begin(chunk);
+            }
+        }
+
+        while (try indexer.next(self.allocator)) |record| {
+            if (record.line.len == 0) continue;
+            if (options.cancel) |cancel| if (cancel.load(.monotonic)) break;
+            stats.lines_processed += 1;
+            if (!self.prefilter.mayMatch(record.line)) continue;
+            timing.lap(worker, .scan);
+            if (counter) |*c| {
+                if (c.add(record.tokens) != .undecided) {
+                    timing.lap(worker, .filter);
+                    if (options.max_matches) |max| if (stats.matches + c.count >= max) break;
+                    continue;
+                }
+            }
+
+            // Parse JSON object (projected to the fields in use)
+            defer _ = scratch.reset(.retain_capacity);
+            const alloc = scratch.allocator();
+            const obj = json_parser.parseObjectTokens(chunk, record.tokens, alloc, projection) catch |err| switch (err) {
+                error.OutOfMemory => return error.OutOfMemory,
+                else => {
+                    if (worker) |w| w.parse_failures += 1;
+                    continue;
+                },
+            };
+            timing.lap(worker, .parse);
+
+            // Evaluate filter
+            const matched = self.plan.matches(&obj);
+            timing.lap(worker, .filter);
+            if (!matched) continue;
+
+            if (out) |buffer| {
+                var start = buffer.items.len;
+                const line = std.mem.trim(u8, record.line, &std.ascii.whitespace);
+                if (self.style.format != .ndjson) {
+                    // Re-serialized: from the projected parse with --select, else in full
+                    const full = if (self.select_fields == null)
+                        json_parser.parseObjectTokens(chunk, record.tokens, alloc, null) catch |err| switch (err) {
+                            error.OutOfMemory => return error.OutOfMemory,
+                            else => continue,
+                        }
+                    else
+                        obj;
+                    if (options.header) |header| {
+                        if (header.items.len == 0) try output.writeCsvHeader(header.writer(self.allocator), &full, self.select_fields);
+                    }
+                    try output.writeRecord(buffer.writer(self.allocator), &full, self.select_fields, self.style);
+                    start += output.Framing.of(self.style).separator.len;
+                } else if (self.verbatim and (format == .ndjson or std.mem.indexOfScalar(u8, line, '\n') == null)) {
+                    // The projected parse above checked the whole record,
+                    // skipped fields included
+                    try buffer.ensureUnusedCapacity(self.allocator, line.len + 1);
+                    buffer.appendSliceAssumeCapacity(line);
+                    buffer.appendAssumeCapacity('\n');
+                } else if (self.verbatim) {
+                    // A pretty-printed array element has to be compacted onto one line
+                    const full = json_parser.parseObjectTokens(chunk, record.tokens, alloc, null) catch |err| switch (err) {
+                        error.OutOfMemory => return error.OutOfMemory,
+                        else => continue,
+                    };
+                    try output.writeNdjson(buffer.writer(self.allocator), &[_]json_parser.JsonObject{full}, null);
+                } else {
+                    // Zero-copy: obj fields are slices into the chunk
+                    try output.writeNdjson(buffer.writer(self.allocator), &[_]json_parser.JsonObject{obj}, self.select_fields);
+                }
+                if (options.label) |label| try prependMember(buffer, start, label, self.allocator);
+                timing.lap(worker, .output);
+            }
+            stats.matches += 1;
+            if (options.max_matches) |max| if (stats.matches + (if (counter) |c| c.count else 0) >= max) break;
+        }
+        if (counter) |*c| stats.matches += c.end();
+        if (options.max_matches) |max| stats.matches = @min(stats.matches, max);
+        return stats;
+    }
 };
 
-/// Process a single line of NDJSON
-fn processLine(line: []const u8, filter: *const query.Filter, result: *ChunkResult) !void {
-    if (line.len == 0) return;
+/// Make `member` the first member of the object serialized at `buffer[start..]`.
+fn prependMember(buffer: *std.ArrayList(u8), start: usize, member: []const u8, allocator: std.mem.Allocator) !void {
+    const empty = buffer.items[start + 1] == '}';
+    try buffer.insertSlice(allocator, start + 1, member);
+    if (!empty) try buffer.insert(allocator, start + 1 + member.len, ',');
+}
+
+/// `obj` with a leading `filename_key` field naming the file it came from.
+/// The hash index is dropped, since every field moves up one place.
+fn withFilename(obj: json_parser.JsonObject, path: []const u8, allocator: std.mem.Allocator) !json_parser.JsonObject {
+    const fields = try allocator.alloc(json_parser.JsonObject.Field, obj.fields.len + 1);
+    fields[0] = .{ .key = filename_key, .value = .{ .string = path } };
+    @memcpy(fields[1..], obj.fields);
+    var tagged = obj;
+    tagged.fields = fields;
+    tagged.slots = null;
+    return tagged;
+}
+
+/// The first `lines` lines of NDJSON `buffer` (matches are one per line;
+/// newlines inside values are always escaped).
+pub fn ndjsonPrefix(buffer: []const u8, lines: usize) []const u8 {
+    var end: usize = 0;
+    for (0..lines) |_| {
+        const nl = std.mem.indexOfScalarPos(u8, buffer, end, '\n') orelse return buffer;
+        end = nl + 1;
+    }
+    return buffer[0..end];
+}
 
-    // Parse the JSON object
-    var obj = json_parser.parseObject(line, result.allocator) catch |err| {
-        // Skip malformed lines
-        std.debug.print("Warning: failed to parse line: {}\n", .{err});
+/// Process a single NDJSON record from the morsel's structural index
+/// `filename`, if set, is added to every match (`Config.with_filename`).
+fn processRecord(ctx: *WorkerContext, morsel: []const u8, filename: ?[]const u8, result: *ChunkResult, record: simd.Record) !void {
+    if (record.line.len == 0) return;
+
+    // Lines missing a literal the filter requires can't match; skip parsing them
+    if (!ctx.prefilter.mayMatch(record.line)) {
+        result.lines_processed += 1;
         return;
+    }
+    timing.lap(ctx.worker, .scan);
+
+    // Rejected records cost a pointer reset rather than a free walk. Only `{}`
+    // has no projection, and it matches everything, so parse straight into the
+    // result arena then.
+    defer _ = ctx.scratch.reset(.retain_capacity);
+    const parse_allocator = if (ctx.projection == null) try result.matchAllocator() else ctx.scratch.allocator();
+
+    // Parse the JSON object (only the fields the filter reads)
+    var obj = json_parser.parseObjectTokens(morsel, record.tokens, parse_allocator, ctx.projection) catch |err| switch (err) {
+        error.OutOfMemory => return error.OutOfMemory,
+        else => {
+            // Skip malformed lines
+            std.debug.print("Warning: failed to parse line: {}\n", .{err});
+            if (ctx.worker) |w| w.parse_failures += 1;
+            return;
+        },
     };
+    timing.lap(ctx.worker, .parse);
 
     // Evaluate against filter
-    const matches = query.matches(&obj, filter);
+    const matches = ctx.plan.matches(&obj);
+    timing.lap(ctx.worker, .filter);
 
     if (matches) {
+        if (ctx.projection != null) {
+            // Callers get complete records: rebuild the match in the result
+            // arena from the same tokens
+            obj = json_parser.parseObjectTokens(morsel, record.tokens, try result.matchAllocator(), null) catch |err| switch (err) {
+                error.OutOfMemory => return error.OutOfMemory,
+                else => {
+                    std.debug.print("Warning: failed to parse line: {}\n", .{err});
+                    return;
+                },
+            };
+        }
+        if (filename) |path| obj = try withFilename(obj, path, try result.matchAllocator());
         try result.matches.append(result.allocator, obj);
-    } else {
-        obj.deinit();
+        timing.lap(ctx.worker, .output);
     }
 
     result.lines_processed += 1;
 }
 
-/// Worker thread function
+/// Worker thread function: pull morsels until the queue is empty. Each morsel
+/// gets one streaming stage-1 pass, then stage 2 on each record's token slice.
 fn workerThread(ctx: *WorkerContext) void {
-    var line_start: usize = 0;
-
-    // Process each line in this chunk
-    for (ctx.data, 0..) |byte, i| {
-        if (byte == '\n') {
-            const line = ctx.data[line_start..i];
-            processLine(line, ctx.filter, ctx.result) catch |err| {
-                std.debug.print("Error processing line: {}\n", .{err});
-            };
-            line_start = i + 1;
-        }
-    }
+    filterWorkerMorsels(ctx) catch |err| {
+        ctx.failure = err;
+        ctx.queue.stop.store(true, .monotonic);
+    };
+}
 
-    // Handle last line if no trailing newline
-    if (line_start < ctx.data.len) {
-        const line = ctx.data[line_start..];
-        processLine(line, ctx.filter, ctx.result) catch |err| {
-            std.debug.print("Error processing last line: {}\n", .{err});
+fn filterWorkerMorsels(ctx: *WorkerContext) !void {
+    var indexer = simd.RecordIndexer.init(&.{});
+    defer indexer.deinit(ctx.allocator);
+
+    while (ctx.queue.pop()) |m| {
+        const morsel = ctx.queue.morsels[m];
+        const filename = ctx.queue.inputs.filenameOf(m);
+        const result = &ctx.results[m];
+        timing.idle(ctx.worker);
+        defer if (ctx.worker) |w| {
+            timing.lap(w, .scan);
+            w.bytes_scanned += morsel.len;
+            w.records += result.lines_processed;
+            w.matches += result.matches.items.len;
         };
+        indexer.reset(morsel);
+        indexer.framing = ctx.queue.inputs.formatOf(m).framing();
+        while (try indexer.next(ctx.allocator)) |record| {
+            // Enough earlier matches are confirmed; the rest of this morsel is moot
+            if (ctx.queue.stopped()) return;
+            try processRecord(ctx, morsel, filename, result, record);
+            // No later match in this morsel can be among the first `limit`
+            if (ctx.queue.limit) |limit| if (result.matches.items.len >= limit.limit) break;
+        }
+        ctx.queue.finish(m, result.matches.items.len);
     }
 }
 
-/// Split data into chunks aligned on newline boundaries
-fn splitIntoChunks(data: []const u8, num_chunks: usize, allocator: std.mem.Allocator) ![][]const u8 {
-    var chunks = try allocator.alloc([]const u8, num_chunks);
+/// Split data into morsels of about `morsel_size` bytes, each ending on a
+/// newline (or at the end of data). Many small morsels let fast workers pick
+/// up the slack of slow ones instead of one static slice per thread.
+pub fn splitIntoMorsels(data: []const u8, morsel_size: usize, allocator: std.mem.Allocator) ![][]const u8 {
+    var morsels = std.ArrayList([]const u8){};
+    errdefer morsels.deinit(allocator);
 
-    if (num_chunks == 1) {
-        chunks[0] = data;
-        return chunks;
+    const size = @max(morsel_size, 1);
+    var start: usize = 0;
+    while (start < data.len) {
+        const target = @min(start + size, data.len);
+        // Extend to the newline that ends the line straddling the target
+        const end = if (target > start and data[target - 1] == '\n')
+            target
+        else if (std.mem.indexOfScalarPos(u8, data, target, '\n')) |nl|
+            nl + 1
+        else
+            data.len;
+        try morsels.append(allocator, data[start..end]);
+        start = end;
     }
 
-    const chunk_size = data.len / num_chunks;
-    var start: usize = 0;
+    return morsels.toOwnedSlice(allocator);
+}
 
-    for (0..num_chunks) |i| {
-        if (i == num_chunks - 1) {
-            // Last chunk gets remainder
-            chunks[i] = data[start..];
+/// Morsels of `data` to scan for `filter`. With a `config.index` built from
+/// this data they are the index's blocks, minus the ones its statistics prove
+/// cannot match; lines of skipped blocks are added to `skipped_lines`.
+/// JSON arrays are cut between elements, in parallel, and never indexed.
+fn selectMorsels(
+    data: []const u8,
+    format: Format,
+    filter: *const query.Filter,
+    config: Config,
+    skipped_lines: *usize,
+    allocator: std.mem.Allocator,
+) ![][]const u8 {
+    if (format == .json_array) return json_array.splitIntoMorsels(data, config.chunk_size, config.num_threads, allocator);
+    const index = config.index orelse return splitIntoMorsels(data, config.chunk_size, allocator);
+    if (index.file_size != data.len) return splitIntoMorsels(data, config.chunk_size, allocator);
+
+    var morsels = std.ArrayList([]const u8){};
+    errdefer morsels.deinit(allocator);
+    for (index.blocks, 0..) |block, b| {
+        if (index.mayMatch(filter, b)) {
+            try morsels.append(allocator, data[@intCast(block.start)..@intCast(block.end)]);
         } else {
-            // Find next newline after chunk_size
-            var end = @min(start + chunk_size, data.len);
+            skipped_lines.* += @intCast(block.lines);
+        }
+    }
+    return morsels.toOwnedSlice(allocator);
+}
 
-            // Scan forward to find newline
-            while (end < data.len and data[end] != '\n') {
-                end += 1;
-            }
+/// Everything one worker pool scans: a buffer in memory, or a list of files
+/// mapped together so that small files share a pool rather than each starting
+/// their own. The morsels of all inputs go into one queue in input order,
+/// so matches come out grouped by file, in the order the files were given.
+pub const Inputs = struct {
+    /// Path of each input; empty for data in memory
+    paths: []const []const u8 = &.{},
+    /// Contents of each input
+    data: [][]const u8,
+    formats: []Format,
+    /// Morsels of every input, in input order
+    morsels: [][]const u8,
+    /// Input each morsel was cut from
+    source_of: []u32,
+    /// Serialized `filename_key` member of each file, with `Config.with_filename`
+    labels: ?[][]u8 = null,
+    /// Lines of index blocks ruled out without being scanned
+    skipped_lines: usize = 0,
+    /// How `openFiles` loaded each of `data`, for deinit; empty when not owned
+    loaded: []Loaded = &.{},
+    /// Workers ask for the morsel this far ahead of the one they take to be
+    /// read in (`fileio.willNeed`); 0 when the inputs are already in memory
+    read_ahead: usize = 0,
+    allocator: std.mem.Allocator,
 
-            if (end < data.len) {
-                end += 1; // Include the newline
-            }
+    const Loaded = union(enum) {
+        file: fileio.Contents,
+        /// gzip/zstd file decompressed into memory
+        decompressed,
+    };
 
-            chunks[i] = data[start..end];
-            start = end;
+    /// Morsels of `data`, which is neither copied nor owned.
+    pub fn fromData(data: []const u8, filter: *const query.Filter, config: Config, allocator: std.mem.Allocator) !Inputs {
+        const list = try allocator.alloc([]const u8, 1);
+        errdefer allocator.free(list);
+        list[0] = data;
+        return init(&.{}, list, &.{config.index}, filter, config, allocator);
+    }
+
+    /// Load every file of `paths` as `config.io` says and cut them all into
+    /// morsels. `indexes` holds the sidecar index of each path, if any.
+    pub fn openFiles(
+        paths: []const []const u8,
+        indexes: ?[]const ?*const Index,
+        filter: *const query.Filter,
+        config: Config,
+        allocator: std.mem.Allocator,
+    ) !Inputs {
+        const data = try allocator.alloc([]const u8, paths.len);
+        const loaded = try allocator.alloc(Loaded, paths.len);
+        var opened: usize = 0;
+        errdefer {
+            release(data[0..opened], loaded[0..opened], allocator);
+            allocator.free(loaded);
+            allocator.free(data);
         }
+        var read = timing.Span.start(config.stats);
+        var mapped = config.io == .mmap;
+        while (opened < paths.len) : (opened += 1) {
+            const contents = try fileio.loadPath(paths[opened], config.io, allocator);
+            data[opened] = contents.data;
+            loaded[opened] = .{ .file = contents };
+            // Every worker needs random access to the morsels, so compressed
+            // files are decompressed whole here
+            if (compress.detect(contents.data) != .none) {
+                const decompressed = compress.decompressAll(contents.data, allocator) catch |err| {
+                    contents.deinit(allocator);
+                    return err;
+                };
+                contents.deinit(allocator);
+                data[opened] = decompressed;
+                loaded[opened] = .decompressed;
+                mapped = false;
+            }
+        }
+        read.end(.read);
+
+        var inputs = try init(paths, data, indexes, filter, config, allocator);
+        inputs.loaded = loaded;
+        // About one round of morsels ahead of the workers
+        if (mapped) inputs.read_ahead = @max(config.num_threads, 1);
+        return inputs;
     }
 
-    return chunks;
-}
+    fn release(data: []const []const u8, loaded: []const Loaded, allocator: std.mem.Allocator) void {
+        for (data, loaded) |d, how| switch (how) {
+            .file => |contents| contents.deinit(allocator),
+            .decompressed => allocator.free(d),
+        };
+    }
 
-/// Context for count-only worker (no allocations, just an atomic counter)
-const CountWorkerContext = struct {
-    data: []const u8,
-    filter: *const query.Filter,
-    count: std.atomic.Value(usize),
+    /// Takes `data` over only on success.
+    fn init(
+        paths: []const []const u8,
+        data: [][]const u8,
+        indexes: ?[]const ?*const Index,
+        filter: *const query.Filter,
+        config: Config,
+        allocator: std.mem.Allocator,
+    ) !Inputs {
+        const formats = try allocator.alloc(Format, data.len);
+        errdefer allocator.free(formats);
+        for (formats, data) |*format, d| format.* = detectFormat(d);
+
+        var split = timing.Span.start(config.stats);
+        var morsels = std.ArrayList([]const u8){};
+        errdefer morsels.deinit(allocator);
+        var source_of = std.ArrayList(u32){};
+        errdefer source_of.deinit(allocator);
+        var skipped_lines: usize = 0;
+        for (data, formats, 0..) |d, format, i| {
+            var input_config = config;
+            input_config.index = if (indexes) |list| list[i] else null;
+            const cut = try selectMorsels(d, format, filter, input_config, &skipped_lines, allocator);
+            defer allocator.free(cut);
+            try morsels.appendSlice(allocator, cut);
+            try source_of.appendNTimes(allocator, @intCast(i), cut.len);
+        }
+        split.end(.split);
 
-    pub fn init(data: []const u8, filter: *const query.Filter) CountWorkerContext {
+        var labels: ?[][]u8 = null;
+        if (config.with_filename and paths.len == data.len) labels = try filenameLabels(paths, allocator);
+        errdefer if (labels) |l| freeLabels(l, allocator);
+
+        const morsel_list = try morsels.toOwnedSlice(allocator);
+        errdefer allocator.free(morsel_list);
         return .{
+            .paths = paths,
             .data = data,
-            .filter = filter,
-            .count = std.atomic.Value(usize).init(0),
+            .formats = formats,
+            .morsels = morsel_list,
+            .source_of = try source_of.toOwnedSlice(allocator),
+            .labels = labels,
+            .skipped_lines = skipped_lines,
+            .allocator = allocator,
         };
     }
-};
 
-fn countWorkerThread(ctx: *CountWorkerContext) void {
-    const alloc = std.heap.c_allocator;
-    var local: usize = 0;
-    var line_start: usize = 0;
-
-    for (ctx.data, 0..) |byte, i| {
-        if (byte == '\n') {
-            const line = ctx.data[line_start..i];
-            if (line.len > 0) {
-                var obj = json_parser.parseObject(line, alloc) catch {
-                    line_start = i + 1;
-                    continue;
-                };
-                defer obj.deinit();
-                if (query.matches(&obj, ctx.filter)) local += 1;
-            }
-            line_start = i + 1;
-        }
+    pub fn deinit(self: *Inputs) void {
+        if (self.labels) |labels| freeLabels(labels, self.allocator);
+        self.allocator.free(self.morsels);
+        self.allocator.free(self.source_of);
+        self.allocator.free(self.formats);
+        release(self.data, self.loaded, self.allocator);
+        self.allocator.free(self.loaded);
+        self.allocator.free(self.data);
     }
-    // Handle last line without trailing newline
-    if (line_start < ctx.data.len) {
-        const line = ctx.data[line_start..];
-        if (line.len > 0) {
-            var obj = json_parser.parseObject(line, alloc) catch {
-                _ = ctx.count.fetchAdd(local, .monotonic);
-                return;
-            };
-            defer obj.deinit();
-            if (query.matches(&obj, ctx.filter)) local += 1;
+
+    fn formatOf(self: *const Inputs, morsel: usize) Format {
+        return self.formats[self.source_of[morsel]];
+    }
+
+    /// Path of the file `morsel` was cut from, when matches are tagged with it
+    fn filenameOf(self: *const Inputs, morsel: usize) ?[]const u8 {
+        if (self.labels == null) return null;
+        return self.paths[self.source_of[morsel]];
+    }
+
+    /// `filenameOf` serialized as a `"key":value` member
+    fn labelOf(self: *const Inputs, morsel: usize) ?[]const u8 {
+        const labels = self.labels orelse return null;
+        return labels[self.source_of[morsel]];
+    }
+
+    fn filenameLabels(paths: []const []const u8, allocator: std.mem.Allocator) ![][]u8 {
+        const labels = try allocator.alloc([]u8, paths.len);
+        var done: usize = 0;
+        errdefer {
+            for (labels[0..done]) |label| allocator.free(label);
+            allocator.free(labels);
         }
+        for (paths) |path| {
+            var member = std.ArrayList(u8){};
+            errdefer member.deinit(allocator);
+            try output.writeJsonString(member.writer(allocator), filename_key);
+            try member.append(allocator, ':');
+            try output.writeJsonString(member.writer(allocator), path);
+            labels[done] = try member.toOwnedSlice(allocator);
+            done += 1;
+        }
+        return labels;
     }
 
-    _ = ctx.count.fetchAdd(local, .monotonic);
-}
+    fn freeLabels(labels: [][]u8, allocator: std.mem.Allocator) void {
+        for (labels) |label| allocator.free(label);
+        allocator.free(labels);
+    }
+};
 
-/// Count matching records without materialising any objects.
-/// Much faster than processFile() for --count mode.
-pub fn processFileCount(
-    file_path: []const u8,
-    filter: *const query.Filter,
-    config: Config,
-    allocator: std.mem.Allocator,
-) !usize {
-    const file = try std.fs.cwd().openFile(file_path, .{});
-    defer file.close();
-    const file_size = try file.getEndPos();
-    if (file_size == 0) return 0;
-
-    const data = if (builtin.os.tag == .windows)
-        try file.readToEndAlloc(allocator, file_size)
-    else
-        try std.posix.mmap(
-            null,
-            file_size,
-            std.posix.PROT.READ,
-            .{ .TYPE = .PRIVATE },
-            file.handle,
-            0,
-        );
-    defer if (builtin.os.tag == .windows) allocator.free(data) else std.posix.munmap(data);
+/// Lock-free morsel dispenser: claiming the next morsel is one atomic add.
+const MorselQueue = struct {
+    morsels: []const []const u8,
+    /// Where each morsel was cut from
+    inputs: *const Inputs,
+    next: std.atomic.Value(usize) = std.atomic.Value(usize).init(0),
+    /// Set once the remaining morsels are no longer needed
+    stop: std.atomic.Value(bool) = std.atomic.Value(bool).init(false),
+    /// Ordered --limit bookkeeping; null when every match is wanted
+    limit: ?*OrderedLimit = null,
+
+    fn pop(self: *MorselQueue) ?usize {
+        if (self.stopped()) return null;
+        const index = self.next.fetchAdd(1, .monotonic);
+        if (index >= self.morsels.len) return null;
+        // Mapped input: the first round asks for its own morsels, every
+        // later claim for the one a round ahead
+        const ahead = self.inputs.read_ahead;
+        if (ahead > 0) {
+            if (index < ahead) fileio.willNeed(self.morsels[index]);
+            if (index + ahead < self.morsels.len) fileio.willNeed(self.morsels[index + ahead]);
+        }
+        return index;
+    }
 
-    // Normalise to NDJSON (JSON arrays are converted; NDJSON passes through untouched)
-    var ndjson_owned: ?[]u8 = null;
-    defer if (ndjson_owned) |d| allocator.free(d);
-    const ndjson: []const u8 = if (detectFormat(data) == .json_array) blk: {
-        ndjson_owned = try jsonArrayToNdjson(data, allocator);
-        break :blk ndjson_owned.?;
-    } else data;
+    fn stopped(self: *const MorselQueue) bool {
+        return self.stop.load(.monotonic);
+    }
 
-    const num_threads = @min(config.num_threads, std.Thread.getCpuCount() catch 4);
-    const chunks = try splitIntoChunks(ndjson, num_threads, allocator);
-    defer allocator.free(chunks);
+    /// Record that morsel `index` is complete with `matches` matches.
+    fn finish(self: *MorselQueue, index: usize, matches: usize) void {
+        const limit = self.limit orelse return;
+        if (limit.confirm(index, matches)) self.stop.store(true, .monotonic);
+    }
+};
 
-    var contexts = try allocator.alloc(CountWorkerContext, num_threads);
-    defer allocator.free(contexts);
-    for (0..num_threads) |i| contexts[i] = CountWorkerContext.init(chunks[i], filter);
+/// Tracks per-morsel match counts for `Config.limit`. Morsels finish out of
+/// order, so the first `limit` matches in input order are only known once
+/// every morsel before the one that reaches the limit has finished too; from
+/// then on all unfinished morsels can be abandoned.
+const OrderedLimit = struct {
+    limit: usize,
+    /// Match count of each finished morsel (null while still running)
+    counts: []?usize,
+    mutex: std.Thread.Mutex = .{},
+    /// Every morsel before `frontier` has finished, with `confirmed` matches in total
+    frontier: usize = 0,
+    confirmed: usize = 0,
+
+    fn init(limit: usize, morsel_count: usize, allocator: std.mem.Allocator) !OrderedLimit {
+        const counts = try allocator.alloc(?usize, morsel_count);
+        @memset(counts, null);
+        return .{ .limit = limit, .counts = counts };
+    }
 
-    var threads = try allocator.alloc(std.Thread, num_threads);
-    defer allocator.free(threads);
-    for (0..num_threads) |i| threads[i] = try std.Thread.spawn(.{}, countWorkerThread, .{&contexts[i]});
-    for (threads) |t| t.join();
+    fn deinit(self: *OrderedLimit, allocator: std.mem.Allocator) void {
+        allocator.free(self.counts);
+    }
 
-    var total: usize = 0;
-    for (contexts) |*ctx| total += ctx.count.load(.monotonic);
-    return total;
-}
+    /// True once the first `limit` matches in input order are confirmed.
+    fn confirm(self: *OrderedLimit, index: usize, matches: usize) bool {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        self.counts[index] = matches;
+        while (self.frontier < self.counts.len) : (self.frontier += 1) {
+            self.confirmed += self.counts[self.frontier] orelse break;
+        }
+        return self.confirmed >= self.limit;
+    }
+};
 
-/// Process NDJSON file - reads file into memory to preserve slice validity
-pub fn processFile(
-    file_path: []const u8,
-    filter: *const query.Filter,
-    config: Config,
+/// Per-morsel output buffers, emitted in morsel order as soon as every
+/// earlier morsel has finished. The worker that completes the next morsel in
+/// line becomes the flusher and writes every contiguous finished buffer with
+/// one vectored write, then frees them; meanwhile the other workers only take
+/// the mutex to mark their morsel done. Output therefore starts with the first
+/// morsel and is never concatenated into one buffer.
+///
+/// JSON arrays and CSV are stitched the same way: the array brackets or the
+/// header are written around the buffers, and the first record emitted
+/// drops the separator every record is written with (`output.Framing`).
+pub const OrderedSink = struct {
+    target: Target,
+    buffers: []std.ArrayList(u8),
+    done: []bool,
+    /// Lines still allowed through under a limit; null means all of them.
+    /// NDJSON only.
+    remaining: ?usize,
+    framing: output.Framing,
+    /// CSV: the header of each morsel's first match, so the header of the
+    /// first record in the output is at hand when it is emitted
+    headers: ?[]std.ArrayList(u8),
     allocator: std.mem.Allocator,
-) !ChunkResult {
-    // Read entire file into memory
-    const file = try std.fs.cwd().openFile(file_path, .{});
-    defer file.close();
-
-    const file_size = try file.getEndPos();
-    if (file_size == 0) {
-        return ChunkResult.init(allocator);
-    }
-
-    const file_data = if (builtin.os.tag == .windows)
-        try file.readToEndAlloc(allocator, file_size)
-    else
-        try std.posix.mmap(
-            null,
-            file_size,
-            std.posix.PROT.READ,
-            .{ .TYPE = .PRIVATE },
-            file.handle,
-            0,
-        );
-
-    // Normalise to NDJSON. JSON arrays are converted (mmap freed immediately after);
-    // NDJSON passes through and the mmap is held alive via merged.mmap_data.
-    var ndjson_owned: ?[]u8 = null;
-    const data: []const u8 = if (detectFormat(file_data) == .json_array) blk: {
-        ndjson_owned = try jsonArrayToNdjson(file_data, allocator);
-        if (builtin.os.tag == .windows) allocator.free(file_data) else std.posix.munmap(file_data);
-        break :blk ndjson_owned.?;
-    } else file_data;
+    mutex: std.Thread.Mutex = .{},
+    /// Every buffer before `next` has been emitted
+    next: usize = 0,
+    /// A worker is writing out buffers right now
+    flushing: bool = false,
+    /// A record has been emitted, after `framing.open`
+    started: bool = false,
+    /// First write error; later output is dropped
+    failure: ?anyerror = null,
+
+    pub const Target = union(enum) {
+        file: std.fs.File,
+        memory: *std.ArrayList(u8),
+    };
 
-    // Use parallel processing
-    const num_threads = @min(config.num_threads, std.Thread.getCpuCount() catch 4);
+    /// Buffers written per vectored write
+    const max_iovecs = 64;
 
-    // Split into chunks aligned on newline boundaries
-    const chunks = try splitIntoChunks(data, num_threads, allocator);
-    defer allocator.free(chunks);
+    pub fn init(
+        target: Target,
+        morsel_count: usize,
+        limit: ?usize,
+        style: output.Style,
+        allocator: std.mem.Allocator,
+    ) !OrderedSink {
+        const buffers = try allocator.alloc(std.ArrayList(u8), morsel_count);
+        errdefer allocator.free(buffers);
+        for (buffers) |*buf| buf.* = .{};
+        const done = try allocator.alloc(bool, morsel_count);
+        errdefer allocator.free(done);
+        @memset(done, false);
+        var headers: ?[]std.ArrayList(u8) = null;
+        if (style.format == .csv) {
+            headers = try allocator.alloc(std.ArrayList(u8), morsel_count);
+            for (headers.?) |*header| header.* = .{};
+        }
+        return .{
+            .target = target,
+            .buffers = buffers,
+            .done = done,
+            .remaining = limit,
+            .framing = output.Framing.of(style),
+            .headers = headers,
+            .allocator = allocator,
+        };
+    }
 
-    // Create results for each thread
-    var results = try allocator.alloc(ChunkResult, num_threads);
-    defer {
-        for (results) |*r| {
-            r.matches.deinit(r.allocator);
+    pub fn deinit(self: *OrderedSink) void {
+        for (self.buffers) |*buf| buf.deinit(self.allocator);
+        self.allocator.free(self.buffers);
+        self.allocator.free(self.done);
+        if (self.headers) |headers| {
+            for (headers) |*header| header.deinit(self.allocator);
+            self.allocator.free(headers);
         }
-        allocator.free(results);
     }
 
-    for (0..num_threads) |i| {
-        results[i] = ChunkResult.init(allocator);
+    /// The buffer morsel `index` appends its output to until `finish`.
+    pub fn buffer(self: *OrderedSink, index: usize) *std.ArrayList(u8) {
+        return &self.buffers[index];
     }
 
-    // Create worker contexts
-    var contexts = try allocator.alloc(WorkerContext, num_threads);
-    defer allocator.free(contexts);
+    /// Where morsel `index` writes the CSV header of its first match.
+    pub fn header(self: *OrderedSink, index: usize) ?*std.ArrayList(u8) {
+        const headers = self.headers orelse return null;
+        return &headers[index];
+    }
 
-    for (0..num_threads) |i| {
-        contexts[i] = .{
-            .data = chunks[i],
-            .filter = filter,
-            .result = &results[i],
-            .allocator = allocator,
-        };
+    /// Mark morsel `index` complete and emit whatever is now in order.
+    pub fn finish(self: *OrderedSink, index: usize) void {
+        self.mutex.lock();
+        self.done[index] = true;
+        if (self.flushing) {
+            // The current flusher picks this buffer up on its next round
+            self.mutex.unlock();
+            return;
+        }
+        self.flushing = true;
+        while (true) {
+            const start = self.next;
+            while (self.next < self.done.len and self.done[self.next]) self.next += 1;
+            const end = self.next;
+            if (start == end) break;
+            self.mutex.unlock();
+            const result = self.emit(start, end);
+            self.mutex.lock();
+            result catch |err| {
+                if (self.failure == null) self.failure = err;
+            };
+        }
+        self.flushing = false;
+        self.mutex.unlock();
     }
 
-    // Spawn worker threads
-    var threads = try allocator.alloc(std.Thread, num_threads);
-    defer allocator.free(threads);
+    /// Emit every remaining buffer, finished or not (call after all workers
+    /// have stopped), and report the first write error.
+    pub fn close(self: *OrderedSink) !void {
+        for (0..self.done.len) |i| {
+            if (!self.done[i]) self.finish(i);
+        }
+        if (self.failure) |err| return err;
+        const tail = if (self.started) self.framing.close else self.framing.empty;
+        if (tail.len > 0) try self.write(&.{tail});
+    }
 
-    for (0..num_threads) |i| {
-        threads[i] = try std.Thread.spawn(.{}, workerThread, .{&contexts[i]});
+    /// Emit the buffers of morsels `first..end`, which are all finished.
+    fn emit(self: *OrderedSink, first: usize, end: usize) !void {
+        const buffers = self.buffers[first..end];
+        defer {
+            for (buffers) |*buf| buf.clearAndFree(self.allocator);
+        }
+        if (self.failure != null) return;
+
+        var slices: [max_iovecs][]const u8 = undefined;
+        var pending: usize = 0;
+        for (buffers, first..) |*buf, index| {
+            var kept = self.take(buf.items);
+            if (kept.len == 0) continue;
+            // Opening the output takes up to two more slices
+            if (pending + 3 > max_iovecs) {
+                try self.write(slices[0..pending]);
+                pending = 0;
+            }
+            if (!self.started) {
+                self.started = true;
+                for ([_][]const u8{ self.framing.open, if (self.header(index)) |h| h.items else "" }) |slice| {
+                    if (slice.len == 0) continue;
+                    slices[pending] = slice;
+                    pending += 1;
+                }
+                kept = kept[self.framing.separator.len..];
+            }
+            slices[pending] = kept;
+            pending += 1;
+        }
+        try self.write(slices[0..pending]);
     }
 
-    // Wait for all threads to complete
-    for (threads) |thread| {
-        thread.join();
+    /// The part of `lines` still within the limit.
+    fn take(self: *OrderedSink, lines: []const u8) []const u8 {
+        const remaining = self.remaining orelse return lines;
+        const kept = ndjsonPrefix(lines, remaining);
+        self.remaining = remaining - std.mem.count(u8, kept, "\n");
+        return kept;
     }
 
-    // Merge results from all threads
-    var merged = ChunkResult.init(allocator);
-    // Keep backing data alive as long as merged: mmap/owned NDJSON input or converted JSON array.
-    if (ndjson_owned) |d|
-        merged.owned_data = d
-    else if (builtin.os.tag == .windows)
-        merged.owned_data = file_data
-    else
-        merged.mmap_data = file_data;
+    fn write(self: *OrderedSink, slices: []const []const u8) !void {
+        switch (self.target) {
+            .memory => |out| {
+                for (slices) |slice| try out.appendSlice(self.allocator, slice);
+            },
+            .file => |file| try writeAllVectored(file, slices),
+        }
+    }
+};
 
-    for (results) |*result| {
-        merged.lines_processed += result.lines_processed;
-        for (result.matches.items) |obj| {
-            try merged.matches.append(merged.allocator, obj);
+/// Write `slices` to `file` back to back, with as few syscalls as writev allows.
+fn writeAllVectored(file: std.fs.File, slices: []const []const u8) !void {
+    if (builtin.os.tag == .windows) {
+        for (slices) |slice| try file.writeAll(slice);
+        return;
+    }
+    var iovecs: [OrderedSink.max_iovecs]std.posix.iovec_const = undefined;
+    for (iovecs[0..slices.len], slices) |*iov, slice| iov.* = .{ .base = slice.ptr, .len = slice.len };
+    var remaining = iovecs[0..slices.len];
+    while (remaining.len > 0) {
+        // writev may stop short; resume inside the first unfinished slice
+        var written = try std.posix.writev(file.handle, remaining);
+        while (remaining.len > 0 and written >= remaining[0].len) {
+            written -= remaining[0].len;
+            remaining = remaining[1..];
+        }
+        if (remaining.len > 0) {
+            remaining[0].base += written;
+            remaining[0].len -= written;
         }
-        result.matches.clearRetainingCapacity();
     }
+}
 
-    return merged;
+/// Worker count for `morsel_count` morsels: never more threads than morsels.
+fn workerCount(config: Config, morsel_count: usize) usize {
+    const available = @min(config.num_threads, std.Thread.getCpuCount() catch 4);
+    return @max(1, @min(available, morsel_count));
 }
 
-/// Process NDJSON data from memory (useful for testing)
-pub fn processData(
-    data: []const u8,
+/// One `Config.stats` slot per worker, or null when stats are off.
+fn statsWorkers(config: Config, num_threads: usize) !?[]timing.Worker {
+    const stats = config.stats orelse return null;
+    return try stats.addWorkers(num_threads);
+}
+
+/// Filter the morsels of `inputs` (NDJSON or JSON arrays) with workers
+/// pulling them from a shared queue. Matches are returned in input order.
+fn filterMorsels(
+    inputs: *const Inputs,
     filter: *const query.Filter,
     config: Config,
     allocator: std.mem.Allocator,
 ) !ChunkResult {
-    // Normalise to NDJSON (JSON arrays are converted; NDJSON passes through)
-    var ndjson_owned: ?[]u8 = null;
-    const ndjson: []const u8 = if (detectFormat(data) == .json_array) blk: {
-        ndjson_owned = try jsonArrayToNdjson(data, allocator);
-        break :blk ndjson_owned.?;
-    } else data;
-
-    // Determine optimal number of threads
-    const num_threads = @min(config.num_threads, std.Thread.getCpuCount() catch 4);
-
-    // Split into chunks aligned on newline boundaries
-    const chunks = try splitIntoChunks(ndjson, num_threads, allocator);
-    defer allocator.free(chunks);
-
-    // Create results for each thread
-    var results = try allocator.alloc(ChunkResult, num_threads);
+    var plan = try Plan.init(filter, allocator);
+    defer plan.deinit();
+    if (config.kernel) |kernel| plan.kernel = kernel;
+    var prefilter = try Prefilter.init(filter, allocator);
+    defer prefilter.deinit();
+    var projection = try filterProjection(filter, allocator);
+    defer if (projection) |*p| p.deinit(allocator);
+
+    if (config.limit) |limit| if (limit == 0) return ChunkResult.init(allocator);
+
+    const morsels = inputs.morsels;
+    var ordered_limit: ?OrderedLimit = if (config.limit) |limit| try OrderedLimit.init(limit, morsels.len, allocator) else null;
+    defer if (ordered_limit) |*l| l.deinit(allocator);
+    var queue = MorselQueue{ .morsels = morsels, .inputs = inputs, .limit = if (ordered_limit) |*l| l else null };
+
+    // Create one result per morsel
+    var results = try allocator.alloc(ChunkResult, morsels.len);
+    for (results) |*r| r.* = ChunkResult.init(allocator);
     defer {
         for (results) |*r| {
             r.deinit();
@@ -459,22 +1118,27 @@ pub fn processData(
         allocator.free(results);
     }
 
-    for (0..num_threads) |i| {
-        results[i] = ChunkResult.init(allocator);
-    }
-
     // Create worker contexts
+    const num_threads = workerCount(config, morsels.len);
     var contexts = try allocator.alloc(WorkerContext, num_threads);
     defer allocator.free(contexts);
+    const workers = try statsWorkers(config, num_threads);
 
     for (0..num_threads) |i| {
         contexts[i] = .{
-            .data = chunks[i],
-            .filter = filter,
-            .result = &results[i],
+            .queue = &queue,
+            .results = results,
+            .plan = &plan,
+            .prefilter = &prefilter,
+            .projection = if (projection) |*p| p else null,
             .allocator = allocator,
+            .scratch = std.heap.ArenaAllocator.init(allocator),
+            .worker = if (workers) |w| &w[i] else null,
         };
     }
+    defer {
+        for (contexts) |*ctx| ctx.scratch.deinit();
+    }
 
     // Spawn worker threads
     var threads = try allocator.alloc(std.Thread, num_threads);
@@ -488,124 +1152,713 @@ pub fn processData(
     for (threads) |thread| {
         thread.join();
     }
+    for (contexts) |*ctx| {
+        if (ctx.failure) |err| return err;
+    }
 
-    // Merge results from all threads
+    // Stitch results back together in morsel order
     var merged = ChunkResult.init(allocator);
-    // If we converted a JSON array, the merged result owns the NDJSON buffer
-    if (ndjson_owned) |d| merged.owned_data = d;
+    errdefer merged.deinit();
+    merged.lines_processed = inputs.skipped_lines;
 
     for (results) |*result| {
-        merged.lines_processed += result.lines_processed;
-        for (result.matches.items) |obj| {
-            try merged.matches.append(merged.allocator, obj);
-        }
-        // Clear items without deinit since we moved ownership
-        result.matches.clearRetainingCapacity();
+        // Moves matches and their arenas; result keeps nothing to free
+        try merged.absorb(result);
+    }
+
+    // Objects live in the absorbed arenas, so dropping extras frees nothing here
+    if (config.limit) |limit| {
+        if (merged.matches.items.len > limit) merged.matches.shrinkRetainingCapacity(limit);
     }
 
     return merged;
 }
 
-/// Process NDJSON file with parallel output generation (sieswi-style optimization)
-/// Each thread processes its chunk AND generates output simultaneously
-/// Returns concatenated output buffer ready for single write() syscall
-pub fn processFileWithOutput(
-    file_path: []const u8,
-    filter: *const query.Filter,
-    config: Config,
-    select_fields: ?[]const []const u8,
+/// Context for count-only workers. Columnar plans count straight off the
+/// structural index; other records are parsed into the scratch arena.
+const CountWorkerContext = struct {
+    queue: *MorselQueue,
+    plan: *const Plan,
+    prefilter: *const Prefilter,
+    projection: *const json_parser.Projection,
+    /// Columnar form of `plan`; null when the filter reads too many fields
+    batch_plan: ?*const batch.BatchPlan,
+    count: std.atomic.Value(usize),
+    /// Count at most this many matches; `total` is shared by all workers
+    limit: ?usize,
+    total: *std.atomic.Value(usize),
     allocator: std.mem.Allocator,
-) !std.ArrayList(u8) {
-    const output_mod = @import("output.zig");
-
-    // Read entire file into memory
-    const file = try std.fs.cwd().openFile(file_path, .{});
-    defer file.close();
-
-    const file_size = try file.getEndPos();
-    if (file_size == 0) {
-        const empty = std.ArrayList(u8){};
-        return empty;
-    }
-
-    const data = if (builtin.os.tag == .windows)
-        try file.readToEndAlloc(allocator, file_size)
-    else
-        try std.posix.mmap(
-            null,
-            file_size,
-            std.posix.PROT.READ,
-            .{ .TYPE = .PRIVATE },
-            file.handle,
-            0,
-        );
-    defer if (builtin.os.tag == .windows) allocator.free(data) else std.posix.munmap(data);
-
-    // Normalise to NDJSON (JSON arrays are converted; NDJSON passes through untouched)
-    var ndjson_owned: ?[]u8 = null;
-    defer if (ndjson_owned) |d| allocator.free(d);
-    const ndjson: []const u8 = if (detectFormat(data) == .json_array) blk: {
-        ndjson_owned = try jsonArrayToNdjson(data, allocator);
-        break :blk ndjson_owned.?;
-    } else data;
-
-    // Use parallel processing
-    const num_threads = @min(config.num_threads, std.Thread.getCpuCount() catch 4);
-
-    // Split into chunks aligned on newline boundaries
-    const chunks = try splitIntoChunks(ndjson, num_threads, allocator);
-    defer allocator.free(chunks);
-
-    // Context for worker threads that generate output
-    const OutputWorkerContext = struct {
-        data: []const u8,
-        filter: *const query.Filter,
-        select_fields: ?[]const []const u8,
-        output_buffer: std.ArrayList(u8),
+    /// Per-line parse memory, reset after every line
+    scratch: std.heap.ArenaAllocator,
+    /// This worker's `Config.stats` slot
+    worker: ?*timing.Worker = null,
+    failure: ?anyerror = null,
+
+    pub fn init(
+        queue: *MorselQueue,
+        plan: *const Plan,
+        prefilter: *const Prefilter,
+        projection: *const json_parser.Projection,
+        batch_plan: ?*const batch.BatchPlan,
+        limit: ?usize,
+        total: *std.atomic.Value(usize),
         allocator: std.mem.Allocator,
-        lines_processed: usize = 0,
+    ) CountWorkerContext {
+        return .{
+            .queue = queue,
+            .plan = plan,
+            .prefilter = prefilter,
+            .projection = projection,
+            .batch_plan = batch_plan,
+            .count = std.atomic.Value(usize).init(0),
+            .limit = limit,
+            .total = total,
+            .allocator = allocator,
+            .scratch = std.heap.ArenaAllocator.init(allocator),
+        };
+    }
+};
+
+fn countWorkerThread(ctx: *CountWorkerContext) void {
+    countMorsels(ctx) catch |err| {
+        ctx.failure = err;
+        ctx.queue.stop.store(true, .monotonic);
     };
+}
 
-    // Create results for each thread
-    var contexts = try allocator.alloc(OutputWorkerContext, num_threads);
-    defer {
+fn countMorsels(ctx: *CountWorkerContext) !void {
+    const alloc = ctx.scratch.allocator();
+    var local: usize = 0;
+    defer _ = ctx.count.fetchAdd(local, .monotonic);
+
+    var indexer = simd.RecordIndexer.init(&.{});
+    defer indexer.deinit(ctx.allocator);
+
+    // Without a columnar plan every record takes the row path
+    var counter: ?batch.BatchCounter = if (ctx.batch_plan) |bp| batch.BatchCounter.init(bp) else null;
+
+    // Match counts are additive, so morsels can finish in any order
+    while (ctx.queue.pop()) |m| {
+        const morsel = ctx.queue.morsels[m];
+        var morsel_count: usize = 0;
+        var records: usize = 0;
+        timing.idle(ctx.worker);
+        indexer.reset(morsel);
+        indexer.framing = ctx.queue.inputs.formatOf(m).framing();
+        if (counter) |*c| c.begin(morsel);
+        while (try indexer.next(ctx.allocator)) |record| {
+            if (record.line.len == 0) continue;
+            records += 1;
+            if (!ctx.prefilter.mayMatch(record.line)) continue;
+            timing.lap(ctx.worker, .scan);
+            if (counter) |*c| {
+                if (c.add(record.tokens) != .undecided) {
+                    timing.lap(ctx.worker, .filter);
+                    continue;
+                }
+            }
+            defer _ = ctx.scratch.reset(.retain_capacity);
+            var obj = json_parser.parseObjectTokens(morsel, record.tokens, alloc, ctx.projection) catch |err| switch (err) {
+                error.OutOfMemory => return error.OutOfMemory,
+                else => {
+                    if (ctx.worker) |w| w.parse_failures += 1;
+                    continue;
+                },
+            };
+            timing.lap(ctx.worker, .parse);
+            if (ctx.plan.matches(&obj)) morsel_count += 1;
+            timing.lap(ctx.worker, .filter);
+        }
+        if (counter) |*c| morsel_count += c.end();
+        local += morsel_count;
+        if (ctx.worker) |w| {
+            timing.lap(w, .scan);
+            w.bytes_scanned += morsel.len;
+            w.records += records;
+            w.matches += morsel_count;
+        }
+
+        // With a limit, stop everyone once the shared total reaches it
+        if (ctx.limit) |limit| {
+            const total = ctx.total.fetchAdd(morsel_count, .monotonic) + morsel_count;
+            if (total >= limit) ctx.queue.stop.store(true, .monotonic);
+        }
+    }
+}
+
+/// Count matching records without materialising any objects.
+/// Much faster than processFile() for --count mode. With `config.limit` the
+/// result is capped at the limit and the scan stops as soon as it is reached.
+pub fn processFileCount(
+    file_path: []const u8,
+    filter: *const query.Filter,
+    config: Config,
+    allocator: std.mem.Allocator,
+) !usize {
+    return processFilesCount(&.{file_path}, &.{config.index}, filter, config, allocator);
+}
+
+/// `processFileCount` over several files at once, with one worker pool.
+/// `indexes` holds the sidecar index of each path, if any.
+pub fn processFilesCount(
+    paths: []const []const u8,
+    indexes: ?[]const ?*const Index,
+    filter: *const query.Filter,
+    config: Config,
+    allocator: std.mem.Allocator,
+) !usize {
+    var inputs = try Inputs.openFiles(paths, indexes, filter, config, allocator);
+    defer inputs.deinit();
+
+    var plan = try Plan.init(filter, allocator);
+    defer plan.deinit();
+    if (config.kernel) |kernel| plan.kernel = kernel;
+    var prefilter = try Prefilter.init(filter, allocator);
+    defer prefilter.deinit();
+
+    // Counting never outputs records, so only the filtered fields are ever built
+    var projection = json_parser.Projection{};
+    defer projection.deinit(allocator);
+    try query.addFilterPaths(filter, &projection, allocator);
+    var batch_plan = try batch.BatchPlan.init(&plan, allocator);
+    defer if (batch_plan) |*b| b.deinit();
+
+    const morsels = inputs.morsels;
+    var queue = MorselQueue{ .morsels = morsels, .inputs = &inputs };
+    var total = std.atomic.Value(usize).init(0);
+
+    const num_threads = workerCount(config, morsels.len);
+    var contexts = try allocator.alloc(CountWorkerContext, num_threads);
+    defer allocator.free(contexts);
+    const workers = try statsWorkers(config, num_threads);
+    for (0..num_threads) |i| {
+        contexts[i] = CountWorkerContext.init(
+            &queue,
+            &plan,
+            &prefilter,
+            &projection,
+            if (batch_plan) |*b| b else null,
+            config.limit,
+            &total,
+            allocator,
+        );
+        if (workers) |w| contexts[i].worker = &w[i];
+    }
+    defer {
+        for (contexts) |*ctx| ctx.scratch.deinit();
+    }
+
+    var threads = try allocator.alloc(std.Thread, num_threads);
+    defer allocator.free(threads);
+    for (0..num_threads) |i| threads[i] = try std.Thread.spawn(.{}, countWorkerThread, .{&contexts[i]});
+    for (threads) |t| t.join();
+
+    var count: usize = 0;
+    for (contexts) |*ctx| {
+        if (ctx.failure) |err| return err;
+        count += ctx.count.load(.monotonic);
+    }
+    if (config.limit) |limit| count = @min(count, limit);
+    return count;
+}
+
+const AggregateWorkerContext = struct {
+    queue: *MorselQueue,
+    plan: *const Plan,
+    prefilter: *const Prefilter,
+    /// Fields the filter and the aggregates read
+    projection: *const json_parser.Projection,
+    /// This worker's groups, merged with the others' after join
+    table: aggregate.Table,
+    allocator: std.mem.Allocator,
+    /// Per-line parse memory, reset after every line
+    scratch: std.heap.ArenaAllocator,
+    /// This worker's `Config.stats` slot
+    worker: ?*timing.Worker = null,
+    failure: ?anyerror = null,
+};
+
+fn aggregateWorkerThread(ctx: *AggregateWorkerContext) void {
+    aggregateMorsels(ctx) catch |err| {
+        ctx.failure = err;
+        ctx.queue.stop.store(true, .monotonic);
+    };
+}
+
+fn aggregateMorsels(ctx: *AggregateWorkerContext) !void {
+    const alloc = ctx.scratch.allocator();
+    var indexer = simd.RecordIndexer.init(&.{});
+    defer indexer.deinit(ctx.allocator);
+
+    // Tables only add up, so morsels can finish in any order
+    while (ctx.queue.pop()) |m| {
+        const morsel = ctx.queue.morsels[m];
+        var records: usize = 0;
+        var matches: usize = 0;
+        timing.idle(ctx.worker);
+        indexer.reset(morsel);
+        indexer.framing = ctx.queue.inputs.formatOf(m).framing();
+        while (try indexer.next(ctx.allocator)) |record| {
+            if (record.line.len == 0) continue;
+            records += 1;
+            if (!ctx.prefilter.mayMatch(record.line)) continue;
+            timing.lap(ctx.worker, .scan);
+            defer _ = ctx.scratch.reset(.retain_capacity);
+            var obj = json_parser.parseObjectTokens(morsel, record.tokens, alloc, ctx.projection) catch {
+                if (ctx.worker) |w| w.parse_failures += 1;
+                continue;
+            };
+            timing.lap(ctx.worker, .parse);
+            const matched = ctx.plan.matches(&obj);
+            timing.lap(ctx.worker, .filter);
+            if (!matched) continue;
+            matches += 1;
+            try ctx.table.add(obj, alloc);
+            timing.lap(ctx.worker, .output);
+        }
+        if (ctx.worker) |w| {
+            timing.lap(w, .scan);
+            w.bytes_scanned += morsel.len;
+            w.records += records;
+            w.matches += matches;
+        }
+    }
+}
+
+/// Group the matches of every file by `spec` and aggregate them in one
+/// worker pool. Only the groups come back, as a table owned by the caller;
+/// no record is kept.
+pub fn processFilesAggregate(
+    paths: []const []const u8,
+    indexes: ?[]const ?*const Index,
+    filter: *const query.Filter,
+    config: Config,
+    spec: *const aggregate.Spec,
+    allocator: std.mem.Allocator,
+) !aggregate.Table {
+    var inputs = try Inputs.openFiles(paths, indexes, filter, config, allocator);
+    defer inputs.deinit();
+    return aggregateInputs(&inputs, filter, config, spec, allocator);
+}
+
+/// `processFilesAggregate` over data already in memory.
+pub fn processDataAggregate(
+    data: []const u8,
+    filter: *const query.Filter,
+    config: Config,
+    spec: *const aggregate.Spec,
+    allocator: std.mem.Allocator,
+) !aggregate.Table {
+    var inputs = try Inputs.fromData(data, filter, config, allocator);
+    defer inputs.deinit();
+    return aggregateInputs(&inputs, filter, config, spec, allocator);
+}
+
+fn aggregateInputs(
+    inputs: *const Inputs,
+    filter: *const query.Filter,
+    config: Config,
+    spec: *const aggregate.Spec,
+    allocator: std.mem.Allocator,
+) !aggregate.Table {
+    var plan = try Plan.init(filter, allocator);
+    defer plan.deinit();
+    if (config.kernel) |kernel| plan.kernel = kernel;
+    var prefilter = try Prefilter.init(filter, allocator);
+    defer prefilter.deinit();
+
+    // Only the filtered and aggregated fields are ever built
+    var projection = json_parser.Projection{};
+    defer projection.deinit(allocator);
+    try query.addFilterPaths(filter, &projection, allocator);
+    try spec.addPaths(&projection, allocator);
+
+    var queue = MorselQueue{ .morsels = inputs.morsels, .inputs = inputs };
+    const num_threads = workerCount(config, inputs.morsels.len);
+    var contexts = try allocator.alloc(AggregateWorkerContext, num_threads);
+    defer allocator.free(contexts);
+    const workers = try statsWorkers(config, num_threads);
+    var ready: usize = 0;
+    defer {
+        for (contexts[0..ready]) |*ctx| {
+            ctx.table.deinit();
+            ctx.scratch.deinit();
+        }
+    }
+    while (ready < num_threads) : (ready += 1) {
+        contexts[ready] = .{
+            .queue = &queue,
+            .plan = &plan,
+            .prefilter = &prefilter,
+            .projection = &projection,
+            .table = try aggregate.Table.init(spec, allocator),
+            .allocator = allocator,
+            .scratch = std.heap.ArenaAllocator.init(allocator),
+            .worker = if (workers) |w| &w[ready] else null,
+        };
+    }
+
+    var threads = try allocator.alloc(std.Thread, num_threads);
+    defer allocator.free(threads);
+    for (0..num_threads) |i| threads[i] = try std.Thread.spawn(.{}, aggregateWorkerThread, .{&contexts[i]});
+    for (threads) |t| t.join();
+
+    var merged = try aggregate.Table.init(spec, allocator);
+    errdefer merged.deinit();
+    for (contexts) |*ctx| {
+        if (ctx.failure) |err| return err;
+        try merged.merge(&ctx.table);
+    }
+    return merged;
+}
+
+const TopKWorkerContext = struct {
+    queue: *MorselQueue,
+    plan: *const Plan,
+    prefilter: *const Prefilter,
+    /// Fields the filter and the sort key read
+    projection: *const json_parser.Projection,
+    /// This worker's best records, merged with the others' after join
+    top: sort.TopK,
+    allocator: std.mem.Allocator,
+    /// Per-line parse memory, reset after every line
+    scratch: std.heap.ArenaAllocator,
+    /// This worker's `Config.stats` slot
+    worker: ?*timing.Worker = null,
+    failure: ?anyerror = null,
+};
+
+fn topKWorkerThread(ctx: *TopKWorkerContext) void {
+    topKMorsels(ctx) catch |err| {
+        ctx.failure = err;
+        ctx.queue.stop.store(true, .monotonic);
+    };
+}
+
+fn topKMorsels(ctx: *TopKWorkerContext) !void {
+    const alloc = ctx.scratch.allocator();
+    var indexer = simd.RecordIndexer.init(&.{});
+    defer indexer.deinit(ctx.allocator);
+
+    while (ctx.queue.pop()) |m| {
+        const morsel = ctx.queue.morsels[m];
+        const source = ctx.queue.inputs.source_of[m];
+        var records: usize = 0;
+        var matches: usize = 0;
+        timing.idle(ctx.worker);
+        indexer.reset(morsel);
+        indexer.framing = ctx.queue.inputs.formatOf(m).framing();
+        while (try indexer.next(ctx.allocator)) |record| {
+            if (record.line.len == 0) continue;
+            records += 1;
+            if (!ctx.prefilter.mayMatch(record.line)) continue;
+            timing.lap(ctx.worker, .scan);
+            defer _ = ctx.scratch.reset(.retain_capacity);
+            var obj = json_parser.parseObjectTokens(morsel, record.tokens, alloc, ctx.projection) catch {
+                if (ctx.worker) |w| w.parse_failures += 1;
+                continue;
+            };
+            timing.lap(ctx.worker, .parse);
+            const matched = ctx.plan.matches(&obj);
+            timing.lap(ctx.worker, .filter);
+            if (!matched) continue;
+            matches += 1;
+            // Morsels are in input order, and so are records within one
+            const offset = @intFromPtr(record.line.ptr) - @intFromPtr(morsel.ptr);
+            const seq = @as(u128, m) << 64 | offset;
+            try ctx.top.offer(sort.Key.of(sort.resolve(obj, ctx.top.order.field)), record.line, seq, source);
+            timing.lap(ctx.worker, .output);
+        }
+        if (ctx.worker) |w| {
+            timing.lap(w, .scan);
+            w.bytes_scanned += morsel.len;
+            w.records += records;
+            w.matches += matches;
+        }
+    }
+}
+
+/// The first `limit` matches of every file under `order` (`--sort-by` with
+/// `--limit`). Each worker keeps a bounded heap of its best records, so
+/// memory is O(threads × limit) rather than O(matches); only the records
+/// that make the final cut are parsed in full. The result keeps the files
+/// mapped.
+pub fn processFilesTopK(
+    paths: []const []const u8,
+    indexes: ?[]const ?*const Index,
+    filter: *const query.Filter,
+    config: Config,
+    order: sort.Order,
+    limit: usize,
+    allocator: std.mem.Allocator,
+) !ChunkResult {
+    var inputs = try Inputs.openFiles(paths, indexes, filter, config, allocator);
+    errdefer inputs.deinit();
+    var result = try topKInputs(&inputs, filter, config, order, limit, allocator);
+    result.inputs = inputs;
+    return result;
+}
+
+/// `processFilesTopK` over data already in memory, which must outlive the result.
+pub fn processDataTopK(
+    data: []const u8,
+    filter: *const query.Filter,
+    config: Config,
+    order: sort.Order,
+    limit: usize,
+    allocator: std.mem.Allocator,
+) !ChunkResult {
+    var inputs = try Inputs.fromData(data, filter, config, allocator);
+    defer inputs.deinit();
+    return topKInputs(&inputs, filter, config, order, limit, allocator);
+}
+
+fn topKInputs(
+    inputs: *const Inputs,
+    filter: *const query.Filter,
+    config: Config,
+    order: sort.Order,
+    limit: usize,
+    allocator: std.mem.Allocator,
+) !ChunkResult {
+    var plan = try Plan.init(filter, allocator);
+    defer plan.deinit();
+    if (config.kernel) |kernel| plan.kernel = kernel;
+    var prefilter = try Prefilter.init(filter, allocator);
+    defer prefilter.deinit();
+
+    var projection = json_parser.Projection{};
+    defer projection.deinit(allocator);
+    try query.addFilterPaths(filter, &projection, allocator);
+    try projection.addPath(allocator, order.field);
+
+    var queue = MorselQueue{ .morsels = inputs.morsels, .inputs = inputs };
+    const num_threads = workerCount(config, inputs.morsels.len);
+    var contexts = try allocator.alloc(TopKWorkerContext, num_threads);
+    defer allocator.free(contexts);
+    const workers = try statsWorkers(config, num_threads);
+    for (contexts, 0..) |*ctx, i| ctx.* = .{
+        .queue = &queue,
+        .plan = &plan,
+        .prefilter = &prefilter,
+        .projection = &projection,
+        .top = sort.TopK.init(order, limit, allocator),
+        .allocator = allocator,
+        .scratch = std.heap.ArenaAllocator.init(allocator),
+        .worker = if (workers) |w| &w[i] else null,
+    };
+    defer {
         for (contexts) |*ctx| {
-            ctx.output_buffer.deinit(allocator);
+            ctx.top.deinit();
+            ctx.scratch.deinit();
         }
+    }
+
+    var threads = try allocator.alloc(std.Thread, num_threads);
+    defer allocator.free(threads);
+    for (0..num_threads) |i| threads[i] = try std.Thread.spawn(.{}, topKWorkerThread, .{&contexts[i]});
+    for (threads) |t| t.join();
+
+    var top = sort.TopK.init(order, limit, allocator);
+    defer top.deinit();
+    for (contexts) |*ctx| {
+        if (ctx.failure) |err| return err;
+        try top.merge(&ctx.top);
+    }
+
+    var result = ChunkResult.init(allocator);
+    errdefer result.deinit();
+    const match_allocator = try result.matchAllocator();
+    for (top.sorted()) |entry| {
+        var obj = try json_parser.parseObject(entry.line, match_allocator);
+        if (inputs.labels != null) obj = try withFilename(obj, inputs.paths[entry.source], match_allocator);
+        try result.matches.append(allocator, obj);
+    }
+    return result;
+}
+
+/// Process an NDJSON or JSON array file. The file stays mapped for the life of
+/// the result, since matched values are slices into it.
+pub fn processFile(
+    file_path: []const u8,
+    filter: *const query.Filter,
+    config: Config,
+    allocator: std.mem.Allocator,
+) !ChunkResult {
+    return processFiles(&.{file_path}, &.{config.index}, filter, config, allocator);
+}
+
+/// `processFile` over several files at once: one worker pool draws morsels of
+/// every file from one queue, and matches come back in file order.
+/// `indexes` holds the sidecar index of each path, if any. With
+/// `config.with_filename` the matches borrow `paths`, which must outlive them.
+pub fn processFiles(
+    paths: []const []const u8,
+    indexes: ?[]const ?*const Index,
+    filter: *const query.Filter,
+    config: Config,
+    allocator: std.mem.Allocator,
+) !ChunkResult {
+    var inputs = try Inputs.openFiles(paths, indexes, filter, config, allocator);
+    errdefer inputs.deinit();
+    var merged = try filterMorsels(&inputs, filter, config, allocator);
+    // Keep the input alive as long as merged
+    merged.inputs = inputs;
+    return merged;
+}
+
+/// Process NDJSON or JSON array data from memory (useful for testing).
+/// Matches are slices into `data`, which must outlive the result.
+pub fn processData(
+    data: []const u8,
+    filter: *const query.Filter,
+    config: Config,
+    allocator: std.mem.Allocator,
+) !ChunkResult {
+    var inputs = try Inputs.fromData(data, filter, config, allocator);
+    defer inputs.deinit();
+    return filterMorsels(&inputs, filter, config, allocator);
+}
+
+/// Process NDJSON file with parallel output generation (sieswi-style optimization)
+/// Each thread processes its chunk AND generates output simultaneously
+/// Returns the matches serialized as NDJSON, in input order
+pub fn processFileWithOutput(
+    file_path: []const u8,
+    filter: *const query.Filter,
+    config: Config,
+    select_fields: ?[]const []const u8,
+    allocator: std.mem.Allocator,
+) !std.ArrayList(u8) {
+    var out = std.ArrayList(u8){};
+    errdefer out.deinit(allocator);
+    try filterFilesOrdered(&.{file_path}, &.{config.index}, filter, config, select_fields, .{}, .{ .memory = &out }, allocator);
+    return out;
+}
+
+/// Like `processFileWithOutput`, but each morsel's output goes straight to
+/// `out` (typically stdout) as soon as every morsel before it is written.
+pub fn processFileToFile(
+    file_path: []const u8,
+    filter: *const query.Filter,
+    config: Config,
+    select_fields: ?[]const []const u8,
+    out: std.fs.File,
+    allocator: std.mem.Allocator,
+) !void {
+    try filterFilesOrdered(&.{file_path}, &.{config.index}, filter, config, select_fields, .{}, .{ .file = out }, allocator);
+}
+
+/// `processFileToFile` over several files at once, with one worker pool;
+/// the output of each file follows that of the files before it.
+/// `indexes` holds the sidecar index of each path, if any.
+pub fn processFilesToFile(
+    paths: []const []const u8,
+    indexes: ?[]const ?*const Index,
+    filter: *const query.Filter,
+    config: Config,
+    select_fields: ?[]const []const u8,
+    out: std.fs.File,
+    allocator: std.mem.Allocator,
+) !void {
+    try filterFilesOrdered(paths, indexes, filter, config, select_fields, .{}, .{ .file = out }, allocator);
+}
+
+/// `processFilesToFile` for every output format: each worker serializes the
+/// matches of its morsels as JSON array elements or CSV rows, and the
+/// morsels are stitched in order with the brackets or header around them.
+/// `config.limit` is for NDJSON only.
+pub fn processFilesToFileStyled(
+    paths: []const []const u8,
+    indexes: ?[]const ?*const Index,
+    filter: *const query.Filter,
+    config: Config,
+    select_fields: ?[]const []const u8,
+    style: output.Style,
+    out: std.fs.File,
+    allocator: std.mem.Allocator,
+) !void {
+    std.debug.assert(style.format == .ndjson or config.limit == null);
+    try filterFilesOrdered(paths, indexes, filter, config, select_fields, style, .{ .file = out }, allocator);
+}
+
+fn filterFilesOrdered(
+    paths: []const []const u8,
+    indexes: ?[]const ?*const Index,
+    filter: *const query.Filter,
+    config: Config,
+    select_fields: ?[]const []const u8,
+    style: output.Style,
+    target: OrderedSink.Target,
+    allocator: std.mem.Allocator,
+) !void {
+    var inputs = try Inputs.openFiles(paths, indexes, filter, config, allocator);
+    defer inputs.deinit();
+
+    var ndjson_filter = try NdjsonFilter.initStyled(filter, select_fields, style, allocator);
+    defer ndjson_filter.deinit();
+
+    const morsels = inputs.morsels;
+    var ordered_limit: ?OrderedLimit = if (config.limit) |limit| try OrderedLimit.init(limit, morsels.len, allocator) else null;
+    defer if (ordered_limit) |*l| l.deinit(allocator);
+    var queue = MorselQueue{ .morsels = morsels, .inputs = &inputs, .limit = if (ordered_limit) |*l| l else null };
+
+    // One output buffer per morsel, emitted in morsel order as they complete
+    var sink = try OrderedSink.init(target, morsels.len, config.limit, style, allocator);
+    defer sink.deinit();
+
+    // Context for worker threads that generate output
+    const OutputWorkerContext = struct {
+        queue: *MorselQueue,
+        filter: *const NdjsonFilter,
+        sink: *OrderedSink,
+        /// Per-line parse memory, reset after every line
+        scratch: std.heap.ArenaAllocator,
+        lines_processed: usize = 0,
+        worker: ?*timing.Worker = null,
+        failure: ?anyerror = null,
+    };
+
+    const num_threads = workerCount(config, morsels.len);
+    var contexts = try allocator.alloc(OutputWorkerContext, num_threads);
+    defer {
+        for (contexts) |*ctx| ctx.scratch.deinit();
         allocator.free(contexts);
     }
+    const workers = try statsWorkers(config, num_threads);
 
     for (0..num_threads) |i| {
         contexts[i] = .{
-            .data = chunks[i],
-            .filter = filter,
-            .select_fields = select_fields,
-            .output_buffer = .{},
-            .allocator = allocator,
+            .queue = &queue,
+            .filter = &ndjson_filter,
+            .sink = &sink,
+            .scratch = std.heap.ArenaAllocator.init(allocator),
+            .worker = if (workers) |w| &w[i] else null,
         };
     }
 
     // Worker function that processes AND generates output
     const workerFunc = struct {
         fn process(ctx: *OutputWorkerContext) void {
-            const writer = ctx.output_buffer.writer(ctx.allocator);
-
-            var line_iter = std.mem.splitScalar(u8, ctx.data, '\n');
-            while (line_iter.next()) |line| {
-                if (line.len == 0) continue;
-                ctx.lines_processed += 1;
-
-                // Parse JSON object
-                var obj = json_parser.parseObject(line, ctx.allocator) catch continue;
-                defer obj.deinit();
-
-                // Evaluate filter
-                if (!query.matches(&obj, ctx.filter)) {
-                    continue;
-                }
-
-                // Generate output directly (zero-copy: obj fields are slices into mmap'd data)
-                output_mod.writeNdjson(writer, &[_]json_parser.JsonObject{obj}, ctx.select_fields) catch continue;
+            const max_matches = if (ctx.queue.limit) |l| l.limit else null;
+            while (ctx.queue.pop()) |m| {
+                const stats = ctx.filter.run(ctx.queue.morsels[m], ctx.queue.inputs.formatOf(m), ctx.sink.buffer(m), &ctx.scratch, .{
+                    .max_matches = max_matches,
+                    .cancel = &ctx.queue.stop,
+                    .worker = ctx.worker,
+                    .label = ctx.queue.inputs.labelOf(m),
+                    .header = ctx.sink.header(m),
+                }) catch |err| {
+                    // The other workers stop too; the command fails after join
+                    ctx.failure = err;
+                    ctx.queue.stop.store(true, .monotonic);
+                    return;
+                };
+                ctx.lines_processed += stats.lines_processed;
+                ctx.queue.finish(m, stats.matches);
+                ctx.sink.finish(m);
+                // Whichever worker flushes the sink spends that time writing
+                timing.lap(ctx.worker, .write);
             }
         }
     }.process;
@@ -622,20 +1875,14 @@ pub fn processFileWithOutput(
     for (threads) |thread| {
         thread.join();
     }
-
-    // Concatenate all output buffers into one (still no locks!)
-    // Calculate total size first to avoid reallocations
-    var total_size: usize = 0;
-    for (contexts) |*ctx| {
-        total_size += ctx.output_buffer.items.len;
-    }
-
-    var final_output = try std.ArrayList(u8).initCapacity(allocator, total_size);
     for (contexts) |*ctx| {
-        try final_output.appendSlice(allocator, ctx.output_buffer.items);
+        if (ctx.failure) |err| return err;
     }
 
-    return final_output;
+    // Morsels abandoned after the limit was confirmed are empty or cut by it
+    var write = timing.Span.start(config.stats);
+    defer write.end(.write);
+    try sink.close();
 }
 
 // ============================================================================
@@ -704,7 +1951,7 @@ test "parallel: multi-threaded processing" {
     try std.testing.expectEqual(@as(usize, 50), result.matches.items.len);
 }
 
-test "parallel: chunk splitting" {
+test "parallel: morsel splitting" {
     const allocator = std.testing.allocator;
 
     const data =
@@ -712,18 +1959,184 @@ test "parallel: chunk splitting" {
         \\{"b": 2}
         \\{"c": 3}
         \\{"d": 4}
+    ;
+
+    const morsels = try splitIntoMorsels(data, 12, allocator);
+    defer allocator.free(morsels);
+
+    // 12 bytes end inside the second line, so each morsel holds two lines
+    try std.testing.expectEqual(@as(usize, 2), morsels.len);
+    try std.testing.expectEqualStrings("{\"a\": 1}\n{\"b\": 2}\n", morsels[0]);
+    try std.testing.expectEqualStrings("{\"c\": 3}\n{\"d\": 4}", morsels[1]);
+
+    // A morsel boundary landing right after a newline does not take another line
+    const exact = try splitIntoMorsels(data, 9, allocator);
+    defer allocator.free(exact);
+    try std.testing.expectEqual(@as(usize, 4), exact.len);
+}
+
+test "parallel: morsels keep matches in input order" {
+    const allocator = std.testing.allocator;
+
+    var data_list = std.ArrayList(u8){};
+    defer data_list.deinit(allocator);
+    const writer = data_list.writer(allocator);
+    for (0..3000) |i| {
+        // Uneven line lengths so morsels carry very different amounts of work
+        const pad: []const u8 = if (i % 100 < 10) "x" ** 200 else "";
+        try writer.print("{{\"id\": {d}, \"pad\": \"{s}\"}}\n", .{ i, pad });
+    }
+
+    var filter = try query.parseQuery("{\"id\": {\"$gte\": 0}}", allocator);
+    defer filter.deinit(allocator);
+
+    var result = try processData(data_list.items, &filter.filter, .{ .num_threads = 4, .chunk_size = 512 }, allocator);
+    defer result.deinit();
+
+    try std.testing.expectEqual(@as(usize, 3000), result.matches.items.len);
+    for (result.matches.items, 0..) |obj, i| {
+        try std.testing.expectEqual(@as(i64, @intCast(i)), try json_parser.getInt(obj.get("id").?));
+    }
+}
+
+test "parallel: limit keeps the first matches in input order" {
+    const allocator = std.testing.allocator;
+
+    var data_list = std.ArrayList(u8){};
+    defer data_list.deinit(allocator);
+    const writer = data_list.writer(allocator);
+    for (0..3000) |i| {
+        // Matches are sparse early on and dense later, so later morsels fill up first
+        const tag: []const u8 = if (i < 1500 and i % 50 != 0) "skip" else "keep";
+        try writer.print("{{\"id\": {d}, \"tag\": \"{s}\"}}\n", .{ i, tag });
+    }
+
+    var filter = try query.parseQuery("{\"tag\": \"keep\"}", allocator);
+    defer filter.deinit(allocator);
+
+    var result = try processData(data_list.items, &filter.filter, .{ .num_threads = 4, .chunk_size = 256, .limit = 40 }, allocator);
+    defer result.deinit();
+
+    try std.testing.expectEqual(@as(usize, 40), result.matches.items.len);
+    for (result.matches.items, 0..) |obj, i| {
+        const expected: i64 = if (i < 30) @intCast(i * 50) else @intCast(1500 + i - 30);
+        try std.testing.expectEqual(expected, try json_parser.getInt(obj.get("id").?));
+    }
+}
+
+test "parallel: ordered sink emits finished morsels in order" {
+    const allocator = std.testing.allocator;
+    var out = std.ArrayList(u8){};
+    defer out.deinit(allocator);
+
+    var sink = try OrderedSink.init(.{ .memory = &out }, 4, 4, .{}, allocator);
+    defer sink.deinit();
+    const lines = [_][]const u8{ "a\nb\n", "c\n", "d\ne\n", "f\n" };
+    for (lines, 0..) |text, i| try sink.buffer(i).appendSlice(allocator, text);
+
+    // Nothing can be emitted before the first morsel is done
+    sink.finish(2);
+    sink.finish(1);
+    try std.testing.expectEqual(@as(usize, 0), out.items.len);
+    sink.finish(0);
+    try std.testing.expectEqualStrings("a\nb\nc\nd\n", out.items);
+    // Emitted buffers are freed right away
+    try std.testing.expectEqual(@as(usize, 0), sink.buffer(0).capacity);
+
+    try sink.close();
+    try std.testing.expectEqualStrings("a\nb\nc\nd\n", out.items);
+}
+
+test "parallel: unprojected matches are copied through verbatim" {
+    const allocator = std.testing.allocator;
+    const data = "  {\"id\": 1, \"s\": \"caf\\u00e9\", \"n\": 1.50e1}\r\n{\"id\":2}\n{ \"id\" : 3 , \"x\" : [ 1 ] }";
+
+    var parsed = try query.parseQuery("{\"id\":{\"$ne\":2}}", allocator);
+    defer parsed.deinit(allocator);
+    var filter = try NdjsonFilter.init(&parsed.filter, null, allocator);
+    defer filter.deinit();
+    var scratch = std.heap.ArenaAllocator.init(allocator);
+    defer scratch.deinit();
+    var out = std.ArrayList(u8){};
+    defer out.deinit(allocator);
+
+    const stats = try filter.run(data, .ndjson, &out, &scratch, .{});
+    try std.testing.expectEqual(@as(usize, 2), stats.matches);
+    try std.testing.expectEqualStrings("{\"id\": 1, \"s\": \"caf\\u00e9\", \"n\": 1.50e1}\n{ \"id\" : 3 , \"x\" : [ 1 ] }\n", out.items);
+}
+
+test "parallel: malformed records match in no output mode" {
+    const allocator = std.testing.allocator;
+    const data =
+        \\{"id":1,"x":}
+        \\{"id":2,"x":bogus}
+        \\{"id":3,"x":[1,,2]}
+        \\{"id":4,"x":[1}}
+        \\{"id":5,"x":[1,2]}
         \\
     ;
 
-    const chunks = try splitIntoChunks(data, 2, allocator);
-    defer allocator.free(chunks);
+    var parsed = try query.parseQuery("{\"id\":{\"$gte\":1}}", allocator);
+    defer parsed.deinit(allocator);
+    var scratch = std.heap.ArenaAllocator.init(allocator);
+    defer scratch.deinit();
+    for ([_]output.Style{ .{}, .{ .format = .json } }) |style| {
+        var filter = try NdjsonFilter.initStyled(&parsed.filter, null, style, allocator);
+        defer filter.deinit();
+        var out = std.ArrayList(u8){};
+        defer out.deinit(allocator);
+        try std.testing.expectEqual(@as(usize, 1), (try filter.run(data, .ndjson, &out, &scratch, .{})).matches);
+        // Counted through the batch path
+        try std.testing.expectEqual(@as(usize, 1), (try filter.run(data, .ndjson, null, &scratch, .{})).matches);
+        if (style.format == .ndjson) try std.testing.expectEqualStrings("{\"id\":5,\"x\":[1,2]}\n", out.items);
+    }
 
-    try std.testing.expectEqual(@as(usize, 2), chunks.len);
+    var result = try processData(data, &parsed.filter, .{ .num_threads = 2 }, allocator);
+    defer result.deinit();
+    try std.testing.expectEqual(@as(usize, 1), result.matches.items.len);
+}
+
+test "parallel: projected evaluation still returns complete records" {
+    const allocator = std.testing.allocator;
+
+    const data =
+        \\{"id": 1, "user": {"age": 41, "name": "Ann"}, "tags": ["a"]}
+        \\{"id": 2, "user": {"age": 20, "name": "Bob"}, "tags": ["b"]}
+        \\
+    ;
+
+    var filter = try query.parseQuery("{\"user.age\": {\"$gt\": 40}}", allocator);
+    defer filter.deinit(allocator);
+
+    var result = try processData(data, &filter.filter, .{ .num_threads = 1 }, allocator);
+    defer result.deinit();
 
-    // Each chunk should end with a newline or be the last chunk
-    for (chunks[0 .. chunks.len - 1]) |chunk| {
-        try std.testing.expect(chunk[chunk.len - 1] == '\n');
+    try std.testing.expectEqual(@as(usize, 2), result.lines_processed);
+    try std.testing.expectEqual(@as(usize, 1), result.matches.items.len);
+    const match = result.matches.items[0];
+    try std.testing.expectEqual(@as(usize, 3), match.fields.len);
+    try std.testing.expectEqualStrings("Ann", match.get("user").?.object.get("name").?.string);
+}
+
+test "parallel: records straddling stage-1 index windows" {
+    const allocator = std.testing.allocator;
+
+    // ~300KB: several index windows per chunk, with records cut at window edges
+    var data_list = std.ArrayList(u8){};
+    defer data_list.deinit(allocator);
+    const writer = data_list.writer(allocator);
+    for (0..4000) |i| {
+        try writer.print("{{\"id\": {d}, \"note\": \"a \\\"quoted\\\" {{note}}, [x]\", \"vals\": [{d}, {{\"k\": {d}}}]}}\n", .{ i, i % 7, i % 3 });
     }
+
+    var filter = try query.parseQuery("{\"vals\": {\"$size\": 2}, \"id\": {\"$lt\": 1000}}", allocator);
+    defer filter.deinit(allocator);
+
+    var result = try processData(data_list.items, &filter.filter, .{ .num_threads = 3 }, allocator);
+    defer result.deinit();
+
+    try std.testing.expectEqual(@as(usize, 4000), result.lines_processed);
+    try std.testing.expectEqual(@as(usize, 1000), result.matches.items.len);
 }
 
 test "jsonArrayToNdjson: basic conversion" {
@@ -754,3 +2167,301 @@ test "processData: JSON array input" {
 
     try std.testing.expectEqual(@as(usize, 2), result.matches.items.len);
 }
+
+test "processData: pretty-printed JSON array filtered in place across morsels" {
+    const allocator = std.testing.allocator;
+
+    var data = std.ArrayList(u8){};
+    defer data.deinit(allocator);
+    try data.appendSlice(allocator, "[\n");
+    for (0..2000) |i| {
+        if (i > 0) try data.appendSlice(allocator, ",\n");
+        const tag: []const u8 = if (i % 3 == 0) "a,]" else "b";
+        try data.writer(allocator).print("  {{\n    \"id\": {d},\n    \"tag\": \"{s}\"\n  }}", .{ i, tag });
+    }
+    try data.appendSlice(allocator, "\n]\n");
+
+    var filter = try query.parseQuery("{\"tag\": \"a,]\"}", allocator);
+    defer filter.deinit(allocator);
+
+    var result = try processData(data.items, &filter.filter, .{ .num_threads = 4, .chunk_size = 512 }, allocator);
+    defer result.deinit();
+
+    try std.testing.expectEqual(@as(usize, 2000), result.lines_processed);
+    try std.testing.expectEqual(@as(usize, 667), result.matches.items.len);
+    for (result.matches.items, 0..) |obj, i| {
+        try std.testing.expectEqual(@as(i64, @intCast(i * 3)), try json_parser.getInt(obj.get("id").?));
+    }
+
+    var limited = try processData(data.items, &filter.filter, .{ .num_threads = 4, .chunk_size = 512, .limit = 5 }, allocator);
+    defer limited.deinit();
+    try std.testing.expectEqual(@as(usize, 5), limited.matches.items.len);
+    try std.testing.expectEqual(@as(i64, 12), try json_parser.getInt(limited.matches.items[4].get("id").?));
+}
+
+test "processFiles: several files share one pool and keep file order" {
+    const allocator = std.testing.allocator;
+
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+    var ndjson = std.ArrayList(u8){};
+    defer ndjson.deinit(allocator);
+    for (0..300) |i| {
+        const even: []const u8 = if (i % 2 == 0) "true" else "false";
+        try ndjson.writer(allocator).print("{{\"id\":{d},\"even\":{s}}}\n", .{ i, even });
+    }
+    try tmp.dir.writeFile(.{ .sub_path = "a.ndjson", .data = ndjson.items });
+    try tmp.dir.writeFile(.{ .sub_path = "b.ndjson", .data = "" });
+    try tmp.dir.writeFile(.{ .sub_path = "c.json", .data = "[{\"id\":1000,\"even\":true},{\"id\":1001,\"even\":false}]" });
+
+    const dir_path = try tmp.dir.realpathAlloc(allocator, ".");
+    defer allocator.free(dir_path);
+    var paths: [3][]const u8 = undefined;
+    for (&paths, [_][]const u8{ "a.ndjson", "b.ndjson", "c.json" }) |*path, name| path.* = try std.fs.path.join(allocator, &.{ dir_path, name });
+    defer {
+        for (paths) |path| allocator.free(path);
+    }
+
+    var filter = try query.parseQuery("{\"even\": true}", allocator);
+    defer filter.deinit(allocator);
+    const config = Config{ .num_threads = 4, .chunk_size = 256, .with_filename = true };
+
+    var result = try processFiles(&paths, null, &filter.filter, config, allocator);
+    defer result.deinit();
+    try std.testing.expectEqual(@as(usize, 151), result.matches.items.len);
+    try std.testing.expectEqualStrings(paths[0], result.matches.items[0].get(filename_key).?.string);
+    const last = result.matches.items[150];
+    try std.testing.expectEqualStrings(paths[2], last.get(filename_key).?.string);
+    try std.testing.expectEqualStrings("1000", last.get("id").?.number);
+
+    try std.testing.expectEqual(@as(usize, 151), try processFilesCount(&paths, null, &filter.filter, config, allocator));
+
+    var out = std.ArrayList(u8){};
+    defer out.deinit(allocator);
+    try filterFilesOrdered(&paths, null, &filter.filter, config, null, .{}, .{ .memory = &out }, allocator);
+    var lines = std.mem.splitScalar(u8, out.items, '\n');
+    const first = lines.next().?;
+    try std.testing.expect(std.mem.startsWith(u8, first, "{\"_file\":\""));
+    try std.testing.expect(std.mem.endsWith(u8, first, "\",\"id\":0,\"even\":true}"));
+    try std.testing.expectEqual(@as(usize, 151), std.mem.count(u8, out.items, "\n"));
+}
+
+test "filterFilesOrdered: JSON and CSV stitched from morsels match the serial writers" {
+    const allocator = std.testing.allocator;
+
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+    var ndjson = std.ArrayList(u8){};
+    defer ndjson.deinit(allocator);
+    // The first matches have no "note", so the CSV header is the first match's
+    for (0..500) |i| {
+        if (i < 40) {
+            try ndjson.writer(allocator).print("{{\"id\": {d}, \"n\": {d}}}\n", .{ i, i % 5 });
+        } else {
+            try ndjson.writer(allocator).print("{{\"id\":{d},\"n\":{d},\"note\":\"a, \\\"b\\\"\"}}\n", .{ i, i % 5 });
+        }
+    }
+    try tmp.dir.writeFile(.{ .sub_path = "in.ndjson", .data = ndjson.items });
+    const path = try tmp.dir.realpathAlloc(allocator, "in.ndjson");
+    defer allocator.free(path);
+    const paths = [_][]const u8{path};
+
+    const config = Config{ .num_threads = 4, .chunk_size = 256 };
+    const queries = [_][]const u8{ "{\"n\": {\"$gte\": 3}}", "{\"n\": 9}" };
+    const styles = [_]output.Style{ .{ .format = .json }, .{ .format = .json, .pretty = true }, .{ .format = .csv } };
+    const selects = [_]?[]const []const u8{ null, &.{ "note", "id" } };
+    for (queries) |query_str| {
+        var filter = try query.parseQuery(query_str, allocator);
+        defer filter.deinit(allocator);
+        var result = try processFiles(&paths, null, &filter.filter, config, allocator);
+        defer result.deinit();
+
+        for (styles) |style| {
+            for (selects) |select| {
+                var expected = std.ArrayList(u8){};
+                defer expected.deinit(allocator);
+                const writer = expected.writer(allocator);
+                if (style.format == .csv) {
+                    try output.writeCsv(writer, result.matches.items, select);
+                } else {
+                    try output.writeJson(writer, result.matches.items, select, style.pretty);
+                }
+
+                var out = std.ArrayList(u8){};
+                defer out.deinit(allocator);
+                try filterFilesOrdered(&paths, null, &filter.filter, config, select, style, .{ .memory = &out }, allocator);
+                try std.testing.expectEqualStrings(expected.items, out.items);
+            }
+        }
+    }
+}
+
+/// Fails every allocation made off the thread that created it, as if the
+/// workers ran out of memory while the caller did not.
+const WorkerFailingAllocator = struct {
+    child: std.mem.Allocator,
+    owner: std.Thread.Id,
+
+    fn init(child: std.mem.Allocator) WorkerFailingAllocator {
+        return .{ .child = child, .owner = std.Thread.getCurrentId() };
+    }
+
+    fn allocator(self: *WorkerFailingAllocator) std.mem.Allocator {
+        return .{ .ptr = self, .vtable = &.{ .alloc = alloc, .resize = resize, .remap = remap, .free = free } };
+    }
+
+    fn onWorker(ctx: *anyopaque) ?std.mem.Allocator {
+        const self: *WorkerFailingAllocator = @ptrCast(@alignCast(ctx));
+        return if (std.Thread.getCurrentId() == self.owner) self.child else null;
+    }
+
+    fn alloc(ctx: *anyopaque, len: usize, alignment: std.mem.Alignment, ret_addr: usize) ?[*]u8 {
+        const child = onWorker(ctx) orelse return null;
+        return child.rawAlloc(len, alignment, ret_addr);
+    }
+
+    fn resize(ctx: *anyopaque, memory: []u8, alignment: std.mem.Alignment, new_len: usize, ret_addr: usize) bool {
+        const child = onWorker(ctx) orelse return false;
+        return child.rawResize(memory, alignment, new_len, ret_addr);
+    }
+
+    fn remap(ctx: *anyopaque, memory: []u8, alignment: std.mem.Alignment, new_len: usize, ret_addr: usize) ?[*]u8 {
+        const child = onWorker(ctx) orelse return null;
+        return child.rawRemap(memory, alignment, new_len, ret_addr);
+    }
+
+    fn free(ctx: *anyopaque, memory: []u8, alignment: std.mem.Alignment, ret_addr: usize) void {
+        const self: *WorkerFailingAllocator = @ptrCast(@alignCast(ctx));
+        self.child.rawFree(memory, alignment, ret_addr);
+    }
+};
+
+test "filterFilesOrdered: a worker that fails fails the command" {
+    const allocator = std.testing.allocator;
+
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+    var ndjson = std.ArrayList(u8){};
+    defer ndjson.deinit(allocator);
+    for (0..500) |i| try ndjson.writer(allocator).print("{{\"id\":{d}}}\n", .{i});
+    try tmp.dir.writeFile(.{ .sub_path = "in.ndjson", .data = ndjson.items });
+    const path = try tmp.dir.realpathAlloc(allocator, "in.ndjson");
+    defer allocator.free(path);
+    const paths = [_][]const u8{path};
+
+    var filter = try query.parseQuery("{\"id\": {\"$gte\": 0}}", allocator);
+    defer filter.deinit(allocator);
+    var failing = WorkerFailingAllocator.init(allocator);
+    var out = std.ArrayList(u8){};
+    defer out.deinit(allocator);
+    const config = Config{ .num_threads = 4, .chunk_size = 256 };
+    try std.testing.expectError(error.OutOfMemory, filterFilesOrdered(&paths, null, &filter.filter, config, null, .{}, .{ .memory = &out }, failing.allocator()));
+}
+
+test "parallel: running out of parse memory fails the chunk" {
+    const allocator = std.testing.allocator;
+    var parsed = try query.parseQuery("{\"id\":1}", allocator);
+    defer parsed.deinit(allocator);
+
+    // Indexing never fails here, only the parses: the projected one, and the
+    // full one of a match for JSON output or of an element spread over lines
+    const Case = struct { style: output.Style, format: Format, chunk: []const u8 };
+    const cases = [_]Case{
+        .{ .style = .{}, .format = .ndjson, .chunk = "{\"id\":1,\"s\":\"a\"}\n" },
+        .{ .style = .{ .format = .json }, .format = .ndjson, .chunk = "{\"id\":1,\"s\":\"a\"}\n" },
+        .{ .style = .{}, .format = .json_array, .chunk = "{\"id\":1,\n\"s\":\"a\"}" },
+    };
+    for (cases) |case| {
+        var filter = try NdjsonFilter.initStyled(&parsed.filter, null, case.style, allocator);
+        defer filter.deinit();
+        // Fail each parse allocation in turn, until none is left to fail
+        var fail_index: usize = 0;
+        while (true) : (fail_index += 1) {
+            var failing = std.testing.FailingAllocator.init(allocator, .{ .fail_index = fail_index });
+            var scratch = std.heap.ArenaAllocator.init(failing.allocator());
+            defer scratch.deinit();
+            var out = std.ArrayList(u8){};
+            defer out.deinit(allocator);
+            const stats = filter.run(case.chunk, case.format, &out, &scratch, .{}) catch |err| {
+                try std.testing.expectEqual(error.OutOfMemory, err);
+                continue;
+            };
+            try std.testing.expect(!failing.has_induced_failure);
+            try std.testing.expectEqual(@as(usize, 1), stats.matches);
+            break;
+        }
+        try std.testing.expect(fail_index > 0);
+    }
+}
+
+test "processData and processFileCount: a worker that fails fails the command" {
+    const allocator = std.testing.allocator;
+
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+    var data = std.ArrayList(u8){};
+    defer data.deinit(allocator);
+    for (0..500) |i| try data.writer(allocator).print("{{\"id\":{d},\"n\":{d}}}\n", .{ i, i % 7 });
+    try tmp.dir.writeFile(.{ .sub_path = "in.ndjson", .data = data.items });
+    const path = try tmp.dir.realpathAlloc(allocator, "in.ndjson");
+    defer allocator.free(path);
+
+    var filter = try query.parseQuery("{\"n\": {\"$gte\": 3}}", allocator);
+    defer filter.deinit(allocator);
+    const config = Config{ .num_threads = 4, .chunk_size = 256 };
+    var failing = WorkerFailingAllocator.init(allocator);
+    try std.testing.expectError(error.OutOfMemory, processData(data.items, &filter.filter, config, failing.allocator()));
+    try std.testing.expectError(error.OutOfMemory, processFileCount(path, &filter.filter, config, failing.allocator()));
+}
+
+test "processDataAggregate: groups from every worker are merged" {
+    const allocator = std.testing.allocator;
+
+    var data = std.ArrayList(u8){};
+    defer data.deinit(allocator);
+    for (0..1000) |i| try data.writer(allocator).print("{{\"id\":{d},\"shard\":{{\"n\":{d}}},\"v\":{d}}}\n", .{ i, i % 3, i % 7 });
+
+    var filter = try query.parseQuery("{\"id\": {\"$lt\": 900}}", allocator);
+    defer filter.deinit(allocator);
+    const spec = aggregate.Spec{
+        .group_by = "shard.n",
+        .aggregates = &.{ .{ .op = .sum, .field = "id" }, .{ .op = .distinct, .field = "v" } },
+    };
+
+    var table = try processDataAggregate(data.items, &filter.filter, .{ .num_threads = 4, .chunk_size = 256 }, &spec, allocator);
+    defer table.deinit();
+    const rows = try table.rows();
+    try std.testing.expectEqual(@as(usize, 3), rows.len);
+    for (rows, 0..) |row, n| {
+        // ids below 900 with id % 3 == n
+        var sum: usize = 0;
+        var i = n;
+        while (i < 900) : (i += 3) sum += i;
+        var expected: [32]u8 = undefined;
+        try std.testing.expectEqualStrings(try std.fmt.bufPrint(&expected, "{d}", .{sum}), row.get("sum(id)").?.number);
+        try std.testing.expectEqualStrings("300", row.get("count").?.number);
+        try std.testing.expectEqualStrings("7", row.get("distinct(v)").?.number);
+    }
+}
+
+test "processDataTopK: the best matches of every worker, in order" {
+    const allocator = std.testing.allocator;
+
+    var data = std.ArrayList(u8){};
+    defer data.deinit(allocator);
+    for (0..1000) |i| try data.writer(allocator).print("{{\"id\":{d},\"ts\":{d}}}\n", .{ i, (i * 37) % 500 });
+
+    var filter = try query.parseQuery("{\"id\": {\"$gte\": 100}}", allocator);
+    defer filter.deinit(allocator);
+    const order = sort.Order{ .field = "ts", .descending = true };
+
+    var result = try processDataTopK(data.items, &filter.filter, .{ .num_threads = 4, .chunk_size = 256 }, order, 5, allocator);
+    defer result.deinit();
+    try std.testing.expectEqual(@as(usize, 5), result.matches.items.len);
+    // Two records share ts 496; the earlier one comes first
+    const expected = [_][2]i64{ .{ 527, 499 }, .{ 554, 498 }, .{ 581, 497 }, .{ 108, 496 }, .{ 608, 496 } };
+    for (result.matches.items, expected) |obj, want| {
+        try std.testing.expectEqual(want[0], try json_parser.getInt(obj.get("id").?));
+        try std.testing.expectEqual(want[1], try json_parser.getInt(obj.get("ts").?));
+    }
+}
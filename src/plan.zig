@@ -0,0 +1,513 @@
+const std = @import("std");
+const json_parser = @import("json_parser.zig");
+const number = @import("number.zig");
+const query = @import("query.zig");
+const regex = @import("regex.zig");
+const simd = @import("simd.zig");
+const Allocator = std.mem.Allocator;
+
+/// Compiled form of a `query.Filter`, built once per query and evaluated for
+/// every record by the parallel and streaming paths.
+///
+/// Compared with walking the filter directly (`query.matches`):
+/// - dotted paths are split into segments once, and every segment remembers
+///   the field index it was last found at. Records of one schema keep their
+///   keys in the same order, so lookups usually hit on the first compare
+///   instead of scanning the object. On a miss, wide objects are probed
+///   through their hash index with the segment's precomputed key hash;
+/// - numeric comparisons become typed tests on an `f64` constant, and all the
+///   bounds an `$and` puts on one path are fused so the field is resolved and
+///   its number text read once (`{"age":{"$gt":18,"$lt":65}}`). Integer text
+///   is compared with integral constants on its bytes, without parsing;
+/// - `$and` / `$or` / `$nor` operands are reordered cheapest and most
+///   selective first, so short-circuiting skips the expensive ones;
+/// - the most common shapes (one equality or range, or a conjunction of up to
+///   `max_kernel_leaves` of them) run through a pre-instantiated kernel that
+///   evaluates every leaf without dispatching on node or value type.
+///
+/// The plan borrows field names and values from the filter, which must
+/// outlive it. One plan is shared by all workers; hints are updated with
+/// relaxed atomics, so a stale hint only costs a scan.
+pub const Plan = struct {
+    root: Node,
+    arena: std.heap.ArenaAllocator,
+    /// Specialised matcher for the root's shape; null walks the node tree.
+    /// Library callers may install one built by `kernel.zig`.
+    kernel: ?Kernel = null,
+
+    pub fn init(filter: *const query.Filter, allocator: Allocator) regex.Error!Plan {
+        var arena = std.heap.ArenaAllocator.init(allocator);
+        errdefer arena.deinit();
+        const root = try compile(filter, arena.allocator());
+        return .{ .root = root, .arena = arena, .kernel = pickKernel(&root) };
+    }
+
+    pub fn deinit(self: *Plan) void {
+        self.arena.deinit();
+    }
+
+    /// Same result as `query.matches(obj, filter)` for the compiled filter.
+    pub fn matches(self: *const Plan, obj: *const json_parser.JsonObject) bool {
+        if (self.kernel) |kernel| return kernel(self, obj);
+        return self.root.eval(obj.*);
+    }
+
+    /// The conjoined leaves of the root: its operands, or the root itself.
+    fn leaves(self: *const Plan) []const Node {
+        if (self.root == .all) return self.root.all;
+        const single: *const [1]Node = &self.root;
+        return single;
+    }
+};
+
+/// A matcher specialised to one plan shape.
+pub const Kernel = *const fn (plan: *const Plan, obj: *const json_parser.JsonObject) bool;
+
+pub const Node = union(enum) {
+    always_true,
+    all: []Node,
+    any: []Node,
+    none: []Node,
+    not: *Node,
+    /// Numeric comparisons against constants, all on the same path
+    number: NumberTest,
+    /// Any other single-field predicate, evaluated by `query.matchesFieldValue`
+    field: FieldTest,
+
+    fn eval(self: *const Node, obj: json_parser.JsonObject) bool {
+        return switch (self.*) {
+            .always_true => true,
+            .all => |nodes| {
+                for (nodes) |*node| if (!node.eval(obj)) return false;
+                return true;
+            },
+            .any => |nodes| {
+                for (nodes) |*node| if (node.eval(obj)) return true;
+                return false;
+            },
+            .none => |nodes| {
+                for (nodes) |*node| if (node.eval(obj)) return false;
+                return true;
+            },
+            .not => |node| !node.eval(obj),
+            .number => |*check| check.eval(obj),
+            .field => |*check| query.matchesFieldValue(check.path.resolve(obj), check.filter),
+        };
+    }
+
+    /// Rough evaluation cost, lower for cheap and selective predicates.
+    fn cost(self: *const Node) usize {
+        return switch (self.*) {
+            .always_true => 0,
+            .all, .any, .none => |nodes| blk: {
+                var total: usize = 1;
+                for (nodes) |*node| total += node.cost();
+                break :blk total;
+            },
+            .not => |node| node.cost() + 1,
+            .number => |*check| blk: {
+                var total = check.path.depth();
+                for (check.bounds) |bound| total += switch (bound.op) {
+                    .eq => 1,
+                    .gt, .gte, .lt, .lte => 2,
+                    // Rarely false, so it rejects little
+                    .ne => 4,
+                };
+                break :blk total;
+            },
+            .field => |*check| check.path.depth() + switch (check.filter.*) {
+                .exists => @as(usize, 1),
+                .comparison => |*cmp| if (cmp.op == .eq) @as(usize, 2) else 4,
+                .size_match, .type_match => 3,
+                .array_op => |*arr| 2 + arr.values.len,
+                .regex_match => |*rm| 8 + rm.pattern.len,
+                .logical, .always_true => unreachable,
+            },
+        };
+    }
+};
+
+pub const NumberTest = struct {
+    path: Path,
+    bounds: []Bound,
+
+    pub const Bound = struct {
+        op: query.Comparison.CompOp,
+        value: f64,
+        /// `value`, when integral and short enough to compare on the bytes
+        integer: ?number.Integer = null,
+
+        pub fn init(op: query.Comparison.CompOp, value: f64) Bound {
+            return .{ .op = op, .value = value, .integer = number.Integer.of(value) };
+        }
+
+        /// `found` is null when the field is not a number. Mirrors
+        /// `query.matchesComparison`: equality then fails, and ordered
+        /// comparisons treat the pair as equal.
+        fn holds(self: *const Bound, found: ?*number.Number) bool {
+            const n = found orelse return self.holdsForNonNumber();
+            if (self.integer) |*integer| {
+                if (integer.order(n)) |order| return switch (self.op) {
+                    .eq => order == .eq,
+                    .ne => order != .eq,
+                    .gt => order == .gt,
+                    .gte => order != .lt,
+                    .lt => order == .lt,
+                    .lte => order != .gt,
+                };
+            }
+            const x = n.float() orelse return self.holdsForNonNumber();
+            return switch (self.op) {
+                .eq => x == self.value,
+                .ne => x != self.value,
+                .gt => x > self.value,
+                .gte => x >= self.value,
+                .lt => x < self.value,
+                .lte => x <= self.value,
+            };
+        }
+
+        fn holdsForNonNumber(self: *const Bound) bool {
+            return switch (self.op) {
+                .eq, .gt, .lt => false,
+                .ne, .gte, .lte => true,
+            };
+        }
+    };
+
+    fn eval(self: *const NumberTest, obj: json_parser.JsonObject) bool {
+        const value = self.path.resolve(obj) orelse return false;
+        // Shared by every bound, so the text is parsed at most once
+        var found = if (value == .number) number.Number.init(value.number) else null;
+        for (self.bounds) |*bound| {
+            if (!bound.holds(if (found) |*n| n else null)) return false;
+        }
+        return true;
+    }
+};
+
+pub const FieldTest = struct {
+    path: Path,
+    filter: *const query.Filter,
+
+    /// Fast path for `{field: "string"}`, exactly as `query.valuesEqual` decides it.
+    fn stringEquals(self: *const FieldTest, obj: json_parser.JsonObject) bool {
+        const value = self.path.resolve(obj) orelse return false;
+        return value == .string and std.mem.eql(u8, value.string, self.filter.comparison.value.string);
+    }
+
+    pub fn isStringEquality(self: *const FieldTest) bool {
+        return switch (self.filter.*) {
+            .comparison => |*cmp| cmp.op == .eq and cmp.value == .string,
+            else => false,
+        };
+    }
+};
+
+fn appendConjunct(nodes: *std.ArrayList(Node), node: Node, allocator: Allocator) Allocator.Error!void {
+    switch (node) {
+        .all => |inner| {
+            for (inner) |child| try appendConjunct(nodes, child, allocator);
+        },
+        .number => |check| {
+            for (nodes.items) |*existing| {
+                if (existing.* != .number or !std.mem.eql(u8, existing.number.path.field, check.path.field)) continue;
+                existing.number.bounds = try std.mem.concat(allocator, NumberTest.Bound, &.{ existing.number.bounds, check.bounds });
+                return;
+            }
+            try nodes.append(allocator, node);
+        },
+        else => try nodes.append(allocator, node),
+    }
+}
+
+// ============================================================================
+// Kernels
+// ============================================================================
+
+/// Leaves a pre-instantiated kernel can evaluate directly
+const LeafKind = enum { number, string_eq };
+
+pub const max_kernel_leaves = 3;
+
+/// One kernel per sequence of leaf kinds, indexed by count and then by a
+/// bitmask of which leaves are string equalities.
+const kernel_table = table: {
+    var table: [max_kernel_leaves][1 << max_kernel_leaves]Kernel = undefined;
+    for (1..max_kernel_leaves + 1) |n| {
+        for (0..1 << n) |bits| {
+            var kinds: [n]LeafKind = undefined;
+            for (&kinds, 0..) |*kind, i| kind.* = if ((bits >> i) & 1 == 1) .string_eq else .number;
+            const final = kinds;
+            table[n - 1][bits] = conjunctionKernel(&final);
+        }
+    }
+    break :table table;
+};
+
+fn conjunctionKernel(comptime kinds: []const LeafKind) Kernel {
+    return struct {
+        fn match(plan: *const Plan, obj: *const json_parser.JsonObject) bool {
+            const leaves = plan.leaves();
+            inline for (kinds, 0..) |kind, i| {
+                const ok = switch (kind) {
+                    .number => leaves[i].number.eval(obj.*),
+                    .string_eq => leaves[i].field.stringEquals(obj.*),
+                };
+                if (!ok) return false;
+            }
+            return true;
+        }
+    }.match;
+}
+
+/// The kernel for `root`, if its shape is one of the pre-instantiated ones.
+fn pickKernel(root: *const Node) ?Kernel {
+    const leaves: []const Node = switch (root.*) {
+        .all => |nodes| nodes,
+        .number, .field => @as(*const [1]Node, root),
+        else => return null,
+    };
+    if (leaves.len == 0 or leaves.len > max_kernel_leaves) return null;
+
+    var bits: usize = 0;
+    for (leaves, 0..) |*leaf, i| {
+        switch (leaf.*) {
+            .number => {},
+            .field => |*check| {
+                if (!check.isStringEquality()) return null;
+                bits |= @as(usize, 1) << @intCast(i);
+            },
+            else => return null,
+        }
+    }
+    return kernel_table[leaves.len - 1][bits];
+}
+
+/// A dotted field path, split once at compile time.
+const Path = struct {
+    field: []const u8,
+    segments: []Segment,
+
+    const Segment = struct {
+        key: []const u8,
+        /// `JsonObject.hashKey(key)`, for objects wide enough to be indexed
+        hash: u32,
+        /// Index the key was last found at in its object
+        hint: std.atomic.Value(u32) = std.atomic.Value(u32).init(0),
+
+        fn lookup(self: *Segment, obj: json_parser.JsonObject) ?json_parser.JsonValue {
+            const hint = self.hint.load(.monotonic);
+            if (hint < obj.fields.len and simd.stringsEqualFast(obj.fields[hint].key, self.key)) {
+                return obj.fields[hint].value;
+            }
+            const i = obj.indexOfHashed(self.key, self.hash) orelse return null;
+            self.hint.store(@intCast(i), .monotonic);
+            return obj.fields[i].value;
+        }
+    };
+
+    fn init(field: []const u8, allocator: Allocator) Allocator.Error!Path {
+        const segments = try allocator.alloc(Segment, std.mem.count(u8, field, ".") + 1);
+        var parts = std.mem.splitScalar(u8, field, '.');
+        for (segments) |*segment| {
+            const key = parts.next().?;
+            segment.* = .{ .key = key, .hash = json_parser.JsonObject.hashKey(key) };
+        }
+        return .{ .field = field, .segments = segments };
+    }
+
+    fn depth(self: Path) usize {
+        return self.segments.len;
+    }
+
+    /// The value at this path, looking through nested objects.
+    fn resolve(self: Path, obj: json_parser.JsonObject) ?json_parser.JsonValue {
+        var current = obj;
+        const last = self.segments.len - 1;
+        for (self.segments[0..last]) |*segment| {
+            const value = segment.lookup(current) orelse return null;
+            if (value != .object) return null;
+            current = value.object;
+        }
+        return self.segments[last].lookup(current);
+    }
+};
+
+fn compile(filter: *const query.Filter, allocator: Allocator) regex.Error!Node {
+    switch (filter.*) {
+        .always_true => return .always_true,
+        .logical => |*log| switch (log.op) {
+            .not => {
+                const inner = try allocator.create(Node);
+                inner.* = try compile(&log.operands[0], allocator);
+                return .{ .not = inner };
+            },
+            .@"and" => return .{ .all = try compileOperands(log.operands, true, allocator) },
+            .@"or" => return .{ .any = try compileOperands(log.operands, false, allocator) },
+            .nor => return .{ .none = try compileOperands(log.operands, false, allocator) },
+        },
+        .comparison => |*cmp| if (cmp.value == .number) {
+            const bounds = try allocator.alloc(NumberTest.Bound, 1);
+            bounds[0] = NumberTest.Bound.init(cmp.op, cmp.value.number);
+            return .{ .number = .{ .path = try Path.init(cmp.field, allocator), .bounds = bounds } };
+        },
+        // Filters built by hand carry no compiled pattern: test a copy that does
+        .regex_match => |*rm| if (rm.compiled == null) {
+            const re = try allocator.create(regex.Regex);
+            re.* = try regex.Regex.compile(rm.pattern, rm.options, allocator);
+            const copy = try allocator.create(query.Filter);
+            copy.* = filter.*;
+            copy.regex_match.compiled = re;
+            return .{ .field = .{ .path = try Path.init(rm.field, allocator), .filter = copy } };
+        },
+        else => {},
+    }
+    return .{ .field = .{ .path = try Path.init(query.fieldPath(filter).?, allocator), .filter = filter } };
+}
+
+/// Compile the operands of a logical filter and order them cheapest first.
+/// Conjoined operands are flattened into one list, with numeric bounds on the
+/// same path fused.
+fn compileOperands(operands: []const query.Filter, conjunction: bool, allocator: Allocator) regex.Error![]Node {
+    var nodes = std.ArrayList(Node){};
+    for (operands) |*operand| {
+        const node = try compile(operand, allocator);
+        if (conjunction) try appendConjunct(&nodes, node, allocator) else try nodes.append(allocator, node);
+    }
+
+    // Stable, so equally cheap operands keep the order they were written in
+    std.sort.insertion(Node, nodes.items, {}, struct {
+        fn lessThan(_: void, a: Node, b: Node) bool {
+            return a.cost() < b.cost();
+        }
+    }.lessThan);
+    return nodes.toOwnedSlice(allocator);
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+fn expectSameAsFilter(query_str: []const u8, records: []const []const u8) !void {
+    const allocator = std.testing.allocator;
+    var parsed = try query.parseQuery(query_str, allocator);
+    defer parsed.deinit(allocator);
+    var plan = try Plan.init(&parsed.filter, allocator);
+    defer plan.deinit();
+
+    for (records) |record| {
+        var obj = try json_parser.parseObject(record, allocator);
+        defer obj.deinit();
+        try std.testing.expectEqual(query.matches(&obj, &parsed.filter), plan.matches(&obj));
+    }
+}
+
+test "plan: evaluates like the filter it was compiled from" {
+    const records = [_][]const u8{
+        "{\"age\":30,\"city\":\"NYC\",\"user\":{\"tier\":\"gold\",\"score\":9.5}}",
+        "{\"city\":\"LA\",\"age\":17,\"user\":{\"score\":-3,\"tier\":\"free\"}}",
+        "{\"age\":\"unknown\",\"tags\":[\"a\",\"b\"]}",
+        "{\"age\":65.0,\"user\":\"flat\",\"name\":\"Bo\"}",
+        "{\"name\":\"alice\",\"age\":1e2}",
+    };
+    try expectSameAsFilter("{\"age\":{\"$gt\":18,\"$lt\":65}}", &records);
+    try expectSameAsFilter("{\"age\":{\"$gte\":30,\"$ne\":100}}", &records);
+    try expectSameAsFilter("{\"user.score\":{\"$lte\":9.5},\"user.tier\":\"gold\"}", &records);
+    try expectSameAsFilter("{\"$or\":[{\"name\":{\"$regex\":\"^al\"}},{\"city\":{\"$in\":[\"LA\",\"SF\"]}}]}", &records);
+    try expectSameAsFilter("{\"$nor\":[{\"tags\":{\"$size\":2}},{\"age\":{\"$exists\":false}}]}", &records);
+    try expectSameAsFilter("{\"age\":{\"$not\":{\"$gt\":20}},\"user\":{\"$type\":\"object\"}}", &records);
+    try expectSameAsFilter("{}", &records);
+}
+
+test "plan: integer bounds decided on the bytes agree with parsed values" {
+    const records = [_][]const u8{
+        "{\"status\":404,\"ts\":-0}",
+        "{\"status\":500,\"ts\":3}",
+        "{\"status\":4e2,\"ts\":-5}",
+        "{\"status\":399.5,\"ts\":12345678901234567}",
+        "{\"status\":\"404\",\"ts\":-6}",
+        "{\"status\":400,\"ts\":-4.5}",
+        "{\"status\":1000,\"ts\":-10}",
+    };
+    try expectSameAsFilter("{\"status\":{\"$gte\":400,\"$lt\":500},\"ts\":{\"$gt\":-5}}", &records);
+    try expectSameAsFilter("{\"status\":{\"$ne\":404},\"ts\":{\"$lte\":0}}", &records);
+    try expectSameAsFilter("{\"ts\":{\"$gt\":2.5,\"$lt\":1e16}}", &records);
+}
+
+test "plan: operands are ordered cheapest first and ranges fused" {
+    const allocator = std.testing.allocator;
+    var parsed = try query.parseQuery(
+        "{\"name\":{\"$regex\":\"^a.*z$\"},\"age\":{\"$gt\":18},\"id\":7,\"age\":{\"$lt\":65}}",
+        allocator,
+    );
+    defer parsed.deinit(allocator);
+    var plan = try Plan.init(&parsed.filter, allocator);
+    defer plan.deinit();
+
+    const nodes = plan.root.all;
+    try std.testing.expectEqual(@as(usize, 3), nodes.len);
+    try std.testing.expectEqualStrings("id", nodes[0].number.path.field);
+    try std.testing.expectEqualStrings("age", nodes[1].number.path.field);
+    try std.testing.expectEqual(@as(usize, 2), nodes[1].number.bounds.len);
+    try std.testing.expect(nodes[2] == .field);
+}
+
+test "plan: hand-built $regex filters are compiled once" {
+    const allocator = std.testing.allocator;
+    const filter = query.Filter{ .regex_match = .{ .field = "name", .pattern = "^(al|bo)b?$", .options = "i" } };
+    var plan = try Plan.init(&filter, allocator);
+    defer plan.deinit();
+    try std.testing.expect(plan.root.field.filter.regex_match.compiled != null);
+
+    var obj = try json_parser.parseObject("{\"name\":\"BOB\"}", allocator);
+    defer obj.deinit();
+    try std.testing.expect(plan.matches(&obj));
+
+    const invalid = query.Filter{ .regex_match = .{ .field = "name", .pattern = "(al", .options = "" } };
+    try std.testing.expectError(error.InvalidRegex, Plan.init(&invalid, allocator));
+}
+
+test "plan: common shapes get a kernel, others walk the tree" {
+    const allocator = std.testing.allocator;
+    const cases = [_]struct { query: []const u8, kernel: bool }{
+        .{ .query = "{\"city\":\"NYC\"}", .kernel = true },
+        .{ .query = "{\"city\":\"NYC\",\"age\":{\"$gte\":30,\"$lt\":40},\"n\":1}", .kernel = true },
+        .{ .query = "{\"a\":1,\"b\":2,\"c\":3,\"d\":4}", .kernel = false },
+        .{ .query = "{\"$or\":[{\"a\":1},{\"b\":2}]}", .kernel = false },
+        .{ .query = "{\"tags\":{\"$in\":[\"x\"]}}", .kernel = false },
+    };
+    for (cases) |case| {
+        var parsed = try query.parseQuery(case.query, allocator);
+        defer parsed.deinit(allocator);
+        var plan = try Plan.init(&parsed.filter, allocator);
+        defer plan.deinit();
+        try std.testing.expectEqual(case.kernel, plan.kernel != null);
+    }
+
+    try expectSameAsFilter("{\"city\":\"NYC\",\"age\":{\"$gte\":30,\"$lt\":40}}", &.{
+        "{\"city\":\"NYC\",\"age\":35}",
+        "{\"city\":\"NYC\",\"age\":40}",
+        "{\"age\":35,\"city\":\"LA\"}",
+        "{\"city\":1,\"age\":\"35\"}",
+    });
+}
+
+test "plan: key hints follow the record schema" {
+    const allocator = std.testing.allocator;
+    var parsed = try query.parseQuery("{\"status\":\"ok\"}", allocator);
+    defer parsed.deinit(allocator);
+    var plan = try Plan.init(&parsed.filter, allocator);
+    defer plan.deinit();
+
+    var first = try json_parser.parseObject("{\"id\":1,\"ts\":2,\"status\":\"ok\"}", allocator);
+    defer first.deinit();
+    var moved = try json_parser.parseObject("{\"status\":\"ok\",\"id\":3}", allocator);
+    defer moved.deinit();
+
+    try std.testing.expect(plan.matches(&first));
+    try std.testing.expectEqual(@as(u32, 2), plan.root.field.path.segments[0].hint.load(.monotonic));
+    // A different layout still matches and moves the hint
+    try std.testing.expect(plan.matches(&moved));
+    try std.testing.expectEqual(@as(u32, 0), plan.root.field.path.segments[0].hint.load(.monotonic));
+}
@@ -0,0 +1,251 @@
+const std = @import("std");
+const query = @import("query.zig");
+const simd = @import("simd.zig");
+const Allocator = std.mem.Allocator;
+
+/// Raw-byte prefilter derived from a query filter.
+///
+/// Most selective queries name literals that must appear verbatim in any
+/// matching line: the quoted key of every field the filter requires, and the
+/// quoted string constants of `$eq` / `$in`. Scanning the raw line for those
+/// needles is much cheaper than parsing it, so lines that cannot match skip
+/// `json_parser.parseObject` entirely.
+///
+/// Needles are kept in conjunctive form: every clause needs at least one of its
+/// needles present. Lines containing a backslash may spell keys or values with
+/// escapes, so they are always handed to the full parser.
+pub const Prefilter = struct {
+    clauses: []Clause,
+    allocator: Allocator,
+
+    pub const Clause = struct {
+        needles: [][]u8,
+
+        fn deinit(self: Clause, allocator: Allocator) void {
+            for (self.needles) |needle| allocator.free(needle);
+            allocator.free(self.needles);
+        }
+    };
+
+    pub fn init(filter: *const query.Filter, allocator: Allocator) Allocator.Error!Prefilter {
+        var builder = Builder{ .allocator = allocator };
+        errdefer builder.deinit();
+        try builder.collect(filter);
+
+        return .{
+            .clauses = try builder.clauses.toOwnedSlice(allocator),
+            .allocator = allocator,
+        };
+    }
+
+    pub fn deinit(self: *Prefilter) void {
+        for (self.clauses) |clause| clause.deinit(self.allocator);
+        self.allocator.free(self.clauses);
+    }
+
+    /// False only when `line` provably cannot match the filter.
+    pub fn mayMatch(self: *const Prefilter, line: []const u8) bool {
+        if (self.clauses.len == 0) return true;
+        if (std.mem.indexOfScalar(u8, line, '\\') != null) return true;
+
+        for (self.clauses) |clause| {
+            for (clause.needles) |needle| {
+                if (simd.containsSubstring(line, needle)) break;
+            } else return false;
+        }
+        return true;
+    }
+};
+
+const Builder = struct {
+    clauses: std.ArrayList(Prefilter.Clause) = .{},
+    allocator: Allocator,
+
+    fn deinit(self: *Builder) void {
+        for (self.clauses.items) |clause| clause.deinit(self.allocator);
+        self.clauses.deinit(self.allocator);
+    }
+
+    fn collect(self: *Builder, filter: *const query.Filter) Allocator.Error!void {
+        switch (filter.*) {
+            .comparison => |*cmp| {
+                // Value needles go first: they are far more selective than keys.
+                if (cmp.op == .eq and cmp.value == .string) {
+                    try self.addClause(&.{cmp.value.string});
+                }
+                try self.addPathKeys(cmp.field);
+            },
+            .array_op => |*arr| {
+                if (arr.op == .nin) return;
+                if (arr.values.len > 0) strings: {
+                    const needles = try self.allocator.alloc([]const u8, arr.values.len);
+                    defer self.allocator.free(needles);
+                    for (arr.values, 0..) |v, i| {
+                        if (v != .string) break :strings;
+                        needles[i] = v.string;
+                    }
+                    try self.addClause(needles);
+                }
+                try self.addPathKeys(arr.field);
+            },
+            .exists => |*ex| if (ex.should_exist) try self.addPathKeys(ex.field),
+            .regex_match => |*rm| {
+                // Raw bytes of the string: a JSON escape always involves a
+                // backslash, and lines with one are never rejected
+                if (rm.compiled) |re| if (re.literal.len > 0) try self.addRawClause(&.{re.literal});
+                try self.addPathKeys(rm.field);
+            },
+            .size_match => |*sm| try self.addPathKeys(sm.field),
+            // A missing field satisfies {$type: "null"}
+            .type_match => |*tm| if (!std.mem.eql(u8, tm.type_name, "null")) try self.addPathKeys(tm.field),
+            .logical => |*log| switch (log.op) {
+                .@"and" => {
+                    for (log.operands) |*operand| try self.collect(operand);
+                },
+                .@"or" => try self.collectAny(log.operands),
+                .not, .nor => {},
+            },
+            .always_true => {},
+        }
+    }
+
+    /// A disjunction only requires *some* operand's literals. Take the most
+    /// selective clause of each operand and merge them into a single clause;
+    /// if any operand has no literal requirement, neither does the disjunction.
+    fn collectAny(self: *Builder, operands: []const query.Filter) Allocator.Error!void {
+        var merged = std.ArrayList([]const u8){};
+        defer merged.deinit(self.allocator);
+
+        var subs = std.ArrayList(Builder){};
+        defer {
+            for (subs.items) |*sub| sub.deinit();
+            subs.deinit(self.allocator);
+        }
+
+        for (operands) |*operand| {
+            var sub = Builder{ .allocator = self.allocator };
+            sub.collect(operand) catch |err| {
+                sub.deinit();
+                return err;
+            };
+            subs.append(self.allocator, sub) catch |err| {
+                sub.deinit();
+                return err;
+            };
+            if (sub.clauses.items.len == 0) return;
+            for (sub.clauses.items[0].needles) |needle| try merged.append(self.allocator, needle);
+        }
+
+        if (merged.items.len > 0) try self.addRawClause(merged.items);
+    }
+
+    /// Every segment of a dotted path must be present as a quoted key.
+    fn addPathKeys(self: *Builder, path: []const u8) Allocator.Error!void {
+        var segments = std.mem.splitScalar(u8, path, '.');
+        while (segments.next()) |segment| try self.addClause(&.{segment});
+    }
+
+    /// Add a clause whose needles are the quoted forms of `literals`.
+    fn addClause(self: *Builder, literals: []const []const u8) Allocator.Error!void {
+        const quoted = try self.allocator.alloc([]u8, literals.len);
+        var filled: usize = 0;
+        errdefer {
+            for (quoted[0..filled]) |q| self.allocator.free(q);
+            self.allocator.free(quoted);
+        }
+        for (literals) |literal| {
+            quoted[filled] = try std.fmt.allocPrint(self.allocator, "\"{s}\"", .{literal});
+            filled += 1;
+        }
+        try self.appendClause(quoted);
+    }
+
+    /// Add a clause from needles that are already quoted (copied).
+    fn addRawClause(self: *Builder, needles: []const []const u8) Allocator.Error!void {
+        const owned = try self.allocator.alloc([]u8, needles.len);
+        var filled: usize = 0;
+        errdefer {
+            for (owned[0..filled]) |n| self.allocator.free(n);
+            self.allocator.free(owned);
+        }
+        for (needles) |needle| {
+            owned[filled] = try self.allocator.dupe(u8, needle);
+            filled += 1;
+        }
+        try self.appendClause(owned);
+    }
+
+    /// Takes ownership of `needles` on success; single-needle duplicates are dropped.
+    fn appendClause(self: *Builder, needles: [][]u8) Allocator.Error!void {
+        const clause = Prefilter.Clause{ .needles = needles };
+        if (needles.len == 1) {
+            for (self.clauses.items) |existing| {
+                if (existing.needles.len == 1 and std.mem.eql(u8, existing.needles[0], needles[0])) {
+                    clause.deinit(self.allocator);
+                    return;
+                }
+            }
+        }
+        try self.clauses.append(self.allocator, clause);
+    }
+};
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+test "prefilter: rejects lines missing a required literal" {
+    const allocator = std.testing.allocator;
+
+    var parsed = try query.parseQuery("{\"tenantId\":\"acme\"}", allocator);
+    defer parsed.deinit(allocator);
+    var pre = try Prefilter.init(&parsed.filter, allocator);
+    defer pre.deinit();
+
+    try std.testing.expect(pre.mayMatch("{\"tenantId\":\"acme\",\"id\":1}"));
+    try std.testing.expect(!pre.mayMatch("{\"tenantId\":\"globex\",\"id\":2}"));
+    try std.testing.expect(!pre.mayMatch("{\"id\":3,\"note\":\"acme\"}"));
+    // Escapes could spell the literal differently, so never reject them
+    try std.testing.expect(pre.mayMatch("{\"tenantId\":\"\\u0061cme\"}"));
+}
+
+test "prefilter: $regex contributes its required literal" {
+    const allocator = std.testing.allocator;
+
+    var parsed = try query.parseQuery("{\"email\":{\"$regex\":\"^[a-z]+@acme\\\\.com$\"}}", allocator);
+    defer parsed.deinit(allocator);
+    var pre = try Prefilter.init(&parsed.filter, allocator);
+    defer pre.deinit();
+
+    try std.testing.expect(pre.mayMatch("{\"email\":\"bo@acme.com\"}"));
+    try std.testing.expect(!pre.mayMatch("{\"email\":\"bo@globex.com\"}"));
+}
+
+test "prefilter: $in and $or produce disjunctive clauses" {
+    const allocator = std.testing.allocator;
+
+    var parsed = try query.parseQuery(
+        "{\"$or\":[{\"city\":{\"$in\":[\"NYC\",\"LA\"]}},{\"role\":\"admin\"}]}",
+        allocator,
+    );
+    defer parsed.deinit(allocator);
+    var pre = try Prefilter.init(&parsed.filter, allocator);
+    defer pre.deinit();
+
+    try std.testing.expectEqual(@as(usize, 1), pre.clauses.len);
+    try std.testing.expect(pre.mayMatch("{\"city\":\"LA\"}"));
+    try std.testing.expect(pre.mayMatch("{\"role\":\"admin\"}"));
+    try std.testing.expect(!pre.mayMatch("{\"city\":\"Chicago\",\"role\":\"guest\"}"));
+}
+
+test "prefilter: filters without literals accept everything" {
+    const allocator = std.testing.allocator;
+
+    var parsed = try query.parseQuery("{\"$nor\":[{\"city\":\"NYC\"}]}", allocator);
+    defer parsed.deinit(allocator);
+    var pre = try Prefilter.init(&parsed.filter, allocator);
+    defer pre.deinit();
+
+    try std.testing.expectEqual(@as(usize, 0), pre.clauses.len);
+    try std.testing.expect(pre.mayMatch("{\"anything\":1}"));
+}
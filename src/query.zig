@@ -1,5 +1,7 @@
 const std = @import("std");
 const json_parser = @import("json_parser.zig");
+const number = @import("number.zig");
+const regex = @import("regex.zig");
 const Allocator = std.mem.Allocator;
 
 /// Query parsing errors
@@ -11,7 +13,7 @@ pub const QueryError = error{
     UnsupportedOperator,
     UnsupportedValueType,
     UnsupportedQueryStructure,
-} || Allocator.Error || json_parser.ParseError;
+} || regex.Error || json_parser.ParseError;
 
 /// MongoDB query AST
 pub const Query = struct {
@@ -122,8 +124,15 @@ pub const RegexMatch = struct {
     field: []const u8,
     pattern: []const u8,
     options: []const u8, // e.g. "i" for case-insensitive
+    /// Compiled once when the query is parsed (or planned); null for filters
+    /// built by hand, which then compile per evaluation
+    compiled: ?*regex.Regex = null,
 
     pub fn deinit(self: *RegexMatch, allocator: Allocator) void {
+        if (self.compiled) |re| {
+            re.deinit();
+            allocator.destroy(re);
+        }
         allocator.free(self.field);
         allocator.free(self.pattern);
         allocator.free(self.options);
@@ -280,10 +289,20 @@ fn parseFieldFilter(key: []const u8, value: json_parser.JsonValue, allocator: Al
 
 /// Build a RegexMatch filter with optional flags (e.g. "i" for case-insensitive)
 fn buildRegexFilter(key: []const u8, pattern: []const u8, options: []const u8, allocator: Allocator) !Filter {
+    const compiled = try allocator.create(regex.Regex);
+    errdefer allocator.destroy(compiled);
+    compiled.* = try regex.Regex.compile(pattern, options, allocator);
+    errdefer compiled.deinit();
+
+    const field = try allocator.dupe(u8, key);
+    errdefer allocator.free(field);
+    const owned_pattern = try allocator.dupe(u8, pattern);
+    errdefer allocator.free(owned_pattern);
     return Filter{ .regex_match = RegexMatch{
-        .field = try allocator.dupe(u8, key),
-        .pattern = try allocator.dupe(u8, pattern),
+        .field = field,
+        .pattern = owned_pattern,
         .options = try allocator.dupe(u8, options),
+        .compiled = compiled,
     } };
 }
 
@@ -416,6 +435,23 @@ fn parseLogical(value: json_parser.JsonValue, op: Logical.LogicalOp, allocator:
     };
 }
 
+/// Add every field path the filter reads to `projection`, so records can be
+/// parsed with `json_parser.parseObjectProjected` and still evaluate the same.
+pub fn addFilterPaths(filter: *const Filter, projection: *json_parser.Projection, allocator: Allocator) Allocator.Error!void {
+    switch (filter.*) {
+        .comparison => |*cmp| try projection.addPath(allocator, cmp.field),
+        .logical => |*log| {
+            for (log.operands) |*operand| try addFilterPaths(operand, projection, allocator);
+        },
+        .array_op => |*arr| try projection.addPath(allocator, arr.field),
+        .exists => |*ex| try projection.addPath(allocator, ex.field),
+        .regex_match => |*rm| try projection.addPath(allocator, rm.field),
+        .size_match => |*sm| try projection.addPath(allocator, sm.field),
+        .type_match => |*tm| try projection.addPath(allocator, tm.field),
+        .always_true => {},
+    }
+}
+
 // ============================================================================
 // QUERY EVALUATION
 // ============================================================================
@@ -423,19 +459,43 @@ fn parseLogical(value: json_parser.JsonValue, op: Logical.LogicalOp, allocator:
 /// Check if a JSON object matches the query filter
 pub fn matches(obj: *json_parser.JsonObject, filter: *const Filter) bool {
     return switch (filter.*) {
-        .comparison => |*cmp| matchesComparison(obj, cmp),
         .logical => |*log| matchesLogical(obj, log),
-        .array_op => |*arr| matchesArrayOp(obj, arr),
-        .exists => |*ex| matchesExists(obj, ex),
-        .regex_match => |*rm| matchesRegex(obj, rm),
-        .size_match => |*sm| matchesSizeMatch(obj, sm),
-        .type_match => |*tm| matchesTypeMatch(obj, tm),
         .always_true => true,
+        else => matchesFieldValue(getNestedValue(obj.*, fieldPath(filter).?), filter),
+    };
+}
+
+/// The dotted field path a single-field filter reads; null for `$and`-style
+/// logical filters and `{}`.
+pub fn fieldPath(filter: *const Filter) ?[]const u8 {
+    return switch (filter.*) {
+        .comparison => |*cmp| cmp.field,
+        .array_op => |*arr| arr.field,
+        .exists => |*ex| ex.field,
+        .regex_match => |*rm| rm.field,
+        .size_match => |*sm| sm.field,
+        .type_match => |*tm| tm.field,
+        .logical, .always_true => null,
+    };
+}
+
+/// Evaluate a single-field filter against the value found at its path (null
+/// when the path is missing). Compiled plans (plan.zig) resolve paths
+/// themselves and evaluate through here.
+pub fn matchesFieldValue(field_value: ?json_parser.JsonValue, filter: *const Filter) bool {
+    return switch (filter.*) {
+        .comparison => |*cmp| matchesComparison(field_value, cmp),
+        .array_op => |*arr| matchesArrayOp(field_value, arr),
+        .exists => |*ex| (field_value != null) == ex.should_exist,
+        .regex_match => |*rm| matchesRegex(field_value, rm),
+        .size_match => |*sm| matchesSizeMatch(field_value, sm),
+        .type_match => |*tm| matchesTypeMatch(field_value, tm),
+        .logical, .always_true => unreachable,
     };
 }
 
-fn matchesComparison(obj: *json_parser.JsonObject, cmp: *const Comparison) bool {
-    const field_value = getNestedValue(obj.*, cmp.field) orelse return false;
+fn matchesComparison(value: ?json_parser.JsonValue, cmp: *const Comparison) bool {
+    const field_value = value orelse return false;
 
     return switch (cmp.op) {
         .eq => valuesEqual(field_value, &cmp.value),
@@ -477,8 +537,8 @@ fn matchesLogical(obj: *json_parser.JsonObject, log: *const Logical) bool {
     };
 }
 
-fn matchesArrayOp(obj: *json_parser.JsonObject, arr: *const ArrayOp) bool {
-    const field_value = getNestedValue(obj.*, arr.field) orelse return arr.op == .nin;
+fn matchesArrayOp(value: ?json_parser.JsonValue, arr: *const ArrayOp) bool {
+    const field_value = value orelse return arr.op == .nin;
 
     // Scalar field: check if field value is one of the listed values
     const scalar_match = for (arr.values) |*v| {
@@ -501,19 +561,14 @@ fn matchesArrayOp(obj: *json_parser.JsonObject, arr: *const ArrayOp) bool {
     };
 }
 
-fn matchesExists(obj: *json_parser.JsonObject, ex: *const Exists) bool {
-    const has_field = getNestedValue(obj.*, ex.field) != null;
-    return has_field == ex.should_exist;
-}
-
-fn matchesSizeMatch(obj: *json_parser.JsonObject, sm: *const SizeMatch) bool {
-    const fv = getNestedValue(obj.*, sm.field) orelse return false;
+fn matchesSizeMatch(value: ?json_parser.JsonValue, sm: *const SizeMatch) bool {
+    const fv = value orelse return false;
     if (fv != .array) return false;
     return fv.array.len == sm.size;
 }
 
-fn matchesTypeMatch(obj: *json_parser.JsonObject, tm: *const TypeMatch) bool {
-    const fv = getNestedValue(obj.*, tm.field) orelse {
+fn matchesTypeMatch(value: ?json_parser.JsonValue, tm: *const TypeMatch) bool {
+    const fv = value orelse {
         return std.mem.eql(u8, tm.type_name, "null");
     };
     const actual: []const u8 = switch (fv) {
@@ -539,50 +594,22 @@ fn getNestedValue(obj: json_parser.JsonObject, field_path: []const u8) ?json_par
     };
 }
 
-/// Match a small, portable regex subset: ^, $, ., and *.
-fn matchesRegex(obj: *json_parser.JsonObject, rm: *const RegexMatch) bool {
-    const field_value = getNestedValue(obj.*, rm.field) orelse return false;
+/// Match a string field against the pattern; see `regex.zig` for the syntax.
+fn matchesRegex(value: ?json_parser.JsonValue, rm: *const RegexMatch) bool {
+    const field_value = value orelse return false;
     if (field_value != .string) return false;
-    return regexMatches(field_value.string, rm.pattern, std.mem.indexOfScalar(u8, rm.options, 'i') != null);
-}
-
-fn regexMatches(text: []const u8, pattern: []const u8, case_insensitive: bool) bool {
-    if (pattern.len > 0 and pattern[0] == '^') {
-        return matchHere(pattern[1..], text, case_insensitive);
-    }
-
-    for (0..text.len + 1) |i| {
-        if (matchHere(pattern, text[i..], case_insensitive)) return true;
-    }
-    return false;
-}
-
-fn matchHere(pattern: []const u8, text: []const u8, case_insensitive: bool) bool {
-    if (pattern.len == 0) return true;
-    if (std.mem.eql(u8, pattern, "$")) return text.len == 0;
-    if (pattern.len >= 2 and pattern[1] == '*') {
-        return matchStar(pattern[0], pattern[2..], text, case_insensitive);
-    }
-    if (text.len > 0 and charMatches(pattern[0], text[0], case_insensitive)) {
-        return matchHere(pattern[1..], text[1..], case_insensitive);
-    }
-    return false;
-}
-
-fn matchStar(c: u8, pattern: []const u8, text: []const u8, case_insensitive: bool) bool {
-    var i: usize = 0;
-    while (true) : (i += 1) {
-        if (matchHere(pattern, text[i..], case_insensitive)) return true;
-        if (i >= text.len or !charMatches(c, text[i], case_insensitive)) return false;
-    }
-}
-
-fn charMatches(pattern_char: u8, text_char: u8, case_insensitive: bool) bool {
-    if (pattern_char == '.') return true;
-    if (case_insensitive) {
-        return std.ascii.toLower(pattern_char) == std.ascii.toLower(text_char);
-    }
-    return pattern_char == text_char;
+    if (rm.compiled) |re| return re.isMatch(field_value.string);
+
+    // Hand-built filter: compile the NFA alone, which fits on the stack for
+    // all but the largest patterns
+    var buffer: [64 * 1024]u8 = undefined;
+    var fba = std.heap.FixedBufferAllocator.init(&buffer);
+    var re = regex.Regex.compileLimited(rm.pattern, rm.options, 0, fba.allocator()) catch |err| switch (err) {
+        error.OutOfMemory => regex.Regex.compileLimited(rm.pattern, rm.options, 0, std.heap.page_allocator) catch return false,
+        else => return false,
+    };
+    defer re.deinit();
+    return re.isMatch(field_value.string);
 }
 
 /// Check if two values are equal
@@ -597,7 +624,7 @@ fn valuesEqual(json_val: json_parser.JsonValue, query_val: *const Value) bool {
         },
         .number => |n| {
             if (json_val == .number) {
-                const val = json_parser.getFloat(json_val) catch return false;
+                const val = number.parse(json_val.number) orelse return false;
                 return val == n;
             }
             return false;
@@ -615,7 +642,7 @@ fn valuesEqual(json_val: json_parser.JsonValue, query_val: *const Value) bool {
 fn compareValues(json_val: json_parser.JsonValue, query_val: *const Value) std.math.Order {
     // Only compare numbers for now
     if (query_val.* == .number and json_val == .number) {
-        const a = json_parser.getFloat(json_val) catch return .eq;
+        const a = number.parse(json_val.number) orelse return .eq;
         const b = query_val.number;
 
         if (a < b) return .lt;
@@ -856,6 +883,23 @@ test "match $regex with $options case-insensitive" {
     try std.testing.expect(!matches(&obj, &query2.filter));
 }
 
+test "$regex patterns are compiled when the query is parsed" {
+    const data = "{\"email\":\"ann@example.com\"}";
+    var obj = try json_parser.parseObject(data, std.testing.allocator);
+    defer obj.deinit();
+
+    var query = try parseQuery("{\"email\":{\"$regex\":\"^[a-z]+@(example|test)\\\\.(com|org)$\"}}", std.testing.allocator);
+    defer query.deinit(std.testing.allocator);
+    try std.testing.expect(query.filter.regex_match.compiled != null);
+    try std.testing.expect(matches(&obj, &query.filter));
+
+    // Hand-built filters compile on the fly
+    const filter = Filter{ .regex_match = .{ .field = "email", .pattern = "@EXAMPLE\\.", .options = "i" } };
+    try std.testing.expect(matches(&obj, &filter));
+
+    try std.testing.expectError(error.InvalidRegex, parseQuery("{\"email\":{\"$regex\":\"[a-\"}}", std.testing.allocator));
+}
+
 test "match $size operator" {
     const data = "{\"tags\":[\"go\",\"zig\",\"rust\"]}";
     var obj = try json_parser.parseObject(data, std.testing.allocator);
@@ -911,6 +955,24 @@ test "match $nor operator" {
     try std.testing.expect(!matches(&obj2, &query.filter));
 }
 
+test "projected parse evaluates like a full parse" {
+    const allocator = std.testing.allocator;
+    const data = "{\"id\":1,\"payload\":{\"big\":[1,2,3]},\"user\":{\"age\":41,\"city\":\"LA\"},\"tags\":[\"go\"]}";
+
+    var query = try parseQuery("{\"user.age\":{\"$gt\":40},\"tags\":{\"$in\":[\"go\"]}}", allocator);
+    defer query.deinit(allocator);
+
+    var projection = json_parser.Projection{};
+    defer projection.deinit(allocator);
+    try addFilterPaths(&query.filter, &projection, allocator);
+
+    var obj = try json_parser.parseObjectProjected(data, allocator, &projection);
+    defer obj.deinit();
+
+    try std.testing.expectEqual(@as(usize, 2), obj.fields.len);
+    try std.testing.expect(matches(&obj, &query.filter));
+}
+
 test "match nested $and with $or" {
     const data = "{\"age\":35,\"city\":\"LA\"}";
     var obj = try json_parser.parseObject(data, std.testing.allocator);
@@ -0,0 +1,750 @@
+const std = @import("std");
+const simd = @import("simd.zig");
+const Allocator = std.mem.Allocator;
+
+/// Compiled `$regex` patterns.
+///
+/// A pattern is parsed once into a small syntax tree and compiled into a
+/// Thompson NFA over bytes, which is then determinised into a DFA whose
+/// alphabet is the pattern's byte equivalence classes. Matching is one table
+/// lookup per input byte and never backtracks, so it is linear in the text
+/// for every pattern (`a*a*a*b` included). A pattern whose DFA would need more
+/// than `max_dfa_states` states keeps only the NFA, which is simulated one
+/// state set per byte, still in linear time.
+///
+/// Before the automaton runs, the longest literal every match must contain
+/// (`literal`) is looked for with a SIMD substring search, so most strings
+/// that cannot match are rejected without touching the automaton.
+///
+/// Syntax: literals, `.`, classes `[...]` / `[^...]` with ranges, `\d \w \s`
+/// and their negations, `\n \t \r \f \v \xHH` and escaped punctuation, groups
+/// `(...)` / `(?:...)`, alternation `|`, repetition `* + ? {n} {n,} {n,m}`
+/// (lazy forms are accepted and match the same strings), and the anchors `^`
+/// and `$`. Options: `i` folds ASCII case at compile time, `s` lets `.` match
+/// a newline; other option letters are ignored.
+pub const Regex = struct {
+    /// Owns everything below
+    arena: std.heap.ArenaAllocator,
+    nfa: Nfa,
+    /// Null when the pattern needs more than `max_dfa_states` states
+    dfa: ?Dfa,
+    /// Bytes every match contains; empty when nothing is required
+    literal: []const u8,
+
+    pub const Error = error{ InvalidRegex, RegexTooComplex } || Allocator.Error;
+
+    pub fn compile(pattern: []const u8, options: []const u8, allocator: Allocator) Error!Regex {
+        return compileLimited(pattern, options, max_dfa_states, allocator);
+    }
+
+    /// Like `compile`, but determinise into at most `dfa_states` states; 0
+    /// keeps only the NFA, which needs far less memory.
+    pub fn compileLimited(pattern: []const u8, options: []const u8, dfa_states: usize, allocator: Allocator) Error!Regex {
+        var arena = std.heap.ArenaAllocator.init(allocator);
+        errdefer arena.deinit();
+        const alloc = arena.allocator();
+
+        var syntax = std.heap.ArenaAllocator.init(allocator);
+        defer syntax.deinit();
+        const flags = Flags.parse(options);
+        var parser = Parser{ .pattern = pattern, .flags = flags, .arena = syntax.allocator() };
+        const root = try parser.parse();
+
+        var builder = Builder{ .case_insensitive = flags.case_insensitive, .allocator = alloc };
+        const nfa = try builder.build(&root);
+
+        var literal = std.ArrayList(u8){};
+        if (!flags.case_insensitive) {
+            var run = std.ArrayList(u8){};
+            try requiredLiteral(&root, &run, &literal, syntax.allocator());
+            try endRun(&run, &literal, syntax.allocator());
+        }
+
+        return .{
+            .nfa = nfa,
+            .dfa = if (dfa_states > 0) try Dfa.build(&nfa, dfa_states, alloc, syntax.allocator()) else null,
+            .literal = try alloc.dupe(u8, literal.items),
+            .arena = arena,
+        };
+    }
+
+    pub fn deinit(self: *Regex) void {
+        self.arena.deinit();
+    }
+
+    /// True when the pattern matches somewhere in `text`.
+    pub fn isMatch(self: *const Regex, text: []const u8) bool {
+        if (self.literal.len > 0 and !simd.containsSubstring(text, self.literal)) return false;
+        if (self.dfa) |*dfa| return dfa.run(text);
+        return self.nfa.run(text);
+    }
+};
+
+pub const Error = Regex.Error;
+
+pub const max_dfa_states = 512;
+const max_nfa_states = 1024;
+const max_repeat = 1000;
+const max_nesting = 64;
+
+const ByteSet = std.StaticBitSet(256);
+const StateSet = std.bit_set.ArrayBitSet(u64, max_nfa_states);
+
+const Flags = struct {
+    case_insensitive: bool = false,
+    dot_all: bool = false,
+
+    fn parse(options: []const u8) Flags {
+        return .{
+            .case_insensitive = std.mem.indexOfScalar(u8, options, 'i') != null,
+            .dot_all = std.mem.indexOfScalar(u8, options, 's') != null,
+        };
+    }
+};
+
+// ============================================================================
+// Parsing
+// ============================================================================
+
+const Node = union(enum) {
+    empty,
+    byte: u8,
+    set: ByteSet,
+    /// `^` and `$`
+    text_start,
+    text_end,
+    concat: []const Node,
+    alternate: []const Node,
+    repeat: Repeat,
+
+    const Repeat = struct {
+        child: *const Node,
+        min: u32,
+        /// Null for no upper bound
+        max: ?u32,
+    };
+};
+
+const Parser = struct {
+    pattern: []const u8,
+    flags: Flags,
+    arena: Allocator,
+    pos: usize = 0,
+    depth: usize = 0,
+
+    fn parse(self: *Parser) Regex.Error!Node {
+        const root = try self.alternation();
+        // An unbalanced ')' stops the top-level alternation early
+        if (self.pos != self.pattern.len) return error.InvalidRegex;
+        return root;
+    }
+
+    fn peek(self: *const Parser) ?u8 {
+        return if (self.pos < self.pattern.len) self.pattern[self.pos] else null;
+    }
+
+    fn eat(self: *Parser, c: u8) bool {
+        const byte = self.peek() orelse return false;
+        if (byte != c) return false;
+        self.pos += 1;
+        return true;
+    }
+
+    fn next(self: *Parser) ?u8 {
+        const c = self.peek() orelse return null;
+        self.pos += 1;
+        return c;
+    }
+
+    fn alternation(self: *Parser) Regex.Error!Node {
+        var branches = std.ArrayList(Node){};
+        try branches.append(self.arena, try self.concatenation());
+        while (self.eat('|')) try branches.append(self.arena, try self.concatenation());
+        if (branches.items.len == 1) return branches.items[0];
+        return .{ .alternate = branches.items };
+    }
+
+    fn concatenation(self: *Parser) Regex.Error!Node {
+        var items = std.ArrayList(Node){};
+        while (self.peek()) |c| {
+            if (c == '|' or c == ')') break;
+            try items.append(self.arena, try self.repetition());
+        }
+        return switch (items.items.len) {
+            0 => .empty,
+            1 => items.items[0],
+            else => .{ .concat = items.items },
+        };
+    }
+
+    fn repetition(self: *Parser) Regex.Error!Node {
+        var node = try self.atom();
+        while (self.peek()) |c| {
+            var min: u32 = 0;
+            var max: ?u32 = null;
+            switch (c) {
+                '*' => self.pos += 1,
+                '+' => {
+                    self.pos += 1;
+                    min = 1;
+                },
+                '?' => {
+                    self.pos += 1;
+                    max = 1;
+                },
+                '{' => {
+                    const bounds = self.counted() orelse break;
+                    min = bounds.min;
+                    max = bounds.max;
+                },
+                else => break,
+            }
+            // Lazy quantifiers match the same strings
+            _ = self.eat('?');
+
+            const child = try self.arena.create(Node);
+            child.* = node;
+            node = .{ .repeat = .{ .child = child, .min = min, .max = max } };
+        }
+        return node;
+    }
+
+    /// `{n}`, `{n,}` or `{n,m}`; anything else leaves `{` a literal.
+    fn counted(self: *Parser) ?struct { min: u32, max: ?u32 } {
+        const start = self.pos;
+        self.pos += 1;
+        const min = self.number() orelse {
+            self.pos = start;
+            return null;
+        };
+        var max: ?u32 = min;
+        if (self.eat(',')) max = self.number();
+        if (!self.eat('}') or min > max_repeat or (max != null and (max.? < min or max.? > max_repeat))) {
+            self.pos = start;
+            return null;
+        }
+        return .{ .min = min, .max = max };
+    }
+
+    fn number(self: *Parser) ?u32 {
+        const start = self.pos;
+        var value: u32 = 0;
+        while (self.peek()) |c| {
+            if (c < '0' or c > '9') break;
+            value = value *| 10 +| (c - '0');
+            self.pos += 1;
+        }
+        return if (self.pos > start) value else null;
+    }
+
+    fn atom(self: *Parser) Regex.Error!Node {
+        const c = self.next().?;
+        switch (c) {
+            '(' => {
+                if (self.eat('?') and !self.eat(':')) return error.InvalidRegex;
+                self.depth += 1;
+                if (self.depth > max_nesting) return error.RegexTooComplex;
+                const inner = try self.alternation();
+                self.depth -= 1;
+                if (!self.eat(')')) return error.InvalidRegex;
+                return inner;
+            },
+            '[' => return .{ .set = try self.class() },
+            '.' => {
+                var set = ByteSet.initFull();
+                if (!self.flags.dot_all) set.unset('\n');
+                return .{ .set = set };
+            },
+            '^' => return .text_start,
+            '$' => return .text_end,
+            '\\' => return self.escape(),
+            // Nothing to repeat
+            '*', '+', '?' => return error.InvalidRegex,
+            else => return .{ .byte = c },
+        }
+    }
+
+    /// The escape after a backslash: a byte or a class shorthand.
+    fn escape(self: *Parser) Regex.Error!Node {
+        const c = self.next() orelse return error.InvalidRegex;
+        return switch (c) {
+            'd', 'D', 'w', 'W', 's', 'S' => {
+                var set = ByteSet.initEmpty();
+                switch (std.ascii.toLower(c)) {
+                    'd' => set.setRangeValue(.{ .start = '0', .end = '9' + 1 }, true),
+                    'w' => {
+                        set.setRangeValue(.{ .start = '0', .end = '9' + 1 }, true);
+                        set.setRangeValue(.{ .start = 'a', .end = 'z' + 1 }, true);
+                        set.setRangeValue(.{ .start = 'A', .end = 'Z' + 1 }, true);
+                        set.set('_');
+                    },
+                    else => for (" \t\n\r\x0b\x0c") |space| set.set(space),
+                }
+                if (std.ascii.isUpper(c)) set.toggleAll();
+                return .{ .set = set };
+            },
+            'n' => .{ .byte = '\n' },
+            't' => .{ .byte = '\t' },
+            'r' => .{ .byte = '\r' },
+            'f' => .{ .byte = 0x0c },
+            'v' => .{ .byte = 0x0b },
+            '0' => .{ .byte = 0 },
+            'x' => {
+                if (self.pos + 2 > self.pattern.len) return error.InvalidRegex;
+                const value = std.fmt.parseInt(u8, self.pattern[self.pos..][0..2], 16) catch return error.InvalidRegex;
+                self.pos += 2;
+                return .{ .byte = value };
+            },
+            // Word boundaries, back-references and the like are not supported
+            else => if (std.ascii.isAlphanumeric(c)) error.InvalidRegex else .{ .byte = c },
+        };
+    }
+
+    /// A bracket expression, after the `[`.
+    fn class(self: *Parser) Regex.Error!ByteSet {
+        var set = ByteSet.initEmpty();
+        const negated = self.eat('^');
+        var first = true;
+        while (true) {
+            var low = self.next() orelse return error.InvalidRegex;
+            // A leading `]` is a member
+            if (low == ']' and !first) break;
+            first = false;
+            if (low == '\\') {
+                switch (try self.escape()) {
+                    .set => |shorthand| {
+                        set.setUnion(shorthand);
+                        continue;
+                    },
+                    .byte => |b| low = b,
+                    else => unreachable,
+                }
+            }
+
+            const is_range = self.pos + 1 < self.pattern.len and self.pattern[self.pos] == '-' and self.pattern[self.pos + 1] != ']';
+            if (!is_range) {
+                set.set(low);
+                continue;
+            }
+            self.pos += 1;
+            var high = self.next().?;
+            if (high == '\\') {
+                const bound = try self.escape();
+                if (bound != .byte) return error.InvalidRegex;
+                high = bound.byte;
+            }
+            if (high < low) return error.InvalidRegex;
+            set.setRangeValue(.{ .start = low, .end = @as(usize, high) + 1 }, true);
+        }
+
+        // Fold before negating, so `[^a]` excludes `A` too
+        if (self.flags.case_insensitive) foldCase(&set);
+        if (negated) set.toggleAll();
+        return set;
+    }
+};
+
+fn foldCase(set: *ByteSet) void {
+    for ('A'..'Z' + 1) |upper| {
+        const lower = upper + ('a' - 'A');
+        if (set.isSet(upper) or set.isSet(lower)) {
+            set.set(upper);
+            set.set(lower);
+        }
+    }
+}
+
+/// Collect the longest run of bytes that every match contains contiguously
+/// into `best`. `run` is the run being extended.
+fn requiredLiteral(node: *const Node, run: *std.ArrayList(u8), best: *std.ArrayList(u8), allocator: Allocator) Allocator.Error!void {
+    switch (node.*) {
+        .byte => |b| try run.append(allocator, b),
+        .concat => |items| {
+            for (items) |*item| try requiredLiteral(item, run, best, allocator);
+        },
+        // Zero-width: whatever surrounds them is still adjacent
+        .empty, .text_start, .text_end => {},
+        .repeat => |r| {
+            if (r.min == 0) return endRun(run, best, allocator);
+            // The first copy follows what came before; later ones vary
+            try requiredLiteral(r.child, run, best, allocator);
+            if (r.min != 1 or (r.max orelse 0) != 1) try endRun(run, best, allocator);
+        },
+        .set, .alternate => try endRun(run, best, allocator),
+    }
+}
+
+fn endRun(run: *std.ArrayList(u8), best: *std.ArrayList(u8), allocator: Allocator) Allocator.Error!void {
+    if (run.items.len > best.items.len) {
+        best.clearRetainingCapacity();
+        try best.appendSlice(allocator, run.items);
+    }
+    run.clearRetainingCapacity();
+}
+
+// ============================================================================
+// NFA
+// ============================================================================
+
+const State = union(enum) {
+    /// Consume one byte in `sets[set]`
+    byte: struct { set: u16, out: u16 },
+    split: [2]u16,
+    /// Zero-width assertions
+    text_start: u16,
+    text_end: u16,
+    match,
+};
+
+const Nfa = struct {
+    states: []const State,
+    sets: []const ByteSet,
+    start: u16,
+    accept: u16,
+
+    /// Add `from` and every state reachable from it without consuming a byte
+    /// to `set`. Assertions are followed only where they hold.
+    fn close(self: *const Nfa, set: *StateSet, from: u16, at_start: bool, at_end: bool) void {
+        if (set.isSet(from)) return;
+        set.set(from);
+        var stack: [max_nfa_states]u16 = undefined;
+        stack[0] = from;
+        var len: usize = 1;
+        while (len > 0) {
+            len -= 1;
+            const targets: [2]?u16 = switch (self.states[stack[len]]) {
+                .split => |outs| .{ outs[0], outs[1] },
+                .text_start => |out| .{ if (at_start) out else null, null },
+                .text_end => |out| .{ if (at_end) out else null, null },
+                .byte, .match => .{ null, null },
+            };
+            for (targets) |target| {
+                const t = target orelse continue;
+                if (set.isSet(t)) continue;
+                set.set(t);
+                stack[len] = t;
+                len += 1;
+            }
+        }
+    }
+
+    /// Add the states reached from `set` by consuming `byte` to `into`.
+    fn step(self: *const Nfa, set: *const StateSet, byte: u8, into: *StateSet) void {
+        var it = set.iterator(.{});
+        while (it.next()) |s| switch (self.states[s]) {
+            .byte => |edge| if (self.sets[edge.set].isSet(byte)) self.close(into, edge.out, false, false),
+            else => {},
+        };
+    }
+
+    /// Whether `set` matches if the text ends here.
+    fn acceptsAtEnd(self: *const Nfa, set: *const StateSet, at_start: bool) bool {
+        var end = set.*;
+        var it = set.iterator(.{});
+        while (it.next()) |s| switch (self.states[s]) {
+            .text_end => |out| self.close(&end, out, at_start, true),
+            else => {},
+        };
+        return end.isSet(self.accept);
+    }
+
+    /// Simulate the NFA over `text`, one state set per byte.
+    fn run(self: *const Nfa, text: []const u8) bool {
+        var current = StateSet.initEmpty();
+        self.close(&current, self.start, true, false);
+        for (text) |b| {
+            if (current.isSet(self.accept)) return true;
+            var next = StateSet.initEmpty();
+            self.step(&current, b, &next);
+            // Unanchored search: a match may also start at the next byte
+            self.close(&next, self.start, false, false);
+            current = next;
+        }
+        return self.acceptsAtEnd(&current, text.len == 0);
+    }
+};
+
+const Builder = struct {
+    states: std.ArrayList(State) = .{},
+    sets: std.ArrayList(ByteSet) = .{},
+    case_insensitive: bool,
+    allocator: Allocator,
+
+    fn build(self: *Builder, root: *const Node) Regex.Error!Nfa {
+        const accept = try self.add(.match);
+        const start = try self.emit(root, accept);
+        return .{
+            .states = try self.states.toOwnedSlice(self.allocator),
+            .sets = try self.sets.toOwnedSlice(self.allocator),
+            .start = start,
+            .accept = accept,
+        };
+    }
+
+    fn add(self: *Builder, state: State) Regex.Error!u16 {
+        if (self.states.items.len >= max_nfa_states) return error.RegexTooComplex;
+        try self.states.append(self.allocator, state);
+        return @intCast(self.states.items.len - 1);
+    }
+
+    fn addSet(self: *Builder, set: ByteSet) Allocator.Error!u16 {
+        for (self.sets.items, 0..) |existing, i| {
+            if (existing.eql(set)) return @intCast(i);
+        }
+        try self.sets.append(self.allocator, set);
+        return @intCast(self.sets.items.len - 1);
+    }
+
+    /// Compile `node` so that it continues at state `next`; returns its entry.
+    /// Building back to front means every state knows its successor upfront.
+    fn emit(self: *Builder, node: *const Node, next: u16) Regex.Error!u16 {
+        switch (node.*) {
+            .empty => return next,
+            .byte => |b| {
+                var set = ByteSet.initEmpty();
+                set.set(b);
+                if (self.case_insensitive) foldCase(&set);
+                return self.add(.{ .byte = .{ .set = try self.addSet(set), .out = next } });
+            },
+            .set => |set| return self.add(.{ .byte = .{ .set = try self.addSet(set), .out = next } }),
+            .text_start => return self.add(.{ .text_start = next }),
+            .text_end => return self.add(.{ .text_end = next }),
+            .concat => |items| {
+                var entry = next;
+                var i = items.len;
+                while (i > 0) {
+                    i -= 1;
+                    entry = try self.emit(&items[i], entry);
+                }
+                return entry;
+            },
+            .alternate => |branches| {
+                var entry = try self.emit(&branches[branches.len - 1], next);
+                var i = branches.len - 1;
+                while (i > 0) {
+                    i -= 1;
+                    const branch = try self.emit(&branches[i], next);
+                    entry = try self.add(.{ .split = .{ branch, entry } });
+                }
+                return entry;
+            },
+            .repeat => |r| {
+                var entry = next;
+                if (r.max) |max| {
+                    // Optional copies nest, x{0,3} = (x(x(x)?)?)?, so skipping
+                    // any of them goes straight to `next`
+                    for (0..max - r.min) |_| {
+                        const body = try self.emit(r.child, entry);
+                        entry = try self.add(.{ .split = .{ body, next } });
+                    }
+                } else {
+                    const loop = try self.add(.{ .split = .{ next, next } });
+                    const body = try self.emit(r.child, loop);
+                    self.states.items[loop] = .{ .split = .{ body, next } };
+                    entry = loop;
+                }
+                for (0..r.min) |_| entry = try self.emit(r.child, entry);
+                return entry;
+            },
+        }
+    }
+};
+
+// ============================================================================
+// DFA
+// ============================================================================
+
+const Dfa = struct {
+    /// Equivalence class of every byte: bytes no NFA edge tells apart
+    classes: [256]u8,
+    class_count: usize,
+    /// `next[state * class_count + class]`
+    next: []const u16,
+    /// A match has been seen, whatever follows
+    accept: []const bool,
+    /// A match ends exactly at the end of the text
+    accept_at_end: []const bool,
+
+    const start = 0;
+
+    /// Subset construction over byte classes; null when more than `limit`
+    /// states are needed. Every transition also re-enters the NFA start, so
+    /// the DFA searches rather than matching only at the beginning.
+    fn build(nfa: *const Nfa, limit: usize, allocator: Allocator, scratch: Allocator) Allocator.Error!?Dfa {
+        var classes: [256]u8 = undefined;
+        const class_count = byteClasses(nfa.sets, &classes);
+        var representatives: [256]u8 = undefined;
+        var b: usize = 256;
+        while (b > 0) {
+            b -= 1;
+            representatives[classes[b]] = @intCast(b);
+        }
+
+        var subsets = std.ArrayList(StateSet){};
+        var ids = std.AutoHashMapUnmanaged([16]u64, u16){};
+        var next = std.ArrayList(u16){};
+        var accept = std.ArrayList(bool){};
+        var accept_at_end = std.ArrayList(bool){};
+
+        var restart = StateSet.initEmpty();
+        nfa.close(&restart, nfa.start, false, false);
+        // The start state is the only one at the beginning of the text, where
+        // `^` holds; it is never shared with a later state that looks the same
+        var initial = StateSet.initEmpty();
+        nfa.close(&initial, nfa.start, true, false);
+        try subsets.append(scratch, initial);
+
+        var state: usize = 0;
+        while (state < subsets.items.len) : (state += 1) {
+            const subset = subsets.items[state];
+            const accepting = subset.isSet(nfa.accept);
+            try accept.append(allocator, accepting);
+            try accept_at_end.append(allocator, accepting or nfa.acceptsAtEnd(&subset, state == start));
+
+            // Matching stops at the first accepting state, so its row is unused
+            if (accepting) {
+                try next.appendNTimes(allocator, @intCast(state), class_count);
+                continue;
+            }
+            for (representatives[0..class_count]) |byte| {
+                var target = restart;
+                nfa.step(&subset, byte, &target);
+                const entry = try ids.getOrPut(scratch, target.masks);
+                if (!entry.found_existing) {
+                    if (subsets.items.len >= limit) return null;
+                    entry.value_ptr.* = @intCast(subsets.items.len);
+                    try subsets.append(scratch, target);
+                }
+                try next.append(allocator, entry.value_ptr.*);
+            }
+        }
+
+        return .{
+            .classes = classes,
+            .class_count = class_count,
+            .next = next.items,
+            .accept = accept.items,
+            .accept_at_end = accept_at_end.items,
+        };
+    }
+
+    fn run(self: *const Dfa, text: []const u8) bool {
+        var state: usize = start;
+        for (text) |b| {
+            if (self.accept[state]) return true;
+            state = self.next[state * self.class_count + self.classes[b]];
+        }
+        return self.accept_at_end[state];
+    }
+};
+
+/// Partition the bytes into classes that every set in `sets` either contains
+/// or excludes as a whole. Returns the number of classes.
+fn byteClasses(sets: []const ByteSet, classes: *[256]u8) usize {
+    @memset(classes, 0);
+    var count: usize = 1;
+    for (sets) |set| {
+        // Split every class into the part inside `set` and the part outside
+        var split = [_]i16{-1} ** 512;
+        count = 0;
+        for (classes, 0..) |*class, b| {
+            const key = @as(usize, class.*) * 2 + @intFromBool(set.isSet(b));
+            if (split[key] < 0) {
+                split[key] = @intCast(count);
+                count += 1;
+            }
+            class.* = @intCast(split[key]);
+        }
+    }
+    return count;
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+fn expectMatches(pattern: []const u8, options: []const u8, matching: []const []const u8, other: []const []const u8) !void {
+    // Both engines must agree on every input
+    for ([_]usize{ max_dfa_states, 0 }) |dfa_states| {
+        var re = try Regex.compileLimited(pattern, options, dfa_states, std.testing.allocator);
+        defer re.deinit();
+        try std.testing.expectEqual(dfa_states > 0, re.dfa != null);
+        for (matching) |text| {
+            if (!re.isMatch(text)) {
+                std.debug.print("/{s}/{s} should match \"{s}\"\n", .{ pattern, options, text });
+                return error.TestExpectedMatch;
+            }
+        }
+        for (other) |text| {
+            if (re.isMatch(text)) {
+                std.debug.print("/{s}/{s} should not match \"{s}\"\n", .{ pattern, options, text });
+                return error.TestUnexpectedMatch;
+            }
+        }
+    }
+}
+
+test "regex: syntax" {
+    try expectMatches("ali", "", &.{ "alice", "malik" }, &.{ "al", "Alice", "" });
+    try expectMatches("^al", "", &.{ "alice", "al" }, &.{ "malik", "" });
+    try expectMatches("ce$", "", &.{ "alice", "ce" }, &.{ "cent", "alic" });
+    try expectMatches("^$", "", &.{""}, &.{"a"});
+    try expectMatches("", "", &.{ "", "x" }, &.{});
+    try expectMatches("^a.*z$", "", &.{ "az", "abcz" }, &.{ "abc", "zaz" });
+    try expectMatches("colou?r", "", &.{ "color", "colour" }, &.{"colouur"});
+    try expectMatches("^(ab)+$", "", &.{ "ab", "abab" }, &.{ "", "aba" });
+    try expectMatches("^(?:cat|dog)s?$", "", &.{ "cat", "dogs" }, &.{ "cow", "cats!" });
+    try expectMatches("^a{2,3}$", "", &.{ "aa", "aaa" }, &.{ "a", "aaaa" });
+    try expectMatches("^a{2}$", "", &.{"aa"}, &.{ "a", "aaa" });
+    try expectMatches("^a{2,}$", "", &.{ "aa", "aaaaa" }, &.{"a"});
+    try expectMatches("a{,2}", "", &.{"a{,2}"}, &.{"aa"});
+    try expectMatches("^[a-c]+[^0-9]$", "", &.{ "abcx", "a-" }, &.{ "abc1", "d" });
+    try expectMatches("^[]a]$", "", &.{ "]", "a" }, &.{"b"});
+    try expectMatches("^\\d{3}-\\w+\\s\\S$", "", &.{"555-ab_9 x"}, &.{ "55-ab x", "555-ab  " });
+    try expectMatches("^\\x41\\.\\*$", "", &.{"A.*"}, &.{"AB*"});
+    try expectMatches("^a.b$", "", &.{"a-b"}, &.{"a\nb"});
+    try expectMatches("^a.b$", "s", &.{"a\nb"}, &.{});
+    try expectMatches("^a(x|y)*?b$", "", &.{ "ab", "axyyb" }, &.{"axzb"});
+
+    for ([_][]const u8{ "(a", "a)", "*a", "[a-", "[b-a]", "\\b", "(?=a)", "\\x4" }) |bad| {
+        try std.testing.expectError(error.InvalidRegex, Regex.compile(bad, "", std.testing.allocator));
+    }
+    try std.testing.expectError(error.RegexTooComplex, Regex.compile("(a{1000}){1000}", "", std.testing.allocator));
+}
+
+test "regex: case-insensitive" {
+    try expectMatches("Alice", "i", &.{ "ALICE", "alice", "xaLiCe" }, &.{"alic"});
+    try expectMatches("^[a-c]+$", "i", &.{"AbC"}, &.{"abd"});
+    try expectMatches("^[^a]$", "i", &.{"b"}, &.{ "a", "A" });
+}
+
+test "regex: linear time on patterns that make backtracking blow up" {
+    const allocator = std.testing.allocator;
+    const text = try allocator.alloc(u8, 1 << 16);
+    defer allocator.free(text);
+    @memset(text, 'a');
+
+    for ([_][]const u8{ "(a*)*[bc]", "a*a*a*a*a*[bc]", "^(a|aa)+[bc]$" }) |pattern| {
+        for ([_]usize{ max_dfa_states, 0 }) |dfa_states| {
+            var re = try Regex.compileLimited(pattern, "", dfa_states, allocator);
+            defer re.deinit();
+            try std.testing.expect(!re.isMatch(text));
+        }
+    }
+}
+
+test "regex: required literal" {
+    const cases = [_]struct { pattern: []const u8, options: []const u8 = "", literal: []const u8 }{
+        .{ .pattern = "^user-\\d+@example\\.com$", .literal = "@example.com" },
+        .{ .pattern = "ab+cd", .literal = "ab" },
+        .{ .pattern = "(?:xyz)+q", .literal = "xyz" },
+        .{ .pattern = "a|bc", .literal = "" },
+        .{ .pattern = "x?yz", .literal = "yz" },
+        .{ .pattern = "Alice", .options = "i", .literal = "" },
+    };
+    for (cases) |case| {
+        var re = try Regex.compile(case.pattern, case.options, std.testing.allocator);
+        defer re.deinit();
+        try std.testing.expectEqualStrings(case.literal, re.literal);
+    }
+}
@@ -1,8 +1,22 @@
 pub const simd = @import("simd.zig");
 pub const json_parser = @import("json_parser.zig");
+pub const regex = @import("regex.zig");
 pub const query = @import("query.zig");
+pub const prefilter = @import("prefilter.zig");
+pub const plan = @import("plan.zig");
+pub const batch = @import("batch.zig");
+pub const json_array = @import("json_array.zig");
 pub const parallel_ndjson = @import("parallel_ndjson.zig");
+pub const stream = @import("stream.zig");
+pub const follow = @import("follow.zig");
+pub const index = @import("index.zig");
 pub const output = @import("output.zig");
+pub const stats = @import("stats.zig");
+pub const compress = @import("compress.zig");
+pub const fileio = @import("fileio.zig");
+pub const aggregate = @import("aggregate.zig");
+pub const sort = @import("sort.zig");
+pub const number = @import("number.zig");
 pub const cli = @import("cli.zig");
 pub const api = @import("api.zig");
 
@@ -11,9 +25,17 @@ pub const Filter = api.Filter;
 pub const Value = api.Value;
 pub const Options = api.Options;
 pub const QueryResult = api.QueryResult;
+pub const Stats = api.Stats;
 pub const queryData = api.queryData;
 pub const queryDataWhere = api.queryDataWhere;
 pub const queryNdjson = api.queryNdjson;
 pub const queryNdjsonWhere = api.queryNdjsonWhere;
+pub const queryDataCompiled = api.queryDataCompiled;
 pub const queryFile = api.queryFile;
 pub const queryFileWhere = api.queryFileWhere;
+pub const queryFileCompiled = api.queryFileCompiled;
+pub const kernel = api.kernel;
+pub const Prepared = api.Prepared;
+pub const Records = api.Records;
+pub const Scratch = api.Scratch;
+pub const Pool = api.Pool;
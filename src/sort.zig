@@ -0,0 +1,310 @@
+const std = @import("std");
+const json_parser = @import("json_parser.zig");
+const number = @import("number.zig");
+const Allocator = std.mem.Allocator;
+
+/// `--sort-by <field> [--desc]`
+pub const Order = struct {
+    /// Dotted path of the sort key
+    field: []const u8,
+    descending: bool = false,
+
+    /// Whether the record with `a` at input position `a_seq` is output before
+    /// the one with `b` at `b_seq`. Ties keep input order, in both directions.
+    pub fn before(self: Order, a: Key, a_seq: u128, b: Key, b_seq: u128) bool {
+        return switch (a.order(b)) {
+            .lt => !self.descending,
+            .gt => self.descending,
+            .eq => a_seq < b_seq,
+        };
+    }
+};
+
+/// Sort key of one value. Types order as in MongoDB: missing and null,
+/// numbers, strings, objects, arrays, booleans. Objects (and arrays) tie
+/// with each other.
+pub const Key = struct {
+    rank: Rank,
+    number: f64 = 0,
+    /// The string, for `.string`; borrowed
+    bytes: []const u8 = "",
+
+    pub const Rank = enum(u8) { null_value, number, string, object, array, bool_value };
+
+    pub fn of(value: ?json_parser.JsonValue) Key {
+        const v = value orelse return .{ .rank = .null_value };
+        return switch (v) {
+            .null_value => .{ .rank = .null_value },
+            .number => |n| .{ .rank = .number, .number = number.parse(n) orelse 0 },
+            .string => |s| .{ .rank = .string, .bytes = s },
+            .object => .{ .rank = .object },
+            .array => .{ .rank = .array },
+            .bool_value => |b| .{ .rank = .bool_value, .number = @floatFromInt(@intFromBool(b)) },
+        };
+    }
+
+    pub fn order(a: Key, b: Key) std.math.Order {
+        if (a.rank != b.rank) return std.math.order(@intFromEnum(a.rank), @intFromEnum(b.rank));
+        return switch (a.rank) {
+            .number, .bool_value => std.math.order(a.number, b.number),
+            .string => std.mem.order(u8, a.bytes, b.bytes),
+            .null_value, .object, .array => .eq,
+        };
+    }
+};
+
+/// The value at a dotted path, looking through nested objects.
+pub fn resolve(obj: json_parser.JsonObject, field: []const u8) ?json_parser.JsonValue {
+    var current = obj;
+    var parts = std.mem.splitScalar(u8, field, '.');
+    var key = parts.first();
+    while (parts.next()) |next| : (key = next) {
+        const value = current.get(key) orelse return null;
+        if (value != .object) return null;
+        current = value.object;
+    }
+    return current.get(key);
+}
+
+/// The first `limit` objects, or all of them without a limit.
+pub fn limited(objects: []const json_parser.JsonObject, limit: ?usize) []const json_parser.JsonObject {
+    if (limit) |n| return objects[0..@min(n, objects.len)];
+    return objects;
+}
+
+const Ranked = struct {
+    key: Key,
+    index: usize,
+
+    fn before(order: Order, a: Ranked, b: Ranked) bool {
+        return order.before(a.key, a.index, b.key, b.index);
+    }
+};
+
+/// Below this many objects per thread a sort stays on one thread
+const min_run = 4096;
+
+/// Sort `objects` by `order`, keeping input order among equal keys. The
+/// input is cut into one run per thread; the runs are sorted in parallel
+/// and then merged.
+pub fn sortObjects(objects: []json_parser.JsonObject, order: Order, num_threads: usize, allocator: Allocator) !void {
+    if (objects.len < 2) return;
+    const ranked = try allocator.alloc(Ranked, objects.len);
+    defer allocator.free(ranked);
+    for (ranked, objects, 0..) |*r, obj, i| r.* = .{ .key = Key.of(resolve(obj, order.field)), .index = i };
+
+    const runs = std.math.clamp(objects.len / min_run, 1, @max(num_threads, 1));
+    const starts = try allocator.alloc(usize, runs + 1);
+    defer allocator.free(starts);
+    for (starts, 0..) |*start, i| start.* = i * objects.len / runs;
+
+    if (runs == 1) {
+        sortRun(ranked, order);
+    } else {
+        const threads = try allocator.alloc(std.Thread, runs);
+        defer allocator.free(threads);
+        for (threads, 0..) |*t, i| t.* = try std.Thread.spawn(.{}, sortRun, .{ ranked[starts[i]..starts[i + 1]], order });
+        for (threads) |t| t.join();
+    }
+
+    // Merge the runs: the best head of all runs goes next. There are only
+    // as many runs as threads, so a linear pick beats a heap.
+    const heads = try allocator.dupe(usize, starts[0..runs]);
+    defer allocator.free(heads);
+    const sorted = try allocator.alloc(json_parser.JsonObject, objects.len);
+    defer allocator.free(sorted);
+    for (sorted) |*out| {
+        var best: ?usize = null;
+        for (heads, 0..) |head, run| {
+            if (head == starts[run + 1]) continue;
+            if (best == null or Ranked.before(order, ranked[head], ranked[heads[best.?]])) best = run;
+        }
+        out.* = objects[ranked[heads[best.?]].index];
+        heads[best.?] += 1;
+    }
+    @memcpy(objects, sorted);
+}
+
+fn sortRun(run: []Ranked, order: Order) void {
+    std.sort.pdq(Ranked, run, order, Ranked.before);
+}
+
+/// The first `limit` records under an order, as kept by one worker: a
+/// bounded heap whose root is the worst record kept, so memory stays
+/// O(limit) however many records match. Records are borrowed slices of the
+/// input; only key strings are copied, into buffers reused as entries are
+/// replaced.
+pub const TopK = struct {
+    order: Order,
+    limit: usize,
+    entries: std.ArrayList(Entry) = .{},
+    allocator: Allocator,
+
+    pub const Entry = struct {
+        key: Key,
+        /// Backs `key.bytes`
+        key_buffer: std.ArrayList(u8) = .{},
+        /// The record's text
+        line: []const u8,
+        /// Input position, for ties
+        seq: u128,
+        /// Which input the record came from
+        source: u32,
+
+        fn ownKey(self: *Entry, allocator: Allocator) Allocator.Error!void {
+            self.key_buffer.clearRetainingCapacity();
+            try self.key_buffer.appendSlice(allocator, self.key.bytes);
+            self.key.bytes = self.key_buffer.items;
+        }
+    };
+
+    pub fn init(order: Order, limit: usize, allocator: Allocator) TopK {
+        return .{ .order = order, .limit = limit, .allocator = allocator };
+    }
+
+    pub fn deinit(self: *TopK) void {
+        for (self.entries.items) |*entry| entry.key_buffer.deinit(self.allocator);
+        self.entries.deinit(self.allocator);
+    }
+
+    /// Whether a record with `key` at `seq` would be kept.
+    pub fn wants(self: *const TopK, key: Key, seq: u128) bool {
+        if (self.entries.items.len < self.limit) return true;
+        if (self.limit == 0) return false;
+        const worst = &self.entries.items[0];
+        return self.order.before(key, seq, worst.key, worst.seq);
+    }
+
+    /// Keep the record if it is among the first `limit` seen so far.
+    pub fn offer(self: *TopK, key: Key, line: []const u8, seq: u128, source: u32) Allocator.Error!void {
+        if (!self.wants(key, seq)) return;
+        if (self.entries.items.len < self.limit) {
+            try self.entries.append(self.allocator, .{ .key = key, .line = line, .seq = seq, .source = source });
+            const last = self.entries.items.len - 1;
+            try self.entries.items[last].ownKey(self.allocator);
+            self.siftUp(last);
+            return;
+        }
+        // Evict the worst
+        const root = &self.entries.items[0];
+        root.key = key;
+        root.line = line;
+        root.seq = seq;
+        root.source = source;
+        try root.ownKey(self.allocator);
+        self.siftDown(0);
+    }
+
+    /// Fold `other`'s records into this one.
+    pub fn merge(self: *TopK, other: *const TopK) Allocator.Error!void {
+        for (other.entries.items) |*entry| try self.offer(entry.key, entry.line, entry.seq, entry.source);
+    }
+
+    /// The records kept, best first. The heap is used up.
+    pub fn sorted(self: *TopK) []Entry {
+        std.sort.pdq(Entry, self.entries.items, self.order, entryBefore);
+        return self.entries.items;
+    }
+
+    fn entryBefore(order: Order, a: Entry, b: Entry) bool {
+        return order.before(a.key, a.seq, b.key, b.seq);
+    }
+
+    /// `a` would be evicted before `b`
+    fn worse(self: *const TopK, a: usize, b: usize) bool {
+        const items = self.entries.items;
+        return self.order.before(items[b].key, items[b].seq, items[a].key, items[a].seq);
+    }
+
+    fn siftUp(self: *TopK, start: usize) void {
+        var i = start;
+        while (i > 0) {
+            const parent = (i - 1) / 2;
+            if (!self.worse(i, parent)) break;
+            std.mem.swap(Entry, &self.entries.items[i], &self.entries.items[parent]);
+            i = parent;
+        }
+    }
+
+    fn siftDown(self: *TopK, start: usize) void {
+        const len = self.entries.items.len;
+        var i = start;
+        while (true) {
+            var worst = i;
+            for ([_]usize{ 2 * i + 1, 2 * i + 2 }) |child| {
+                if (child < len and self.worse(child, worst)) worst = child;
+            }
+            if (worst == i) return;
+            std.mem.swap(Entry, &self.entries.items[i], &self.entries.items[worst]);
+            i = worst;
+        }
+    }
+};
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+test "sort: keys order by type, then value" {
+    const values = [_]?json_parser.JsonValue{
+        null,
+        .{ .number = "-2" },
+        .{ .number = "10" },
+        .{ .string = "apple" },
+        .{ .string = "banana" },
+        .{ .bool_value = false },
+        .{ .bool_value = true },
+    };
+    for (values[0 .. values.len - 1], values[1..]) |a, b| {
+        try std.testing.expectEqual(std.math.Order.lt, Key.of(a).order(Key.of(b)));
+    }
+    try std.testing.expectEqual(std.math.Order.eq, Key.of(null).order(Key.of(.null_value)));
+}
+
+test "sort: parallel runs merge into a stable order" {
+    const allocator = std.testing.allocator;
+    var arena = std.heap.ArenaAllocator.init(allocator);
+    defer arena.deinit();
+
+    // Enough objects for several runs; ids tie in groups of ten
+    const objects = try arena.allocator().alloc(json_parser.JsonObject, 20_000);
+    for (objects, 0..) |*obj, i| {
+        const line = try std.fmt.allocPrint(arena.allocator(), "{{\"a\":{{\"k\":{d}}},\"i\":{d}}}", .{ (i * 7919) % 2000, i });
+        obj.* = try json_parser.parseObject(line, arena.allocator());
+    }
+
+    try sortObjects(objects, .{ .field = "a.k", .descending = true }, 4, allocator);
+    for (objects[0 .. objects.len - 1], objects[1..]) |a, b| {
+        const ka = try json_parser.getInt(resolve(a, "a.k").?);
+        const kb = try json_parser.getInt(resolve(b, "a.k").?);
+        try std.testing.expect(ka >= kb);
+        if (ka == kb) try std.testing.expect(try json_parser.getInt(a.get("i").?) < try json_parser.getInt(b.get("i").?));
+    }
+}
+
+test "sort: top-k heaps keep the best records and merge" {
+    const allocator = std.testing.allocator;
+    const order = Order{ .field = "name" };
+    var heaps = [_]TopK{ TopK.init(order, 3, allocator), TopK.init(order, 3, allocator) };
+    defer {
+        for (&heaps) |*h| h.deinit();
+    }
+
+    const names = [_][]const u8{ "m", "c", "x", "a", "q", "c", "b", "z" };
+    for (names, 0..) |name, i| {
+        // The key string is copied, so its source can go away
+        var buf: [8]u8 = undefined;
+        @memcpy(buf[0..name.len], name);
+        try heaps[i % 2].offer(Key.of(.{ .string = buf[0..name.len] }), name, i, 0);
+        @memset(&buf, 0);
+    }
+    try heaps[0].merge(&heaps[1]);
+
+    const best = heaps[0].sorted();
+    try std.testing.expectEqual(@as(usize, 3), best.len);
+    try std.testing.expectEqualStrings("a", best[0].line);
+    try std.testing.expectEqualStrings("b", best[1].line);
+    // Of the two "c"s, the earlier one
+    try std.testing.expectEqualStrings("c", best[2].line);
+    try std.testing.expectEqual(@as(u128, 1), best[2].seq);
+}
@@ -0,0 +1,185 @@
+const std = @import("std");
+
+/// Where a query spends its time, as reported by `--stats`
+pub const Stage = enum {
+    /// Mapping or reading the input
+    read,
+    /// Cutting the input into morsels (JSON arrays are split between elements)
+    split,
+    /// Structural indexing and the literal prefilter
+    scan,
+    /// Building objects from the records the prefilter lets through
+    parse,
+    /// Evaluating the plan, row by row or in columnar batches
+    filter,
+    /// Serializing matches
+    output,
+    /// Writing the output
+    write,
+};
+
+/// Instrumentation for one query, filled in when `Config.stats` is set.
+///
+/// The serial stages (read, split, final write) are wall time. The per-record
+/// stages are timed by each worker and summed, so they read as CPU time; each
+/// worker's own counters show how evenly the morsels spread the load. Timing
+/// every record costs a few clock reads, so this is only enabled on request.
+pub const Stats = struct {
+    allocator: std.mem.Allocator,
+    /// Time of the stages run outside the workers
+    serial_ns: std.EnumArray(Stage, u64) = std.EnumArray(Stage, u64).initFill(0),
+    /// Wall time of the whole query, set by the caller
+    total_ns: u64 = 0,
+    workers: std.ArrayList(Worker) = .{},
+
+    pub fn init(allocator: std.mem.Allocator) Stats {
+        return .{ .allocator = allocator };
+    }
+
+    pub fn deinit(self: *Stats) void {
+        self.workers.deinit(self.allocator);
+    }
+
+    /// Slots for `count` workers about to start, one each. The slots stay
+    /// valid until the next call.
+    pub fn addWorkers(self: *Stats, count: usize) std.mem.Allocator.Error![]Worker {
+        const start = self.workers.items.len;
+        try self.workers.appendNTimes(self.allocator, .{ .timer = std.time.Timer.start() catch null }, count);
+        return self.workers.items[start..];
+    }
+
+    /// Total time in `stage`: serial time plus the workers' summed time.
+    pub fn stageNs(self: *const Stats, stage: Stage) u64 {
+        var total = self.serial_ns.get(stage);
+        for (self.workers.items) |*w| total += w.stage_ns.get(stage);
+        return total;
+    }
+
+    /// Counters summed over every worker
+    pub fn totals(self: *const Stats) Worker {
+        var sum = Worker{};
+        for (self.workers.items) |*w| {
+            sum.bytes_scanned += w.bytes_scanned;
+            sum.records += w.records;
+            sum.parse_failures += w.parse_failures;
+            sum.matches += w.matches;
+            for (std.enums.values(Stage)) |stage| sum.stage_ns.getPtr(stage).* += w.stage_ns.get(stage);
+        }
+        return sum;
+    }
+
+    /// Busiest worker's busy time over the mean; 1.0 is a perfect spread.
+    pub fn imbalance(self: *const Stats) f64 {
+        var max: u64 = 0;
+        var sum: u64 = 0;
+        for (self.workers.items) |*w| {
+            max = @max(max, w.busyNs());
+            sum += w.busyNs();
+        }
+        if (sum == 0) return 1;
+        const mean = @as(f64, @floatFromInt(sum)) / @as(f64, @floatFromInt(self.workers.items.len));
+        return @as(f64, @floatFromInt(max)) / mean;
+    }
+
+    /// Human-readable report, for stderr.
+    pub fn write(self: *const Stats, writer: anytype) !void {
+        try writer.print("stats: wall {d:.2} ms\n", .{ms(self.total_ns)});
+        for (std.enums.values(Stage)) |stage| {
+            try writer.print("  {s:<8} {d:>10.2} ms\n", .{ @tagName(stage), ms(self.stageNs(stage)) });
+        }
+        try writer.print("  threads {d}, imbalance {d:.2} (busiest / mean busy time)\n", .{ self.workers.items.len, self.imbalance() });
+
+        try writer.print("  {s:>6} {s:>14} {s:>12} {s:>10} {s:>12} {s:>10}\n", .{ "thread", "bytes", "records", "failures", "matches", "busy ms" });
+        for (self.workers.items, 0..) |*w, i| try writeWorker(writer, "", i, w);
+        const sum = self.totals();
+        try writeWorker(writer, "total", null, &sum);
+    }
+
+    fn writeWorker(writer: anytype, label: []const u8, index: ?usize, w: *const Worker) !void {
+        if (index) |i| try writer.print("  {d:>6}", .{i}) else try writer.print("  {s:>6}", .{label});
+        try writer.print(" {d:>14} {d:>12} {d:>10} {d:>12} {d:>10.2}\n", .{
+            w.bytes_scanned,
+            w.records,
+            w.parse_failures,
+            w.matches,
+            ms(w.busyNs()),
+        });
+    }
+};
+
+/// Counters of one worker thread; only that thread writes them.
+pub const Worker = struct {
+    bytes_scanned: u64 = 0,
+    records: u64 = 0,
+    parse_failures: u64 = 0,
+    matches: u64 = 0,
+    /// Time in the per-record stages
+    stage_ns: std.EnumArray(Stage, u64) = std.EnumArray(Stage, u64).initFill(0),
+    /// Time spent waiting for work
+    idle_ns: u64 = 0,
+    timer: ?std.time.Timer = null,
+
+    pub fn busyNs(self: *const Worker) u64 {
+        var total: u64 = 0;
+        for (self.stage_ns.values) |ns| total += ns;
+        return total;
+    }
+};
+
+/// Charge the time since the worker's previous lap to `stage`. A no-op for
+/// a null worker, so call sites need no checks of their own.
+pub inline fn lap(worker: ?*Worker, stage: Stage) void {
+    const w = worker orelse return;
+    if (w.timer) |*t| w.stage_ns.getPtr(stage).* += t.lap();
+}
+
+/// Charge the time since the worker's previous lap to waiting.
+pub inline fn idle(worker: ?*Worker) void {
+    const w = worker orelse return;
+    if (w.timer) |*t| w.idle_ns += t.lap();
+}
+
+/// Times one serial stage: `var span = Span.start(s); ...; span.end(.read);`
+pub const Span = struct {
+    stats: ?*Stats,
+    timer: ?std.time.Timer,
+
+    pub fn start(stats: ?*Stats) Span {
+        return .{ .stats = stats, .timer = if (stats != null) std.time.Timer.start() catch null else null };
+    }
+
+    pub fn end(self: *Span, stage: Stage) void {
+        const s = self.stats orelse return;
+        if (self.timer) |*t| s.serial_ns.getPtr(stage).* += t.read();
+    }
+};
+
+fn ms(ns: u64) f64 {
+    return @as(f64, @floatFromInt(ns)) / std.time.ns_per_ms;
+}
+
+test "stats: workers sum into stage totals and imbalance" {
+    var stats = Stats.init(std.testing.allocator);
+    defer stats.deinit();
+
+    const workers = try stats.addWorkers(2);
+    workers[0].stage_ns.set(.parse, 3_000_000);
+    workers[0].records = 10;
+    workers[1].stage_ns.set(.parse, 1_000_000);
+    workers[1].records = 5;
+    stats.serial_ns.set(.read, 500);
+
+    try std.testing.expectEqual(@as(u64, 4_000_000), stats.stageNs(.parse));
+    try std.testing.expectEqual(@as(u64, 500), stats.stageNs(.read));
+    try std.testing.expectEqual(@as(u64, 15), stats.totals().records);
+    try std.testing.expectApproxEqAbs(@as(f64, 1.5), stats.imbalance(), 1e-9);
+
+    var out = std.ArrayList(u8){};
+    defer out.deinit(std.testing.allocator);
+    try stats.write(out.writer(std.testing.allocator));
+    try std.testing.expect(std.mem.indexOf(u8, out.items, "imbalance 1.50") != null);
+
+    // Lapping a null worker is a no-op
+    lap(null, .parse);
+    idle(null);
+}
@@ -0,0 +1,750 @@
+const std = @import("std");
+const query = @import("query.zig");
+const json_parser = @import("json_parser.zig");
+const parallel = @import("parallel_ndjson.zig");
+const json_array = @import("json_array.zig");
+const timing = @import("stats.zig");
+const compress = @import("compress.zig");
+const fileio = @import("fileio.zig");
+
+/// Totals for one streamed input
+pub const Summary = struct {
+    lines_processed: usize = 0,
+    matches: usize = 0,
+};
+
+/// Stream NDJSON from `file` (e.g. stdin). Matches are written to `out` as
+/// NDJSON; with a null `out` they are only counted. JSON arrays have no line
+/// boundaries to cut on, so they are read whole and then cut between elements.
+/// gzip and zstd input is decompressed on the fly, in one stream since a pipe
+/// can't be cut into frames ahead of time.
+pub fn streamFile(
+    file: std.fs.File,
+    filter: *const query.Filter,
+    config: parallel.Config,
+    select_fields: ?[]const []const u8,
+    out: ?*std.Io.Writer,
+    allocator: std.mem.Allocator,
+) !Summary {
+    var buffer: [64 * 1024]u8 = undefined;
+    var file_reader = file.readerStreaming(&buffer);
+    const input = &file_reader.interface;
+    input.fill(4) catch |err| switch (err) {
+        error.EndOfStream => {},
+        error.ReadFailed => return file_reader.err orelse error.ReadFailed,
+    };
+
+    const codec = compress.detect(input.buffered());
+    if (codec == .none) return streamReader(input, filter, config, select_fields, out, allocator);
+    const window = try allocator.alloc(u8, codec.windowLen());
+    defer allocator.free(window);
+    var decompressor = compress.Stream.init(codec, input, window);
+    return streamReader(decompressor.reader(), filter, config, select_fields, out, allocator);
+}
+
+fn streamReader(
+    reader: *std.Io.Reader,
+    filter: *const query.Filter,
+    config: parallel.Config,
+    select_fields: ?[]const []const u8,
+    out: ?*std.Io.Writer,
+    allocator: std.mem.Allocator,
+) !Summary {
+    var source = FileSource{ .reader = reader };
+    defer source.deinit(allocator);
+
+    var head = std.ArrayList(u8){};
+    defer head.deinit(allocator);
+    var read = timing.Span.start(config.stats);
+    try source.fill(&head, config.chunk_size, allocator);
+    read.end(.read);
+
+    if (parallel.detectFormat(head.items) == .json_array) {
+        read = timing.Span.start(config.stats);
+        try head.appendSlice(allocator, source.carry.items);
+        while (!source.eof) {
+            try head.ensureUnusedCapacity(allocator, config.chunk_size);
+            const free = head.unusedCapacitySlice();
+            const n = reader.readSliceShort(free) catch return error.ReadFailed;
+            head.items.len += n;
+            if (n < free.len) break;
+        }
+        read.end(.read);
+        return streamArray(head.items, filter, config, select_fields, out, allocator);
+    }
+
+    return run(.{ .file = &source }, &head, .ndjson, filter, config, select_fields, out, allocator);
+}
+
+/// Stream in-memory (e.g. memory-mapped) data through the same pipeline.
+/// Chunks are slices of `data`; nothing is copied on the way in. gzip and
+/// zstd data is recognised by its magic bytes and decompressed as it goes.
+pub fn streamData(
+    data: []const u8,
+    filter: *const query.Filter,
+    config: parallel.Config,
+    select_fields: ?[]const []const u8,
+    out: ?*std.Io.Writer,
+    allocator: std.mem.Allocator,
+) !Summary {
+    const codec = compress.detect(data);
+    if (codec != .none) return streamCompressed(data, codec, filter, config, select_fields, out, allocator);
+    if (parallel.detectFormat(data) == .json_array) {
+        return streamArray(data, filter, config, select_fields, out, allocator);
+    }
+    return run(.{ .memory = .{ .data = data } }, null, .ndjson, filter, config, select_fields, out, allocator);
+}
+
+/// Compressed NDJSON made of many frames is cut into pieces of whole frames;
+/// each worker decompresses its own piece into its slot, so the decompressed
+/// input is never held whole. A single frame (plain gzip) or a JSON array is
+/// decompressed as one stream instead.
+fn streamCompressed(
+    data: []const u8,
+    codec: compress.Codec,
+    filter: *const query.Filter,
+    config: parallel.Config,
+    select_fields: ?[]const []const u8,
+    out: ?*std.Io.Writer,
+    allocator: std.mem.Allocator,
+) !Summary {
+    var split = timing.Span.start(config.stats);
+    // Aim for about a chunk of decompressed data per piece
+    const pieces = try compress.splitPieces(codec, data, @max(config.chunk_size / 4, 1), allocator);
+    defer allocator.free(pieces);
+    split.end(.split);
+
+    if (pieces.len > 1 and try decodesToNdjson(codec, pieces[0], allocator)) {
+        const source = MemorySource{ .data = data, .morsels = pieces, .codec = codec };
+        return run(.{ .memory = source }, null, .ndjson, filter, config, select_fields, out, allocator);
+    }
+
+    var input = std.Io.Reader.fixed(data);
+    const window = try allocator.alloc(u8, codec.windowLen());
+    defer allocator.free(window);
+    var decompressor = compress.Stream.init(codec, &input, window);
+    return streamReader(decompressor.reader(), filter, config, select_fields, out, allocator);
+}
+
+/// Whether `piece`, the first of the input, starts NDJSON rather than a JSON
+/// array. Only its first bytes are decoded; the worker that gets the piece
+/// decodes it in full. After nothing but whitespace, the answer is no, and
+/// the caller's single stream sorts the format out.
+fn decodesToNdjson(codec: compress.Codec, piece: []const u8, allocator: std.mem.Allocator) !bool {
+    var decoder = try compress.Decoder.init(codec, allocator);
+    defer decoder.deinit();
+    var buffer: [4096]u8 = undefined;
+    const head = try decoder.decodeHead(piece, &buffer);
+    const text = std.mem.trimLeft(u8, head, " \t\n\r");
+    if (text.len == 0 and head.len == buffer.len) return false;
+    return parallel.detectFormat(text) == .ndjson;
+}
+
+/// Elements of a JSON array are filtered in place, in morsels cut between them.
+fn streamArray(
+    data: []const u8,
+    filter: *const query.Filter,
+    config: parallel.Config,
+    select_fields: ?[]const []const u8,
+    out: ?*std.Io.Writer,
+    allocator: std.mem.Allocator,
+) !Summary {
+    var split = timing.Span.start(config.stats);
+    const morsels = try json_array.splitIntoMorsels(data, config.chunk_size, config.num_threads, allocator);
+    defer allocator.free(morsels);
+    split.end(.split);
+    return run(.{ .memory = .{ .data = data, .morsels = morsels } }, null, .json_array, filter, config, select_fields, out, allocator);
+}
+
+/// Stream `file_path`. Mapped (`Config.io`), the page cache holds the input
+/// and the ring bounds the output held in memory; with `.read` the file is
+/// read chunk by chunk like stdin, so the input is bounded too.
+pub fn streamPath(
+    file_path: []const u8,
+    filter: *const query.Filter,
+    config: parallel.Config,
+    select_fields: ?[]const []const u8,
+    out: ?*std.Io.Writer,
+    allocator: std.mem.Allocator,
+) !Summary {
+    const file = try std.fs.cwd().openFile(file_path, .{});
+    defer file.close();
+    if (config.io == .read) return streamFile(file, filter, config, select_fields, out, allocator);
+
+    var read = timing.Span.start(config.stats);
+    const contents = try fileio.load(file, config.io, allocator);
+    read.end(.read);
+    defer contents.deinit(allocator);
+    if (contents.data.len == 0) return .{};
+
+    return streamData(contents.data, filter, config, select_fields, out, allocator);
+}
+
+const Source = union(enum) {
+    file: *FileSource,
+    memory: MemorySource,
+};
+
+/// Reads a stream sequentially; the partial line at the end of each chunk is
+/// carried over to the start of the next one.
+const FileSource = struct {
+    reader: *std.Io.Reader,
+    carry: std.ArrayList(u8) = .{},
+    eof: bool = false,
+
+    fn deinit(self: *FileSource, allocator: std.mem.Allocator) void {
+        self.carry.deinit(allocator);
+    }
+
+    /// Refill `buffer` with at least `chunk_size` bytes ending on a newline,
+    /// or with the rest of the file. A line longer than `chunk_size` grows the
+    /// buffer until the line ends.
+    fn fill(self: *FileSource, buffer: *std.ArrayList(u8), chunk_size: usize, allocator: std.mem.Allocator) !void {
+        buffer.clearRetainingCapacity();
+        try buffer.appendSlice(allocator, self.carry.items);
+        self.carry.clearRetainingCapacity();
+
+        while (!self.eof) {
+            if (buffer.items.len >= chunk_size) {
+                if (std.mem.lastIndexOfScalar(u8, buffer.items, '\n')) |nl| {
+                    try self.carry.appendSlice(allocator, buffer.items[nl + 1 ..]);
+                    buffer.shrinkRetainingCapacity(nl + 1);
+                    return;
+                }
+            }
+            const want = @max(chunk_size -| buffer.items.len, 64 * 1024);
+            try buffer.ensureUnusedCapacity(allocator, want);
+            const n = self.reader.readSliceShort(buffer.unusedCapacitySlice()[0..want]) catch return error.ReadFailed;
+            // Short only at the end of the stream
+            if (n < want) self.eof = true;
+            buffer.items.len += n;
+        }
+    }
+};
+
+/// Cuts chunks out of a buffer that is already in memory.
+const MemorySource = struct {
+    data: []const u8,
+    pos: usize = 0,
+    /// Chunks cut in advance (JSON arrays, compressed pieces); `pos` then counts chunks
+    morsels: ?[]const []const u8 = null,
+    /// Morsels are compressed pieces that workers decompress
+    codec: compress.Codec = .none,
+
+    fn next(self: *MemorySource, chunk_size: usize) []const u8 {
+        if (self.morsels) |morsels| {
+            if (self.pos == morsels.len) return &.{};
+            self.pos += 1;
+            return morsels[self.pos - 1];
+        }
+        const start = self.pos;
+        var end = @min(start + chunk_size, self.data.len);
+        if (std.mem.indexOfScalarPos(u8, self.data, end, '\n')) |nl| end = nl + 1 else end = self.data.len;
+        self.pos = end;
+        return self.data[start..end];
+    }
+
+    fn exhausted(self: *const MemorySource) bool {
+        const end = if (self.morsels) |morsels| morsels.len else self.data.len;
+        return self.pos >= end;
+    }
+};
+
+const Slot = struct {
+    /// Input storage for file sources; memory sources point `data` at the input
+    buffer: std.ArrayList(u8) = .{},
+    data: []const u8 = &.{},
+    output: std.ArrayList(u8) = .{},
+    stats: parallel.NdjsonFilter.Stats = .{},
+    /// Set by the worker once `output` is complete (guarded by Pipeline.mutex)
+    done: bool = false,
+    /// Compressed pieces don't end on newlines: the text up to the first
+    /// newline and after the last is left to the writer, which joins it with
+    /// the neighbouring pieces' (both point into `buffer`)
+    head: []const u8 = &.{},
+    tail: []const u8 = &.{},
+    /// `head` ends on a newline
+    head_complete: bool = false,
+
+    /// Split the decompressed `buffer` into the whole lines in the middle,
+    /// returned, and the partial ones at either end.
+    fn cutPartialLines(self: *Slot) []const u8 {
+        const decoded = self.buffer.items;
+        const first = std.mem.indexOfScalar(u8, decoded, '\n') orelse {
+            self.head = decoded;
+            self.head_complete = false;
+            self.tail = &.{};
+            return &.{};
+        };
+        const last = std.mem.lastIndexOfScalar(u8, decoded, '\n').?;
+        self.head = decoded[0 .. first + 1];
+        self.head_complete = true;
+        self.tail = decoded[last + 1 ..];
+        return decoded[first + 1 .. last + 1];
+    }
+};
+
+/// Bounded-memory NDJSON pipeline: reader → workers → ordered writer.
+///
+/// The reader (the calling thread) cuts the input into chunks of
+/// `Config.chunk_size` bytes on newline boundaries and places each in the next
+/// slot of a ring. Workers take filled slots in input order, filter them and
+/// serialize the matches into the slot's own output buffer. The writer
+/// flushes slots strictly in input order as soon as each is done and hands
+/// the slot back to the reader. At most `2 × num_threads` chunks are in flight,
+/// so memory stays bounded by the chunk size rather than the input size, and
+/// output starts while the input is still being read.
+///
+/// With `Config.limit` the writer cuts the output at the limit and raises
+/// `stop`: workers abandon their chunks and the reader stops reading, so
+/// `--limit 10` on a huge input only reads the first few chunks.
+///
+/// Compressed pieces are decompressed by the worker that takes them; the
+/// records cut in two between pieces are joined in `carry` and filtered by
+/// the writer ahead of the piece that completes them.
+const Pipeline = struct {
+    slots: []Slot,
+    ndjson_filter: *const parallel.NdjsonFilter,
+    format: parallel.Format,
+    codec: compress.Codec,
+    out: ?*std.Io.Writer,
+    limit: ?usize,
+    /// The reader times the read stage here, the writer the write stage
+    stats: ?*timing.Stats,
+    allocator: std.mem.Allocator,
+
+    mutex: std.Thread.Mutex = .{},
+    /// Broadcast on every state change below
+    cond: std.Thread.Condition = .{},
+    /// Chunks handed out by the reader, taken by workers, flushed by the writer
+    filled: usize = 0,
+    claimed: usize = 0,
+    written: usize = 0,
+    eof: bool = false,
+    failure: ?anyerror = null,
+    /// Set once the limit is reached; also polled by workers without the lock
+    stop: std.atomic.Value(bool) = std.atomic.Value(bool).init(false),
+    summary: Summary = .{},
+    /// Writer only: the record spanning the pieces written so far, and its output
+    carry: std.ArrayList(u8) = .{},
+    carry_output: std.ArrayList(u8) = .{},
+
+    fn slotFor(self: *Pipeline, seq: usize) *Slot {
+        return &self.slots[seq % self.slots.len];
+    }
+
+    /// Record the first error and wake everyone up so the pipeline drains.
+    fn fail(self: *Pipeline, err: anyerror) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        if (self.failure == null) self.failure = err;
+        self.cond.broadcast();
+    }
+
+    /// True when no further chunk needs processing (caller holds the mutex).
+    fn halted(self: *Pipeline) bool {
+        return self.failure != null or self.stop.load(.monotonic);
+    }
+
+    fn worker(self: *Pipeline, counters: ?*timing.Worker) void {
+        var scratch = std.heap.ArenaAllocator.init(self.allocator);
+        defer scratch.deinit();
+        var decoder: ?compress.Decoder = null;
+        defer if (decoder) |*d| d.deinit();
+
+        while (true) {
+            self.mutex.lock();
+            while (self.claimed == self.filled and !self.eof and !self.halted()) self.cond.wait(&self.mutex);
+            if (self.claimed == self.filled or self.halted()) {
+                self.mutex.unlock();
+                return;
+            }
+            const slot = self.slotFor(self.claimed);
+            self.claimed += 1;
+            self.mutex.unlock();
+
+            var chunk = slot.data;
+            if (self.codec != .none) {
+                timing.idle(counters);
+                if (decoder == null) decoder = compress.Decoder.init(self.codec, self.allocator) catch |err| return self.fail(err);
+                slot.buffer.clearRetainingCapacity();
+                decoder.?.decode(slot.data, &slot.buffer) catch |err| return self.fail(err);
+                chunk = slot.cutPartialLines();
+                timing.lap(counters, .read);
+            }
+
+            slot.output.clearRetainingCapacity();
+            const out_buffer: ?*std.ArrayList(u8) = if (self.out != null) &slot.output else null;
+            const stats = self.ndjson_filter.run(chunk, self.format, out_buffer, &scratch, .{
+                .max_matches = self.limit,
+                .cancel = &self.stop,
+                .worker = counters,
+            }) catch |err| {
+                self.fail(err);
+                return;
+            };
+
+            self.mutex.lock();
+            slot.stats = stats;
+            slot.done = true;
+            self.cond.broadcast();
+            self.mutex.unlock();
+        }
+    }
+
+    fn writer(self: *Pipeline) void {
+        var scratch = std.heap.ArenaAllocator.init(self.allocator);
+        defer scratch.deinit();
+
+        while (true) {
+            self.mutex.lock();
+            const slot = self.slotFor(self.written);
+            while (!slot.done and !(self.eof and self.written == self.filled) and self.failure == null) self.cond.wait(&self.mutex);
+            if (!slot.done or self.failure != null) {
+                self.mutex.unlock();
+                return;
+            }
+            self.mutex.unlock();
+
+            // A record cut between pieces comes before the piece's own
+            if (self.codec != .none) {
+                self.carry.appendSlice(self.allocator, slot.head) catch |err| return self.fail(err);
+                if (slot.head_complete) {
+                    const reached = self.flushCarry(&scratch) catch |err| return self.fail(err);
+                    if (reached) return;
+                }
+            }
+            const reached = self.emit(slot.stats, slot.output.items) catch |err| return self.fail(err);
+            if (self.codec != .none) self.carry.appendSlice(self.allocator, slot.tail) catch |err| return self.fail(err);
+
+            self.mutex.lock();
+            slot.done = false;
+            self.written += 1;
+            self.cond.broadcast();
+            self.mutex.unlock();
+            if (reached) return;
+        }
+    }
+
+    /// Write `output`, the serialized matches behind `stats`, cutting it down
+    /// to the matches still missing under the limit. True once the limit is
+    /// reached.
+    fn emit(self: *Pipeline, stats: parallel.NdjsonFilter.Stats, output: []const u8) !bool {
+        var matches = stats.matches;
+        var written_out = output;
+        const reached = if (self.limit) |limit| cut: {
+            const remaining = limit - self.summary.matches;
+            if (matches < remaining) break :cut false;
+            matches = remaining;
+            written_out = parallel.ndjsonPrefix(written_out, remaining);
+            break :cut true;
+        } else false;
+
+        if (self.out) |out| {
+            var write = timing.Span.start(self.stats);
+            try out.writeAll(written_out);
+            try out.flush();
+            write.end(.write);
+        }
+
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        self.summary.lines_processed += stats.lines_processed;
+        self.summary.matches += matches;
+        if (reached) {
+            self.stop.store(true, .monotonic);
+            self.cond.broadcast();
+        }
+        return reached;
+    }
+
+    /// Filter and write the record joined from the pieces' partial lines.
+    fn flushCarry(self: *Pipeline, scratch: *std.heap.ArenaAllocator) !bool {
+        defer self.carry.clearRetainingCapacity();
+        if (self.carry.items.len == 0) return false;
+        self.carry_output.clearRetainingCapacity();
+        const out_buffer: ?*std.ArrayList(u8) = if (self.out != null) &self.carry_output else null;
+        const stats = try self.ndjson_filter.run(self.carry.items, self.format, out_buffer, scratch, .{ .max_matches = self.limit });
+        return self.emit(stats, self.carry_output.items);
+    }
+};
+
+fn run(
+    source: Source,
+    head: ?*std.ArrayList(u8),
+    format: parallel.Format,
+    filter: *const query.Filter,
+    config: parallel.Config,
+    select_fields: ?[]const []const u8,
+    out: ?*std.Io.Writer,
+    allocator: std.mem.Allocator,
+) !Summary {
+    if (config.limit) |limit| if (limit == 0) return .{};
+
+    var ndjson_filter = try parallel.NdjsonFilter.init(filter, select_fields, allocator);
+    defer ndjson_filter.deinit();
+
+    const num_workers = @max(1, @min(config.num_threads, std.Thread.getCpuCount() catch 4));
+    const chunk_size = @max(config.chunk_size, 1);
+
+    // Two slots per worker lets the reader run ahead while the writer waits
+    // on the oldest chunk.
+    const slots = try allocator.alloc(Slot, num_workers * 2);
+    for (slots) |*slot| slot.* = .{};
+    defer {
+        for (slots) |*slot| {
+            slot.buffer.deinit(allocator);
+            slot.output.deinit(allocator);
+        }
+        allocator.free(slots);
+    }
+
+    var pipeline = Pipeline{
+        .slots = slots,
+        .ndjson_filter = &ndjson_filter,
+        .format = format,
+        .codec = switch (source) {
+            .memory => |memory| memory.codec,
+            .file => .none,
+        },
+        .out = out,
+        .limit = config.limit,
+        .stats = config.stats,
+        .allocator = allocator,
+    };
+    defer pipeline.carry.deinit(allocator);
+    defer pipeline.carry_output.deinit(allocator);
+    const workers = if (config.stats) |st| try st.addWorkers(num_workers) else null;
+
+    var threads = try allocator.alloc(std.Thread, num_workers + 1);
+    defer allocator.free(threads);
+    var spawned: usize = 0;
+    defer {
+        // Make sure every thread can observe the end of input before joining
+        pipeline.mutex.lock();
+        pipeline.eof = true;
+        pipeline.cond.broadcast();
+        pipeline.mutex.unlock();
+        for (threads[0..spawned]) |t| t.join();
+    }
+    threads[0] = try std.Thread.spawn(.{}, Pipeline.writer, .{&pipeline});
+    spawned = 1;
+    while (spawned < threads.len) : (spawned += 1) {
+        const counters: ?*timing.Worker = if (workers) |w| &w[spawned - 1] else null;
+        threads[spawned] = try std.Thread.spawn(.{}, Pipeline.worker, .{ &pipeline, counters });
+    }
+
+    // Reader: fill slots in order as the writer frees them
+    var pending_head = head;
+    var input = source;
+    while (true) {
+        pipeline.mutex.lock();
+        while (pipeline.filled - pipeline.written >= slots.len and !pipeline.halted()) pipeline.cond.wait(&pipeline.mutex);
+        const stop = pipeline.halted();
+        pipeline.mutex.unlock();
+        if (stop) break;
+
+        // Only the reader touches a slot between the writer freeing and the reader filling it
+        const slot = pipeline.slotFor(pipeline.filled);
+        var more = true;
+        switch (input) {
+            .file => |file_source| {
+                if (pending_head) |h| {
+                    std.mem.swap(std.ArrayList(u8), &slot.buffer, h);
+                    pending_head = null;
+                } else {
+                    var read = timing.Span.start(config.stats);
+                    file_source.fill(&slot.buffer, chunk_size, allocator) catch |err| {
+                        pipeline.fail(err);
+                        break;
+                    };
+                    read.end(.read);
+                }
+                slot.data = slot.buffer.items;
+                more = !file_source.eof;
+            },
+            .memory => |*memory| {
+                slot.data = memory.next(chunk_size);
+                more = !memory.exhausted();
+            },
+        }
+
+        pipeline.mutex.lock();
+        if (slot.data.len > 0) pipeline.filled += 1;
+        if (!more) pipeline.eof = true;
+        pipeline.cond.broadcast();
+        pipeline.mutex.unlock();
+        if (!more) break;
+    }
+
+    // Wait for the writer to drain everything that was read
+    pipeline.mutex.lock();
+    while (pipeline.written < pipeline.filled and !pipeline.halted()) pipeline.cond.wait(&pipeline.mutex);
+    const failure = pipeline.failure;
+    pipeline.mutex.unlock();
+
+    if (failure) |err| return err;
+    // The writer is done with `carry`: what is left is the last record, which
+    // had no newline after it
+    if (pipeline.codec != .none and !pipeline.stop.load(.monotonic)) {
+        var scratch = std.heap.ArenaAllocator.init(allocator);
+        defer scratch.deinit();
+        _ = try pipeline.flushCarry(&scratch);
+    }
+    return pipeline.summary;
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+test "stream: output keeps input order across many small chunks" {
+    const allocator = std.testing.allocator;
+
+    var data = std.ArrayList(u8){};
+    defer data.deinit(allocator);
+    var expected = std.ArrayList(u8){};
+    defer expected.deinit(allocator);
+    for (0..2000) |i| {
+        const even = if (i % 2 == 0) "true" else "false";
+        try data.writer(allocator).print("{{\"id\":{d},\"even\":{s}}}\n", .{ i, even });
+        if (i % 2 == 0) try expected.writer(allocator).print("{{\"id\":{d}}}\n", .{i});
+    }
+
+    var parsed = try query.parseQuery("{\"even\":true}", allocator);
+    defer parsed.deinit(allocator);
+
+    var out = std.Io.Writer.Allocating.init(allocator);
+    defer out.deinit();
+
+    const select = [_][]const u8{"id"};
+    const summary = try streamData(data.items, &parsed.filter, .{ .num_threads = 4, .chunk_size = 256 }, &select, &out.writer, allocator);
+
+    try std.testing.expectEqual(@as(usize, 2000), summary.lines_processed);
+    try std.testing.expectEqual(@as(usize, 1000), summary.matches);
+    try std.testing.expectEqualStrings(expected.items, out.written());
+}
+
+test "stream: file source carries partial lines and counts without output" {
+    const allocator = std.testing.allocator;
+
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    {
+        const file = try tmp.dir.createFile("events.ndjson", .{});
+        defer file.close();
+        var buf: [4096]u8 = undefined;
+        var file_writer = file.writer(&buf);
+        const w = &file_writer.interface;
+        for (0..500) |i| try w.print("{{\"n\":{d},\"pad\":\"{s}\"}}\n", .{ i, "x" ** 40 });
+        // Last line without a trailing newline, longer than a chunk
+        try w.print("{{\"n\":500,\"pad\":\"{s}\"}}", .{"y" ** 300});
+        try w.flush();
+    }
+
+    var parsed = try query.parseQuery("{\"n\":{\"$gte\":250}}", allocator);
+    defer parsed.deinit(allocator);
+
+    const file = try tmp.dir.openFile("events.ndjson", .{});
+    defer file.close();
+    const summary = try streamFile(file, &parsed.filter, .{ .num_threads = 2, .chunk_size = 200 }, null, null, allocator);
+
+    try std.testing.expectEqual(@as(usize, 501), summary.lines_processed);
+    try std.testing.expectEqual(@as(usize, 251), summary.matches);
+}
+
+test "stream: limit stops at the first matches in input order" {
+    const allocator = std.testing.allocator;
+
+    var data = std.ArrayList(u8){};
+    defer data.deinit(allocator);
+    for (0..5000) |i| try data.writer(allocator).print("{{\"id\":{d}}}\n", .{i});
+
+    var parsed = try query.parseQuery("{\"id\":{\"$gte\":100}}", allocator);
+    defer parsed.deinit(allocator);
+
+    var out = std.Io.Writer.Allocating.init(allocator);
+    defer out.deinit();
+
+    const config = parallel.Config{ .num_threads = 4, .chunk_size = 128, .limit = 3 };
+    const summary = try streamData(data.items, &parsed.filter, config, null, &out.writer, allocator);
+
+    try std.testing.expectEqual(@as(usize, 3), summary.matches);
+    try std.testing.expectEqualStrings("{\"id\":100}\n{\"id\":101}\n{\"id\":102}\n", out.written());
+    // Most of the input is never looked at
+    try std.testing.expect(summary.lines_processed < 5000);
+}
+
+test "stream: JSON array elements are filtered in place, one line each" {
+    const allocator = std.testing.allocator;
+
+    var data = std.ArrayList(u8){};
+    defer data.deinit(allocator);
+    try data.appendSlice(allocator, "[");
+    for (0..1000) |i| {
+        if (i > 0) try data.appendSlice(allocator, ",");
+        // Every tenth element is pretty-printed over several lines
+        if (i % 10 == 0) {
+            try data.writer(allocator).print("\n  {{\n    \"id\": {d}\n  }}", .{i});
+        } else {
+            try data.writer(allocator).print("{{\"id\":{d}}}", .{i});
+        }
+    }
+    try data.appendSlice(allocator, "]");
+
+    var parsed = try query.parseQuery("{\"id\":{\"$gte\":500}}", allocator);
+    defer parsed.deinit(allocator);
+
+    var out = std.Io.Writer.Allocating.init(allocator);
+    defer out.deinit();
+    const summary = try streamData(data.items, &parsed.filter, .{ .num_threads = 4, .chunk_size = 256 }, null, &out.writer, allocator);
+
+    try std.testing.expectEqual(@as(usize, 1000), summary.lines_processed);
+    try std.testing.expectEqual(@as(usize, 500), summary.matches);
+    var lines = std.mem.splitScalar(u8, out.written(), '\n');
+    for (500..1000) |i| {
+        const line = lines.next().?;
+        var obj = try json_parser.parseObject(line, allocator);
+        defer obj.deinit();
+        try std.testing.expectEqual(@as(i64, @intCast(i)), try json_parser.getInt(obj.get("id").?));
+    }
+    try std.testing.expectEqualStrings("", lines.next().?);
+}
+
+test "stream: compressed frames are decompressed by the workers in order" {
+    const allocator = std.testing.allocator;
+
+    var text = std.ArrayList(u8){};
+    defer text.deinit(allocator);
+    for (0..300) |i| try text.writer(allocator).print("{{\"id\":{d}}}\n", .{i});
+    // The last record has no newline
+    text.items.len -= 1;
+
+    var parsed = try query.parseQuery("{\"id\":{\"$gte\":100}}", allocator);
+    defer parsed.deinit(allocator);
+
+    inline for (.{ .zstd, .gzip }) |codec| {
+        // Frames of 50 bytes cut records anywhere, some frames inside one record
+        var data = std.ArrayList(u8){};
+        defer data.deinit(allocator);
+        var pos: usize = 0;
+        while (pos < text.items.len) : (pos += 50) {
+            const part = text.items[pos..@min(pos + 50, text.items.len)];
+            if (codec == .zstd) try compress.testZstdFrame(part, &data, allocator) else try compress.testBgzfBlock(part, &data, allocator);
+        }
+
+        var out = std.Io.Writer.Allocating.init(allocator);
+        defer out.deinit();
+        const summary = try streamData(data.items, &parsed.filter, .{ .num_threads = 4, .chunk_size = 4 }, null, &out.writer, allocator);
+
+        try std.testing.expectEqual(@as(usize, 300), summary.lines_processed);
+        try std.testing.expectEqual(@as(usize, 200), summary.matches);
+        var lines = std.mem.splitScalar(u8, out.written(), '\n');
+        for (100..300) |i| {
+            var obj = try json_parser.parseObject(lines.next().?, allocator);
+            defer obj.deinit();
+            try std.testing.expectEqual(@as(i64, @intCast(i)), try json_parser.getInt(obj.get("id").?));
+        }
+    }
+}